@@ -287,6 +287,43 @@ struct CAddressHistoryValue {
     }
 };
 
+/** Balances of an address history after all its entries up to the height of the checkpoint */
+struct CAddressHistoryCheckpoint {
+    CAmount spendable;
+    CAmount stakable;
+    CAmount voting_weight;
+    uint256 blockHash;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 56;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata64(s, spendable);
+        ser_writedata64(s, stakable);
+        ser_writedata64(s, voting_weight);
+        blockHash.Serialize(s, nType, nVersion);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        spendable = ser_readdata64(s);
+        stakable = ser_readdata64(s);
+        voting_weight = ser_readdata64(s);
+        blockHash.Unserialize(s, nType, nVersion);
+    }
+
+    CAddressHistoryCheckpoint() {
+        SetNull();
+    }
+
+    void SetNull() {
+        spendable = 0;
+        stakable = 0;
+        voting_weight = 0;
+        blockHash.SetNull();
+    }
+};
+
 struct CAddressIndexIteratorKey {
     unsigned int type;
     uint160 hashBytes;
@@ -43,14 +43,17 @@ namespace benchmark {
         double lastTime, minTime, maxTime, countMaskInv;
         int64_t count;
         int64_t countMask;
+        int64_t itemsPerIteration;
     public:
-        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0) {
+        State(std::string _name, double _maxElapsed) : name(_name), maxElapsed(_maxElapsed), count(0), itemsPerIteration(0) {
             minTime = std::numeric_limits<double>::max();
             maxTime = std::numeric_limits<double>::min();
             countMask = 1;
             countMaskInv = 1./(countMask + 1);
         }
         bool KeepRunning();
+        // Number of items (hashes, kernels...) handled by every iteration, reported as a rate
+        void SetItemsPerIteration(int64_t n) { itemsPerIteration = n; }
     };
 
     typedef boost::function<void(State&)> BenchFunction;
@@ -0,0 +1,171 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <cassert>
+
+#include <bench/bench.h>
+#include <blsct/bulletproofs.h>
+#include <blsct/transaction.h>
+#include <blsct/verification.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <primitives/transaction.h>
+#include <streams.h>
+#include <version.h>
+
+static CTxOut CreateBLSCTOutput()
+{
+    bls::G1Element nonce = bls::G1Element::Infinity();
+
+    std::vector<Scalar> values;
+    values.push_back(Scalar(1000));
+
+    BulletproofsRangeproof bprp;
+    bprp.Prove(values, nonce, {1, 2, 3, 4});
+
+    return CTxOut(0, CScript(), nonce, nonce, nonce, bprp);
+}
+
+// Every access decodes the range proof again, as CTxOut used to do.
+static void CTxOutBulletproofParse(benchmark::State& state)
+{
+    CTxOut txout = CreateBLSCTOutput();
+
+    while (state.KeepRunning())
+    {
+        BulletproofsRangeproof bp(txout.bp);
+        assert(bp.GetValueCommitments().size() > 0);
+    }
+}
+
+// The decoded range proof is cached on the output.
+static void CTxOutBulletproofCached(benchmark::State& state)
+{
+    CTxOut txout = CreateBLSCTOutput();
+
+    while (state.KeepRunning())
+    {
+        assert(txout.HasRangeProof());
+        assert(txout.GetBulletproofRef()->GetValueCommitments().size() > 0);
+    }
+}
+
+static void CTxOutBLSCTSerialize(benchmark::State& state)
+{
+    CTxOut txout = CreateBLSCTOutput();
+
+    while (state.KeepRunning())
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << txout;
+        CTxOut txout2;
+        ss >> txout2;
+        assert(txout2.HasRangeProof());
+    }
+}
+
+static bls::PrivateKey RandKey()
+{
+    return bls::PrivateKey::FromBN(Scalar::Rand().bn);
+}
+
+// Spends two private outputs into two private outputs plus the fee, the
+// outputs being sent to the double key (v*S, S).
+static CTransaction CreateBLSCTTransaction(CStateViewCache& view, const bls::PrivateKey& viewKey, const bls::PrivateKey& spendKey)
+{
+    bls::G1Element S = spendKey.GetG1Element();
+    bls::G1Element V = S * viewKey;
+    blsctDoublePublicKey destKey(V, S);
+
+    Scalar gammaIns, gammaOuts;
+    std::string strFailReason;
+    std::vector<bls::G2Element> vBLSSignatures;
+    bls::G1Element nonce;
+
+    CMutableTransaction prevTx;
+    prevTx.vout.resize(2);
+
+    std::vector<bls::PrivateKey> vBlindingKeys;
+
+    for (size_t i = 0; i < prevTx.vout.size(); i++)
+    {
+        vBlindingKeys.push_back(RandKey());
+        bool ret = CreateBLSCTOutput(vBlindingKeys[i], nonce, prevTx.vout[i], destKey, 10*COIN, "", gammaIns, strFailReason, false, vBLSSignatures);
+        assert(ret);
+    }
+
+    AddCoins(view, prevTx, 0);
+
+    CAmount nFee = 10000;
+
+    CMutableTransaction tx;
+    tx.nVersion |= TX_BLS_CT_FLAG | TX_BLS_INPUT_FLAG;
+    tx.vin.resize(2);
+    tx.vout.resize(3);
+
+    bool ret = CreateBLSCTOutput(RandKey(), nonce, tx.vout[0], destKey, 12*COIN, "", gammaOuts, strFailReason, true, vBLSSignatures);
+    assert(ret);
+    ret = CreateBLSCTOutput(RandKey(), nonce, tx.vout[1], destKey, 8*COIN-nFee, "", gammaOuts, strFailReason, true, vBLSSignatures);
+    assert(ret);
+    tx.vout[2] = CTxOut(nFee, CScript(OP_RETURN));
+
+    for (size_t i = 0; i < tx.vin.size(); i++)
+    {
+        tx.vin[i].prevout = COutPoint(prevTx.GetHash(), i);
+
+        // P = H(r*V)*G + S
+        Scalar sk = Scalar(HashG1Element(vBlindingKeys[i] * V, 0)) + Scalar(spendKey);
+        SignBLSInput(bls::PrivateKey::FromBN(sk.bn), tx.vin[i], vBLSSignatures);
+    }
+
+    Scalar diff = gammaIns-gammaOuts;
+    tx.vchBalanceSig = bls::BasicSchemeMPL::Sign(bls::PrivateKey::FromBN(diff.bn), balanceMsg).Serialize();
+    tx.vchTxSig = bls::AugSchemeMPL::Aggregate(vBLSSignatures).Serialize();
+
+    return tx;
+}
+
+static void VerifyBLSCTTransaction(benchmark::State& state)
+{
+    CStateView coinsDummy;
+    CStateViewCache view(&coinsDummy);
+
+    bls::PrivateKey viewKey = RandKey();
+    CTransaction tx = CreateBLSCTTransaction(view, viewKey, RandKey());
+
+    while (state.KeepRunning())
+    {
+        std::vector<RangeproofEncodedData> vData;
+        CValidationState valState;
+        bool ret = VerifyBLSCT(tx, viewKey, vData, view, valState);
+        assert(ret);
+    }
+}
+
+static void CombineBLSCTTransaction(benchmark::State& state)
+{
+    CStateView coinsDummy;
+    CStateViewCache view(&coinsDummy);
+
+    bls::PrivateKey viewKey = RandKey();
+    bls::PrivateKey spendKey = RandKey();
+
+    std::set<CTransaction> setTx;
+    setTx.insert(CreateBLSCTTransaction(view, viewKey, spendKey));
+    setTx.insert(CreateBLSCTTransaction(view, viewKey, spendKey));
+
+    while (state.KeepRunning())
+    {
+        CTransaction combinedTx;
+        CValidationState valState;
+        bool ret = CombineBLSCTTransactions(setTx, combinedTx, view, valState);
+        assert(ret);
+    }
+}
+
+BENCHMARK(CTxOutBulletproofParse);
+BENCHMARK(CTxOutBulletproofCached);
+BENCHMARK(CTxOutBLSCTSerialize);
+BENCHMARK(VerifyBLSCTTransaction);
+BENCHMARK(CombineBLSCTTransaction);
@@ -0,0 +1,226 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <cassert>
+
+#include <bench/bench.h>
+#include <blsct/bulletproofs.h>
+#include <blsct/multiexp.h>
+
+static std::vector<Scalar> GetValues(size_t M)
+{
+    std::vector<Scalar> values;
+
+    for (size_t i = 0; i < M; i++)
+        values.push_back(Scalar(1000 + i));
+
+    return values;
+}
+
+static void BulletproofProve(benchmark::State& state, size_t M)
+{
+    bls::G1Element nonce = bls::G1Element::Infinity();
+    std::vector<Scalar> values = GetValues(M);
+
+    BulletproofsRangeproof::Init();
+
+    while (state.KeepRunning())
+    {
+        BulletproofsRangeproof bprp;
+        bprp.Prove(values, nonce);
+    }
+}
+
+static void BulletproofVerify(benchmark::State& state, size_t M)
+{
+    bls::G1Element nonce = bls::G1Element::Infinity();
+
+    BulletproofsRangeproof bprp;
+    bprp.Prove(GetValues(M), nonce);
+
+    std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
+    proofs.push_back(std::make_pair(0, bprp));
+
+    std::vector<RangeproofEncodedData> vData;
+    std::vector<bls::G1Element> nonces;
+
+    while (state.KeepRunning())
+    {
+        bool ret = VerifyBulletproof(proofs, vData, nonces);
+        assert(ret);
+    }
+}
+
+// Single value proofs, as found in the outputs of a block
+static void BulletproofVerifyBatch(benchmark::State& state, size_t nProofs)
+{
+    bls::G1Element nonce = bls::G1Element::Infinity();
+
+    std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
+
+    for (size_t i = 0; i < nProofs; i++)
+    {
+        BulletproofsRangeproof bprp;
+        bprp.Prove(GetValues(1), nonce);
+        proofs.push_back(std::make_pair(i, bprp));
+    }
+
+    std::vector<RangeproofEncodedData> vData;
+    std::vector<bls::G1Element> nonces;
+
+    while (state.KeepRunning())
+    {
+        bool ret = VerifyBulletproof(proofs, vData, nonces);
+        assert(ret);
+    }
+}
+
+static std::vector<MultiexpData> GetMultiexpData(size_t nPoints)
+{
+    BulletproofsRangeproof::Init();
+
+    std::vector<MultiexpData> data;
+
+    for (size_t i = 0; i < nPoints; i++)
+        data.push_back(MultiexpData(NativeToG1Element(BulletproofsRangeproof::GiNative[i]), Scalar::Rand()));
+
+    return data;
+}
+
+static void MultiExp128(benchmark::State& state)
+{
+    std::vector<MultiexpData> data = GetMultiexpData(128);
+
+    while (state.KeepRunning())
+    {
+        MultiExp(data);
+    }
+}
+
+static void MultiExpLegacy128(benchmark::State& state)
+{
+    std::vector<MultiexpData> data = GetMultiexpData(128);
+
+    while (state.KeepRunning())
+    {
+        MultiExpLegacy(data);
+    }
+}
+
+// Distinct bases beyond the generators, as a block wide batch has
+static void GetMultiExpNative(size_t n, std::vector<G1>& bases, std::vector<Fr>& exps)
+{
+    BulletproofsRangeproof::Init();
+
+    size_t nGens = BulletproofsRangeproof::GiNative.size();
+
+    bases.resize(n);
+    exps.resize(n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        G1::add(bases[i], BulletproofsRangeproof::GiNative[i % nGens], BulletproofsRangeproof::HiNative[(i / nGens) % nGens]);
+        ScalarToNative(exps[i], Scalar::Rand());
+    }
+}
+
+// G1::mulVec, the implementation used before the Pippenger engine
+static void MultiExpStrausN(benchmark::State& state, size_t n)
+{
+    std::vector<G1> bases;
+    std::vector<Fr> exps;
+    GetMultiExpNative(n, bases, exps);
+
+    state.SetItemsPerIteration(n);
+
+    G1 out;
+    while (state.KeepRunning())
+    {
+        MultiExpStraus(out, bases.data(), exps.data(), n);
+    }
+}
+
+static void MultiExpPippengerN(benchmark::State& state, size_t n, int nThreads)
+{
+    std::vector<G1> bases;
+    std::vector<Fr> exps;
+    GetMultiExpNative(n, bases, exps);
+
+    state.SetItemsPerIteration(n);
+
+    G1 out;
+    while (state.KeepRunning())
+    {
+        MultiExpPippenger(out, bases.data(), exps.data(), n, 0, nThreads);
+    }
+}
+
+static void MultiExpStraus16(benchmark::State& state) { MultiExpStrausN(state, 16); }
+static void MultiExpStraus64(benchmark::State& state) { MultiExpStrausN(state, 64); }
+static void MultiExpStraus256(benchmark::State& state) { MultiExpStrausN(state, 256); }
+static void MultiExpStraus1024(benchmark::State& state) { MultiExpStrausN(state, 1024); }
+static void MultiExpStraus4096(benchmark::State& state) { MultiExpStrausN(state, 4096); }
+static void MultiExpStraus16384(benchmark::State& state) { MultiExpStrausN(state, 16384); }
+static void MultiExpStraus65536(benchmark::State& state) { MultiExpStrausN(state, 65536); }
+
+static void MultiExpPippenger16(benchmark::State& state) { MultiExpPippengerN(state, 16, 1); }
+static void MultiExpPippenger64(benchmark::State& state) { MultiExpPippengerN(state, 64, 1); }
+static void MultiExpPippenger256(benchmark::State& state) { MultiExpPippengerN(state, 256, 1); }
+static void MultiExpPippenger1024(benchmark::State& state) { MultiExpPippengerN(state, 1024, 1); }
+static void MultiExpPippenger4096(benchmark::State& state) { MultiExpPippengerN(state, 4096, 1); }
+static void MultiExpPippenger16384(benchmark::State& state) { MultiExpPippengerN(state, 16384, 1); }
+static void MultiExpPippenger65536(benchmark::State& state) { MultiExpPippengerN(state, 65536, 1); }
+
+static void MultiExpPippenger4096Threads4(benchmark::State& state) { MultiExpPippengerN(state, 4096, 4); }
+static void MultiExpPippenger65536Threads4(benchmark::State& state) { MultiExpPippengerN(state, 65536, 4); }
+
+static void BulletproofProveM1(benchmark::State& state) { BulletproofProve(state, 1); }
+static void BulletproofProveM2(benchmark::State& state) { BulletproofProve(state, 2); }
+static void BulletproofProveM4(benchmark::State& state) { BulletproofProve(state, 4); }
+static void BulletproofProveM16(benchmark::State& state) { BulletproofProve(state, 16); }
+
+static void BulletproofVerifyM1(benchmark::State& state) { BulletproofVerify(state, 1); }
+static void BulletproofVerifyM2(benchmark::State& state) { BulletproofVerify(state, 2); }
+static void BulletproofVerifyM4(benchmark::State& state) { BulletproofVerify(state, 4); }
+static void BulletproofVerifyM16(benchmark::State& state) { BulletproofVerify(state, 16); }
+
+static void BulletproofVerifyBatch1(benchmark::State& state) { BulletproofVerifyBatch(state, 1); }
+static void BulletproofVerifyBatch8(benchmark::State& state) { BulletproofVerifyBatch(state, 8); }
+static void BulletproofVerifyBatch64(benchmark::State& state) { BulletproofVerifyBatch(state, 64); }
+
+BENCHMARK(BulletproofProveM1);
+BENCHMARK(BulletproofProveM2);
+BENCHMARK(BulletproofProveM4);
+BENCHMARK(BulletproofProveM16);
+
+BENCHMARK(BulletproofVerifyM1);
+BENCHMARK(BulletproofVerifyM2);
+BENCHMARK(BulletproofVerifyM4);
+BENCHMARK(BulletproofVerifyM16);
+
+BENCHMARK(BulletproofVerifyBatch1);
+BENCHMARK(BulletproofVerifyBatch8);
+BENCHMARK(BulletproofVerifyBatch64);
+
+BENCHMARK(MultiExp128);
+BENCHMARK(MultiExpLegacy128);
+
+BENCHMARK(MultiExpStraus16);
+BENCHMARK(MultiExpStraus64);
+BENCHMARK(MultiExpStraus256);
+BENCHMARK(MultiExpStraus1024);
+BENCHMARK(MultiExpStraus4096);
+BENCHMARK(MultiExpStraus16384);
+BENCHMARK(MultiExpStraus65536);
+
+BENCHMARK(MultiExpPippenger16);
+BENCHMARK(MultiExpPippenger64);
+BENCHMARK(MultiExpPippenger256);
+BENCHMARK(MultiExpPippenger1024);
+BENCHMARK(MultiExpPippenger4096);
+BENCHMARK(MultiExpPippenger16384);
+BENCHMARK(MultiExpPippenger65536);
+
+BENCHMARK(MultiExpPippenger4096Threads4);
+BENCHMARK(MultiExpPippenger65536Threads4);
@@ -0,0 +1,79 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <cassert>
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <kernel.h>
+#include <main.h>
+#include <primitives/transaction.h>
+
+// Timestamps tried for a coin by CreateCoinStake
+static const unsigned int KERNEL_SEARCH_INTERVAL = 60;
+
+// A target no kernel meets, so every timestamp gets hashed
+static const unsigned int KERNEL_BITS = 0x1b00ffff;
+
+static CMutableTransaction GetKernelPrevTx()
+{
+    CMutableTransaction tx;
+    tx.nTime = 1500000000;
+    tx.vout.push_back(CTxOut(1000 * COIN, CScript()));
+    return tx;
+}
+
+static CBlockIndex GetKernelPrevIndex()
+{
+    CBlockIndex index;
+    index.nHeight = 100000;
+    index.nTime = 1600000000;
+    index.nStakeModifier = 0x0123456789abcdef;
+    return index;
+}
+
+// Kernels hashed through CheckStakeKernelHash, as the staker used to do
+static void StakeKernelCheck(benchmark::State& state)
+{
+    CBlockIndex indexPrev = GetKernelPrevIndex();
+    CBlockIndex indexFrom = GetKernelPrevIndex();
+    indexFrom.nTime = 1500000000;
+
+    CTransaction txPrev = GetKernelPrevTx();
+    COutPoint prevout(txPrev.GetHash(), 0);
+
+    state.SetItemsPerIteration(KERNEL_SEARCH_INTERVAL);
+
+    while (state.KeepRunning())
+    {
+        for (unsigned int n = 0; n < KERNEL_SEARCH_INTERVAL; n++)
+        {
+            arith_uint256 hashProofOfStake, targetProofOfStake;
+            CheckStakeKernelHash(&indexPrev, KERNEL_BITS, indexFrom, txPrev, prevout, indexPrev.nTime - n, hashProofOfStake, targetProofOfStake);
+        }
+    }
+}
+
+static void StakeKernelSearch(benchmark::State& state)
+{
+    CBlockIndex indexPrev = GetKernelPrevIndex();
+
+    CTransaction txPrev = GetKernelPrevTx();
+    COutPoint prevout(txPrev.GetHash(), 0);
+
+    state.SetItemsPerIteration(KERNEL_SEARCH_INTERVAL);
+
+    while (state.KeepRunning())
+    {
+        CStakeKernelSearch kernelSearch(&indexPrev, KERNEL_BITS, 1500000000, txPrev.nTime, txPrev.vout[0].nValue, prevout);
+
+        unsigned int nTimeFound;
+        arith_uint256 hashProofOfStake;
+        bool ret = kernelSearch.Search(indexPrev.nTime, KERNEL_SEARCH_INTERVAL, nTimeFound, hashProofOfStake);
+        assert(!ret);
+    }
+}
+
+BENCHMARK(StakeKernelCheck);
+BENCHMARK(StakeKernelSearch);
@@ -9,7 +9,7 @@ CCriticalSection cs_aggregation;
 CCriticalSection cs_sessionKeys;
 
 bool AggregationSession::fJoining = false;
-SafeQueue<EncryptedCandidateTransaction> candidatesQueue;
+CandidateVerificationPool candidatesQueue;
 std::vector<COutput> vAvailableCoins;
 
 AggregationSession::AggregationSession(const CStateViewCache* inputsIn) : inputs(inputsIn), fState(0), nVersion(2)
@@ -253,8 +253,6 @@ void AggregationSession::SetCandidateTransactions(std::vector<CandidateTransacti
 
 bool AggregationSession::AddCandidateTransaction(const std::vector<unsigned char>& v)
 {
-    LOCK(cs_aggregation);
-
     if (!inputs)
         return false;
 
@@ -269,12 +267,38 @@ bool AggregationSession::AddCandidateTransaction(const std::vector<unsigned char
         return error("AggregationSession::%s: Wrong serialization of transaction candidate\n", __func__);
     }
 
-    for (auto& it: vTransactionCandidates)
     {
-        if (it.tx.vin == tx.tx.vin) // We already have this input
-            return true;
+        LOCK(cs_aggregation);
+
+        for (auto& it: vTransactionCandidates)
+        {
+            if (it.tx.vin == tx.tx.vin) // We already have this input
+                return true;
+        }
     }
 
+    // Validation does not hold cs_aggregation, so it does not stall the selection of candidates
+    if (!tx.Validate(inputs))
+        return error("AggregationSession::%s: Failed validation of candidate", __func__);
+
+    return AddVerifiedCandidateTransaction(tx);
+}
+
+bool AggregationSession::AddVerifiedCandidateTransaction(const CandidateTransaction& tx)
+{
+    LOCK(cs_aggregation);
+
+    for (auto& it: vTransactionCandidates)
+    {
+        for (auto &in: it.tx.vin)
+        {
+            for (auto &in2: tx.tx.vin)
+            {
+                if (in == in2) // We already have this input
+                    return false;
+            }
+        }
+    }
 
     if (CWalletTx(NULL, tx.tx).InputsInMempool()) {
         return error ("CandidateTransaction::%s: Received transaction in mempool\n", __func__);
@@ -284,9 +308,6 @@ bool AggregationSession::AddCandidateTransaction(const std::vector<unsigned char
         return error ("CandidateTransaction::%s: Received transaction in stempool\n", __func__);
     }
 
-    if (!tx.Validate(inputs))
-        return error("AggregationSession::%s: Failed validation of candidate", __func__);
-
     vTransactionCandidates.push_back(tx);
 
     LogPrint("aggregationsession", "AggregationSession::%s: received one candidate\n", __func__);
@@ -309,9 +330,10 @@ bool AggregationSession::NewEncryptedCandidateTransaction(EncryptedCandidateTran
     {
         ret = false;
     }
-    else
+    else if (!candidatesQueue.Push(etx))
     {
-        candidatesQueue.push(etx);
+        LogPrint("aggregationsession", "AggregationSession::%s: verification queue is full, candidate dropped\n", __func__);
+        ret = false;
     }
 
 
@@ -507,7 +529,7 @@ bool AggregationSession::BuildCandidateTransaction(const CWalletTx *prevcoin, co
 
     try
     {
-        if (!CreateBLSCTOutput(bls::PrivateKey::FromBytes(ephemeralKey.data()), nonce, newTxOut, k, prevcoin->vAmounts[prevout]+nAddedFee, "Mixing Reward: " + FormatMoney(nAddedFee), gammaOuts, strFailReason, true, vBLSSignatures))
+        if (!CreateBLSCTOutput(bls::PrivateKey::FromBytes(ephemeralKey.data()), nonce, newTxOut, k, prevcoin->vAmounts[prevout]+nAddedFee, "Mixing Reward: " + FormatMoney(nAddedFee), gammaOuts, strFailReason, true, vBLSSignatures, IsBLSCTViewTagEnabled(chainActive.Tip(), Params().GetConsensus())))
         {
             return error("AggregationSession::%s: Error creating BLSCT output: %s\n",__func__, strFailReason);
         }
@@ -990,6 +1012,202 @@ void AggregationSessionThread()
     }
 }
 
+void CandidateVerificationPool::SetMaxSize(size_t nMaxSizeIn)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nMaxSize = std::max((size_t)1, nMaxSizeIn);
+}
+
+bool CandidateVerificationPool::Push(const EncryptedCandidateTransaction& etx)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+
+        nReceived++;
+
+        if (queue.size() >= nMaxSize)
+        {
+            nDropped++;
+            return false;
+        }
+
+        queue.push_back(etx);
+        nMaxQueued = std::max(nMaxQueued, queue.size());
+    }
+
+    cond.notify_one();
+
+    return true;
+}
+
+bool CandidateVerificationPool::PopBatch(std::vector<EncryptedCandidateTransaction>& vRet, size_t nMax, int64_t nTimeout)
+{
+    vRet.clear();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    // Interruption point for the thread group
+    if (queue.empty())
+        cond.timed_wait(lock, boost::posix_time::milliseconds(nTimeout));
+
+    while (!queue.empty() && vRet.size() < nMax)
+    {
+        vRet.push_back(queue.front());
+        queue.pop_front();
+    }
+
+    return !vRet.empty();
+}
+
+void CandidateVerificationPool::BatchDone(const std::vector<EncryptedCandidateTransaction>& vBatch, size_t nAcceptedIn, int64_t nTime)
+{
+    int64_t nNow = GetTimeMillis();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    nBatches++;
+    nAccepted += nAcceptedIn;
+    nRejected += vBatch.size() - nAcceptedIn;
+    nVerifyTime += nTime;
+    nLastVerifyTime = nTime;
+
+    for (const EncryptedCandidateTransaction& etx: vBatch)
+        nWaitTime += nNow - etx.nTime;
+}
+
+size_t CandidateVerificationPool::size() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
+
+UniValue CandidateVerificationPool::GetStats() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    uint64_t nVerified = nAccepted + nRejected;
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("queueSize", (uint64_t)queue.size());
+    ret.pushKV("maxQueueSize", (uint64_t)nMaxSize);
+    ret.pushKV("peakQueueSize", (uint64_t)nMaxQueued);
+    ret.pushKV("received", nReceived);
+    ret.pushKV("dropped", nDropped);
+    ret.pushKV("accepted", nAccepted);
+    ret.pushKV("rejected", nRejected);
+    ret.pushKV("batches", nBatches);
+    ret.pushKV("avgVerifyTimeMs", nVerified ? 0.001 * nVerifyTime / nVerified : 0.0);
+    ret.pushKV("avgQueueTimeMs", nVerified ? (double)nWaitTime / nVerified : 0.0);
+    ret.pushKV("lastBatchVerifyTimeMs", 0.001 * nLastVerifyTime);
+    return ret;
+}
+
+// Decrypts and validates a batch of candidates, checking all their range proofs at once
+static size_t VerifyCandidateBatch(const std::vector<EncryptedCandidateTransaction>& vBatch)
+{
+    std::vector<std::pair<uint256, bls::PrivateKey>> vKeys;
+
+    {
+        LOCK(cs_sessionKeys);
+        // The session can be gone by the time the batch is popped, without its keys nothing can be decrypted
+        if (!pwalletMain || !pwalletMain->aggSession)
+        {
+            LogPrint("aggregationsession", "AggregationSession::%s: no session, %u candidates dropped\n", __func__, vBatch.size());
+            return 0;
+        }
+        vKeys = pwalletMain->aggSession->vKeys;
+    }
+
+    std::vector<CandidateTransaction> vCandidates;
+
+    for (const EncryptedCandidateTransaction& etx: vBatch)
+    {
+        CandidateTransaction tx;
+
+        for (auto& it: vKeys)
+        {
+            try
+            {
+                if (etx.Decrypt(it.second, nullptr, tx, false))
+                {
+                    vCandidates.push_back(tx);
+                    break;
+                }
+            }
+            catch(...)
+            {
+                continue;
+            }
+        }
+    }
+
+    if (vCandidates.empty())
+        return 0;
+
+    // The prevouts are copied while cs_main is held, the validation runs without it
+    CStateView dummy;
+    CStateViewCache view(&dummy);
+
+    {
+        LOCK(cs_main);
+        view.SetBackend(*pcoinsTip);
+        for (const CandidateTransaction& tx: vCandidates)
+            view.HaveInputs(tx.tx);
+        view.SetBackend(dummy);
+    }
+
+    RangeproofBatch rangeproofBatch;
+    std::vector<CandidateTransaction> vValid;
+
+    for (CandidateTransaction& tx: vCandidates)
+    {
+        if (tx.Validate(&view, &rangeproofBatch))
+            vValid.push_back(tx);
+    }
+
+    std::set<uint256> setInvalid;
+
+    try
+    {
+        setInvalid = rangeproofBatch.GetInvalid();
+    }
+    catch(...)
+    {
+        // A malformed proof makes the whole batch throw, verify the candidates one by one instead
+        for (CandidateTransaction& tx: vValid)
+        {
+            try
+            {
+                if (!tx.Validate(&view))
+                    setInvalid.insert(tx.tx.GetHash());
+            }
+            catch(...)
+            {
+                setInvalid.insert(tx.tx.GetHash());
+            }
+        }
+    }
+
+    size_t nAccepted = 0;
+
+    for (const CandidateTransaction& tx: vValid)
+    {
+        if (setInvalid.count(tx.tx.GetHash()))
+        {
+            LogPrint("aggregationsession", "AggregationSession::%s: candidate %s has an invalid range proof\n", __func__, tx.tx.GetHash().ToString());
+            continue;
+        }
+
+        if (!pwalletMain || !pwalletMain->aggSession)
+            break;
+
+        if (pwalletMain->aggSession->AddVerifiedCandidateTransaction(tx))
+            nAccepted++;
+    }
+
+    return nAccepted;
+}
+
 void CandidateVerificationThread()
 {
     LogPrintf("NavcoinCandidateVerificationThread started\n");
@@ -1011,94 +1229,18 @@ void CandidateVerificationThread()
                 MilliSleep(1000);
             } while (true);
 
-            EncryptedCandidateTransaction etx;
+            std::vector<EncryptedCandidateTransaction> vBatch;
 
-            while(candidatesQueue.pop(etx))
+            while (candidatesQueue.PopBatch(vBatch, AGGREGATION_VERIFY_BATCH, verSleep))
             {
-                bool fSolved = false;
-                CandidateTransaction tx;
+                int64_t nStart = GetTimeMicros();
+                size_t nAccepted = VerifyCandidateBatch(vBatch);
+                int64_t nTime = GetTimeMicros() - nStart;
 
-                {
-                    LOCK(cs_sessionKeys);
+                candidatesQueue.BatchDone(vBatch, nAccepted, nTime);
 
-                    for (auto& it: pwalletMain->aggSession->vKeys)
-                    {
-                        try
-                        {
-                            if (etx.Decrypt(it.second, pwalletMain->aggSession->inputs, tx))
-                            {
-                                fSolved = true;
-                                break;
-                            }
-                        }
-                        catch(...)
-                        {
-                            continue;
-                        }
-                    }
-                }
-
-                if (!fSolved)
-                {
-                    continue;
-                }
-
-                {
-                    LOCK(cs_aggregation);
-
-                    bool stop = false;
-
-                    for (auto& it: pwalletMain->aggSession->GetTransactionCandidates())
-                    {
-                        bool stop1 = false;
-                        for (auto &in: it.tx.vin)
-                        {
-                            bool stop2 = false;
-                            for (auto &in2: tx.tx.vin)
-                            {
-                                if (in == in2) // We already have this input
-                                {
-                                    stop2 = true;
-                                    break;
-                                }
-                            }
-
-                            if (stop2)
-                            {
-                                stop1 = true;
-                                break;
-                            }
-                        }
-                        if (stop1)
-                        {
-                            stop = true;
-                            break;
-                        }
-                    }
-
-                    if (stop)
-                    {
-                        continue;
-                    }
-
-                    if (CWalletTx(NULL, tx.tx).InputsInMempool()) {
-                        stop = true;
-                    } else if (CWalletTx(NULL, tx.tx).InputsInStempool()) {
-                        stop = true;
-                    }
-
-                    if (stop)
-                    {
-                        continue;
-                    }
-
-                    pwalletMain->aggSession->vTransactionCandidates.push_back(tx);
-                }
-
-                LogPrint("aggregationsession", "AggregationSession::%s: received one candidate\n", __func__);
+                LogPrint("aggregationsession", "AggregationSession::%s: verified %u candidates, %u accepted: %.2fms\n", __func__, vBatch.size(), nAccepted, 0.001 * nTime);
             }
-
-            MilliSleep(GetRand(verSleep, verSleep + 100));
         }
     }
     catch (const boost::thread_interrupted&)
@@ -16,7 +16,12 @@
 #include <utiltime.h>
 #include <wallet/wallet.h>
 
-#include <queue>
+#include <deque>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <univalue.h>
 
 extern CCriticalSection cs_aggregation;
 extern CCriticalSection cs_sessionKeys;
@@ -49,6 +54,9 @@ public:
 
     bool NewEncryptedCandidateTransaction(EncryptedCandidateTransaction v);
 
+    /** Adds a candidate which already passed validation, unless its inputs are taken */
+    bool AddVerifiedCandidateTransaction(const CandidateTransaction& tx);
+
     bool SelectCandidates(CandidateTransaction& ret);
 
     void SetCandidateTransactions(std::vector<CandidateTransaction> candidates);
@@ -118,41 +126,53 @@ private:
 void AggregationSessionThread();
 void CandidateVerificationThread();
 
-template <class T>
-class SafeQueue
+/**
+ * Bounded queue of the encrypted candidates waiting for verification. The
+ * verification threads take them in batches, so the range proofs of several
+ * candidates are checked with one multi-exponentiation. New candidates are
+ * refused while the queue is full instead of letting it grow until they are
+ * stale.
+ */
+class CandidateVerificationPool
 {
 public:
-    SafeQueue(void)
-        : q()
-        , m()
-    {}
+    CandidateVerificationPool() : nMaxSize(DEFAULT_AGGREGATION_QUEUE_SIZE), nMaxQueued(0), nReceived(0), nDropped(0),
+        nAccepted(0), nRejected(0), nBatches(0), nVerifyTime(0), nWaitTime(0), nLastVerifyTime(0) {}
 
-    ~SafeQueue(void)
-    {}
+    void SetMaxSize(size_t nMaxSizeIn);
 
-    void push(T t)
-    {
-        std::lock_guard<std::mutex> lock(m);
-        q.push(t);
-    }
+    /** Returns false when the queue is full */
+    bool Push(const EncryptedCandidateTransaction& etx);
 
-    bool pop(T& val)
-    {
-        while (q.empty())
-        {
-            MilliSleep(50);
-        }
+    /** Waits up to nTimeout milliseconds for candidates and moves up to nMax of them to vRet */
+    bool PopBatch(std::vector<EncryptedCandidateTransaction>& vRet, size_t nMax, int64_t nTimeout);
 
-        std::unique_lock<std::mutex> lock(m);
-        val = q.front();
-        q.pop();
+    /** Accounts a verified batch which took nTime microseconds */
+    void BatchDone(const std::vector<EncryptedCandidateTransaction>& vBatch, size_t nAcceptedIn, int64_t nTime);
 
-        return true;
-    }
+    size_t size() const;
+
+    UniValue GetStats() const;
 
 private:
-    std::queue<T> q;
-    mutable std::mutex m;
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<EncryptedCandidateTransaction> queue;
+    size_t nMaxSize;
+
+    size_t nMaxQueued;
+    uint64_t nReceived;
+    uint64_t nDropped;
+    uint64_t nAccepted;
+    uint64_t nRejected;
+    uint64_t nBatches;
+    //! Microseconds spent verifying
+    int64_t nVerifyTime;
+    //! Milliseconds the verified candidates waited since they were received
+    int64_t nWaitTime;
+    int64_t nLastVerifyTime;
 };
 
+extern CandidateVerificationPool candidatesQueue;
+
 #endif // AGGREGATIONSESSION_H
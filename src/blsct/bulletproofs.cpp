@@ -9,7 +9,11 @@
 #include <boost/algorithm/string.hpp>
 
 #include <blsct/bulletproofs.h>
+#include <blsct/multiexp.h>
+#include <random.h>
 #include <tinyformat.h>
+
+#include <cstdio>
 #include <utiltime.h>
 
 bool BLSInitResult = bls::BLS::Init();
@@ -21,7 +25,6 @@ static Scalar InnerProduct(const std::vector<Scalar> &a, const std::vector<Scala
 Scalar BulletproofsRangeproof::one;
 Scalar BulletproofsRangeproof::two;
 
-std::vector<bls::G1Element> BulletproofsRangeproof::Hi, BulletproofsRangeproof::Gi;
 std::vector<Scalar> BulletproofsRangeproof::oneN;
 std::vector<Scalar> BulletproofsRangeproof::twoN;
 Scalar BulletproofsRangeproof::ip12;
@@ -31,6 +34,15 @@ boost::mutex BulletproofsRangeproof::init_mutex;
 bls::G1Element BulletproofsRangeproof::G;
 bls::G1Element BulletproofsRangeproof::H;
 
+G1 BulletproofsRangeproof::GNative;
+G1 BulletproofsRangeproof::HNative;
+std::vector<G1> BulletproofsRangeproof::HiNative, BulletproofsRangeproof::GiNative;
+
+mcl::fp::WindowMethod<G1> BulletproofsRangeproof::GTable, BulletproofsRangeproof::HTable;
+
+static const uint32_t GENERATORS_CACHE_VERSION = 1;
+static const size_t G1_AFFINE_SIZE = 96;
+
 // Calculate base point
 static bls::G1Element GetBaseG1Element(const bls::G1Element &base, size_t idx)
 {
@@ -52,8 +64,106 @@ static bls::G1Element GetBaseG1Element(const bls::G1Element &base, size_t idx)
     return e;
 }
 
+static void GetBaseG1ElementNative(G1& out, const bls::G1Element &base, size_t idx)
+{
+    G1ElementToNative(out, GetBaseG1Element(base, idx));
+}
+
+// Load Gi and Hi from the cache file, instead of hashing them to the curve again
+static bool ReadGeneratorsCache(const std::string& strCacheFile)
+{
+    CAutoFile file(fopen(strCacheFile.c_str(), "rb"), SER_DISK, 0);
+
+    if (file.IsNull())
+        return false;
+
+    uint32_t nVersion, nMN;
+    std::vector<unsigned char> vData;
+    uint256 checksum;
+
+    try
+    {
+        file >> nVersion;
+        file >> nMN;
+
+        if (nVersion != GENERATORS_CACHE_VERSION || nMN != maxMN)
+            return false;
+
+        file >> vData;
+        file >> checksum;
+    }
+    catch(...)
+    {
+        return false;
+    }
+
+    if (vData.size() != 2 * maxMN * G1_AFFINE_SIZE || Hash(vData.begin(), vData.end()) != checksum)
+        return false;
+
+    std::vector<G1> Hi(maxMN), Gi(maxMN);
+
+    for (size_t i = 0; i < maxMN; ++i)
+    {
+        // Points are checked to be on the curve when deserialized
+        if (Hi[i].deserialize(&vData[i * 2 * G1_AFFINE_SIZE], G1_AFFINE_SIZE, mcl::IoEcAffineSerialize) == 0)
+            return false;
+        if (Gi[i].deserialize(&vData[(i * 2 + 1) * G1_AFFINE_SIZE], G1_AFFINE_SIZE, mcl::IoEcAffineSerialize) == 0)
+            return false;
+    }
+
+    // Spot check the cache against the derivation, so a stale file is not used
+    G1 check;
+    GetBaseG1ElementNative(check, BulletproofsRangeproof::H, 1);
+    if (check != Hi[0])
+        return false;
+    GetBaseG1ElementNative(check, BulletproofsRangeproof::H, maxMN * 2);
+    if (check != Gi[maxMN - 1])
+        return false;
+
+    BulletproofsRangeproof::HiNative.swap(Hi);
+    BulletproofsRangeproof::GiNative.swap(Gi);
+
+    return true;
+}
+
+static bool WriteGeneratorsCache(const std::string& strCacheFile)
+{
+    std::vector<unsigned char> vData(2 * maxMN * G1_AFFINE_SIZE);
+
+    for (size_t i = 0; i < maxMN; ++i)
+    {
+        if (BulletproofsRangeproof::HiNative[i].serialize(&vData[i * 2 * G1_AFFINE_SIZE], G1_AFFINE_SIZE, mcl::IoEcAffineSerialize) != G1_AFFINE_SIZE)
+            return false;
+        if (BulletproofsRangeproof::GiNative[i].serialize(&vData[(i * 2 + 1) * G1_AFFINE_SIZE], G1_AFFINE_SIZE, mcl::IoEcAffineSerialize) != G1_AFFINE_SIZE)
+            return false;
+    }
+
+    // Write to a temporary file first, so a partially written cache is never loaded
+    std::string strTmpFile = strCacheFile + ".new";
+    CAutoFile file(fopen(strTmpFile.c_str(), "wb"), SER_DISK, 0);
+
+    if (file.IsNull())
+        return false;
+
+    try
+    {
+        file << GENERATORS_CACHE_VERSION;
+        file << (uint32_t)maxMN;
+        file << vData;
+        file << Hash(vData.begin(), vData.end());
+    }
+    catch(...)
+    {
+        return false;
+    }
+
+    file.fclose();
+
+    return std::rename(strTmpFile.c_str(), strCacheFile.c_str()) == 0;
+}
+
 // Initialize bases and constants
-bool BulletproofsRangeproof::Init()
+bool BulletproofsRangeproof::Init(const std::string& strCacheFile)
 {
     boost::lock_guard<boost::mutex> lock(BulletproofsRangeproof::init_mutex);
 
@@ -73,13 +183,26 @@ bool BulletproofsRangeproof::Init()
     BulletproofsRangeproof::G = bls::G1Element::Generator();
     BulletproofsRangeproof::H = GetBaseG1Element(BulletproofsRangeproof::G, 0);
 
-    BulletproofsRangeproof::Hi.resize(maxMN);
-    BulletproofsRangeproof::Gi.resize(maxMN);
+    G1ElementToNative(BulletproofsRangeproof::GNative, BulletproofsRangeproof::G);
+    G1ElementToNative(BulletproofsRangeproof::HNative, BulletproofsRangeproof::H);
 
-    for (size_t i = 0; i < maxMN; ++i)
+    BulletproofsRangeproof::GTable.init(BulletproofsRangeproof::GNative, Fr::getBitSize(), fixedBaseWindow);
+    BulletproofsRangeproof::HTable.init(BulletproofsRangeproof::HNative, Fr::getBitSize(), fixedBaseWindow);
+
+    if (strCacheFile.empty() || !ReadGeneratorsCache(strCacheFile))
     {
-        BulletproofsRangeproof::Hi[i] = GetBaseG1Element(BulletproofsRangeproof::H, i * 2 + 1);
-        BulletproofsRangeproof::Gi[i] = GetBaseG1Element(BulletproofsRangeproof::H, i * 2 + 2);
+        BulletproofsRangeproof::HiNative.resize(maxMN);
+        BulletproofsRangeproof::GiNative.resize(maxMN);
+
+        for (size_t i = 0; i < maxMN; ++i)
+        {
+            GetBaseG1ElementNative(BulletproofsRangeproof::HiNative[i], BulletproofsRangeproof::H, i * 2 + 1);
+            GetBaseG1ElementNative(BulletproofsRangeproof::GiNative[i], BulletproofsRangeproof::H, i * 2 + 2);
+        }
+
+        // The cache is only an optimization, the node works without it
+        if (!strCacheFile.empty())
+            WriteGeneratorsCache(strCacheFile);
     }
 
     BulletproofsRangeproof::oneN = VectorDup(BulletproofsRangeproof::one, maxN);
@@ -91,34 +214,97 @@ bool BulletproofsRangeproof::Init()
     return true;
 }
 
-// Todo multi-exp optimization
-bls::G1Element MultiExp(std::vector<MultiexpData> multiexp_data)
+G1 BulletproofsRangeproof::MulGNative(const Scalar& s)
 {
-    G1 x[multiexp_data.size()], z;
-    Fr y[multiexp_data.size()];
+    Fr exp;
+    G1 ret;
+    ScalarToNative(exp, s);
+    GTable.mul(ret, exp);
+    return ret;
+}
 
+G1 BulletproofsRangeproof::MulHNative(const Scalar& s)
+{
+    Fr exp;
+    G1 ret;
+    ScalarToNative(exp, s);
+    HTable.mul(ret, exp);
+    return ret;
+}
 
-    for (size_t i = 0; i < multiexp_data.size(); i++)
-    {
-        std::vector<unsigned char> base = multiexp_data[i].base.Serialize();
-        std::vector<unsigned char> exp = multiexp_data[i].exp.GetVch();
+bls::G1Element BulletproofsRangeproof::MulG(const Scalar& s)
+{
+    return NativeToG1Element(MulGNative(s));
+}
 
-        x[i].deserialize(&base[0], base.size());
-        y[i].deserialize(&exp[0], exp.size());
-    }
+bls::G1Element BulletproofsRangeproof::MulH(const Scalar& s)
+{
+    return NativeToG1Element(MulHNative(s));
+}
+
+void G1ElementToNative(G1& out, const bls::G1Element& in)
+{
+    std::vector<uint8_t> vch = in.Serialize();
 
-    G1::mulVec(z, x, y, multiexp_data.size());
+    if (out.deserialize(vch.data(), vch.size()) == 0)
+        throw std::runtime_error("G1ElementToNative(): could not deserialize point");
+}
+
+bls::G1Element NativeToG1Element(const G1& in)
+{
+    uint8_t buf[bls::G1Element::SIZE];
 
-    std::vector<unsigned char> res(48);
+    if (in.serialize(buf, sizeof(buf)) == 0)
+        throw std::runtime_error("NativeToG1Element(): could not serialize point");
 
-    z.serialize(&res[0], 48);
+    return bls::G1Element::FromBytes(buf);
+}
 
-    bls::G1Element result = bls::G1Element::FromByteVector(res);
+void ScalarToNative(Fr& out, const Scalar& in)
+{
+    uint8_t buf[bls::PrivateKey::PRIVATE_KEY_SIZE];
 
-    return result;
+    bn_write_bin(buf, sizeof(buf), in.bn);
+    out.setBigEndianMod(buf, sizeof(buf));
 }
 
-bls::G1Element MultiExpLegacy(std::vector<MultiexpData> multiexp_data)
+void NativeToScalar(Scalar& out, const Fr& in)
+{
+    uint8_t buf[bls::PrivateKey::PRIVATE_KEY_SIZE];
+    memset(buf, 0, sizeof(buf));
+
+    if (in.getLittleEndian(buf, sizeof(buf)) == 0)
+        throw std::runtime_error("NativeToScalar(): could not serialize scalar");
+
+    std::reverse(buf, buf + sizeof(buf));
+    bn_read_bin(out.bn, buf, sizeof(buf));
+}
+
+G1 MultiExpNative(const std::vector<G1>& bases, const std::vector<Fr>& exps)
+{
+    CHECK_AND_ASSERT_THROW_MES(bases.size() == exps.size(), "Incompatible sizes of bases and exps");
+
+    G1 z;
+    MultiExpAdaptive(z, bases.data(), exps.data(), bases.size());
+
+    return z;
+}
+
+bls::G1Element MultiExp(const std::vector<MultiexpData>& multiexp_data)
+{
+    std::vector<G1> x(multiexp_data.size());
+    std::vector<Fr> y(multiexp_data.size());
+
+    for (size_t i = 0; i < multiexp_data.size(); i++)
+    {
+        G1ElementToNative(x[i], multiexp_data[i].base);
+        ScalarToNative(y[i], multiexp_data[i].exp);
+    }
+
+    return NativeToG1Element(MultiExpNative(x, y));
+}
+
+bls::G1Element MultiExpLegacy(const std::vector<MultiexpData>& multiexp_data)
 {
     bls::G1Element result;
 
@@ -136,20 +322,71 @@ bls::G1Element MultiExpLegacy(std::vector<MultiexpData> multiexp_data)
     return result;
 }
 
-/* Given two Scalar arrays, construct a vector commitment */
-static bls::G1Element VectorCommitment(const std::vector<Scalar> &a, const std::vector<Scalar> &b)
+// Bases and exponents of a multi-exponentiation in mcl form
+struct MultiexpNativeData
+{
+    std::vector<G1> bases;
+    std::vector<Fr> exps;
+
+    void reserve(size_t n)
+    {
+        bases.reserve(n);
+        exps.reserve(n);
+    }
+
+    void resize(size_t n)
+    {
+        bases.resize(n);
+        exps.resize(n);
+    }
+
+    void set(size_t i, const G1& base, const Scalar& exp)
+    {
+        bases[i] = base;
+        ScalarToNative(exps[i], exp);
+    }
+
+    void push_back(const G1& base, const Scalar& exp)
+    {
+        bases.push_back(base);
+        exps.emplace_back();
+        ScalarToNative(exps.back(), exp);
+    }
+
+    void push_back(const bls::G1Element& base, const Scalar& exp)
+    {
+        bases.emplace_back();
+        G1ElementToNative(bases.back(), base);
+        exps.emplace_back();
+        ScalarToNative(exps.back(), exp);
+    }
+};
+
+/* Draw a uniform Fr, the 512 random bits make the bias of the reduction negligible */
+static void RandNative(Fr& out)
+{
+    uint8_t buf[64];
+    GetRandBytes(buf, sizeof(buf));
+    out.setLittleEndianMod(buf, sizeof(buf));
+}
+
+/* Given two Fr arrays, construct a vector commitment */
+static G1 VectorCommitment(const std::vector<Fr> &a, const std::vector<Fr> &b, MultiexpNativeData &scratch)
 {
     CHECK_AND_ASSERT_THROW_MES(a.size() == b.size(), "Incompatible sizes of a and b");
     CHECK_AND_ASSERT_THROW_MES(a.size() <= maxMN, "Incompatible sizes of a and maxN");
 
-    std::vector<MultiexpData> multiexp_data;
+    scratch.resize(a.size() * 2);
+
     for (size_t i = 0; i < a.size(); ++i)
     {
-        multiexp_data.push_back({BulletproofsRangeproof::Gi[i], a[i]});
-        multiexp_data.push_back({BulletproofsRangeproof::Hi[i], b[i]});
+        scratch.bases[i*2] = BulletproofsRangeproof::GiNative[i];
+        scratch.exps[i*2] = a[i];
+        scratch.bases[i*2+1] = BulletproofsRangeproof::HiNative[i];
+        scratch.exps[i*2+1] = b[i];
     }
 
-    return MultiExp(multiexp_data);
+    return MultiExpNative(scratch.bases, scratch.exps);
 }
 
 /* Given a Scalar x, construct a vector of powers [x^0, x^1, ..., x^n] */
@@ -175,6 +412,22 @@ static std::vector<Scalar> VectorPowers(const Scalar &x, size_t n)
     return res;
 }
 
+/* Fill out with the powers [x^0, x^1, ..., x^n-1] */
+static void VectorPowers(std::vector<Fr> &out, const Fr &x, size_t n)
+{
+    out.resize(n);
+
+    if (n == 0)
+        return;
+
+    out[0] = 1;
+
+    for (size_t i = 1; i < n; ++i)
+    {
+        Fr::mul(out[i], out[i-1], x);
+    }
+}
+
 static Scalar VectorPowerSum(const Scalar &x, size_t n)
 {
     std::vector<Scalar> res = VectorPowers(x, n);
@@ -219,142 +472,158 @@ static Scalar InnerProduct(const std::vector<Scalar> &a, const std::vector<Scala
     return res;
 }
 
-static std::vector<Scalar> VectorProduct(const std::vector<Scalar> &a, const std::vector<Scalar> &b)
+/* Inner product of n elements starting at a and b, slices are passed as offsets instead of copies */
+static Fr InnerProduct(const Fr *a, const Fr *b, size_t n)
 {
-    CHECK_AND_ASSERT_THROW_MES(a.size() == b.size(), "Incompatible sizes of a and b");
-
-    std::vector<Scalar> res(a.size());
+    Fr res, tmp;
+    res.clear();
 
-    for (size_t i = 0; i < a.size(); ++i)
+    for (size_t i = 0; i < n; ++i)
     {
-        res[i] = (a[i] * b[i]);
+        Fr::mul(tmp, a[i], b[i]);
+        Fr::add(res, res, tmp);
     }
+
     return res;
 }
 
-/* Subtract a number from all the elements of a vectors */
-static std::vector<Scalar> VectorSubtract(const std::vector<Scalar>& a, const Scalar& b)
+/* Subtract a number from all the elements of a vector, in place */
+static void VectorSubtract(std::vector<Fr>& a, const Fr& b)
 {
-
-    std::vector<Scalar> ret(a.size());
-
-    for (unsigned int i = 0; i < a.size(); i++)
+    for (size_t i = 0; i < a.size(); i++)
     {
-        ret[i] = (a[i] - b);
+        Fr::sub(a[i], a[i], b);
     }
-
-    return ret;
 }
 
-/* Given two scalar arrays, construct the Hadamard product */
-std::vector<Scalar> Hadamard(const std::vector<Scalar>& a, const std::vector<Scalar>& b)
+/* Add a number to all the elements of a vector, in place */
+static void VectorAdd(std::vector<Fr>& a, const Fr& b)
 {
-    if (a.size() != b.size())
-        throw std::runtime_error("Hadamard(): a and b should be of the same size");
-
-    std::vector<Scalar> ret(a.size());
-
-    for (unsigned int i = 0; i < a.size(); i++)
+    for (size_t i = 0; i < a.size(); i++)
     {
-        ret[i] = (a[i] * b[i]);
+        Fr::add(a[i], a[i], b);
     }
-
-    return ret;
 }
 
-/* Add a number to all the elements of a vectors */
-static std::vector<Scalar> VectorAdd(const std::vector<Scalar>& a, const Scalar& b)
+/* a = a + b, in place */
+static void VectorAdd(std::vector<Fr>& a, const std::vector<Fr>& b)
 {
+    CHECK_AND_ASSERT_THROW_MES(a.size() == b.size(), "Incompatible sizes of a and b");
 
-    std::vector<Scalar> ret(a.size());
-
-    for (unsigned int i = 0; i < a.size(); i++)
+    for (size_t i = 0; i < a.size(); i++)
     {
-        ret[i] = (a[i] + b);
+        Fr::add(a[i], a[i], b[i]);
     }
-
-    return ret;
 }
 
-static std::vector<Scalar> VectorAdd(const std::vector<Scalar>& a, const std::vector<Scalar>& b)
+/* a = a + b*x, in place */
+static void VectorAddScaled(std::vector<Fr>& a, const std::vector<Fr>& b, const Fr& x)
 {
     CHECK_AND_ASSERT_THROW_MES(a.size() == b.size(), "Incompatible sizes of a and b");
 
-    std::vector<Scalar> ret(a.size());
+    Fr tmp;
 
-    for (unsigned int i = 0; i < a.size(); i++)
+    for (size_t i = 0; i < a.size(); i++)
     {
-        ret[i] = (a[i] + b[i]);
+        Fr::mul(tmp, b[i], x);
+        Fr::add(a[i], a[i], tmp);
     }
-
-    return ret;
 }
 
-/* Multiply all the elements of a vector by a number */
-static std::vector<Scalar> VectorScalar(const std::vector<Scalar>& a, const Scalar& x)
+/* Given two Fr arrays, construct the Hadamard product in the first one */
+static void Hadamard(std::vector<Fr>& a, const std::vector<Fr>& b)
 {
-    std::vector<Scalar> ret(a.size());
+    if (a.size() != b.size())
+        throw std::runtime_error("Hadamard(): a and b should be of the same size");
 
-    for (unsigned int i = 0; i < a.size(); i++)
+    for (size_t i = 0; i < a.size(); i++)
     {
-        ret[i] = (a[i] * x);
+        Fr::mul(a[i], a[i], b[i]);
     }
-
-    return ret;
 }
 
-/* Compute the slice of a scalar vector */
-static std::vector<Scalar> VectorSlice(const std::vector<Scalar>& a, unsigned int start, unsigned int stop)
+/* Fold the two halves of a into its first half, a[i] = a[i]*x + a[n+i]*y */
+static void VectorFold(std::vector<Fr>& a, const Fr& x, const Fr& y)
 {
-    if (start > a.size() || stop > a.size())
-        throw std::runtime_error("VectorSlice(): wrong start or stop point");
+    if(!((a.size() & 1) == 0))
+        throw std::runtime_error("VectorFold(): vector argument size is not even");
 
-    std::vector<Scalar> ret(stop-start);
+    const size_t sz = a.size() / 2;
+    Fr tmp;
 
-    for (unsigned int i = start; i < stop; i++)
+    for (size_t n = 0; n < sz; ++n)
     {
-        ret[i-start] = a[i];
+        Fr::mul(tmp, a[sz + n], y);
+        Fr::mul(a[n], a[n], x);
+        Fr::add(a[n], a[n], tmp);
     }
 
-    return ret;
+    a.resize(sz);
 }
 
-static std::vector<bls::G1Element> HadamardFold(const std::vector<bls::G1Element> &vec, const std::vector<Scalar> *scale, const Scalar &a, const Scalar &b)
+/* Same fold for a vector of points, optionally scaled element wise */
+static void HadamardFold(std::vector<G1> &vec, const std::vector<Fr> *scale, const Fr &a, const Fr &b)
 {
     if(!((vec.size() & 1) == 0))
         throw std::runtime_error("HadamardFold(): vector argument size is not even");
 
     const size_t sz = vec.size() / 2;
-    std::vector<bls::G1Element> out(sz);
+
+    Fr sa, sb;
+    G1 l, r;
 
     for (size_t n = 0; n < sz; ++n)
     {
-        bls::G1Element c0 = vec[n];
-        bls::G1Element c1 = vec[sz + n];
-        Scalar sa, sb;
-        if (scale) sa = a*(*scale)[n]; else sa = a;
-        if (scale) sb = b*(*scale)[sz + n]; else sb = b;
-        bls::G1Element l = c0*sa.bn;
-        bls::G1Element r = c1*sb.bn;
-        out[n] = l + r;
+        sa = a;
+        sb = b;
+        if (scale)
+        {
+            sa *= (*scale)[n];
+            sb *= (*scale)[sz + n];
+        }
+        G1::mul(l, vec[n], sa);
+        G1::mul(r, vec[sz + n], sb);
+        G1::add(vec[n], l, r);
     }
 
-    return out;
+    vec.resize(sz);
 }
 
+/* Invert all the elements of a vector with a single inversion (Montgomery's trick), zeros are left as they are */
 std::vector<Scalar> VectorInvert(const std::vector<Scalar>& x)
 {
     std::vector<Scalar> ret(x.size());
 
-    for (size_t i = 0; i < ret.size(); i++)
+    if (x.empty())
+        return ret;
+
+    // ret[i] holds the product of the non zero elements before i
+    Scalar acc = 1;
+
+    for (size_t i = 0; i < x.size(); i++)
     {
-        ret[i] = x[i].Invert();
+        ret[i] = acc;
+        if (!(x[i] == 0))
+            acc = acc * x[i];
+    }
+
+    Scalar inv = acc.Invert();
+
+    for (size_t i = x.size(); i-- > 0;)
+    {
+        if (x[i] == 0)
+        {
+            ret[i] = 0;
+            continue;
+        }
+        ret[i] = ret[i] * inv;
+        inv = inv * x[i];
     }
 
     return ret;
 }
 
-bls::G1Element CrossVectorExponent(size_t size, const std::vector<bls::G1Element> &A, size_t Ao, const std::vector<bls::G1Element> &B, size_t Bo, const std::vector<Scalar> &a, size_t ao, const std::vector<Scalar> &b, size_t bo, const std::vector<Scalar> *scale, const bls::G1Element *extra_point, const Scalar *extra_scalar)
+static bls::G1Element CrossVectorExponent(size_t size, const std::vector<G1> &A, size_t Ao, const std::vector<G1> &B, size_t Bo, const std::vector<Fr> &a, size_t ao, const std::vector<Fr> &b, size_t bo, const std::vector<Fr> *scale, const G1 *extra_point, const Fr *extra_scalar, MultiexpNativeData &scratch)
 {
     if (!(size + Ao <= A.size()))
         throw std::runtime_error("CrossVectorExponent(): Incompatible size for A");
@@ -377,26 +646,27 @@ bls::G1Element CrossVectorExponent(size_t size, const std::vector<bls::G1Element
     if (!(!!extra_point == !!extra_scalar))
         throw std::runtime_error("CrossVectorExponent(): Only one of extra base/exp present");
 
-    std::vector<MultiexpData> multiexp_data;
-    multiexp_data.resize(size*2 + (!!extra_point));
+    scratch.resize(size*2 + (!!extra_point));
+
     for (size_t i = 0; i < size; ++i)
     {
-        multiexp_data[i*2].exp = a[ao+i];
-        multiexp_data[i*2].base = A[Ao+i];
-        multiexp_data[i*2+1].exp = b[bo+i];
+        scratch.exps[i*2] = a[ao+i];
+        scratch.bases[i*2] = A[Ao+i];
 
         if (scale)
-            multiexp_data[i*2+1].exp =  multiexp_data[i*2+1].exp * (*scale)[Bo+i];
+            Fr::mul(scratch.exps[i*2+1], b[bo+i], (*scale)[Bo+i]);
+        else
+            scratch.exps[i*2+1] = b[bo+i];
 
-        multiexp_data[i*2+1].base = B[Bo+i];
+        scratch.bases[i*2+1] = B[Bo+i];
     }
     if (extra_point)
     {
-        multiexp_data.back().exp = *extra_scalar;
-        multiexp_data.back().base = *extra_point;
+        scratch.exps.back() = *extra_scalar;
+        scratch.bases.back() = *extra_point;
     }
 
-    return MultiExp(multiexp_data);
+    return NativeToG1Element(MultiExpNative(scratch.bases, scratch.exps));
 }
 
 void BulletproofsRangeproof::Prove(std::vector<Scalar> v, bls::G1Element nonce, const std::vector<uint8_t>& message)
@@ -438,16 +708,14 @@ void BulletproofsRangeproof::Prove(std::vector<Scalar> v, bls::G1Element nonce,
 
     for (unsigned int j = 0; j < v.size(); j++)
     {
-        bls::G1Element gammaElement = G*gamma[j].bn;
-        bls::G1Element valueElement = H*v[j].bn;
-        this->V[j] = gammaElement + valueElement;
+        this->V[j] = NativeToG1Element(MulGNative(gamma[j]) + MulHNative(v[j]));
         hasher << this->V[j];
     }
 
     // PAPER LINES 41-42
     // Value to be obfuscated is encoded in binary in aL
     // aR is aL-1
-    std::vector<Scalar> aL(MN), aR(MN);
+    std::vector<Fr> aL(MN), aR(MN);
 
     for (size_t j = 0; j < M; ++j)
     {
@@ -461,12 +729,14 @@ void BulletproofsRangeproof::Prove(std::vector<Scalar> v, bls::G1Element nonce,
             else
             {
                 aL[j*N+i] = 0;
-                aR[j*N+i] = 1;
-                aR[j*N+i] = aR[j*N+i].Negate();
+                aR[j*N+i] = -1;
             }
         }
     }
 
+    // Bases and exponents of the multi-exponentiations, reused by every one of them
+    MultiexpNativeData scratch;
+    scratch.reserve(MN*2 + 1);
 
 try_again:
     // PAPER LINES 43-44
@@ -480,31 +750,23 @@ try_again:
     alpha = HashG1Element(nonce, 1);
     alpha = alpha + (v[0] | sM);
 
-    this->A = VectorCommitment(aL, aR);
-    {
-    bls::G1Element alphaElement = G*alpha.bn;
-    this->A = this->A + alphaElement;
-    }
+    this->A = NativeToG1Element(VectorCommitment(aL, aR, scratch) + MulGNative(alpha));
 
     // PAPER LINES 45-47
     // Commitment to blinding sL and sR (obfuscated with rho)
-    std::vector<Scalar> sL(MN);
-    std::vector<Scalar> sR(MN);
+    std::vector<Fr> sL(MN);
+    std::vector<Fr> sR(MN);
 
     for (unsigned int i = 0; i < MN; i++)
     {
-        sL[i] = Scalar::Rand();
-        sR[i] = Scalar::Rand();
+        RandNative(sL[i]);
+        RandNative(sR[i]);
     }
 
     Scalar rho;
     rho = HashG1Element(nonce, 2);
 
-    this->S = VectorCommitment(sL, sR);
-    {
-    bls::G1Element rhoElement = G*rho.bn;
-    this->S = this->S + rhoElement;
-    }
+    this->S = NativeToG1Element(VectorCommitment(sL, sR, scratch) + MulGNative(rho));
 
     // PAPER LINES 48-50
     hasher << this->A;
@@ -524,43 +786,62 @@ try_again:
     if (z == 0)
         goto try_again;
 
+    Fr yNative, zNative;
+    ScalarToNative(yNative, y);
+    ScalarToNative(zNative, z);
+
     // Polynomial construction by coefficients
     // PAPER LINE AFTER 50
-    std::vector<Scalar> l0;
-    std::vector<Scalar> l1;
-    std::vector<Scalar> r0;
-    std::vector<Scalar> r1;
+    // The coefficient vectors are computed in place, aL and aR are kept
+    // for a new attempt and sL and sR are consumed
+    std::vector<Fr> l0(aL);
+    std::vector<Fr> r0(aR);
+    std::vector<Fr>& l1 = sL;
+    std::vector<Fr>& r1 = sR;
 
     // l(x) = (aL - z 1^n) + sL X
-    l0 = VectorSubtract(aL, z);
+    VectorSubtract(l0, zNative);
 
     // l(1) is (aL - z 1^n) + sL, but this is reduced to sL
-    l1 = sL;
 
     // This computes the ugly sum/concatenation from page 19
     // Calculation of r(0) and r(1)
-    std::vector<Scalar> zerosTwos(MN);
-    std::vector<Scalar> zpow(M+2);
-
-    zpow = VectorPowers(z, M+2);
+    std::vector<Fr> zerosTwos(MN);
+    std::vector<Scalar> zpow = VectorPowers(z, M+2);
 
     for (unsigned int j = 0; j < M; ++j)
     {
+        CHECK_AND_ASSERT_THROW_MES(j+2 < zpow.size(), "invalid zpow index");
+
+        // zpow[j+2] * 2^i
+        Fr zt;
+        ScalarToNative(zt, zpow[j+2]);
+
         for (unsigned int i = 0; i < N; ++i)
         {
-            CHECK_AND_ASSERT_THROW_MES(j+2 < zpow.size(), "invalid zpow index");
-            CHECK_AND_ASSERT_THROW_MES(i < twoN.size(), "invalid twoN index");
-            zerosTwos[j*N+i] = zpow[j+2] * BulletproofsRangeproof::twoN[i];
+            zerosTwos[j*N+i] = zt;
+            Fr::add(zt, zt, zt);
         }
     }
 
-    std::vector<Scalar> yMN = VectorPowers(y, MN);
-    r0 = VectorAdd(Hadamard(VectorAdd(aR, z), yMN), zerosTwos);
-    r1 = Hadamard(yMN, sR);
+    std::vector<Fr> yMN;
+    VectorPowers(yMN, yNative, MN);
+
+    // r0 = ((aR + z 1^n) o y^n) + zerosTwos
+    VectorAdd(r0, zNative);
+    Hadamard(r0, yMN);
+    VectorAdd(r0, zerosTwos);
+
+    // r1 = y^n o sR
+    Hadamard(r1, yMN);
 
     // Polynomial construction before PAPER LINE 51
-    Scalar t1 = InnerProduct(l0, r1) + InnerProduct(l1, r0);
-    Scalar t2 = InnerProduct(l1, r1);
+    Fr t1Native = InnerProduct(l0.data(), r1.data(), MN) + InnerProduct(l1.data(), r0.data(), MN);
+    Fr t2Native = InnerProduct(l1.data(), r1.data(), MN);
+
+    Scalar t1, t2;
+    NativeToScalar(t1, t1Native);
+    NativeToScalar(t2, t2Native);
 
     // PAPER LINES 52-53
     Scalar tau1 = HashG1Element(nonce, 3);
@@ -569,15 +850,8 @@ try_again:
     Scalar sM2 = secondMessage;
     tau1 = tau1 + sM2;
 
-    {
-    bls::G1Element t1Element = H*t1.bn;
-    bls::G1Element t2Element = H*t2.bn;
-    bls::G1Element tau1Element = G*tau1.bn;
-    bls::G1Element tau2Element = G*tau2.bn;
-
-    this->T1 = t1Element + tau1Element;
-    this->T2 = t2Element + tau2Element;
-    }
+    this->T1 = NativeToG1Element(MulHNative(t1) + MulGNative(tau1));
+    this->T2 = NativeToG1Element(MulHNative(t2) + MulGNative(tau2));
 
     // PAPER LINES 54-56
     hasher << z;
@@ -590,18 +864,25 @@ try_again:
     if (x == 0)
         goto try_again;
 
+    Fr xNative;
+    ScalarToNative(xNative, x);
+
+    Fr t0Native = InnerProduct(l0.data(), r0.data(), MN);
+
     // PAPER LINES 58-59
-    std::vector<Scalar> l = VectorAdd(l0, VectorScalar(l1, x));
-    std::vector<Scalar> r = VectorAdd(r0, VectorScalar(r1, x));
+    // l = l0 + l1 x and r = r0 + r1 x, built over l0 and r0
+    VectorAddScaled(l0, l1, xNative);
+    VectorAddScaled(r0, r1, xNative);
+
+    std::vector<Fr>& l = l0;
+    std::vector<Fr>& r = r0;
 
     // PAPER LINE 60
-    this->t = InnerProduct(l, r);
+    Fr tNative = InnerProduct(l.data(), r.data(), MN);
+    NativeToScalar(this->t, tNative);
 
     // TEST
-    Scalar test_t;
-    Scalar t0 = InnerProduct(l0, r0);
-    test_t = ((t0 + (t1*x)) + (t2*x*x));
-    if (!(test_t==this->t))
+    if (!(tNative == t0Native + (t1Native*xNative) + (t2Native*xNative*xNative)))
         throw std::runtime_error("BulletproofsRangeproof::Prove(): L60 Invalid test");
 
     // PAPER LINES 61-62
@@ -625,32 +906,22 @@ try_again:
     if (x_ip == 0)
         goto try_again;
 
-    // These are used in the inner product rounds
-    unsigned int nprime = MN;
-
-    std::vector<bls::G1Element> gprime(nprime);
-    std::vector<bls::G1Element> hprime(nprime);
-    std::vector<Scalar> aprime(nprime);
-    std::vector<Scalar> bprime(nprime);
+    Fr x_ipNative;
+    ScalarToNative(x_ipNative, x_ip);
 
-    Scalar yinv = y.Invert();
-
-    std::vector<Scalar> yinvpow(nprime);
-
-    yinvpow[0] = 1;
-    yinvpow[1] = yinv;
+    // These are used in the inner product rounds, every round folds them in place
+    unsigned int nprime = MN;
 
-    for (unsigned int i = 0; i < nprime; i++)
-    {
-        gprime[i] = BulletproofsRangeproof::Gi[i];
-        hprime[i] = BulletproofsRangeproof::Hi[i];
+    std::vector<G1> gprime(BulletproofsRangeproof::GiNative.begin(), BulletproofsRangeproof::GiNative.begin() + nprime);
+    std::vector<G1> hprime(BulletproofsRangeproof::HiNative.begin(), BulletproofsRangeproof::HiNative.begin() + nprime);
+    std::vector<Fr>& aprime = l;
+    std::vector<Fr>& bprime = r;
 
-        if(i > 1)
-            yinvpow[i] = yinvpow[i-1] * yinv;
+    Fr yinv;
+    Fr::inv(yinv, yNative);
 
-        aprime[i] = l[i];
-        bprime[i] = r[i];
-    }
+    std::vector<Fr> yinvpow;
+    VectorPowers(yinvpow, yinv, nprime);
 
     this->L.resize(logMN);
     this->R.resize(logMN);
@@ -659,9 +930,9 @@ try_again:
 
     std::vector<Scalar> w(logMN);
 
-    std::vector<Scalar>* scale = &yinvpow;
+    std::vector<Fr>* scale = &yinvpow;
 
-    Scalar tmp;
+    Fr tmp, wNative, winv;
 
     while (nprime > 1)
     {
@@ -669,17 +940,14 @@ try_again:
         nprime /= 2;
 
         // PAPER LINES 21-22
-        Scalar cL = InnerProduct(VectorSlice(aprime, 0, nprime),
-                                 VectorSlice(bprime, nprime, bprime.size()));
-
-        Scalar cR = InnerProduct(VectorSlice(aprime, nprime, aprime.size()),
-                                 VectorSlice(bprime, 0, nprime));
+        Fr cL = InnerProduct(aprime.data(), bprime.data() + nprime, nprime);
+        Fr cR = InnerProduct(aprime.data() + nprime, bprime.data(), nprime);
 
         // PAPER LINES 23-24
-        tmp = cL * x_ip;
-        this->L[round] = CrossVectorExponent(nprime, gprime, nprime, hprime, 0, aprime, 0, bprime, nprime, scale, &H, &tmp);
-        tmp = cR * x_ip;
-        this->R[round] = CrossVectorExponent(nprime, gprime, 0, hprime, nprime, aprime, nprime, bprime, 0, scale, &H, &tmp);
+        tmp = cL * x_ipNative;
+        this->L[round] = CrossVectorExponent(nprime, gprime, nprime, hprime, 0, aprime, 0, bprime, nprime, scale, &HNative, &tmp, scratch);
+        tmp = cR * x_ipNative;
+        this->R[round] = CrossVectorExponent(nprime, gprime, 0, hprime, nprime, aprime, nprime, bprime, 0, scale, &HNative, &tmp, scratch);
 
         // PAPER LINES 25-27
         hasher << this->L[round];
@@ -690,29 +958,27 @@ try_again:
         if (w[round] == 0)
             goto try_again;
 
-        Scalar winv = w[round].Invert();
+        ScalarToNative(wNative, w[round]);
+        Fr::inv(winv, wNative);
 
         // PAPER LINES 29-31
         if (nprime > 1)
         {
-            gprime = HadamardFold(gprime, NULL, winv, w[round]);
-            hprime = HadamardFold(hprime, scale, w[round], winv);
+            HadamardFold(gprime, NULL, winv, wNative);
+            HadamardFold(hprime, scale, wNative, winv);
         }
 
         // PAPER LINES 33-34
-        aprime = VectorAdd(VectorScalar(VectorSlice(aprime, 0, nprime), w[round]),
-                           VectorScalar(VectorSlice(aprime, nprime, aprime.size()), winv));
-
-        bprime = VectorAdd(VectorScalar(VectorSlice(bprime, 0, nprime), winv),
-                           VectorScalar(VectorSlice(bprime, nprime, bprime.size()), w[round]));
+        VectorFold(aprime, wNative, winv);
+        VectorFold(bprime, winv, wNative);
 
         scale = NULL;
 
         round += 1;
     }
 
-    this->a = aprime[0];
-    this->b = bprime[0];
+    NativeToScalar(this->a, aprime[0]);
+    NativeToScalar(this->b, bprime[0]);
 }
 
 struct proof_data_t
@@ -720,10 +986,11 @@ struct proof_data_t
     Scalar x, y, z, x_ip;
     std::vector<Scalar> w;
     std::vector<bls::G1Element> V;
+    std::vector<G1> VNative;
     size_t logM, inv_offset;
 };
 
-bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>& proofs, std::vector<RangeproofEncodedData>& vData, const std::vector<bls::G1Element>& nonces, const bool &fOnlyRecover)
+bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>& proofs, std::vector<RangeproofEncodedData>& vData, const std::vector<bls::G1Element>& nonces, const bool &fOnlyRecover, const std::vector<bool>& vRecover)
 {
     bool fRecover = false;
 
@@ -749,7 +1016,7 @@ bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>
 
     for (auto& p: proofs)
     {
-        BulletproofsRangeproof proof = p.second;
+        const BulletproofsRangeproof& proof = p.second;
         if (!(proof.V.size() >= 1 && proof.L.size() == proof.R.size() &&
               proof.L.size() > 0))
             return false;
@@ -760,6 +1027,17 @@ bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>
         proof_data.resize(proof_data.size() + 1);
         proof_data_t &pd = proof_data.back();
         pd.V = proof.V;
+        pd.VNative.resize(pd.V.size());
+
+        try
+        {
+            for (unsigned int j = 0; j < pd.V.size(); j++)
+                G1ElementToNative(pd.VNative[j], pd.V[j]);
+        }
+        catch(...)
+        {
+            return false;
+        }
 
         CHashWriter hasher(0,0);
 
@@ -814,6 +1092,13 @@ bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>
 
         if (fRecover)
         {
+            // The output's view tag already showed it is not ours
+            if (!vRecover.empty() && !vRecover[j])
+            {
+                j++;
+                continue;
+            }
+
             Scalar alpha = HashG1Element(nonces[j], 1);
             Scalar rho = HashG1Element(nonces[j], 2);
             Scalar tau1 = HashG1Element(nonces[j], 3);
@@ -860,9 +1145,7 @@ bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>
             data.message = std::string(vMsgTrimmed.begin(), vMsgTrimmed.end()) + std::string(vMsg2Trimmed.begin(), vMsg2Trimmed.end());
 
             {
-            bls::G1Element gammaElement = BulletproofsRangeproof::G*gamma.bn;
-            bls::G1Element valueElement = BulletproofsRangeproof::H*amount.bn;
-            bool fIsMine = ((gammaElement + valueElement) == pd.V[0]);
+            bool fIsMine = (BulletproofsRangeproof::MulGNative(gamma) + BulletproofsRangeproof::MulHNative(amount)) == pd.VNative[0];
 
             if (fIsMine)
                 vData.push_back(data);
@@ -894,14 +1177,15 @@ bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>
 
     int proof_data_index = 0;
 
-    std::vector<MultiexpData> multiexpdata;
+    // The points of the final multi-exponentiation are kept in mcl form, the generators don't need any conversion
+    MultiexpNativeData multiexpdata;
 
     multiexpdata.reserve(nV + (2 * (10/*logM*/ + BulletproofsRangeproof::logN) + 4) * proofs.size() + 2 * maxMN);
     multiexpdata.resize(2 * maxMN);
 
     for (auto& p: proofs)
     {
-        BulletproofsRangeproof proof = p.second;
+        const BulletproofsRangeproof& proof = p.second;
 
         const proof_data_t &pd = proof_data[proof_data_index++];
 
@@ -937,21 +1221,21 @@ bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>
         for (size_t j = 0; j < pd.V.size(); j++)
         {
             tmp = zpow[j+2] * weight_y;
-            multiexpdata.push_back({pd.V[j], tmp});
+            multiexpdata.push_back(pd.VNative[j], tmp);
         }
 
         tmp = pd.x * weight_y;
 
-        multiexpdata.push_back({proof.T1, tmp});
+        multiexpdata.push_back(proof.T1, tmp);
 
         tmp = pd.x * pd.x * weight_y;
 
-        multiexpdata.push_back({proof.T2, tmp});
-        multiexpdata.push_back({proof.A, weight_z});
+        multiexpdata.push_back(proof.T2, tmp);
+        multiexpdata.push_back(proof.A, weight_z);
 
         tmp = pd.x * weight_z;
 
-        multiexpdata.push_back({proof.S, tmp});
+        multiexpdata.push_back(proof.S, tmp);
 
         const size_t rounds = pd.logM+BulletproofsRangeproof::logN;
 
@@ -1024,11 +1308,11 @@ bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>
         {
             tmp = pd.w[i] * pd.w[i] * weight_z;
 
-            multiexpdata.push_back({proof.L[i], tmp});
+            multiexpdata.push_back(proof.L[i], tmp);
 
             tmp = winv[i] * winv[i] * weight_z;
 
-            multiexpdata.push_back({proof.R[i], tmp});
+            multiexpdata.push_back(proof.R[i], tmp);
         }
 
         tmp = proof.t - (proof.a*proof.b);
@@ -1038,20 +1322,18 @@ bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>
 
     tmp = y0 - z1;
 
-    multiexpdata.push_back({BulletproofsRangeproof::G, tmp});
+    multiexpdata.push_back(BulletproofsRangeproof::GNative, tmp);
 
 
     tmp = z3 - y1;
 
-    multiexpdata.push_back({BulletproofsRangeproof::H, tmp});
+    multiexpdata.push_back(BulletproofsRangeproof::HNative, tmp);
 
     for (size_t i = 0; i < maxMN; ++i)
     {
-        multiexpdata[i * 2] = {BulletproofsRangeproof::Gi[i], z4[i]};
-        multiexpdata[i * 2 + 1] = {BulletproofsRangeproof::Hi[i], z5[i]};
+        multiexpdata.set(i * 2, BulletproofsRangeproof::GiNative[i], z4[i]);
+        multiexpdata.set(i * 2 + 1, BulletproofsRangeproof::HiNative[i], z5[i]);
     }
 
-    bls::G1Element mexp = MultiExp(multiexpdata);
-
-    return mexp == bls::G1Element::Infinity();
+    return MultiExpNative(multiexpdata.bases, multiexpdata.exps).isZero();
 }
@@ -26,6 +26,7 @@
 #define MCL_DONT_USE_OPENSSL
 
 #include <mcl/bls12_381.hpp>
+#include <mcl/window_method.hpp>
 
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/lock_guard.hpp>
@@ -37,6 +38,9 @@ static const size_t maxMessageSize = 54;
 static const size_t maxM = 16;
 static const size_t maxMN = maxM*maxN;
 
+// Window size of the fixed-base tables of G and H
+static const size_t fixedBaseWindow = 8;
+
 static const std::vector<uint8_t> balanceMsg = {'B', 'L', 'S', 'C', 'T', 'B', 'A', 'L', 'A', 'N', 'C', 'E'};
 
 class MultiexpData {
@@ -80,7 +84,13 @@ public:
         return std::vector<unsigned char>();
     }
 
-    static bool Init();
+    static bool Init(const std::string& strCacheFile = "");
+
+    // Multiplication of the fixed generators G and H using their precomputed tables
+    static G1 MulGNative(const Scalar& s);
+    static G1 MulHNative(const Scalar& s);
+    static bls::G1Element MulG(const Scalar& s);
+    static bls::G1Element MulH(const Scalar& s);
 
     void Prove(std::vector<Scalar> v, bls::G1Element nonce, const std::vector<uint8_t>& message = std::vector<uint8_t>());
 
@@ -161,7 +171,7 @@ public:
             ::Unserialize(s, t, nType, nVersion);
     }
 
-    std::vector<bls::G1Element> GetValueCommitments() const { return V; }
+    const std::vector<bls::G1Element>& GetValueCommitments() const { return V; }
 
     static const size_t logN = 6;
 
@@ -171,7 +181,12 @@ public:
     static Scalar one;
     static Scalar two;
 
-    static std::vector<bls::G1Element> Hi, Gi;
+    // The generators in mcl form, so the multi-exponentiations don't need to decompress them
+    static G1 GNative;
+    static G1 HNative;
+    static std::vector<G1> HiNative, GiNative;
+
+    static mcl::fp::WindowMethod<G1> GTable, HTable;
     static std::vector<Scalar> oneN;
     static std::vector<Scalar> twoN;
     static Scalar ip12;
@@ -201,6 +216,16 @@ struct RangeproofEncodedData
     bool valid = false;
 };
 
-bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>& proofs, std::vector<RangeproofEncodedData>& data, const std::vector<bls::G1Element>& nonces, const bool &fOnlyRecover = false);
+bool VerifyBulletproof(const std::vector<std::pair<int, BulletproofsRangeproof>>& proofs, std::vector<RangeproofEncodedData>& data, const std::vector<bls::G1Element>& nonces, const bool &fOnlyRecover = false, const std::vector<bool>& vRecover = std::vector<bool>());
+
+// Conversions between the bls and the mcl representations
+void G1ElementToNative(G1& out, const bls::G1Element& in);
+bls::G1Element NativeToG1Element(const G1& in);
+void ScalarToNative(Fr& out, const Scalar& in);
+void NativeToScalar(Scalar& out, const Fr& in);
+
+bls::G1Element MultiExp(const std::vector<MultiexpData>& multiexp_data);
+bls::G1Element MultiExpLegacy(const std::vector<MultiexpData>& multiexp_data);
+G1 MultiExpNative(const std::vector<G1>& bases, const std::vector<Fr>& exps);
 
 #endif // NAVCOIN_BLSCT_BULLETPROOFS_H
@@ -0,0 +1,202 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blsct/multiexp.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+// Bits of the order of G1
+static const size_t SCALAR_BITS = 255;
+static const size_t SCALAR_BYTES = 32;
+static const size_t MAX_WINDOW = 16;
+
+static std::atomic<int> nMultiExpThreads(DEFAULT_MULTIEXP_THREADS);
+
+void SetMultiExpThreads(int nThreads)
+{
+    nMultiExpThreads = std::max(1, std::min(nThreads, MAX_MULTIEXP_THREADS));
+}
+
+int GetMultiExpThreads()
+{
+    return nMultiExpThreads;
+}
+
+void MultiExpStraus(G1& out, const G1* bases, const Fr* exps, size_t n)
+{
+    out.clear();
+
+    if (n > 0)
+        G1::mulVec(out, bases, exps, n);
+}
+
+// Signed digits of c bits need one more window for the last carry
+static inline size_t GetWindowCount(size_t c)
+{
+    return SCALAR_BITS / c + 1;
+}
+
+size_t MultiExpPippengerWindow(size_t n)
+{
+    // Every window costs one addition per term to fill the buckets and two
+    // per bucket to sum them
+    size_t nBest = 1;
+    uint64_t nBestCost = std::numeric_limits<uint64_t>::max();
+
+    for (size_t c = 1; c <= MAX_WINDOW; c++)
+    {
+        uint64_t nCost = GetWindowCount(c) * (n + (1ull << c));
+        if (nCost < nBestCost)
+        {
+            nBest = c;
+            nBestCost = nCost;
+        }
+    }
+
+    return nBest;
+}
+
+// Bits [nBit, nBit + c) of a little endian scalar
+static inline int32_t GetDigit(const uint8_t* scalar, size_t nBit, size_t c)
+{
+    size_t nByte = nBit / 8;
+    uint32_t v = 0;
+
+    for (size_t i = 0; i < 3 && nByte + i < SCALAR_BYTES; i++)
+        v |= (uint32_t)scalar[nByte + i] << (8 * i);
+
+    return (v >> (nBit % 8)) & ((1u << c) - 1);
+}
+
+// Splits every scalar in digits of c bits in [-2^(c-1), 2^(c-1)], so
+// negating the base halves the number of buckets
+static void GetSignedDigits(std::vector<int32_t>& digits, const Fr* exps, size_t n, size_t c)
+{
+    size_t nWindows = GetWindowCount(c);
+    int32_t nHalf = 1 << (c - 1);
+    uint8_t buf[SCALAR_BYTES];
+
+    digits.resize(n * nWindows);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        memset(buf, 0, sizeof(buf));
+        if (exps[i].getLittleEndian(buf, sizeof(buf)) == 0)
+            throw std::runtime_error("MultiExpPippenger(): could not serialize scalar");
+
+        int32_t nCarry = 0;
+
+        for (size_t w = 0; w < nWindows; w++)
+        {
+            int32_t nDigit = (w * c < SCALAR_BITS ? GetDigit(buf, w * c, c) : 0) + nCarry;
+
+            nCarry = nDigit > nHalf;
+            if (nCarry)
+                nDigit -= 1 << c;
+
+            digits[w * n + i] = nDigit;
+        }
+
+        assert(nCarry == 0);
+    }
+}
+
+// Sum of digit * base for the digits of window w
+static void PippengerWindow(G1& out, const G1* bases, const int32_t* digits, size_t n, size_t c, std::vector<G1>& buckets)
+{
+    buckets.resize(size_t(1) << (c - 1));
+    for (G1& bucket: buckets)
+        bucket.clear();
+
+    for (size_t i = 0; i < n; i++)
+    {
+        int32_t nDigit = digits[i];
+        if (nDigit > 0)
+            G1::add(buckets[nDigit - 1], buckets[nDigit - 1], bases[i]);
+        else if (nDigit < 0)
+            G1::sub(buckets[-nDigit - 1], buckets[-nDigit - 1], bases[i]);
+    }
+
+    // sum(j * bucket[j]) as a running sum from the highest bucket down
+    G1 running;
+    running.clear();
+    out.clear();
+
+    for (size_t j = buckets.size(); j-- > 0;)
+    {
+        G1::add(running, running, buckets[j]);
+        G1::add(out, out, running);
+    }
+}
+
+static void PippengerWindows(G1* windows, const G1* bases, const std::vector<int32_t>* digits, size_t n, size_t c, size_t nFirst, size_t nStep)
+{
+    std::vector<G1> buckets;
+
+    for (size_t w = nFirst; w < GetWindowCount(c); w += nStep)
+        PippengerWindow(windows[w], bases, digits->data() + w * n, n, c, buckets);
+}
+
+void MultiExpPippenger(G1& out, const G1* bases, const Fr* exps, size_t n, size_t c, int nThreads)
+{
+    out.clear();
+
+    if (n == 0)
+        return;
+
+    if (c == 0)
+        c = MultiExpPippengerWindow(n);
+
+    if (c > MAX_WINDOW)
+        throw std::runtime_error("MultiExpPippenger(): window is too large");
+
+    std::vector<int32_t> digits;
+    GetSignedDigits(digits, exps, n, c);
+
+    size_t nWindows = GetWindowCount(c);
+    std::vector<G1> windows(nWindows);
+
+    nThreads = std::max(1, std::min(nThreads, (int)nWindows));
+
+    if (nThreads > 1)
+    {
+        boost::thread_group threads;
+
+        for (int t = 1; t < nThreads; t++)
+            threads.create_thread(boost::bind(&PippengerWindows, windows.data(), bases, &digits, n, c, t, nThreads));
+
+        PippengerWindows(windows.data(), bases, &digits, n, c, 0, nThreads);
+
+        threads.join_all();
+    }
+    else
+    {
+        PippengerWindows(windows.data(), bases, &digits, n, c, 0, 1);
+    }
+
+    // Horner over the windows, from the most significant one
+    for (size_t w = nWindows; w-- > 0;)
+    {
+        for (size_t i = 0; i < c; i++)
+            G1::dbl(out, out);
+        G1::add(out, out, windows[w]);
+    }
+}
+
+void MultiExpAdaptive(G1& out, const G1* bases, const Fr* exps, size_t n)
+{
+    if (n < MULTIEXP_PIPPENGER_MIN)
+        MultiExpStraus(out, bases, exps, n);
+    else
+        MultiExpPippenger(out, bases, exps, n, 0, n >= MULTIEXP_PARALLEL_MIN ? GetMultiExpThreads() : 1);
+}
@@ -0,0 +1,48 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Multi-exponentiation in G1 with the algorithm picked from the number of terms:
+// interleaved wNAF (Straus) through mcl for small inputs and Pippenger's bucket
+// method for the large ones built by batch verification.
+
+#ifndef NAVCOIN_BLSCT_MULTIEXP_H
+#define NAVCOIN_BLSCT_MULTIEXP_H
+
+#define MCL_DONT_USE_XBYAK
+#define MCL_DONT_USE_OPENSSL
+
+#include <mcl/bls12_381.hpp>
+
+#include <cstddef>
+
+using namespace mcl::bn;
+
+/** From this number of terms the bucket method is used */
+static const size_t MULTIEXP_PIPPENGER_MIN = 512;
+/** From this number of terms the windows of the bucket method are split between threads */
+static const size_t MULTIEXP_PARALLEL_MIN = 4096;
+/** Default for -multiexpthreads, 1 keeps the multi-exponentiations on the calling thread */
+static const int DEFAULT_MULTIEXP_THREADS = 1;
+static const int MAX_MULTIEXP_THREADS = 16;
+
+/** Interleaved wNAF multi-exponentiation, as done by G1::mulVec */
+void MultiExpStraus(G1& out, const G1* bases, const Fr* exps, size_t n);
+
+/**
+ * Pippenger's bucket method with windows of c bits, or of the size with the
+ * least additions for n terms when c is 0. The windows are split between
+ * nThreads threads.
+ */
+void MultiExpPippenger(G1& out, const G1* bases, const Fr* exps, size_t n, size_t c = 0, int nThreads = 1);
+
+/** Window size used by MultiExpPippenger for n terms */
+size_t MultiExpPippengerWindow(size_t n);
+
+/** Picks the algorithm for n terms, and the threads configured with SetMultiExpThreads */
+void MultiExpAdaptive(G1& out, const G1* bases, const Fr* exps, size_t n);
+
+void SetMultiExpThreads(int nThreads);
+int GetMultiExpThreads();
+
+#endif // NAVCOIN_BLSCT_MULTIEXP_H
@@ -66,6 +66,24 @@ UniValue viewaggregationsession(const UniValue& params, bool fHelp)
         throw std::runtime_error(
                 "viewaggregationsession <show_candidates>\n"
                 "Shows the active mix session if any\n"
+                "\nResult:\n"
+                "{\n"
+                "  ...\n"
+                "  \"txCandidatesCount\": n,        (numeric) Number of verified candidates\n"
+                "  \"verification\": {             (json object) Verification of received candidates\n"
+                "    \"queueSize\": n,              (numeric) Candidates waiting for verification\n"
+                "    \"maxQueueSize\": n,           (numeric) Candidates are dropped when the queue has this size\n"
+                "    \"peakQueueSize\": n,          (numeric) Largest size reached by the queue\n"
+                "    \"received\": n,               (numeric) Candidates received\n"
+                "    \"dropped\": n,                (numeric) Candidates dropped because the queue was full\n"
+                "    \"accepted\": n,               (numeric) Candidates which passed verification\n"
+                "    \"rejected\": n,               (numeric) Candidates which could not be decrypted or failed verification\n"
+                "    \"batches\": n,                (numeric) Batches verified\n"
+                "    \"avgVerifyTimeMs\": x.xx,     (numeric) Average verification time of a candidate\n"
+                "    \"avgQueueTimeMs\": x.xx,      (numeric) Average time since a candidate was received until it was verified\n"
+                "    \"lastBatchVerifyTimeMs\": x.xx (numeric) Verification time of the last batch\n"
+                "  }\n"
+                "}\n"
                 );
 
     UniValue ret(UniValue::VOBJ);
@@ -99,6 +117,7 @@ UniValue viewaggregationsession(const UniValue& params, bool fHelp)
             ret.pushKV("txCandidates",candidates);
         }
         ret.pushKV("txCandidatesCount", (uint64_t)pwalletMain->aggSession->GetTransactionCandidates().size());
+        ret.pushKV("verification", candidatesQueue.GetStats());
     }
 
     return ret;
@@ -278,7 +297,7 @@ UniValue scanviewkey(const UniValue& params, bool fHelp)
                             try
                             {
                                 proofs.push_back(std::make_pair(0,txout.GetBulletproof()));
-                                bls::G1Element t = bls::G1Element::FromByteVector(txout.outputKey);
+                                bls::G1Element t = txout.GetOutputKey();
                                 bls::PrivateKey k = vk.GetKey();
                                 t = t * k;
 
@@ -297,6 +297,15 @@ uint256 Scalar::Hash(const int& n) const
     return hasher.GetHash();
 }
 
+std::vector<uint8_t> CalculateViewTag(const bls::G1Element& sharedKey)
+{
+    CHashWriter hasher(0,0);
+    hasher << std::string("ViewTag");
+    hasher << sharedKey.Serialize();
+    uint256 hash = hasher.GetHash();
+    return std::vector<uint8_t>(hash.begin(), hash.begin() + VIEW_TAG_SIZE);
+}
+
 Scalar::Scalar(const bn_t& n)
 {
     bn_new(this->bn);
@@ -103,4 +103,10 @@ public:
 
 uint256 HashG1Element(bls::G1Element g1, uint64_t n);
 
+// Size of the view tag of a BLSCT output
+static const size_t VIEW_TAG_SIZE = 2;
+
+// View tag of an output, taken from the shared key of the sender and the receiver
+std::vector<uint8_t> CalculateViewTag(const bls::G1Element& sharedKey);
+
 #endif // NAVCOIN_BLSCT_SCALAR_H
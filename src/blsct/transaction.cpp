@@ -5,7 +5,7 @@
 #include "transaction.h"
 
 bool CreateBLSCTOutput(bls::PrivateKey blindingKey, bls::G1Element& nonce, CTxOut& newTxOut, const blsctDoublePublicKey& destKey, const CAmount& nAmount, std::string sMemo,
-                       Scalar& gammaAcc, std::string &strFailReason, const bool& fBLSSign, std::vector<bls::G2Element>& vBLSSignatures, bool fVerify)
+                       Scalar& gammaAcc, std::string &strFailReason, const bool& fBLSSign, std::vector<bls::G2Element>& vBLSSignatures, bool fViewTag, bool fVerify)
 {
     newTxOut = CTxOut(0, CScript(OP_1));
 
@@ -54,7 +54,7 @@ bool CreateBLSCTOutput(bls::PrivateKey blindingKey, bls::G1Element& nonce, CTxOu
         return false;
     }
 
-    newTxOut.bp = bprp.GetVch();
+    newTxOut.SetBulletproof(bprp);
 
     if (!GenTxOutputKeys(blindingKey, destKey, newTxOut.spendingKey, newTxOut.outputKey, newTxOut.ephemeralKey))
     {
@@ -62,6 +62,11 @@ bool CreateBLSCTOutput(bls::PrivateKey blindingKey, bls::G1Element& nonce, CTxOu
         return false;
     }
 
+    // r*V, which the receiver gets as v*R. Only set once the deployment is active,
+    // as older nodes can not deserialize an output carrying it.
+    if (fViewTag)
+        newTxOut.viewTag = CalculateViewTag(nonce);
+
     if (fBLSSign)
     {
         SignBLSOutput(blindingKey, newTxOut, vBLSSignatures);
@@ -131,7 +136,7 @@ bool GenTxOutputKeys(bls::PrivateKey blindingKey, const blsctDoublePublicKey& de
 CandidateTransaction::CandidateTransaction() : fee(0) {
 }
 
-bool CandidateTransaction::Validate(const CStateViewCache* inputs) {
+bool CandidateTransaction::Validate(const CStateViewCache* inputs, RangeproofBatch* pRangeproofBatch) {
     if (!(tx.IsBLSInput() && tx.IsCTOutput() && tx.vin.size() > 0 && tx.vout.size() == 1 && minAmountProofs.V.size() == tx.vout.size()))
         return error("CandidateTransaction::%s: Received transaction is not BLSCT mix compliant", __func__);
 
@@ -145,15 +150,17 @@ bool CandidateTransaction::Validate(const CStateViewCache* inputs) {
     for (unsigned int i = 0; i < tx.vout.size(); i++)
     {
         Scalar s = minAmount;
-        bls::G1Element l = (BulletproofsRangeproof::H*s.bn).Inverse();
-        bls::G1Element r = tx.vout[i].GetBulletproof().V[0];
+        bls::G1Element l = BulletproofsRangeproof::MulH(s).Inverse();
+        bls::G1Element r = tx.vout[i].GetBulletproofRef()->V[0];
         l = l + r;
         if (!(l == minAmountProofs.V[i]))
             return error ("CandidateTransaction::%s: Failed verification from output's amount %d", __func__, i);
         proofs.push_back(std::make_pair(i, minAmountProofs));
     }
 
-    if (!VerifyBulletproof(proofs, blsctData, nonces))
+    if (pRangeproofBatch)
+        pRangeproofBatch->Add(tx.GetHash(), proofs);
+    else if (!VerifyBulletproof(proofs, blsctData, nonces))
         return error("CandidateTransaction::%s: Failed verification of min amount range proofs", __func__);
 
     if (!MoneyRange(fee))
@@ -166,7 +173,7 @@ bool CandidateTransaction::Validate(const CStateViewCache* inputs) {
 
     try
     {
-        if(!VerifyBLSCT(tx, bls::PrivateKey::FromBN(Scalar::Rand().bn), blsctData, *inputs, state, false, fee))
+        if(!VerifyBLSCT(tx, bls::PrivateKey::FromBN(Scalar::Rand().bn), blsctData, *inputs, state, false, fee, pRangeproofBatch))
         {
             return error("CandidateTransaction::%s: Failed validation of transaction candidate %s", __func__, state.GetRejectReason());
         }
@@ -213,7 +220,7 @@ EncryptedCandidateTransaction::EncryptedCandidateTransaction(const bls::G1Elemen
         throw std::runtime_error("EncryptSecret returned false");
 }
 
-bool EncryptedCandidateTransaction::Decrypt(const bls::PrivateKey &key, const CStateViewCache* inputs, CandidateTransaction& tx) const
+bool EncryptedCandidateTransaction::Decrypt(const bls::PrivateKey &key, const CStateViewCache* inputs, CandidateTransaction& tx, bool fValidate) const
 {
     if (vPublicKey.size() == 0)
         return false;
@@ -248,7 +255,7 @@ bool EncryptedCandidateTransaction::Decrypt(const bls::PrivateKey &key, const CS
     if (!bls::AugSchemeMPL::Verify(publicKey, key.GetG1Element().Serialize(), sig))
         return false;
 
-    if (!dct.tx.Validate(inputs))
+    if (fValidate && !dct.tx.Validate(inputs))
         return false;
 
     tx = dct.tx;
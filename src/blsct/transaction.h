@@ -30,13 +30,18 @@
 #define BLSCT_THREAD_SLEEP_AGG 5000
 #define BLSCT_THREAD_SLEEP_VER 16000
 
+#define DEFAULT_AGGREGATION_VERIFY_THREADS 2
+#define MAX_AGGREGATION_VERIFY_THREADS 8
+#define DEFAULT_AGGREGATION_QUEUE_SIZE 500
+#define AGGREGATION_VERIFY_BATCH 16
+
 #define BLSCT_TX_INPUT_FEE 200000
 #define BLSCT_TX_OUTPUT_FEE 200000
 
 class CWalletDB;
 
 bool CreateBLSCTOutput(bls::PrivateKey ephemeralKey, bls::G1Element &nonce, CTxOut& newTxOut, const blsctDoublePublicKey& destKey, const CAmount& nAmount, std::string sMemo,
-                  Scalar& gammaAcc, std::string &strFailReason, const bool& fBLSSign, std::vector<bls::G2Element>& vBLSSignatures, bool fVerify = true);
+                  Scalar& gammaAcc, std::string &strFailReason, const bool& fBLSSign, std::vector<bls::G2Element>& vBLSSignatures, bool fViewTag = false, bool fVerify = true);
 bool GenTxOutputKeys(bls::PrivateKey blindingKey, const blsctDoublePublicKey& destKey, std::vector<unsigned char>& spendingKey, std::vector<unsigned char>& outputKey, std::vector<unsigned char>& ephemeralKey);
 bool SignBLSOutput(const bls::PrivateKey& ephemeralKey, CTxOut& newTxOut, std::vector<bls::G2Element>& vBLSSignatures);
 bool SignBLSInput(const bls::PrivateKey& ephemeralKey, CTxIn& newTxOut, std::vector<bls::G2Element>& vBLSSignatures);
@@ -48,7 +53,8 @@ public:
     CandidateTransaction(CTransaction txIn, CAmount feeIn, CAmount minAmountIn, BulletproofsRangeproof minAmountProofsIn) :
         tx(txIn), fee(feeIn), minAmount(minAmountIn), minAmountProofs(minAmountProofsIn) {}
 
-    bool Validate(const CStateViewCache* inputs);
+    /** With pRangeproofBatch the range proofs are added to the batch instead of being verified */
+    bool Validate(const CStateViewCache* inputs, RangeproofBatch* pRangeproofBatch = nullptr);
 
     friend inline  bool operator==(const CandidateTransaction& a, const CandidateTransaction& b) { return a.tx == b.tx; }
     friend inline  bool operator<(const CandidateTransaction& a, const CandidateTransaction& b) { return a.fee < b.fee; }
@@ -75,7 +81,8 @@ public:
     EncryptedCandidateTransaction() {};
     EncryptedCandidateTransaction(const bls::G1Element &pubKey, const CandidateTransaction &tx);
 
-    bool Decrypt(const bls::PrivateKey &key, const CStateViewCache* inputs, CandidateTransaction& tx) const;
+    /** Without fValidate only the encryption and the signature of the sender are checked */
+    bool Decrypt(const bls::PrivateKey &key, const CStateViewCache* inputs, CandidateTransaction& tx, bool fValidate = true) const;
 
     friend inline  bool operator==(const EncryptedCandidateTransaction& a, const EncryptedCandidateTransaction& b) { return a.vData == b.vData && a.vPublicKey == b.vPublicKey; }
     friend inline  bool operator<(const EncryptedCandidateTransaction& a, const EncryptedCandidateTransaction& b) { return a.vData < b.vData; }
@@ -3,13 +3,253 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "verification.h"
+#include "core_memusage.h"
+#include "crypto/sha256.h"
+#include "memusage.h"
+#include "util.h"
 #include "utiltime.h"
 
-bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover, CAmount nMixFee)
+#include <boost/thread.hpp>
+#include <boost/unordered_set.hpp>
+
+namespace {
+
+class CBLSCTCacheHasher
+{
+public:
+    size_t operator()(const uint256& key) const {
+        return key.GetCheapHash();
+    }
+};
+
+/**
+ * Transactions whose BLSCT proofs were found valid, to avoid verifying the
+ * range proofs, the balance signature and the aggregated BLS signature again
+ * when a transaction accepted to the mempool is connected in a block.
+ */
+class CBLSCTCache
+{
+private:
+    //! Entries are SHA256(nonce || witness hash || mix fee)
+    uint256 nonce;
+    typedef boost::unordered_set<uint256, CBLSCTCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_blsctcache;
+
+public:
+    CBLSCTCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const CTransaction& tx, CAmount nMixFee)
+    {
+        uint256 hash = tx.GetWitnessHash();
+        unsigned char buf[8];
+        WriteLE64(buf, nMixFee);
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(buf, sizeof(buf)).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_blsctcache);
+        return setValid.count(entry);
+    }
+
+    void Erase(const uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_blsctcache);
+        setValid.erase(entry);
+    }
+
+    void Set(const uint256& entry)
+    {
+        size_t nMaxCacheSize = GetArg("-maxblsctcachesize", DEFAULT_MAX_BLSCT_CACHE_SIZE) * ((size_t) 1 << 20);
+        if (nMaxCacheSize <= 0) return;
+
+        boost::unique_lock<boost::shared_mutex> lock(cs_blsctcache);
+        while (memusage::DynamicUsage(setValid) > nMaxCacheSize)
+        {
+            map_type::size_type s = GetRand(setValid.bucket_count());
+            map_type::local_iterator it = setValid.begin(s);
+            if (it != setValid.end(s)) {
+                setValid.erase(*it);
+            }
+        }
+
+        setValid.insert(entry);
+    }
+};
+
+CBLSCTCache& GetBLSCTCache()
+{
+    static CBLSCTCache blsctCache;
+    return blsctCache;
+}
+
+}
+
+void RangeproofBatch::Add(const uint256& txHash, const std::vector<std::pair<int, BulletproofsRangeproof>>& vProofs)
+{
+    vTx.push_back(std::make_pair(txHash, proofs.size()));
+    proofs.insert(proofs.end(), vProofs.begin(), vProofs.end());
+}
+
+bool RangeproofBatch::Verify(CValidationState& state) const
+{
+    if (proofs.empty())
+        return true;
+
+    std::vector<RangeproofEncodedData> vData;
+    std::vector<bls::G1Element> nonces;
+
+    if (VerifyBulletproof(proofs, vData, nonces))
+        return true;
+
+    // Look for the transaction which made the batch fail
+    for (size_t i = 0; i < vTx.size(); i++)
+    {
+        auto itBegin = proofs.begin() + vTx[i].second;
+        auto itEnd = i + 1 < vTx.size() ? proofs.begin() + vTx[i+1].second : proofs.end();
+        std::vector<std::pair<int, BulletproofsRangeproof>> txProofs(itBegin, itEnd);
+
+        if (!VerifyBulletproof(txProofs, vData, nonces))
+            return state.DoS(100, error("%s: invalid range proof in transaction %s", __func__, vTx[i].first.ToString()),
+                             REJECT_INVALID, "invalid-rangeproof");
+    }
+
+    return state.DoS(100, error("%s: batch of %d range proofs failed verification", __func__, proofs.size()),
+                     REJECT_INVALID, "invalid-rangeproof");
+}
+
+std::set<uint256> RangeproofBatch::GetInvalid() const
+{
+    std::set<uint256> setInvalid;
+
+    if (proofs.empty())
+        return setInvalid;
+
+    std::vector<RangeproofEncodedData> vData;
+    std::vector<bls::G1Element> nonces;
+
+    if (VerifyBulletproof(proofs, vData, nonces))
+        return setInvalid;
+
+    for (size_t i = 0; i < vTx.size(); i++)
+    {
+        auto itBegin = proofs.begin() + vTx[i].second;
+        auto itEnd = i + 1 < vTx.size() ? proofs.begin() + vTx[i+1].second : proofs.end();
+        std::vector<std::pair<int, BulletproofsRangeproof>> txProofs(itBegin, itEnd);
+
+        if (!VerifyBulletproof(txProofs, vData, nonces))
+            setInvalid.insert(vTx[i].first);
+    }
+
+    return setInvalid;
+}
+
+void CBLSCTCheckResult::SetRejectReason(const std::string& strReason)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (strRejectReason.empty())
+        strRejectReason = strReason;
+}
+
+std::string CBLSCTCheckResult::GetRejectReason() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return strRejectReason;
+}
+
+bool CBLSCTCheck::operator()()
+{
+    if (Verify())
+        return true;
+
+    if (pResult)
+        pResult->SetRejectReason(strRejectReason);
+
+    return false;
+}
+
+bool CBLSCTCheck::Verify()
+{
+    if (pvData && proofs.size() > 0)
+    {
+        try
+        {
+            if (!VerifyBulletproof(proofs, *pvData, nonces, fOnlyRangeRecover, vRecover))
+            {
+                strRejectReason = "invalid-rangeproof";
+                return false;
+            }
+        }
+        catch(std::exception& e)
+        {
+            strRejectReason = "caught-rangeproof-exception";
+            return false;
+        }
+    }
+
+    if (fCheckBalance)
+    {
+        if (ptxTo->vchBalanceSig.size() == 0)
+        {
+            strRejectReason = "could-not-read-balanceproof";
+            return false;
+        }
+
+        try
+        {
+            bls::G2Element sig = bls::G2Element::FromBytes(ptxTo->vchBalanceSig.data());
+
+            if (!bls::BasicSchemeMPL::Verify(balKey, balanceMsg, sig))
+            {
+                strRejectReason = "invalid-balanceproof";
+                return false;
+            }
+        }
+        catch(std::exception& e)
+        {
+            strRejectReason = "caught-balanceproof-exception";
+            return false;
+        }
+    }
+
+    if (fCheckBLSSignature)
+    {
+        if (ptxTo->vchTxSig.size() == 0)
+        {
+            strRejectReason = "could-not-read-blstxsig";
+            return false;
+        }
+
+        try
+        {
+            bls::G2Element txsig = bls::G2Element::FromBytes(ptxTo->vchTxSig.data());
+
+            if (!bls::AugSchemeMPL::AggregateVerify(txSigningKeys, vMessages, txsig))
+            {
+                strRejectReason = "invalid-bls-signature";
+                return false;
+            }
+        }
+        catch(std::exception& e)
+        {
+            strRejectReason = "caught-blstxsig-exception";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover, CAmount nMixFee, RangeproofBatch* pRangeproofBatch, std::vector<CBLSCTCheck>* pvChecks, bool fCacheStore)
 {
     auto nStart = GetTimeMicros();
     std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
     std::vector<bls::G1Element> nonces;
+    std::vector<bool> vRecover;
 
     bls::G1Element balKey;
     bool fElementZero = true;
@@ -18,6 +258,8 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
     bool fCheckBLSSignature = tx.IsBLSInput();
     bool fCheckBalance = fCheckBLSSignature || fCheckRange;
 
+    uint256 cacheEntry;
+
     if (fOnlyRecover)
     {
         fCheckBLSSignature = false;
@@ -26,6 +268,23 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
     else if (!view.HaveInputs(tx)) {
         return state.DoS(100, false, REJECT_INVALID, strprintf("inputs-not-available"));
     }
+    else if (fCheckRange || fCheckBalance)
+    {
+        // The spent outputs are fixed by the outpoints, so the witness hash covers
+        // everything which is verified
+        GetBLSCTCache().ComputeEntry(cacheEntry, tx, nMixFee);
+
+        if (GetBLSCTCache().Get(cacheEntry))
+        {
+            if (!fCacheStore)
+                GetBLSCTCache().Erase(cacheEntry);
+
+            // Only the amounts are recovered
+            fOnlyRecover = true;
+            fCheckBLSSignature = false;
+            fCheckBalance = false;
+        }
+    }
 
     if (!(fCheckRange || fCheckBalance || fCheckBLSSignature))
         return true;
@@ -44,7 +303,7 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
             sMixFee = sMixFee.Negate();
 
         Scalar s = Scalar(sMixFee).bn;
-        bls::G1Element t = BulletproofsRangeproof::H*s.bn;
+        bls::G1Element t = BulletproofsRangeproof::MulH(s);
         balKey = fElementZero ? t : balKey + t;
         valIn += nMixFee;
         fElementZero = false;
@@ -60,13 +319,13 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
             {
                 if (prevOut.HasRangeProof())
                 {
-                    balKey = fElementZero ? prevOut.GetBulletproof().GetValueCommitments()[0] : balKey + prevOut.GetBulletproof().GetValueCommitments()[0];
+                    balKey = fElementZero ? prevOut.GetBulletproofRef()->GetValueCommitments()[0] : balKey + prevOut.GetBulletproofRef()->GetValueCommitments()[0];
                     fElementZero = false;
                 }
                 else
                 {
                     Scalar s = Scalar(prevOut.nValue).bn;
-                    bls::G1Element t = BulletproofsRangeproof::H*s.bn;
+                    bls::G1Element t = BulletproofsRangeproof::MulH(s);
                     balKey = fElementZero ? t : balKey + t;
                     valIn += prevOut.nValue;
                     fElementZero = false;
@@ -77,7 +336,7 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
             {
                 try
                 {
-                    txSigningKeys.push_back(bls::G1Element::FromBytes(prevOut.spendingKey.data()));
+                    txSigningKeys.push_back(prevOut.GetSpendingKey());
                 }
                 catch(std::exception& e)
                 {
@@ -106,9 +365,10 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
                 // Shared key v*R - Used as nonce for bulletproof
                 try
                 {
-                    bls::G1Element t = bls::G1Element::FromBytes(tx.vout[j].outputKey.data());
+                    bls::G1Element t = tx.vout[j].GetOutputKey();
                     t = t * viewKey;
                     nonces.push_back(t);
+                    vRecover.push_back(tx.vout[j].viewTag.empty() || tx.vout[j].viewTag == CalculateViewTag(t));
                 }
                 catch(std::exception& e)
                 {
@@ -119,11 +379,12 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
             {
                 if (fElementZero)
                 {
-                    balKey = tx.vout[j].GetBulletproof().GetValueCommitments()[0];
+                    balKey = tx.vout[j].GetBulletproofRef()->GetValueCommitments()[0];
                 }
                 else
                 {
-                    bls::G1Element t = tx.vout[j].GetBulletproof().GetValueCommitments()[0].Inverse();
+                    bls::G1Element t = tx.vout[j].GetBulletproofRef()->GetValueCommitments()[0];
+                    t = t.Inverse();
                     balKey = balKey + t;
                 }
                 fElementZero = false;
@@ -134,12 +395,12 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
             if (fElementZero)
             {
                 Scalar s = Scalar(tx.vout[j].nValue);
-                balKey = BulletproofsRangeproof::H*s.bn;
+                balKey = BulletproofsRangeproof::MulH(s);
             }
             else
             {
                 Scalar s = Scalar(tx.vout[j].nValue);
-                bls::G1Element t = BulletproofsRangeproof::H*s.bn;
+                bls::G1Element t = BulletproofsRangeproof::MulH(s);
                 t = t.Inverse();
                 balKey = balKey + t;
             }
@@ -155,7 +416,7 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
             }
             try
             {
-                txSigningKeys.push_back(bls::G1Element::FromBytes(tx.vout[j].ephemeralKey.data()));
+                txSigningKeys.push_back(tx.vout[j].GetEphemeralKey());
             }
             catch(std::exception& e)
             {
@@ -166,59 +427,40 @@ bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<Ra
         }
     }
 
-    if (fCheckRange && proofs.size() > 0)
+    if (fCheckRange && proofs.size() > 0 && pRangeproofBatch && !fOnlyRecover)
     {
-        if (!VerifyBulletproof(proofs, vData, nonces, fOnlyRecover))
-        {
-            return state.DoS(100, false, REJECT_INVALID, "invalid-rangeproof");
-        }
+        // The proofs are verified later together with the batch, the check only recovers the amounts
+        pRangeproofBatch->Add(tx.GetHash(), proofs);
     }
 
-    if (fCheckBalance)
-    {
-        if (tx.vchBalanceSig.size() == 0)
-            return state.DoS(100, false, REJECT_INVALID, strprintf("could-not-read-balanceproof"));
-
-        try
-        {
-            bls::G2Element sig = bls::G2Element::FromBytes(tx.vchBalanceSig.data());
+    CBLSCTCheck check(tx, fCheckRange ? &vData : nullptr, proofs, nonces, vRecover, fOnlyRecover || pRangeproofBatch,
+                      fCheckBalance, balKey, fCheckBLSSignature, txSigningKeys, vMessages);
 
-            if (!bls::BasicSchemeMPL::Verify(balKey, balanceMsg, sig))
-                return state.DoS(100, false, REJECT_INVALID, strprintf("invalid-balanceproof"));
-        }
-        catch(std::exception& e)
-        {
-            return state.DoS(100, false, REJECT_INVALID, strprintf("caught-balanceproof-exception"));
-        }
-    }
-
-    if (fCheckBLSSignature)
+    if (pvChecks)
     {
-        if (tx.vchTxSig.size() == 0)
-            return state.DoS(100, false, REJECT_INVALID, strprintf("could-not-read-blstxsig"));
+        pvChecks->push_back(CBLSCTCheck());
+        check.swap(pvChecks->back());
+        return true;
+    }
 
-        try
-        {
-            bls::G2Element txsig = bls::G2Element::FromBytes(tx.vchTxSig.data());
+    if (!check())
+        return state.DoS(100, false, REJECT_INVALID, check.GetRejectReason());
 
-            if (!bls::AugSchemeMPL::AggregateVerify(txSigningKeys, vMessages, txsig))
-                return state.DoS(100, false, REJECT_INVALID, "invalid-bls-signature");
-        }
-        catch(std::exception& e)
-        {
-            return state.DoS(100, false, REJECT_INVALID, strprintf("caught-blstxsig-exception"));
-        }
-    }
+    // Only a transaction verified here entirely can be cached, the range proofs of a batch
+    // are verified by the caller
+    if (fCacheStore && !fOnlyRecover && !pRangeproofBatch)
+        GetBLSCTCache().Set(cacheEntry);
 
     //std::cout << strprintf("%s: took %.2f ms\n", __func__, (GetTimeMicros()-nStart)/1000);
     return true;
 }
 
 
-bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover, CAmount nMixFee)
+bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover, CAmount nMixFee, RangeproofBatch* pRangeproofBatch)
 {
     std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
     std::vector<bls::G1Element> nonces;
+    std::vector<bool> vRecover;
 
     bls::G1Element balKey;
     bool fElementZero = true;
@@ -237,7 +479,7 @@ bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey,
             sMixFee = sMixFee.Negate();
 
         Scalar s = Scalar(sMixFee).bn;
-        bls::G1Element t = BulletproofsRangeproof::H*s.bn;
+        bls::G1Element t = BulletproofsRangeproof::MulH(s);
         balKey = fElementZero ? t : balKey + t;
         valIn += nMixFee;
         fElementZero = false;
@@ -258,9 +500,10 @@ bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey,
                 // Shared key v*R - Used as nonce for bulletproof
                 try
                 {
-                    bls::G1Element t = bls::G1Element::FromBytes(tx.vout[j].outputKey.data());
+                    bls::G1Element t = tx.vout[j].GetOutputKey();
                     t = t * viewKey;
                     nonces.push_back(t);
+                    vRecover.push_back(tx.vout[j].viewTag.empty() || tx.vout[j].viewTag == CalculateViewTag(t));
                 }
                 catch(std::exception& e)
                 {
@@ -271,11 +514,12 @@ bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey,
             {
                 if (fElementZero)
                 {
-                    balKey = tx.vout[j].GetBulletproof().GetValueCommitments()[0];
+                    balKey = tx.vout[j].GetBulletproofRef()->GetValueCommitments()[0];
                 }
                 else
                 {
-                    bls::G1Element t = tx.vout[j].GetBulletproof().GetValueCommitments()[0].Inverse();
+                    bls::G1Element t = tx.vout[j].GetBulletproofRef()->GetValueCommitments()[0];
+                    t = t.Inverse();
                     balKey = balKey + t;
                 }
                 fElementZero = false;
@@ -285,10 +529,13 @@ bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey,
 
     if (fCheckRange && proofs.size() > 0)
     {
-        if (!VerifyBulletproof(proofs, vData, nonces, fOnlyRecover))
+        // With a batch, only recover the amounts now. The proofs are verified later together with the batch.
+        if (!VerifyBulletproof(proofs, vData, nonces, fOnlyRecover || pRangeproofBatch, vRecover))
         {
             return state.DoS(100, false, REJECT_INVALID, "invalid-rangeproof");
         }
+        if (pRangeproofBatch && !fOnlyRecover)
+            pRangeproofBatch->Add(tx.GetHash(), proofs);
     }
 
     if (fCheckBalance)
@@ -334,13 +581,8 @@ bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx,
 
         for (auto& in: tx.vin)
         {
-            for (auto &cin: setInputs)
-            {
-                if (cin == in)
-                    return state.DoS(100, false, REJECT_INVALID, strprintf("duplicate-input"));
-            }
-
-            setInputs.insert(in);
+            if (!setInputs.insert(in).second)
+                return state.DoS(100, false, REJECT_INVALID, strprintf("duplicate-input"));
         }
 
         for (auto& out: tx.vout)
@@ -356,13 +598,8 @@ bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx,
                 continue;
             }
 
-            for (auto &cout: setOutputs)
-            {
-                if (cout == out)
-                    return state.DoS(100, false, REJECT_INVALID, strprintf("duplicate-output"));
-            }
-
-            setOutputs.insert(out);
+            if (!setOutputs.insert(out).second)
+                return state.DoS(100, false, REJECT_INVALID, strprintf("duplicate-output"));
         }
 
         if (tx.vchBalanceSig.size() > 0)
@@ -433,3 +670,227 @@ bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx,
         return state.DoS(100, false, REJECT_INVALID, strprintf("%s: catched exception", __func__));
     }
 }
+
+void CBLSCTAggregate::clear()
+{
+    mapMembers.clear();
+    mapInputs.clear();
+    mapOutputs.clear();
+    mapRejected.clear();
+    balanceSig = bls::G2Element::Infinity();
+    txSig = bls::G2Element::Infinity();
+    nFee = 0;
+    nCTOutputs = 0;
+    fDirty = true;
+    fVerified = false;
+    fFailed = false;
+    strFailReason.clear();
+    combinedTx = CTransaction();
+}
+
+bool CBLSCTAggregate::Add(const std::shared_ptr<const CTransaction>& ptx)
+{
+    const CTransaction& tx = *ptx;
+    uint256 hash = tx.GetHash();
+
+    if (!tx.IsBLSInput() || mapMembers.count(hash))
+        return false;
+
+    Member member;
+    member.tx = ptx;
+    member.fBalanceSig = tx.vchBalanceSig.size() > 0;
+    member.fTxSig = tx.vchTxSig.size() > 0;
+
+    try
+    {
+        if (member.fBalanceSig)
+            member.balanceSig = bls::G2Element::FromByteVector(tx.vchBalanceSig);
+        if (member.fTxSig)
+            member.txSig = bls::G2Element::FromByteVector(tx.vchTxSig);
+    }
+    catch(std::exception& e)
+    {
+        return false;
+    }
+
+    // The same checks CombineBLSCTTransactions does against the other members
+    std::set<CTxIn> setInputs;
+    for (auto& in: tx.vin)
+    {
+        if (!setInputs.insert(in).second)
+            return false;
+        if (mapInputs.count(in))
+        {
+            mapRejected[hash] = ptx;
+            return false;
+        }
+    }
+
+    std::set<CTxOut> setOutputs;
+    for (auto& out: tx.vout)
+    {
+        if (out.scriptPubKey.IsFee())
+            continue;
+        if (!setOutputs.insert(out).second)
+            return false;
+        if (mapOutputs.count(out))
+        {
+            mapRejected[hash] = ptx;
+            return false;
+        }
+    }
+
+    for (auto& in: setInputs)
+        mapInputs.insert(std::make_pair(in, hash));
+
+    for (auto& out: setOutputs)
+        mapOutputs.insert(std::make_pair(out, hash));
+
+    for (auto& out: tx.vout)
+    {
+        if (out.HasRangeProof())
+            nCTOutputs++;
+        if (out.scriptPubKey.IsFee())
+            nFee += out.nValue;
+    }
+
+    if (member.fBalanceSig)
+        balanceSig = balanceSig + member.balanceSig;
+    if (member.fTxSig)
+        txSig = txSig + member.txSig;
+
+    mapMembers.insert(std::make_pair(hash, member));
+    mapRejected.erase(hash);
+    fDirty = true;
+
+    return true;
+}
+
+void CBLSCTAggregate::Remove(const uint256& hash)
+{
+    mapRejected.erase(hash);
+
+    auto it = mapMembers.find(hash);
+
+    if (it == mapMembers.end())
+        return;
+
+    const Member& member = it->second;
+
+    for (auto& in: member.tx->vin)
+        mapInputs.erase(in);
+
+    for (auto& out: member.tx->vout)
+    {
+        if (out.HasRangeProof())
+            nCTOutputs--;
+        if (out.scriptPubKey.IsFee())
+            nFee -= out.nValue;
+        else
+            mapOutputs.erase(out);
+    }
+
+    if (member.fBalanceSig)
+        balanceSig = balanceSig + member.balanceSig.Negate();
+    if (member.fTxSig)
+        txSig = txSig + member.txSig.Negate();
+
+    mapMembers.erase(it);
+    fDirty = true;
+
+    // The removed member could have been the only conflict of the transactions left out
+    std::map<uint256, std::shared_ptr<const CTransaction>> mapRetry;
+    mapRetry.swap(mapRejected);
+    for (auto& itRetry: mapRetry)
+        Add(itRetry.second);
+}
+
+bool CBLSCTAggregate::GetCombined(CTransaction& outTx, const CStateViewCache& inputs, CValidationState& state)
+{
+    if (mapMembers.empty())
+        return state.DoS(100, false, REJECT_INVALID, strprintf("empty-vector-combine-blsct"));
+
+    if (fDirty)
+        Build();
+
+    if (fFailed)
+        return state.Invalid(false, REJECT_INVALID, strFailReason, "combined transaction failed before");
+
+    // The inputs come and go with the chain, so they are looked up on every call and
+    // a combination missing some is not remembered as failed
+    if (!inputs.HaveInputs(combinedTx))
+        return state.Invalid(false, REJECT_INVALID, "inputs-not-available");
+
+    // The only member was verified when it entered the pool
+    if (!fVerified && mapMembers.size() > 1)
+    {
+        std::vector<RangeproofEncodedData> blsctData;
+        bool fValid;
+
+        try
+        {
+            fValid = VerifyBLSCT(combinedTx, bls::PrivateKey::FromBN(Scalar::Rand().bn), blsctData, inputs, state);
+        }
+        catch(...)
+        {
+            fValid = state.DoS(100, false, REJECT_INVALID, strprintf("%s: catched exception", __func__));
+        }
+
+        // With the inputs available, the result only depends on the members
+        if (!fValid)
+        {
+            fFailed = true;
+            strFailReason = state.GetRejectReason();
+            return false;
+        }
+    }
+
+    fVerified = true;
+    outTx = combinedTx;
+
+    return true;
+}
+
+void CBLSCTAggregate::Build()
+{
+    fDirty = false;
+    fVerified = false;
+    fFailed = false;
+    strFailReason.clear();
+
+    if (mapMembers.size() == 1)
+    {
+        combinedTx = *mapMembers.begin()->second.tx;
+        return;
+    }
+
+    CMutableTransaction mutOutTx;
+    mutOutTx.nVersion = TX_BLS_INPUT_FLAG;
+    if (nCTOutputs > 0)
+        mutOutTx.nVersion |= TX_BLS_CT_FLAG;
+    mutOutTx.nTime = GetTime();
+
+    mutOutTx.vin.reserve(mapInputs.size());
+    for (auto& it: mapInputs)
+        mutOutTx.vin.push_back(it.first);
+
+    mutOutTx.vout.reserve(mapOutputs.size() + 1);
+    for (auto& it: mapOutputs)
+        mutOutTx.vout.push_back(it.first);
+
+    std::random_shuffle(mutOutTx.vin.begin(), mutOutTx.vin.end(), GetRandInt);
+    std::random_shuffle(mutOutTx.vout.begin(), mutOutTx.vout.end(), GetRandInt);
+
+    mutOutTx.vout.push_back(CTxOut(nFee, CScript(OP_RETURN)));
+    mutOutTx.SetBalanceSignature(balanceSig);
+    mutOutTx.SetTxSignature(txSig);
+
+    combinedTx = mutOutTx;
+}
+
+size_t CBLSCTAggregate::DynamicMemoryUsage() const
+{
+    // The transactions of the members are counted by the pool entries sharing them
+    return memusage::DynamicUsage(mapMembers) + memusage::DynamicUsage(mapInputs) + memusage::DynamicUsage(mapOutputs) +
+           memusage::DynamicUsage(mapRejected) + RecursiveDynamicUsage(combinedTx);
+}
@@ -21,7 +21,181 @@
 #include <schemes.hpp>
 #include <utiltime.h>
 
-bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover = false, CAmount nMixFee = 0);
-bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover = false, CAmount nMixFee = 0);
+#include <memory>
+
+#include <boost/thread/mutex.hpp>
+
+/** Default for -maxblsctcachesize, the size in MiB of the cache of transactions with valid BLSCT proofs */
+static const unsigned int DEFAULT_MAX_BLSCT_CACHE_SIZE = 8;
+
+/** Range proofs of several transactions which are verified together with a single multi-exponentiation.
+ *  When the batch fails, the transactions are checked one by one to find the invalid one. */
+class RangeproofBatch
+{
+public:
+    void Add(const uint256& txHash, const std::vector<std::pair<int, BulletproofsRangeproof>>& vProofs);
+    bool Verify(CValidationState& state) const;
+    /** Verifies the batch and, when it fails, each transaction on its own. Returns the hashes of the invalid ones. */
+    std::set<uint256> GetInvalid() const;
+
+    size_t size() const { return proofs.size(); }
+    bool empty() const { return proofs.empty(); }
+    void clear() { proofs.clear(); vTx.clear(); }
+
+private:
+    std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
+    //! Hash of each transaction together with the position of its first proof in proofs
+    std::vector<std::pair<uint256, size_t>> vTx;
+};
+
+/** Keeps the reject reason of the first CBLSCTCheck failing on the check queue, whose
+ *  workers drop the checks once they have run them. */
+class CBLSCTCheckResult
+{
+public:
+    void SetRejectReason(const std::string& strReason);
+    std::string GetRejectReason() const;
+
+private:
+    mutable boost::mutex mutex;
+    std::string strRejectReason;
+};
+
+/**
+ * Closure representing the verification of the BLSCT proofs of one transaction:
+ * range proofs, balance signature and aggregated BLS signature.
+ * The keys are read from the coins view when the check is created, so it can run
+ * on the script check threads. It stores a reference to the transaction.
+ */
+class CBLSCTCheck
+{
+private:
+    const CTransaction *ptxTo;
+    std::vector<RangeproofEncodedData> *pvData;
+    std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
+    std::vector<bls::G1Element> nonces;
+    std::vector<bool> vRecover;
+    bool fOnlyRangeRecover;
+    bool fCheckBalance;
+    bls::G1Element balKey;
+    bool fCheckBLSSignature;
+    std::vector<bls::G1Element> txSigningKeys;
+    std::vector<std::vector<uint8_t>> vMessages;
+    std::string strRejectReason;
+    CBLSCTCheckResult *pResult;
+
+    bool Verify();
+
+public:
+    CBLSCTCheck(): ptxTo(0), pvData(0), fOnlyRangeRecover(false), fCheckBalance(false), fCheckBLSSignature(false), pResult(0) {}
+    CBLSCTCheck(const CTransaction& txToIn, std::vector<RangeproofEncodedData>* pvDataIn,
+                std::vector<std::pair<int, BulletproofsRangeproof>>& proofsIn, std::vector<bls::G1Element>& noncesIn, std::vector<bool>& vRecoverIn, bool fOnlyRangeRecoverIn,
+                bool fCheckBalanceIn, const bls::G1Element& balKeyIn,
+                bool fCheckBLSSignatureIn, std::vector<bls::G1Element>& txSigningKeysIn, std::vector<std::vector<uint8_t>>& vMessagesIn) :
+        ptxTo(&txToIn), pvData(pvDataIn), fOnlyRangeRecover(fOnlyRangeRecoverIn), fCheckBalance(fCheckBalanceIn), balKey(balKeyIn),
+        fCheckBLSSignature(fCheckBLSSignatureIn), pResult(0)
+    {
+        proofs.swap(proofsIn);
+        nonces.swap(noncesIn);
+        vRecover.swap(vRecoverIn);
+        txSigningKeys.swap(txSigningKeysIn);
+        vMessages.swap(vMessagesIn);
+    }
+
+    bool operator()();
+
+    void swap(CBLSCTCheck &check) {
+        std::swap(ptxTo, check.ptxTo);
+        std::swap(pvData, check.pvData);
+        proofs.swap(check.proofs);
+        nonces.swap(check.nonces);
+        vRecover.swap(check.vRecover);
+        std::swap(fOnlyRangeRecover, check.fOnlyRangeRecover);
+        std::swap(fCheckBalance, check.fCheckBalance);
+        std::swap(balKey, check.balKey);
+        std::swap(fCheckBLSSignature, check.fCheckBLSSignature);
+        txSigningKeys.swap(check.txSigningKeys);
+        vMessages.swap(check.vMessages);
+        strRejectReason.swap(check.strRejectReason);
+        std::swap(pResult, check.pResult);
+    }
+
+    const std::string& GetRejectReason() const { return strRejectReason; }
+    /** Where the reject reason is reported when the check runs on the check queue */
+    void SetResult(CBLSCTCheckResult* pResultIn) { pResult = pResultIn; }
+};
+
+/** Verify the BLSCT proofs of a transaction. When pvChecks is given, the expensive checks are
+ *  appended to it instead of being run, and vData is only filled once they have run.
+ *  Transactions found valid before, usually when they entered the mempool, only have their
+ *  amounts recovered. With fCacheStore a transaction verified inline is added to that cache,
+ *  without it a cached transaction is removed from the cache as it is used. */
+bool VerifyBLSCT(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover = false, CAmount nMixFee = 0, RangeproofBatch* pRangeproofBatch = nullptr, std::vector<CBLSCTCheck>* pvChecks = nullptr, bool fCacheStore = false);
+bool VerifyBLSCTBalanceOutputs(const CTransaction &tx, bls::PrivateKey viewKey, std::vector<RangeproofEncodedData> &vData, const CStateViewCache& view, CValidationState& state, bool fOnlyRecover = false, CAmount nMixFee = 0, RangeproofBatch* pRangeproofBatch = nullptr);
 bool CombineBLSCTTransactions(std::set<CTransaction> &vTx, CTransaction& outTx, const CStateViewCache& inputs, CValidationState& state, CAmount nMixFee = 0);
+
+/**
+ * Combination of the BLS input transactions of a pool, kept up to date as
+ * they enter and leave it: the inputs and outputs of the members, their fees
+ * and the sums of their balance and transaction signatures. The combined
+ * transaction is only built and verified again after the members changed,
+ * also when it failed verification. Whether its inputs are available is
+ * checked on every use, as it depends on the chain. The members share the
+ * transactions of the pool entries.
+ */
+class CBLSCTAggregate
+{
+public:
+    CBLSCTAggregate() { clear(); }
+
+    /** Returns false, leaving the transaction out, when it can not be combined with the members.
+     *  Transactions left out for conflicting with a member are added again when a member is removed. */
+    bool Add(const std::shared_ptr<const CTransaction>& tx);
+    void Remove(const uint256& hash);
+    void clear();
+
+    size_t size() const { return mapMembers.size(); }
+    bool empty() const { return mapMembers.empty(); }
+    bool Has(const uint256& hash) const { return mapMembers.count(hash); }
+    bool IsRejected(const uint256& hash) const { return mapRejected.count(hash); }
+
+    /** The transaction combining all the members, or the only member when there is one.
+     *  A combination which failed verification is reported again without being rebuilt until
+     *  the members change, one missing inputs is tried again on the next call. */
+    bool GetCombined(CTransaction& outTx, const CStateViewCache& inputs, CValidationState& state);
+
+    size_t DynamicMemoryUsage() const;
+
+private:
+    void Build();
+
+    struct Member
+    {
+        std::shared_ptr<const CTransaction> tx;
+        bls::G2Element balanceSig;
+        bool fBalanceSig;
+        bls::G2Element txSig;
+        bool fTxSig;
+    };
+
+    std::map<uint256, Member> mapMembers;
+    std::map<CTxIn, uint256> mapInputs;
+    std::map<CTxOut, uint256> mapOutputs;
+    //! Transactions left out for conflicting with the members
+    std::map<uint256, std::shared_ptr<const CTransaction>> mapRejected;
+
+    bls::G2Element balanceSig;
+    bls::G2Element txSig;
+    CAmount nFee;
+    size_t nCTOutputs;
+
+    //! Whether combinedTx has to be built again
+    bool fDirty;
+    //! Whether combinedTx passed verification
+    bool fVerified;
+    //! Whether combinedTx failed verification, and why
+    bool fFailed;
+    std::string strFailReason;
+    CTransaction combinedTx;
+};
 #endif // BLSCT_VERIFICATION_H
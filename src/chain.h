@@ -513,6 +513,7 @@ public:
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
         hashNext = (pnext ? pnext->GetBlockHash() : uint256());
+        blockHash = (phashBlock ? *phashBlock : uint256());
     }
 
     ADD_SERIALIZE_METHODS;
@@ -605,7 +606,7 @@ public:
         }
     }
 
-    uint256 GetBlockHash() const
+    CBlockHeader GetHeader() const
     {
         CBlockHeader block;
         block.nVersion        = nVersion;
@@ -614,10 +615,20 @@ public:
         block.nTime           = nTime;
         block.nBits           = nBits;
         block.nNonce          = nNonce;
+        return block;
+    }
+
+    uint256 GetBlockHash() const
+    {
+        const_cast<CDiskBlockIndex*>(this)->blockHash = GetHeader().GetHash();
 
-        const_cast<CDiskBlockIndex*>(this)->blockHash = block.GetHash();
+        return blockHash;
+    }
 
-        return block.GetHash();
+    /** The hash persisted with the record, null for records written by older versions */
+    const uint256& GetStoredBlockHash() const
+    {
+        return blockHash;
     }
 
 
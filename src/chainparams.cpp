@@ -250,6 +250,11 @@ public:
         consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT].nStartTime = 1612137600; // Feb 1st, 2021
         consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT].nTimeout = 1640995200; // Jun 1st, 2022
 
+        // Deployment of BLSCT view tags
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].bit = 19;
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].nStartTime = 1625097600; // Jul 1st, 2021
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].nTimeout = 1656633600; // Jul 1st, 2022
+
         /**
          * The message start string is designed to be unlikely to occur in normal data.
          * The characters are rarely used upper ASCII, not valid as UTF-8, and produce
@@ -499,6 +504,11 @@ public:
         consensus.vDeployments[Consensus::DEPLOYMENT_EXCLUDE].nStartTime =1602343915; // oct 10th, 2020
         consensus.vDeployments[Consensus::DEPLOYMENT_EXCLUDE].nTimeout = 1633879915; // oct 10th, 2021
 
+        // Deployment of BLSCT view tags
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].bit = 19;
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].nStartTime = 1577836800; // Jan 1st, 2020
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].nTimeout = 1656633600; // Jul 1st, 2022
+
         /**
          * The message start string is designed to be unlikely to occur in normal data.
          * The characters are rarely used upper ASCII, not valid as UTF-8, and produce
@@ -732,6 +742,11 @@ public:
         consensus.vDeployments[Consensus::DEPLOYMENT_EXCLUDE].nStartTime =1602343915; // oct 10th, 2020
         consensus.vDeployments[Consensus::DEPLOYMENT_EXCLUDE].nTimeout = 1633879915; // oct 10th, 2021
 
+        // Deployment of BLSCT view tags
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].bit = 19;
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].nStartTime = 1577836800; // Jan 1st, 2020
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].nTimeout = 1656633600; // Jul 1st, 2022
+
         /**
          * The message start string is designed to be unlikely to occur in normal data.
          * The characters are rarely used upper ASCII, not valid as UTF-8, and produce
@@ -975,6 +990,11 @@ public:
         consensus.vDeployments[Consensus::DEPLOYMENT_EXCLUDE].nStartTime =1602343915; // oct 10th, 2020
         consensus.vDeployments[Consensus::DEPLOYMENT_EXCLUDE].nTimeout = 1633879915; // oct 10th, 2021
 
+        // Deployment of BLSCT view tags
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].bit = 19;
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].nStartTime = 1577836800; // Jan 1st, 2020
+        consensus.vDeployments[Consensus::DEPLOYMENT_BLSCT_VIEWTAG].nTimeout = 1656633600; // Jul 1st, 2022
+
         /**
          * The message start string is designed to be unlikely to occur in normal data.
          * The characters are rarely used upper ASCII, not valid as UTF-8, and produce
@@ -5,6 +5,7 @@
 
 #include <coins.h>
 
+#include <consensus/consensus.h>
 #include <main.h>
 #include <memusage.h>
 #include <random.h>
@@ -12,47 +13,20 @@
 #include <utiltime.h>
 
 #include <assert.h>
+#include <stdexcept>
 
-/**
- * calculate number of bytes for the bitmask, and its number of non-zero bytes
- * each bit in the bitmask represents the availability of one output, but the
- * availabilities of the first two outputs are encoded separately
- */
-void CCoins::CalcMaskSize(unsigned int &nBytes, unsigned int &nNonzeroBytes) const {
-    unsigned int nLastUsedByte = 0;
-    for (unsigned int b = 0; 2+b*8 < vout.size(); b++) {
-        bool fZero = true;
-        for (unsigned int i = 0; i < 8 && 2+b*8+i < vout.size(); i++) {
-            if (!vout[2+b*8+i].IsNull()) {
-                fZero = false;
-                continue;
-            }
-        }
-        if (!fZero) {
-            nLastUsedByte = b + 1;
-            nNonzeroBytes++;
-        }
-    }
-    nBytes += nLastUsedByte;
-}
-
-bool CCoins::Spend(uint32_t nPos)
-{
-    if (nPos >= vout.size() || vout[nPos].IsNull())
-        return false;
-    vout[nPos].SetNull();
-    Cleanup();
-    return true;
-}
-
-bool CStateView::GetCoins(const uint256 &txid, CCoins &coins) const { return false; }
+bool CStateView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
 bool CStateView::GetProposal(const uint256 &pid, CProposal &proposal) const { return false; }
 bool CStateView::GetPaymentRequest(const uint256 &prid, CPaymentRequest &prequest) const { return false; }
 bool CStateView::GetCachedVoter(const CVoteMapKey &voter, CVoteMapValue& vote) const { return false; }
 bool CStateView::GetConsultation(const uint256 &cid, CConsultation& consultation) const { return false; }
 bool CStateView::GetConsultationAnswer(const uint256 &cid, CConsultationAnswer& answer) const { return false; }
 bool CStateView::GetConsensusParameter(const int &pid, CConsensusParameter& cparameter) const { return false; }
-bool CStateView::HaveCoins(const uint256 &txid) const { return false; }
+bool CStateView::HaveCoin(const COutPoint &outpoint) const
+{
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
 bool CStateView::HaveProposal(const uint256 &pid) const { return false; }
 bool CStateView::HavePaymentRequest(const uint256 &prid) const { return false; }
 bool CStateView::HaveCachedVoter(const CVoteMapKey &voter) const { return false; }
@@ -66,22 +40,24 @@ bool CStateView::GetAllPaymentRequests(CPaymentRequestMap& map) { return false;
 bool CStateView::GetAllVotes(CVoteMap& map) { return false; }
 bool CStateView::GetAllConsultations(CConsultationMap& map) { return false; }
 bool CStateView::GetAllConsultationAnswers(CConsultationAnswerMap& map) { return false; }
+bool CStateView::GetDAOStateCommitment(CMultisetHash& commitment) const { return false; }
 uint256 CStateView::GetBestBlock() const { return uint256(); }
 bool CStateView::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
                             CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                             CConsultationMap& mapConsultations, CConsultationAnswerMap& mapAnswers,
-                            CConsensusParameterMap& mapConsensus, const uint256 &hashBlock, const int& nCacheExcludeVotes) { return false; }
+                            CConsensusParameterMap& mapConsensus, const uint256 &hashBlock, const int& nCacheExcludeVotes,
+                            const CMultisetHash& daoStateDelta) { return false; }
 CStateViewCursor *CStateView::Cursor() const { return 0; }
 
 
 CStateViewBacked::CStateViewBacked(CStateView *viewIn) : base(viewIn) { }
-bool CStateViewBacked::GetCoins(const uint256 &txid, CCoins &coins) const { return base->GetCoins(txid, coins); }
+bool CStateViewBacked::GetCoin(const COutPoint &outpoint, Coin &coin) const { return base->GetCoin(outpoint, coin); }
 bool CStateViewBacked::GetProposal(const uint256 &pid, CProposal &proposal) const { return base->GetProposal(pid, proposal); }
 bool CStateViewBacked::GetPaymentRequest(const uint256 &prid, CPaymentRequest &prequest) const { return base->GetPaymentRequest(prid, prequest); }
 bool CStateViewBacked::GetConsultation(const uint256 &cid, CConsultation &consultation) const { return base->GetConsultation(cid, consultation); }
 bool CStateViewBacked::GetConsultationAnswer(const uint256 &cid, CConsultationAnswer &answer) const { return base->GetConsultationAnswer(cid, answer); }
 bool CStateViewBacked::GetConsensusParameter(const int &pid, CConsensusParameter& cparameter) const { return base->GetConsensusParameter(pid, cparameter); }
-bool CStateViewBacked::HaveCoins(const uint256 &txid) const { return base->HaveCoins(txid); }
+bool CStateViewBacked::HaveCoin(const COutPoint &outpoint) const { return base->HaveCoin(outpoint); }
 bool CStateViewBacked::HaveProposal(const uint256 &pid) const { return base->HaveProposal(pid); }
 bool CStateViewBacked::HavePaymentRequest(const uint256 &prid) const { return base->HavePaymentRequest(prid); }
 bool CStateViewBacked::HaveCachedVoter(const CVoteMapKey &voter) const { return base->HaveCachedVoter(voter); }
@@ -96,18 +72,22 @@ bool CStateViewBacked::GetAllPaymentRequests(CPaymentRequestMap& map) { return b
 bool CStateViewBacked::GetAllVotes(CVoteMap& map) { return base->GetAllVotes(map); }
 bool CStateViewBacked::GetAllConsultations(CConsultationMap& map) { return base->GetAllConsultations(map); }
 bool CStateViewBacked::GetAllConsultationAnswers(CConsultationAnswerMap& map) { return base->GetAllConsultationAnswers(map); }
+bool CStateViewBacked::GetDAOStateCommitment(CMultisetHash& commitment) const { return base->GetDAOStateCommitment(commitment); }
 uint256 CStateViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 void CStateViewBacked::SetBackend(CStateView &viewIn) { base = &viewIn; }
 bool CStateViewBacked::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
                                   CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                                   CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
-                                  CConsensusParameterMap& mapConsensus, const uint256 &hashBlock, const int &nCacheExcludeVotes) {
-    return base->BatchWrite(mapCoins, mapProposals, mapPaymentRequests, mapVotes, mapConsultations, mapAnswers, mapConsensus, hashBlock, nCacheExcludeVotes);
+                                  CConsensusParameterMap& mapConsensus, const uint256 &hashBlock, const int &nCacheExcludeVotes,
+                                  const CMultisetHash& daoStateDelta) {
+    return base->BatchWrite(mapCoins, mapProposals, mapPaymentRequests, mapVotes, mapConsultations, mapAnswers, mapConsensus, hashBlock, nCacheExcludeVotes, daoStateDelta);
 }
 CStateViewCursor *CStateViewBacked::Cursor() const { return base->Cursor(); }
 
 SaltedTxidHasher::SaltedTxidHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
+SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
 CStateViewCache::CStateViewCache(CStateView *baseIn) : CStateViewBacked(baseIn), hasModifier(false), hasModifierConsensus(false), cachedCoinsUsage(0), nCacheExcludeVotes(-1) { }
 
 CStateViewCache::~CStateViewCache()
@@ -120,21 +100,20 @@ size_t CStateViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
 }
 
-CCoinsMap::const_iterator CStateViewCache::FetchCoins(const uint256 &txid) const {
-    CCoinsMap::iterator it = cacheCoins.find(txid);
+CCoinsMap::iterator CStateViewCache::FetchCoin(const COutPoint &outpoint) const {
+    CCoinsMap::iterator it = cacheCoins.find(outpoint);
     if (it != cacheCoins.end())
         return it;
-    CCoins tmp;
-    if (!base->GetCoins(txid, tmp))
+    Coin tmp;
+    if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
-    CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
-    tmp.swap(ret->second.coins);
-    if (ret->second.coins.IsPruned()) {
-        // The parent only has an empty entry for this txid; we can consider our
+    CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(outpoint, CCoinsCacheEntry(std::move(tmp)))).first;
+    if (ret->second.coin.IsSpent()) {
+        // The parent only has an empty entry for this outpoint; we can consider our
         // version as fresh.
         ret->second.flags = CCoinsCacheEntry::FRESH;
     }
-    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
+    cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
     return ret;
 }
 
@@ -242,11 +221,11 @@ CConsensusParameterMap::const_iterator CStateViewCache::FetchConsensusParameter(
 }
 
 
-bool CStateViewCache::GetCoins(const uint256 &txid, CCoins &coins) const {
-    CCoinsMap::const_iterator it = FetchCoins(txid);
+bool CStateViewCache::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it != cacheCoins.end()) {
-        coins = it->second.coins;
-        return true;
+        coin = it->second.coin;
+        return !coin.IsSpent();
     }
     return false;
 }
@@ -334,6 +313,13 @@ bool CStateViewCache::SetExcludeVotes(int count) {
     return true;
 }
 
+bool CStateViewCache::GetDAOStateCommitment(CMultisetHash& commitment) const {
+    if (!base->GetDAOStateCommitment(commitment))
+        return false;
+    commitment += daoStateDelta;
+    return true;
+}
+
 bool CStateViewCache::GetAllPaymentRequests(CPaymentRequestMap& mapPaymentRequests) {
     mapPaymentRequests.clear();
     mapPaymentRequests.insert(cachePaymentRequests.begin(), cachePaymentRequests.end());
@@ -410,25 +396,55 @@ bool CStateViewCache::GetAllConsultationAnswers(CConsultationAnswerMap& mapAnswe
     return true;
 }
 
-CCoinsModifier CStateViewCache::ModifyCoins(const uint256 &txid) {
-    assert(!hasModifier);
-    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
-    size_t cachedCoinUsage = 0;
-    if (ret.second) {
-        if (!base->GetCoins(txid, ret.first->second.coins)) {
-            // The parent view does not have this entry; mark it as fresh.
-            ret.first->second.coins.Clear();
-            ret.first->second.flags = CCoinsCacheEntry::FRESH;
-        } else if (ret.first->second.coins.IsPruned()) {
-            // The parent view only has a pruned entry for this; mark it as fresh.
-            ret.first->second.flags = CCoinsCacheEntry::FRESH;
+void CStateViewCache::AddCoin(const COutPoint &outpoint, Coin&& coin, bool possible_overwrite) {
+    assert(!coin.IsSpent());
+    if (!coin.out.IsBLSCT() && coin.out.scriptPubKey.IsUnspendable())
+        return;
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(outpoint, CCoinsCacheEntry()));
+    bool fresh = false;
+    if (!ret.second) {
+        cachedCoinsUsage -= ret.first->second.coin.DynamicMemoryUsage();
+    }
+    if (!possible_overwrite) {
+        if (!ret.first->second.coin.IsSpent()) {
+            throw std::logic_error("Adding new coin that replaces non-pruned entry");
         }
+        // The parent view can only have it if we did not modify it ourselves.
+        fresh = !(ret.first->second.flags & CCoinsCacheEntry::DIRTY);
+    }
+    ret.first->second.coin = std::move(coin);
+    ret.first->second.flags |= CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    cachedCoinsUsage += ret.first->second.coin.DynamicMemoryUsage();
+}
+
+void AddCoins(CStateViewCache& cache, const CTransaction &tx, int nHeight, bool check) {
+    bool fCoinbase = tx.IsCoinBase();
+    bool fCoinstake = tx.IsCoinStake();
+    const uint256& txid = tx.GetHash();
+    for (size_t i = 0; i < tx.vout.size(); ++i) {
+        COutPoint outpoint(txid, i);
+        // Coinbase transactions can always be overwritten, in order to correctly
+        // deal with the pre-BIP30 occurrences of duplicate coinbase transactions.
+        bool overwrite = check ? cache.HaveCoin(outpoint) : fCoinbase;
+        cache.AddCoin(outpoint, Coin(tx.vout[i], nHeight, fCoinbase, fCoinstake), overwrite);
+    }
+}
+
+bool CStateViewCache::SpendCoin(const COutPoint &outpoint, Coin* moveout) {
+    CCoinsMap::iterator it = FetchCoin(outpoint);
+    if (it == cacheCoins.end())
+        return false;
+    cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+    if (moveout) {
+        *moveout = std::move(it->second.coin);
+    }
+    if (it->second.flags & CCoinsCacheEntry::FRESH) {
+        cacheCoins.erase(it);
     } else {
-        cachedCoinUsage = ret.first->second.coins.DynamicMemoryUsage();
+        it->second.flags |= CCoinsCacheEntry::DIRTY;
+        it->second.coin.Clear();
     }
-    // Assume that whenever ModifyCoins is called, the entry will be modified.
-    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
-    return CCoinsModifier(*this, ret.first, cachedCoinUsage);
+    return true;
 }
 
 CProposalModifier CStateViewCache::ModifyProposal(const uint256 &pid, int nHeight) {
@@ -497,27 +513,15 @@ CConsultationAnswerModifier CStateViewCache::ModifyConsultationAnswer(const uint
     return CConsultationAnswerModifier(*this, ret.first, nHeight);
 }
 
-// ModifyNewCoins has to know whether the new outputs its creating are for a
-// coinbase or not.  If they are for a coinbase, it can not mark them as fresh.
-// This is to ensure that the historical duplicate coinbases before BIP30 was
-// in effect will still be properly overwritten when spent.
-CCoinsModifier CStateViewCache::ModifyNewCoins(const uint256 &txid, bool coinbase) {
-    assert(!hasModifier);
-    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
-    ret.first->second.coins.Clear();
-    if (!coinbase) {
-        ret.first->second.flags = CCoinsCacheEntry::FRESH;
-    }
-    ret.first->second.flags |= CCoinsCacheEntry::DIRTY;
-    return CCoinsModifier(*this, ret.first, 0);
-}
-
 bool CStateViewCache::AddProposal(const CProposal& proposal) const {
     if (HaveProposal(proposal.hash))
         return false;
 
     assert(proposal.fDirty == true);
 
+    if (!proposal.IsNull())
+        daoStateDelta.Insert(GetDAOStateEntryHash(proposal));
+
     if (cacheProposals.count(proposal.hash))
         cacheProposals[proposal.hash]=proposal;
     else
@@ -532,6 +536,9 @@ bool CStateViewCache::AddCachedVoter(const CVoteMapKey &voter, CVoteMapValue& vo
 
     assert(vote.fDirty == true);
 
+    if (!vote.IsNull())
+        daoStateDelta.Insert(GetDAOStateEntryHash(voter, vote));
+
     if (cacheVotes.count(voter))
         cacheVotes[voter]=vote;
     else
@@ -546,6 +553,9 @@ bool CStateViewCache::AddPaymentRequest(const CPaymentRequest& prequest) const {
 
     assert(prequest.fDirty == true);
 
+    if (!prequest.IsNull())
+        daoStateDelta.Insert(GetDAOStateEntryHash(prequest));
+
     if (cachePaymentRequests.count(prequest.hash))
         cachePaymentRequests[prequest.hash]=prequest;
     else
@@ -560,6 +570,9 @@ bool CStateViewCache::AddConsultation(const CConsultation& consultation) const {
 
     assert(consultation.fDirty == true);
 
+    if (!consultation.IsNull())
+        daoStateDelta.Insert(GetDAOStateEntryHash(consultation));
+
     if (cacheConsultations.count(consultation.hash))
         cacheConsultations[consultation.hash]=consultation;
     else
@@ -577,6 +590,9 @@ bool CStateViewCache::AddConsultationAnswer(const CConsultationAnswer& answer) {
 
     assert(answer.fDirty == true);
 
+    if (!answer.IsNull())
+        daoStateDelta.Insert(GetDAOStateEntryHash(answer));
+
     if (cacheAnswers.count(answer.hash))
         cacheAnswers[answer.hash]=answer;
     else
@@ -586,9 +602,12 @@ bool CStateViewCache::AddConsultationAnswer(const CConsultationAnswer& answer) {
 }
 
 bool CStateViewCache::RemoveProposal(const uint256 &pid) const {
-    if (!HaveProposal(pid))
+    CProposal proposal;
+    if (!GetProposal(pid, proposal))
         return false;
 
+    daoStateDelta.Remove(GetDAOStateEntryHash(proposal));
+
     cacheProposals[pid] = CProposal();
     cacheProposals[pid].SetNull();
 
@@ -598,9 +617,12 @@ bool CStateViewCache::RemoveProposal(const uint256 &pid) const {
 }
 
 bool CStateViewCache::RemovePaymentRequest(const uint256 &prid) const {
-    if (!HavePaymentRequest(prid))
+    CPaymentRequest prequest;
+    if (!GetPaymentRequest(prid, prequest))
         return false;
 
+    daoStateDelta.Remove(GetDAOStateEntryHash(prequest));
+
     cachePaymentRequests[prid] = CPaymentRequest();
     cachePaymentRequests[prid].SetNull();
 
@@ -610,9 +632,12 @@ bool CStateViewCache::RemovePaymentRequest(const uint256 &prid) const {
 }
 
 bool CStateViewCache::RemoveCachedVoter(const CVoteMapKey &voter) const {
-    if (!HaveCachedVoter(voter))
+    CVoteMapValue vote;
+    if (!GetCachedVoter(voter, vote))
         return false;
 
+    daoStateDelta.Remove(GetDAOStateEntryHash(voter, vote));
+
     cacheVotes[voter] = CVoteList();
     cacheVotes[voter].SetNull();
 
@@ -632,6 +657,12 @@ bool CStateViewCache::RemoveConsultation(const uint256 &cid) {
         RemoveConsultationAnswer(it);
     }
 
+    // Removing the answers modified the list of answers of the consultation
+    if (!GetConsultation(cid, consultation))
+        return false;
+
+    daoStateDelta.Remove(GetDAOStateEntryHash(consultation));
+
     cacheConsultations[cid] = CConsultation();
     cacheConsultations[cid].SetNull();
 
@@ -651,6 +682,8 @@ bool CStateViewCache::RemoveConsultationAnswer(const uint256 &cid) {
         if (*it == cid)
             mConsultation->vAnswers.erase(it);
 
+    daoStateDelta.Remove(GetDAOStateEntryHash(answer));
+
     cacheAnswers[cid] = CConsultationAnswer();
     cacheAnswers[cid].SetNull();
 
@@ -659,22 +692,20 @@ bool CStateViewCache::RemoveConsultationAnswer(const uint256 &cid) {
     return true;
 }
 
-const CCoins* CStateViewCache::AccessCoins(const uint256 &txid) const {
-    CCoinsMap::const_iterator it = FetchCoins(txid);
+static const Coin coinEmpty;
+
+const Coin& CStateViewCache::AccessCoin(const COutPoint &outpoint) const {
+    CCoinsMap::const_iterator it = FetchCoin(outpoint);
     if (it == cacheCoins.end()) {
-        return nullptr;
+        return coinEmpty;
     } else {
-        return &it->second.coins;
+        return it->second.coin;
     }
 }
 
-bool CStateViewCache::HaveCoins(const uint256 &txid) const {
-    CCoinsMap::const_iterator it = FetchCoins(txid);
-    // We're using vtx.empty() instead of IsPruned here for performance reasons,
-    // as we only care about the case where a transaction was replaced entirely
-    // in a reorganization (which wipes vout entirely, as opposed to spending
-    // which just cleans individual outputs).
-    return (it != cacheCoins.end() && !it->second.coins.vout.empty());
+bool CStateViewCache::HaveCoin(const COutPoint &outpoint) const {
+    CCoinsMap::const_iterator it = FetchCoin(outpoint);
+    return (it != cacheCoins.end() && !it->second.coin.IsSpent());
 }
 
 bool CStateViewCache::HaveProposal(const uint256 &id) const {
@@ -711,9 +742,9 @@ bool CStateViewCache::HaveConsultationAnswer(const uint256 &cid) const {
     return (it != cacheAnswers.end() && !it->second.IsNull());
 }
 
-bool CStateViewCache::HaveCoinsInCache(const uint256 &txid) const {
-    CCoinsMap::const_iterator it = cacheCoins.find(txid);
-    return it != cacheCoins.end();
+bool CStateViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
+    CCoinsMap::const_iterator it = cacheCoins.find(outpoint);
+    return (it != cacheCoins.end() && !it->second.coin.IsSpent());
 }
 
 bool CStateViewCache::HaveProposalInCache(const uint256 &pid) const {
@@ -738,7 +769,8 @@ void CStateViewCache::SetBestBlock(const uint256 &hashBlockIn) {
 
 bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals, CPaymentRequestMap &mapPaymentRequests,
                                  CVoteMap& mapVotes, CConsultationMap& mapConsultations, CConsultationAnswerMap& mapAnswers,
-                                 CConsensusParameterMap& mapConsensus, const uint256 &hashBlockIn, const int &nCacheExcludeVotesIn) {
+                                 CConsensusParameterMap& mapConsensus, const uint256 &hashBlockIn, const int &nCacheExcludeVotesIn,
+                                 const CMultisetHash& daoStateDeltaIn) {
     assert(!hasModifier);
     assert(!hasModifierConsensus);
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
@@ -747,12 +779,12 @@ bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
             if (itUs == cacheCoins.end()) {
                 // The parent cache does not have an entry, while the child does
                 // We can ignore it if it's both FRESH and pruned in the child
-                if (!(it->second.flags & CCoinsCacheEntry::FRESH && it->second.coins.IsPruned())) {
+                if (!(it->second.flags & CCoinsCacheEntry::FRESH && it->second.coin.IsSpent())) {
                     // Otherwise we will need to create it in the parent
                     // and move the data up and mark it as dirty
                     CCoinsCacheEntry& entry = cacheCoins[it->first];
-                    entry.coins.swap(it->second.coins);
-                    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
+                    entry.coin = std::move(it->second.coin);
+                    cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
                     entry.flags = CCoinsCacheEntry::DIRTY;
                     // We can mark it FRESH in the parent if it was FRESH in the child
                     // Otherwise it might have just been flushed from the parent's cache
@@ -762,17 +794,17 @@ bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
                 }
             } else {
                 // Found the entry in the parent cache
-                if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
+                if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.coin.IsSpent()) {
                     // The grandparent does not have an entry, and the child is
                     // modified and being pruned. This means we can just delete
                     // it from the parent.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+                    cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
                     cacheCoins.erase(itUs);
                 } else {
                     // A normal modification.
-                    cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
-                    itUs->second.coins.swap(it->second.coins);
-                    cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
+                    cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
+                    itUs->second.coin = std::move(it->second.coin);
+                    cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
                     itUs->second.flags |= CCoinsCacheEntry::DIRTY;
                 }
             }
@@ -837,11 +869,12 @@ bool CStateViewCache::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals
 
     hashBlock = hashBlockIn;
     nCacheExcludeVotes = nCacheExcludeVotesIn;
+    daoStateDelta += daoStateDeltaIn;
     return true;
 }
 
 bool CStateViewCache::Flush() {
-    bool fOk = base->BatchWrite(cacheCoins, cacheProposals, cachePaymentRequests, cacheVotes, cacheConsultations, cacheAnswers, cacheConsensus, hashBlock, nCacheExcludeVotes);
+    bool fOk = base->BatchWrite(cacheCoins, cacheProposals, cachePaymentRequests, cacheVotes, cacheConsultations, cacheAnswers, cacheConsensus, hashBlock, nCacheExcludeVotes, daoStateDelta);
     cacheCoins.clear();
     cacheProposals.clear();
     cachePaymentRequests.clear();
@@ -851,14 +884,15 @@ bool CStateViewCache::Flush() {
     cacheConsensus.clear();
     cachedCoinsUsage = 0;
     nCacheExcludeVotes = -1;
+    daoStateDelta.SetNull();
     return fOk;
 }
 
-void CStateViewCache::Uncache(const uint256& hash)
+void CStateViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
     if (it != cacheCoins.end() && it->second.flags == 0) {
-        cachedCoinsUsage -= it->second.coins.DynamicMemoryUsage();
+        cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
         cacheCoins.erase(it);
     }
 }
@@ -869,9 +903,9 @@ unsigned int CStateViewCache::GetCacheSize() const {
 
 const CTxOut &CStateViewCache::GetOutputFor(const CTxIn& input) const
 {
-    const CCoins* coins = AccessCoins(input.prevout.hash);
-    assert(coins && coins->IsAvailable(input.prevout.n));
-    return coins->vout[input.prevout.n];
+    const Coin& coin = AccessCoin(input.prevout);
+    assert(!coin.IsSpent());
+    return coin.out;
 }
 
 CAmount CStateViewCache::GetValueIn(const CTransaction& tx) const
@@ -890,9 +924,7 @@ bool CStateViewCache::HaveInputs(const CTransaction& tx) const
 {
     if (!tx.IsCoinBase()) {
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
-            const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins* coins = AccessCoins(prevout.hash);
-            if (!coins || !coins->IsAvailable(prevout.n)) {
+            if (!HaveCoin(tx.vin[i].prevout)) {
                 return false;
             }
         }
@@ -908,34 +940,27 @@ double CStateViewCache::GetPriority(const CTransaction &tx, int nHeight, CAmount
     double dResult = 0.0;
     for(const CTxIn& txin: tx.vin)
     {
-        const CCoins* coins = AccessCoins(txin.prevout.hash);
-        assert(coins);
-        if (!coins->IsAvailable(txin.prevout.n)) continue;
-        if (coins->nHeight <= nHeight) {
-            dResult += coins->vout[txin.prevout.n].nValue * (nHeight-coins->nHeight);
-            inChainInputValue += coins->vout[txin.prevout.n].nValue;
+        const Coin& coin = AccessCoin(txin.prevout);
+        if (coin.IsSpent()) continue;
+        if (coin.nHeight <= nHeight) {
+            dResult += coin.out.nValue * (nHeight-coin.nHeight);
+            inChainInputValue += coin.out.nValue;
         }
     }
     return tx.ComputePriority(dResult);
 }
 
-CCoinsModifier::CCoinsModifier(CStateViewCache& cache_, CCoinsMap::iterator it_, size_t usage) : cache(cache_), it(it_), cachedCoinUsage(usage) {
-    assert(!cache.hasModifier);
-    cache.hasModifier = true;
-}
+static const size_t MAX_OUTPUTS_PER_BLOCK = MAX_BLOCK_BASE_SIZE / ::GetSerializeSize(CTxOut(), SER_NETWORK, PROTOCOL_VERSION);
 
-CCoinsModifier::~CCoinsModifier()
+const Coin& AccessByTxid(const CStateViewCache& view, const uint256& txid)
 {
-    assert(cache.hasModifier);
-    cache.hasModifier = false;
-    it->second.coins.Cleanup();
-    cache.cachedCoinsUsage -= cachedCoinUsage; // Subtract the old usage
-    if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
-        cache.cacheCoins.erase(it);
-    } else {
-        // If the coin still exists after the modification, add the new usage
-        cache.cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+    COutPoint iter(txid, 0);
+    while (iter.n < MAX_OUTPUTS_PER_BLOCK) {
+        const Coin& alternate = view.AccessCoin(iter);
+        if (!alternate.IsSpent()) return alternate;
+        ++iter.n;
     }
+    return coinEmpty;
 }
 
 CProposalModifier::CProposalModifier(CStateViewCache& cache_, CProposalMap::iterator it_, int height_) : cache(cache_), it(it_), height(height_) {
@@ -956,6 +981,10 @@ CProposalModifier::~CProposalModifier()
     if (prev != it->second)
     {
         it->second.fDirty = true;
+        if (!prev.IsNull())
+            cache.daoStateDelta.Remove(GetDAOStateEntryHash(prev));
+        if (!it->second.IsNull())
+            cache.daoStateDelta.Insert(GetDAOStateEntryHash(it->second));
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString(), prev.diff(it->second));
     }
 }
@@ -978,6 +1007,10 @@ CPaymentRequestModifier::~CPaymentRequestModifier()
     if (prev != it->second)
     {
         it->second.fDirty = true;
+        if (!prev.IsNull())
+            cache.daoStateDelta.Remove(GetDAOStateEntryHash(prev));
+        if (!it->second.IsNull())
+            cache.daoStateDelta.Insert(GetDAOStateEntryHash(it->second));
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString(), prev.diff(it->second));
     }
 }
@@ -1000,6 +1033,10 @@ CVoteModifier::~CVoteModifier()
     if (prev != it->second)
     {
         it->second.fDirty = true;
+        if (!prev.IsNull())
+            cache.daoStateDelta.Remove(GetDAOStateEntryHash(it->first, prev));
+        if (!it->second.IsNull())
+            cache.daoStateDelta.Insert(GetDAOStateEntryHash(it->first, it->second));
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"", HexStr(it->first), prev.diff(it->second));
     }
 }
@@ -1022,6 +1059,10 @@ CConsultationModifier::~CConsultationModifier()
     if (prev != it->second)
     {
         it->second.fDirty = true;
+        if (!prev.IsNull())
+            cache.daoStateDelta.Remove(GetDAOStateEntryHash(prev));
+        if (!it->second.IsNull())
+            cache.daoStateDelta.Insert(GetDAOStateEntryHash(it->second));
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString(), prev.diff(it->second));
     }
 }
@@ -1044,6 +1085,10 @@ CConsultationAnswerModifier::~CConsultationAnswerModifier()
     if (prev != it->second)
     {
         it->second.fDirty = true;
+        if (!prev.IsNull())
+            cache.daoStateDelta.Remove(GetDAOStateEntryHash(prev));
+        if (!it->second.IsNull())
+            cache.daoStateDelta.Insert(GetDAOStateEntryHash(it->second));
         LogPrint("daoextra", "%s: Modified %s%s: %s\n", __func__, height>0?strprintf("at height %d ",height):"",it->first.ToString(), prev.diff(it->second));
     }
 }
@@ -1073,3 +1118,76 @@ CConsensusParameterModifier::~CConsensusParameterModifier()
 CStateViewCursor::~CStateViewCursor()
 {
 }
+
+uint256 GetDAOStateEntryHash(const CProposal& proposal)
+{
+    CHashWriter writer(0,0);
+    writer << 'o' << proposal;
+    return writer.GetHash();
+}
+
+uint256 GetDAOStateEntryHash(const CPaymentRequest& prequest)
+{
+    CHashWriter writer(0,0);
+    writer << 'r' << prequest;
+    return writer.GetHash();
+}
+
+uint256 GetDAOStateEntryHash(const CConsultation& consultation)
+{
+    CHashWriter writer(0,0);
+    writer << 'K' << consultation;
+    return writer.GetHash();
+}
+
+uint256 GetDAOStateEntryHash(const CConsultationAnswer& answer)
+{
+    CHashWriter writer(0,0);
+    writer << 'A' << answer;
+    return writer.GetHash();
+}
+
+uint256 GetDAOStateEntryHash(const CVoteMapKey& voter, const CVoteMapValue& vote)
+{
+    CHashWriter writer(0,0);
+    writer << 'C' << voter << vote;
+    return writer.GetHash();
+}
+
+bool ComputeDAOStateCommitment(CStateView& view, CMultisetHash& commitment)
+{
+    CProposalMap mapProposals;
+    CPaymentRequestMap mapPaymentRequests;
+    CConsultationMap mapConsultations;
+    CConsultationAnswerMap mapAnswers;
+    CVoteMap mapVotes;
+
+    commitment.SetNull();
+
+    if (!view.GetAllProposals(mapProposals) || !view.GetAllPaymentRequests(mapPaymentRequests) ||
+            !view.GetAllConsultations(mapConsultations) || !view.GetAllVotes(mapVotes) ||
+            !view.GetAllConsultationAnswers(mapAnswers))
+        return false;
+
+    for (auto &it: mapProposals)
+        if (!it.second.IsNull())
+            commitment.Insert(GetDAOStateEntryHash(it.second));
+
+    for (auto &it: mapPaymentRequests)
+        if (!it.second.IsNull())
+            commitment.Insert(GetDAOStateEntryHash(it.second));
+
+    for (auto &it: mapConsultations)
+        if (!it.second.IsNull())
+            commitment.Insert(GetDAOStateEntryHash(it.second));
+
+    for (auto &it: mapVotes)
+        if (!it.second.IsNull())
+            commitment.Insert(GetDAOStateEntryHash(it.first, it.second));
+
+    for (auto &it: mapAnswers)
+        if (!it.second.IsNull())
+            commitment.Insert(GetDAOStateEntryHash(it.second));
+
+    return true;
+}
@@ -123,8 +123,15 @@ public:
                 READWRITE(txout.ephemeralKey);
                 READWRITE(txout.outputKey);
                 READWRITE(txout.spendingKey);
-                BulletproofsRangeproof bp = txout.GetBulletproof();
-                READWRITE(bp);
+                if (txout.bp.empty())
+                {
+                    BulletproofsRangeproof bp;
+                    READWRITE(bp);
+                }
+                else
+                {
+                    READWRITE(REF(CFlatData(txout.bp)));
+                }
             }
             else
             {
@@ -143,7 +150,8 @@ public:
                 READWRITE(txout.spendingKey);
                 BulletproofsRangeproof bp_;
                 READWRITE(bp_);
-                txout.bp = bp_.GetVch();
+                // Only the serialized proof is kept, coins rarely need it decoded
+                txout.SetBulletproof(bp_.GetVch());
             }
             else
             {
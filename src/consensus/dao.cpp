@@ -3374,78 +3374,51 @@ uint256 GetConsensusStateHash(CStateViewCache& view)
     return ret;
 }
 
-uint256 GetDAOStateHash(CStateViewCache& view, const CAmount& nCFLocked, const CAmount& nCFSupply)
+static uint256 FinalizeDAOStateHash(CStateViewCache& view, const CMultisetHash& commitment, const CAmount& nCFLocked, const CAmount& nCFSupply)
 {
-    CPaymentRequestMap mapPaymentRequests;
-    CProposalMap mapProposals;
-    CConsultationMap mapConsultations;
-    CConsultationAnswerMap mapAnswers;
-    CVoteMap mapVotes;
-
-    int64_t nTimeStart = GetTimeMicros();
-
     CHashWriter writer(0,0);
 
     writer << nCFSupply;
     writer << nCFLocked;
+    writer << commitment.Finalize();
 
-    if (view.GetAllProposals(mapProposals) && view.GetAllPaymentRequests(mapPaymentRequests) &&
-            view.GetAllConsultations(mapConsultations) && view.GetAllVotes(mapVotes) &&
-            view.GetAllConsultationAnswers(mapAnswers))
+    for (unsigned int i = 0; i < Consensus::MAX_CONSENSUS_PARAMS; i++)
     {
+        Consensus::ConsensusParamsPos id = (Consensus::ConsensusParamsPos)i;
+        writer << GetConsensusParameter(id, view);
+    }
 
-        for (auto &it: mapProposals)
-        {
-            if (!it.second.IsNull())
-            {
-                writer << it.second;
-            }
-        }
+    return writer.GetHash();
+}
 
-        for (auto &it: mapPaymentRequests)
-        {
-            if (!it.second.IsNull())
-            {
-                writer << it.second;
-            }
-        }
+uint256 GetDAOStateHash(CStateViewCache& view, const CAmount& nCFLocked, const CAmount& nCFSupply)
+{
+    int64_t nTimeStart = GetTimeMicros();
 
-        for (auto &it: mapConsultations)
-        {
-            if (!it.second.IsNull())
-            {
-                writer << it.second;
-            }
-        }
+    CMultisetHash commitment;
 
-        for (auto &it: mapVotes)
-        {
-            if (!it.second.IsNull())
-            {
-                writer << it.first;
-                writer << it.second.GetList();
-            }
-        }
+    // The commitment is maintained incrementally by the view, only fall back
+    // to walking all the entries when its backend does not keep one.
+    if (!view.GetDAOStateCommitment(commitment))
+        ComputeDAOStateCommitment(view, commitment);
 
-        for (auto &it: mapAnswers)
-        {
-            if (!it.second.IsNull())
-            {
-                writer << it.second;
-            }
-        }
+    uint256 ret = FinalizeDAOStateHash(view, commitment, nCFLocked, nCFSupply);
+    int64_t nTimeEnd = GetTimeMicros();
+    LogPrint("bench", " Benchmark: Calculate CFundDB state hash: %.2fms\n", (nTimeEnd - nTimeStart) * 0.001);
 
-        for (unsigned int i = 0; i < Consensus::MAX_CONSENSUS_PARAMS; i++)
-        {
-            Consensus::ConsensusParamsPos id = (Consensus::ConsensusParamsPos)i;
-            writer << GetConsensusParameter(id, view);
-        }
+    return ret;
+}
 
-    }
+uint256 GetDAOStateHashFullScan(CStateViewCache& view, const CAmount& nCFLocked, const CAmount& nCFSupply)
+{
+    int64_t nTimeStart = GetTimeMicros();
 
-    uint256 ret = writer.GetHash();
+    CMultisetHash commitment;
+    ComputeDAOStateCommitment(view, commitment);
+
+    uint256 ret = FinalizeDAOStateHash(view, commitment, nCFLocked, nCFSupply);
     int64_t nTimeEnd = GetTimeMicros();
-    LogPrint("bench", " Benchmark: Calculate CFundDB state hash: %.2fms\n", (nTimeEnd - nTimeStart) * 0.001);
+    LogPrint("bench", " Benchmark: Calculate CFundDB state hash (full scan): %.2fms\n", (nTimeEnd - nTimeStart) * 0.001);
 
     return ret;
 }
@@ -40,6 +40,7 @@ bool Support(uint256 hash, bool &duplicate);
 bool RemoveSupport(string str);
 
 uint256 GetDAOStateHash(CStateViewCache& view, const CAmount& nCFLocked, const CAmount& nCFSupply);
+uint256 GetDAOStateHashFullScan(CStateViewCache& view, const CAmount& nCFLocked, const CAmount& nCFSupply);
 uint256 GetConsensusStateHash(CStateViewCache& view);
 
 void GetVersionMask(uint64_t& nProposalMask, uint64_t& nPaymentRequestMask, uint64_t& nConsultationMask, uint64_t& nConsultatioAnswernMask, CBlockIndex* pindex);
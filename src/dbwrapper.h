@@ -83,6 +83,17 @@ public:
 
         batch.Delete(slKey);
     }
+
+    void Clear()
+    {
+        batch.Clear();
+    }
+
+    //! Approximate size of the data queued in the batch
+    size_t SizeEstimate() const
+    {
+        return batch.ApproximateSize();
+    }
 };
 
 class CDBIterator
@@ -146,6 +157,19 @@ public:
         return piter->value().size();
     }
 
+    /** The raw value, deobfuscated, so it can be deserialized later or on another thread */
+    bool GetValueStream(CDataStream& ssValue) {
+        leveldb::Slice slValue = piter->value();
+        try {
+            CDataStream ssCopy(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            ssCopy.Xor(dbwrapper_private::GetObfuscateKey(parent));
+            ssValue = std::move(ssCopy);
+        } catch (const std::exception&) {
+            return false;
+        }
+        return true;
+    }
+
 };
 
 class CDBWrapper
@@ -273,6 +297,19 @@ public:
         return WriteBatch(batch, true);
     }
 
+    template<typename K>
+    void CompactRange(const K& key_begin, const K& key_end) const
+    {
+        CDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        ssKey1.reserve(ssKey1.GetSerializeSize(key_begin));
+        ssKey2.reserve(ssKey2.GetSerializeSize(key_end));
+        ssKey1 << key_begin;
+        ssKey2 << key_end;
+        leveldb::Slice slKey1(&ssKey1[0], ssKey1.size());
+        leveldb::Slice slKey2(&ssKey2[0], ssKey2.size());
+        pdb->CompactRange(&slKey1, &slKey2);
+    }
+
     CDBIterator *NewIterator()
     {
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
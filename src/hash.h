@@ -205,4 +205,10 @@ public:
  */
 uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
 
+/** Optimized SipHash-2-4 of a uint256 followed by a 32-bit integer, as used
+ *  to hash outpoints. It is identical to the SipHash of the 36 bytes of val
+ *  and extra (little endian).
+ */
+uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
+
 #endif // NAVCOIN_HASH_H
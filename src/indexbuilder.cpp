@@ -0,0 +1,454 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <indexbuilder.h>
+
+#include <chainparams.h>
+#include <indexwriter.h>
+#include <main.h>
+#include <txdb.h>
+#include <util.h>
+
+#include <boost/bind.hpp>
+
+CIndexBuilder indexBuilder;
+
+struct CIndexOption
+{
+    const char* name;
+    bool* flag;
+    bool fDefault;
+};
+
+static const CIndexOption indexOptions[] = {
+    {"txindex", &fTxIndex, DEFAULT_TXINDEX},
+    {"addressindex", &fAddressIndex, DEFAULT_ADDRESSINDEX},
+    {"spentindex", &fSpentIndex, DEFAULT_SPENTINDEX},
+    {"timestampindex", &fTimestampIndex, DEFAULT_TIMESTAMPINDEX},
+};
+
+static const CIndexOption* GetIndexOption(const std::string& name)
+{
+    for (const CIndexOption& option: indexOptions)
+        if (name == option.name)
+            return &option;
+
+    return nullptr;
+}
+
+CIndexBuilder::CIndexBuilder() : fRunning(false)
+{
+}
+
+CIndexBuilder::~CIndexBuilder()
+{
+    Stop();
+}
+
+std::vector<std::string> CIndexBuilder::GetNames()
+{
+    std::vector<std::string> vNames;
+
+    for (const CIndexOption& option: indexOptions)
+        vNames.push_back(option.name);
+
+    return vNames;
+}
+
+bool CIndexBuilder::IsEnabled(const std::string& name)
+{
+    const CIndexOption* option = GetIndexOption(name);
+
+    return option && *option->flag;
+}
+
+bool CIndexBuilder::Init(std::string& strError)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        mapStatus.clear();
+    }
+
+    bool fAllIndex = GetBoolArg("-allindex", false);
+
+    for (const CIndexOption& option: indexOptions)
+    {
+        std::string name = option.name;
+        bool fBuilding = false;
+        bool fDropping = false;
+
+        pblocktree->ReadFlag(name + "building", fBuilding);
+        pblocktree->ReadFlag(name + "dropping", fDropping);
+
+        if (fBuilding || fDropping)
+        {
+            int nHeight = -1;
+            uint256 hashBest;
+
+            if (fBuilding && pblocktree->ReadIndexBestBlock(name, hashBest) && !hashBest.IsNull())
+            {
+                LOCK(cs_main);
+                BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+                if (mi != mapBlockIndex.end())
+                    nHeight = mi->second->nHeight;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            CIndexBuildStatus& status = mapStatus[name];
+            status.fBuilding = fBuilding;
+            status.fDropping = fDropping && !fBuilding;
+            status.nHeight = nHeight;
+
+            LogPrintf("%s: resuming to %s %s\n", __func__, fBuilding ? "build" : "drop", name);
+        }
+
+        // An index which was built before is only dropped when its option is turned off explicitly
+        bool fWanted = fAllIndex || GetBoolArg("-" + name, option.fDefault);
+
+        if (fWanted && !*option.flag && !fBuilding)
+        {
+            if (!Build(name, strError))
+                return false;
+        }
+        else if (!fWanted && mapArgs.count("-" + name) && (*option.flag || fBuilding))
+        {
+            if (!Drop(name, strError))
+                return false;
+        }
+        else if (!fWanted && *option.flag)
+        {
+            LogPrintf("%s: keeping %s, start with -%s=0 to drop it\n", __func__, name, name);
+        }
+    }
+
+    return true;
+}
+
+void CIndexBuilder::Start()
+{
+    if (fRunning)
+        return;
+
+    thread = boost::thread(boost::bind(&CIndexBuilder::Thread, this));
+    fRunning = true;
+}
+
+void CIndexBuilder::Stop()
+{
+    if (!fRunning)
+        return;
+
+    thread.interrupt();
+    thread.join();
+    fRunning = false;
+}
+
+bool CIndexBuilder::Build(const std::string& name, std::string& strError)
+{
+    const CIndexOption* option = GetIndexOption(name);
+
+    if (!option) {
+        strError = strprintf(_("Unknown index %s"), name);
+        return false;
+    }
+
+    if (fPruneMode || fHavePruned) {
+        strError = strprintf(_("%s can not be built on a pruned node"), name);
+        return false;
+    }
+
+    LOCK(cs_main);
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    if (*option->flag) {
+        strError = strprintf(_("%s is already enabled"), name);
+        return false;
+    }
+
+    CIndexBuildStatus& status = mapStatus[name];
+
+    if (status.fBuilding && !status.fFailed) {
+        strError = strprintf(_("%s is already being built"), name);
+        return false;
+    }
+
+    // A null best block makes the build erase what an earlier one left first
+    if (!pblocktree->WriteIndexBestBlock(name, uint256()) ||
+        !pblocktree->WriteFlag(name + "dropping", false) ||
+        !pblocktree->WriteFlag(name + "building", true)) {
+        strError = _("Failed to write to the block database");
+        return false;
+    }
+
+    status.fBuilding = true;
+    status.fDropping = false;
+    status.fFailed = false;
+    status.nHeight = -1;
+    status.nGeneration++;
+
+    condWork.notify_one();
+
+    LogPrintf("%s: building %s\n", __func__, name);
+
+    return true;
+}
+
+bool CIndexBuilder::Drop(const std::string& name, std::string& strError)
+{
+    const CIndexOption* option = GetIndexOption(name);
+
+    if (!option) {
+        strError = strprintf(_("Unknown index %s"), name);
+        return false;
+    }
+
+    LOCK(cs_main);
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    std::map<std::string, CIndexBuildStatus>::iterator it = mapStatus.find(name);
+    bool fBuilding = it != mapStatus.end() && it->second.fBuilding;
+
+    if (!*option->flag && !fBuilding) {
+        strError = strprintf(it != mapStatus.end() ? _("%s is already being dropped") : _("%s is not enabled"), name);
+        return false;
+    }
+
+    if (!pblocktree->WriteFlag(name, false) ||
+        !pblocktree->WriteFlag(name + "building", false) ||
+        !pblocktree->WriteFlag(name + "dropping", true)) {
+        strError = _("Failed to write to the block database");
+        return false;
+    }
+
+    // ConnectBlock stops adding entries to it from here on
+    *option->flag = false;
+
+    CIndexBuildStatus& status = mapStatus[name];
+    status.fBuilding = false;
+    status.fDropping = true;
+    status.fFailed = false;
+    status.nHeight = -1;
+    status.nGeneration++;
+
+    condWork.notify_one();
+
+    LogPrintf("%s: dropping %s\n", __func__, name);
+
+    return true;
+}
+
+bool CIndexBuilder::IsBuilding(const std::string& name, int& nHeight) const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    std::map<std::string, CIndexBuildStatus>::const_iterator it = mapStatus.find(name);
+    if (it == mapStatus.end() || !it->second.fBuilding)
+        return false;
+
+    nHeight = it->second.nHeight;
+
+    return true;
+}
+
+std::map<std::string, CIndexBuildStatus> CIndexBuilder::GetStatus() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return mapStatus;
+}
+
+// Requires mutex
+bool CIndexBuilder::GetPending(std::string& name, CIndexBuildStatus& status)
+{
+    for (const auto& it: mapStatus)
+    {
+        if ((it.second.fBuilding || it.second.fDropping) && !it.second.fFailed)
+        {
+            name = it.first;
+            status = it.second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void CIndexBuilder::Thread()
+{
+    RenameThread("navcoin-indexbuilder");
+
+    try
+    {
+        while (true)
+        {
+            std::string name;
+            CIndexBuildStatus status;
+
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!GetPending(name, status))
+                    condWork.wait(lock);
+            }
+
+            bool fOk;
+
+            if (status.fDropping || status.nHeight < 0)
+            {
+                bool fDone = false;
+                fOk = Erase(name, status.nGeneration, fDone);
+
+                if (fOk && fDone)
+                {
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    CIndexBuildStatus& current = mapStatus[name];
+
+                    if (current.nGeneration != status.nGeneration) {
+                        continue;
+                    } else if (current.fDropping) {
+                        fOk = pblocktree->WriteFlag(name + "dropping", false);
+                        mapStatus.erase(name);
+                        LogPrintf("%s: dropped %s\n", __func__, name);
+                    } else {
+                        // The transactions of the genesis block are not indexed
+                        fOk = pblocktree->WriteIndexBestBlock(name, Params().GetConsensus().hashGenesisBlock);
+                        current.nHeight = 0;
+                    }
+                }
+            }
+            else
+            {
+                fOk = BuildBatch(name, status.nGeneration);
+            }
+
+            if (!fOk)
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                CIndexBuildStatus& current = mapStatus[name];
+
+                if (current.nGeneration == status.nGeneration) {
+                    current.fFailed = true;
+                    strMiscWarning = strprintf(_("Warning: Failed to %s %s, see debug.log for details"), status.fDropping ? "drop" : "build", name);
+                    LogPrintf("*** %s\n", strMiscWarning);
+                }
+            }
+        }
+    }
+    catch (const boost::thread_interrupted&)
+    {
+    }
+}
+
+bool CIndexBuilder::Erase(const std::string& name, int nGeneration, bool& fDone)
+{
+    fDone = false;
+
+    // Nothing of the index may still be waiting in the index writer
+    if (!indexWriter.Sync())
+        return false;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    if (mapStatus[name].nGeneration != nGeneration)
+        return true;
+
+    return pblocktree->EraseIndex(name, INDEX_BUILDER_ERASE_BATCH, fDone);
+}
+
+bool CIndexBuilder::BuildBatch(const std::string& name, int nGeneration)
+{
+    std::vector<const CBlockIndex*> vBlocks;
+
+    {
+        LOCK(cs_main);
+
+        uint256 hashBest;
+        BlockMap::iterator mi = mapBlockIndex.end();
+
+        if (pblocktree->ReadIndexBestBlock(name, hashBest))
+            mi = mapBlockIndex.find(hashBest);
+
+        if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+        {
+            // Only the last blocks are indexed holding cs_main, so a deep enough
+            // reorganization leaves the build on a block which is no longer active
+            LogPrintf("%s: %s was built up to block %s, which is not active any more. Building it again\n", __func__, name, hashBest.ToString());
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            CIndexBuildStatus& status = mapStatus[name];
+
+            if (status.nGeneration != nGeneration)
+                return true;
+
+            status.nHeight = -1;
+
+            return pblocktree->WriteIndexBestBlock(name, uint256());
+        }
+
+        int nHeight = mi->second->nHeight;
+
+        // The last blocks are indexed without letting the tip move, then the index is switched on
+        if (chainActive.Height() - nHeight <= 2 * INDEX_BUILDER_BATCH)
+        {
+            for (int i = nHeight + 1; i <= chainActive.Height(); i++)
+                vBlocks.push_back(chainActive[i]);
+
+            return WriteBlocks(name, nGeneration, vBlocks, true);
+        }
+
+        for (int i = nHeight + 1; i <= nHeight + INDEX_BUILDER_BATCH; i++)
+            vBlocks.push_back(chainActive[i]);
+    }
+
+    return WriteBlocks(name, nGeneration, vBlocks, false);
+}
+
+bool CIndexBuilder::WriteBlocks(const std::string& name, int nGeneration, const std::vector<const CBlockIndex*>& vBlocks, bool fFinish)
+{
+    bool fTimestamp = name == "timestampindex";
+    unsigned int nLogicalTimestamp = 0;
+
+    // The logical timestamps follow the one of the last block built, which
+    // is none for the genesis block
+    if (fTimestamp && !vBlocks.empty() && vBlocks[0]->pprev->pprev)
+        if (!pblocktree->ReadTimestampBlockIndex(vBlocks[0]->pprev->GetBlockHash(), nLogicalTimestamp))
+            return error("%s: failed to read the logical timestamp of block %s", __func__, vBlocks[0]->pprev->GetBlockHash().ToString());
+
+    std::vector<CIndexUpdate> vUpdates(vBlocks.size());
+
+    for (size_t i = 0; i < vBlocks.size(); i++)
+    {
+        boost::this_thread::interruption_point();
+
+        if (!ReadIndexUpdate(vBlocks[i], name == "txindex", name == "addressindex", name == "spentindex", fTimestamp,
+                             nLogicalTimestamp, vUpdates[i]))
+            return false;
+
+        vUpdates[i].vIndexes.push_back(name);
+        nLogicalTimestamp = vUpdates[i].nLogicalTimestamp;
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    CIndexBuildStatus& status = mapStatus[name];
+
+    if (status.nGeneration != nGeneration || !status.fBuilding)
+        return true;
+
+    if (!pblocktree->WriteIndexUpdates(vUpdates))
+        return error("%s: failed to write %s", __func__, name);
+
+    if (!vBlocks.empty())
+        status.nHeight = vBlocks.back()->nHeight;
+
+    if (fFinish)
+    {
+        if (!pblocktree->WriteFlag(name, true) || !pblocktree->WriteFlag(name + "building", false))
+            return error("%s: failed to enable %s", __func__, name);
+
+        *GetIndexOption(name)->flag = true;
+        mapStatus.erase(name);
+
+        LogPrintf("%s: %s is synced and enabled\n", __func__, name);
+    }
+
+    return true;
+}
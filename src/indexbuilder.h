@@ -0,0 +1,91 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_INDEXBUILDER_H
+#define NAVCOIN_INDEXBUILDER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CBlockIndex;
+
+/** Blocks read from disk and written per batch while building an index */
+static const int INDEX_BUILDER_BATCH = 100;
+/** Entries erased per batch while dropping an index */
+static const size_t INDEX_BUILDER_ERASE_BATCH = 100000;
+
+struct CIndexBuildStatus
+{
+    bool fBuilding;
+    bool fDropping;
+    bool fFailed;
+    //! Height of the last block indexed by the build, -1 while old entries are erased
+    int nHeight;
+    //! Bumped by every request, so the thread drops the work of a cancelled one
+    int nGeneration;
+
+    CIndexBuildStatus() : fBuilding(false), fDropping(false), fFailed(false), nHeight(-1), nGeneration(0) {}
+};
+
+/**
+ * Builds the optional indexes (-txindex, -addressindex, -spentindex and
+ * -timestampindex) enabled after the chain was synced, and erases the ones
+ * which are dropped, from a background thread while the node keeps running.
+ *
+ * A build first erases whatever an earlier build or drop left behind, then
+ * indexes the active chain from the block and undo files in batches which also
+ * store the block the index reached. Once it is close to the tip the last
+ * blocks are indexed holding cs_main and the index is switched on, so from
+ * there on ConnectBlock keeps it up to date. Until then the index is reported
+ * as syncing. A reorganization below the blocks already built starts it over.
+ *
+ * The state of every build and drop is stored in the block tree flags, so they
+ * are resumed after a restart.
+ */
+class CIndexBuilder
+{
+public:
+    CIndexBuilder();
+    ~CIndexBuilder();
+
+    /** Resumes the builds and drops of the last run and applies the command line */
+    bool Init(std::string& strError);
+    void Start();
+    void Stop();
+
+    bool Build(const std::string& name, std::string& strError);
+    bool Drop(const std::string& name, std::string& strError);
+
+    /** Whether the index is being built, and the height it reached */
+    bool IsBuilding(const std::string& name, int& nHeight) const;
+    std::map<std::string, CIndexBuildStatus> GetStatus() const;
+
+    /** Names of all the optional indexes */
+    static std::vector<std::string> GetNames();
+    /** Whether the index is enabled and kept up to date at the tip */
+    static bool IsEnabled(const std::string& name);
+
+private:
+    void Thread();
+    bool GetPending(std::string& name, CIndexBuildStatus& status);
+    bool Erase(const std::string& name, int nGeneration, bool& fDone);
+    bool BuildBatch(const std::string& name, int nGeneration);
+    bool WriteBlocks(const std::string& name, int nGeneration, const std::vector<const CBlockIndex*>& vBlocks, bool fFinish);
+
+    mutable boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::thread thread;
+    bool fRunning;
+
+    std::map<std::string, CIndexBuildStatus> mapStatus;
+};
+
+extern CIndexBuilder indexBuilder;
+
+#endif // NAVCOIN_INDEXBUILDER_H
@@ -0,0 +1,259 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <indexwriter.h>
+
+#include <init.h>
+#include <main.h>
+#include <ui_interface.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <boost/bind.hpp>
+
+CIndexWriter indexWriter;
+
+CIndexWriter::CIndexWriter() : pdb(nullptr), nPendingEntries(0), fWriting(false), fRunning(false), fStop(false),
+    fFailed(false), nSyncRequests(0), nLastTimestamp(0)
+{
+}
+
+CIndexWriter::~CIndexWriter()
+{
+    Stop();
+}
+
+std::vector<std::string> CIndexWriter::GetIndexNames()
+{
+    std::vector<std::string> vIndexes;
+
+    if (fTxIndex)
+        vIndexes.push_back("txindex");
+    if (fAddressIndex)
+        vIndexes.push_back("addressindex");
+    if (fSpentIndex)
+        vIndexes.push_back("spentindex");
+    if (fTimestampIndex)
+        vIndexes.push_back("timestampindex");
+
+    return vIndexes;
+}
+
+void CIndexWriter::Start(CBlockTreeDB* pdbIn)
+{
+    Stop();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    pdb = pdbIn;
+    mapPendingTx.clear();
+    fStop = false;
+    fFailed = false;
+    fRunning = true;
+    thread = boost::thread(boost::bind(&CIndexWriter::Thread, this));
+}
+
+void CIndexWriter::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fRunning)
+            return;
+        fStop = true;
+    }
+
+    condWork.notify_all();
+    thread.join();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fRunning = false;
+    pdb = nullptr;
+    condDone.notify_all();
+}
+
+bool CIndexWriter::Write(const std::vector<CIndexUpdate>& vUpdates)
+{
+    int64_t nStart = GetTimeMicros();
+    CBlockTreeDB* db = pdb ? pdb : pblocktree;
+
+    if (!db || !db->WriteIndexUpdates(vUpdates))
+    {
+        strMiscWarning = "Failed to write the block indexes";
+        LogPrintf("*** %s\n", strMiscWarning);
+        uiInterface.ThreadSafeMessageBox(_("Error: A fatal internal error occurred, see debug.log for details"),
+                                         "", CClientUIInterface::MSG_ERROR);
+        StartShutdown();
+        return false;
+    }
+
+    LogPrint("bench", "    - Index batch of %u blocks: %.2fms\n", vUpdates.size(), 0.001 * (GetTimeMicros() - nStart));
+
+    return true;
+}
+
+void CIndexWriter::Thread()
+{
+    RenameThread("navcoin-indexwriter");
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    while (true)
+    {
+        // Wait for enough updates to fill a batch, unless somebody needs them written
+        while (!fStop && (queue.empty() || (queue.size() < INDEX_WRITER_MAX_BATCH && nSyncRequests == 0 &&
+                                            nPendingEntries < INDEX_WRITER_MAX_PENDING_ENTRIES)))
+        {
+            if (queue.empty())
+                condWork.wait(lock);
+            else if (!condWork.timed_wait(lock, boost::posix_time::milliseconds(INDEX_WRITER_INTERVAL)))
+                break;
+        }
+
+        if (queue.empty())
+        {
+            if (fStop)
+                return;
+            continue;
+        }
+
+        std::vector<CIndexUpdate> vUpdates;
+        size_t nEntries = 0;
+
+        while (!queue.empty() && vUpdates.size() < INDEX_WRITER_MAX_BATCH)
+        {
+            nEntries += queue.front().GetEntryCount();
+            vUpdates.push_back(std::move(queue.front()));
+            queue.pop_front();
+        }
+
+        fWriting = true;
+        lock.unlock();
+
+        bool fOk = fFailed ? false : Write(vUpdates);
+
+        lock.lock();
+
+        // Written now, unless a later update moved the transaction again
+        for (const CIndexUpdate& update: vUpdates)
+        {
+            for (const auto& it: update.vTxIndex)
+            {
+                std::map<uint256, CDiskTxPos>::iterator mi = mapPendingTx.find(it.first);
+                if (mi != mapPendingTx.end() && mi->second == it.second && mi->second.nTxOffset == it.second.nTxOffset)
+                    mapPendingTx.erase(mi);
+            }
+        }
+
+        fWriting = false;
+        fFailed |= !fOk;
+        nPendingEntries -= nEntries;
+        condDone.notify_all();
+    }
+}
+
+bool CIndexWriter::Push(CIndexUpdate& update)
+{
+    // An index switched off or on later must not see its best block moved
+    // by updates built for the previous set
+    update.vIndexes = GetIndexNames();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    if (update.fTimestampIndex)
+    {
+        hashLastTimestamp = update.hashBlock;
+        nLastTimestamp = update.nLogicalTimestamp;
+    }
+
+    if (!fRunning)
+    {
+        lock.unlock();
+        return Write(std::vector<CIndexUpdate>(1, update));
+    }
+
+    // Let the writer catch up before the queue takes too much memory
+    while (nPendingEntries >= INDEX_WRITER_MAX_PENDING_ENTRIES && !fFailed)
+    {
+        condWork.notify_one();
+        condDone.wait(lock);
+    }
+
+    if (fFailed)
+        return false;
+
+    for (const auto& it: update.vTxIndex)
+        mapPendingTx[it.first] = it.second;
+
+    nPendingEntries += update.GetEntryCount();
+    queue.push_back(std::move(update));
+
+    condWork.notify_one();
+
+    return true;
+}
+
+bool CIndexWriter::Sync()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    if (!fRunning)
+        return !fFailed;
+
+    nSyncRequests++;
+    condWork.notify_one();
+
+    while ((!queue.empty() || fWriting) && !fFailed)
+        condDone.wait(lock);
+
+    nSyncRequests--;
+
+    return !fFailed;
+}
+
+bool CIndexWriter::ReadTxIndex(const uint256& txid, CDiskTxPos& pos)
+{
+    CBlockTreeDB* db;
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+
+        if (fFailed)
+            return false;
+
+        std::map<uint256, CDiskTxPos>::const_iterator it = mapPendingTx.find(txid);
+        if (it != mapPendingTx.end())
+        {
+            pos = it->second;
+            return true;
+        }
+
+        db = pdb ? pdb : pblocktree;
+    }
+
+    // Not pending, so either written already or unknown. Updates are only
+    // pushed holding cs_main, like the callers
+    return db && db->ReadTxIndex(txid, pos);
+}
+
+bool CIndexWriter::GetLogicalTimestamp(const uint256& hashBlock, unsigned int& nLogicalTimestamp)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (hashBlock == hashLastTimestamp)
+        {
+            nLogicalTimestamp = nLastTimestamp;
+            return true;
+        }
+    }
+
+    CBlockTreeDB* db = pdb ? pdb : pblocktree;
+
+    return Sync() && db && db->ReadTimestampBlockIndex(hashBlock, nLogicalTimestamp);
+}
+
+size_t CIndexWriter::GetPending() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
@@ -0,0 +1,94 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_INDEXWRITER_H
+#define NAVCOIN_INDEXWRITER_H
+
+#include <txdb.h>
+#include <uint256.h>
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/** Blocks coalesced at most in one index write */
+static const unsigned int INDEX_WRITER_MAX_BATCH = 2000;
+/** Milliseconds an update waits at most to be joined by the next ones */
+static const int64_t INDEX_WRITER_INTERVAL = 500;
+/** Pending entries after which the validation thread waits for the writer */
+static const size_t INDEX_WRITER_MAX_PENDING_ENTRIES = 2000000;
+
+/**
+ * Writes the transaction, address, spent and timestamp index entries of the
+ * connected and disconnected blocks from a background thread, joining the
+ * updates of many blocks in one database batch. Every batch also stores the
+ * block the indexes are synced to, so after a crash they can be compared with
+ * the chain state.
+ *
+ * The chain state is only flushed after the pending updates are written, and
+ * the readers of the indexes call Sync() first, so they never see the indexes
+ * behind the chain tip. Transaction lookups, which validation also does, find
+ * the pending entries in memory instead of waiting for them.
+ */
+class CIndexWriter
+{
+public:
+    CIndexWriter();
+    ~CIndexWriter();
+
+    void Start(CBlockTreeDB* pdbIn);
+    /** Writes the pending updates and stops the thread */
+    void Stop();
+
+    /** Queues an update, or writes it right away when the thread is not running */
+    bool Push(CIndexUpdate& update);
+
+    /** Waits until the queued updates are written, returns false if a write failed */
+    bool Sync();
+
+    /** Position of a transaction in the tx index, pending or already written */
+    bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
+
+    /** Logical timestamp of the given block for the timestamp index */
+    bool GetLogicalTimestamp(const uint256& hashBlock, unsigned int& nLogicalTimestamp);
+
+    size_t GetPending() const;
+
+    /** Names of the indexes whose best block is kept by the writer */
+    static std::vector<std::string> GetIndexNames();
+
+private:
+    void Thread();
+    bool Write(const std::vector<CIndexUpdate>& vUpdates);
+
+    CBlockTreeDB* pdb;
+
+    mutable boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    boost::thread thread;
+
+    std::deque<CIndexUpdate> queue;
+    //! Transactions of the updates queued or being written, at their last position
+    std::map<uint256, CDiskTxPos> mapPendingTx;
+    size_t nPendingEntries;
+    bool fWriting;
+    bool fRunning;
+    bool fStop;
+    bool fFailed;
+    int nSyncRequests;
+
+    //! Logical timestamp of the last connected block
+    uint256 hashLastTimestamp;
+    unsigned int nLastTimestamp;
+};
+
+extern CIndexWriter indexWriter;
+
+#endif // NAVCOIN_INDEXWRITER_H
@@ -18,9 +18,12 @@
 #include <compat/sanity.h>
 #include <consensus/validation.h>
 #include <blsct/aggregationsession.h>
+#include <blsct/multiexp.h>
 #include <blsct/rpc.h>
 #include <httpserver.h>
 #include <httprpc.h>
+#include <indexbuilder.h>
+#include <indexwriter.h>
 #include <kernel.h>
 #include <key.h>
 #include <main.h>
@@ -80,6 +83,7 @@ static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_DISABLE_SAFEMODE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
+static const bool DEFAULT_BULLETPROOFS_CACHE = true;
 
 unsigned int nMinerSleep;
 
@@ -184,9 +188,9 @@ class CStateViewErrorCatcher : public CStateViewBacked
 {
 public:
     CStateViewErrorCatcher(CStateView* view) : CStateViewBacked(view) {}
-    bool GetCoins(const uint256 &txid, CCoins &coins) const {
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const {
         try {
-            return CStateViewBacked::GetCoins(txid, coins);
+            return CStateViewBacked::GetCoin(outpoint, coin);
         } catch(const std::runtime_error& e) {
             uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
             LogPrintf("Error reading from database: %s\n", e.what());
@@ -263,7 +267,10 @@ void PrepareShutdown()
 #endif
     StopNode();
     torController.Stop();
+    indexBuilder.Stop();
     UnregisterNodeSignals(GetNodeSignals());
+    if (IsMempoolLoaded() && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
 
     if (fFeeEstimatesInitialized)
     {
@@ -287,6 +294,7 @@ void PrepareShutdown()
         pcoinscatcher = nullptr;
         delete pcoinsdbview;
         pcoinsdbview = nullptr;
+        indexWriter.Stop();
         delete pblocktree;
         pblocktree = nullptr;
     }
@@ -393,6 +401,7 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
     strUsage += HelpMessageOpt("-bootstrap=<url>", _("Specifies an URL from where a bootstrapped copy of the blockchain would be downloaded"));
+    strUsage += HelpMessageOpt("-bulletproofscache", strprintf(_("Keep the bulletproof generators cached in the data directory (default: %u)"), DEFAULT_BULLETPROOFS_CACHE));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), NAVCOIN_CONF_FILENAME));
@@ -410,9 +419,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool and the stempool on shutdown and load them on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-minersleep=<n>", strprintf(_("Sets the default sleep for the staking thread (default: %u)"), 500));
     strUsage += HelpMessageOpt("-mininputvalue=<n>", strprintf(_("Sets the minimum value for an output to be considered as a coinstake kernel candidate")));
-    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script and BLSCT verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
                                                      -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), NAVCOIN_PID_FILENAME));
@@ -507,7 +517,10 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt("-checkdaostatehash", "Cross-check the incrementally maintained DAO state hash against a full scan of the DAO database on every block (default: 0)");
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
+        strUsage += HelpMessageOpt("-multiexpthreads=<n>", strprintf("Number of threads for the large multi-exponentiations of range proof batch verification (1 to %d, default: %d)", MAX_MULTIEXP_THREADS, DEFAULT_MULTIEXP_THREADS));
+        strUsage += HelpMessageOpt("-verifyblockindexhashes", strprintf("Recompute the hash of every block index entry on startup instead of trusting its key (default: %u)", DEFAULT_VERIFY_BLOCK_INDEX_HASHES));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
@@ -534,6 +547,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
+        strUsage += HelpMessageOpt("-maxblsctcachesize=<n>", strprintf("Limit size of the cache of verified BLSCT transactions to <n> MiB (default: %u)", DEFAULT_MAX_BLSCT_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
@@ -547,6 +561,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blsctmix", _("Turn on/off the blsct mixing threads"));
     strUsage += HelpMessageOpt("-blsctsleepagg", _("How many milliseconds to rest during blsct aggregation thread loop"));
     strUsage += HelpMessageOpt("-blsctsleepver", _("How many milliseconds to rest during blsct verification thread loop"));
+    strUsage += HelpMessageOpt("-aggregationverifythreads=<n>", strprintf(_("Number of threads verifying received mix candidates (1 to %d, default: %d)"), MAX_AGGREGATION_VERIFY_THREADS, DEFAULT_AGGREGATION_VERIFY_THREADS));
+    strUsage += HelpMessageOpt("-aggregationqueuesize=<n>", strprintf(_("Keep at most <n> received mix candidates waiting for verification (default: %u)"), DEFAULT_AGGREGATION_QUEUE_SIZE));
 
     if (showDebug)
     {
@@ -777,6 +793,10 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        LoadMempool();
+    SetMempoolLoaded(!ShutdownRequested());
 }
 
 /** Sanity checks
@@ -1037,7 +1057,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
         SoftSetBoolArg("-rescan", true);
     }
 
-    BulletproofsRangeproof::Init();
+    // Builds the bulletproof generators and their fixed-base tables once, before any proof is handled
+    BulletproofsRangeproof::Init(GetBoolArg("-bulletproofscache", DEFAULT_BULLETPROOFS_CACHE) ? (GetDataDir() / "bulletproofs.dat").string() : "");
 
     // ********************************************************* Step 1: setup
 #ifdef _MSC_VER
@@ -1180,6 +1201,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    SetMultiExpThreads(GetArg("-multiexpthreads", DEFAULT_MULTIEXP_THREADS));
+
     fServer = GetBoolArg("-server", false);
 
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
@@ -1298,10 +1321,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
-    LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
+    LogPrintf("Using %u threads for script and BLSCT verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
+        {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadBLSCTCheck);
+        }
     }
 
     // Start the lightweight task scheduler thread
@@ -1600,6 +1626,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
                 pcoinsdbview = new CStateViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
 
+                // If necessary, upgrade from older database format.
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+
                 pcoinscatcher = new CStateViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CStateViewCache(pcoinscatcher);
 
@@ -1626,27 +1658,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
                     break;
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -txindex");
-                    break;
-                }
-
-                // Check for changed -addressindex state
-                if (fAddressIndex != GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -addressindex");
-                    break;
-                }
-
-                // Check for changed -spentindex state
-                if (fSpentIndex != GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -spentindex");
-                    break;
-                }
-
-                // Check for changed -timestampindex state
-                if (fTimestampIndex != GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex-chainstate to change -timestampindex");
+                // Indexes enabled or turned off since the last run are built or dropped in the background
+                std::string strIndexError;
+                if (!indexBuilder.Init(strIndexError)) {
+                    strLoadError = strIndexError;
                     break;
                 }
 
@@ -1786,6 +1801,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     }
     LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
 
+    indexWriter.Start(pblocktree);
+    indexBuilder.Start();
+
     boost::filesystem::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fopen(est_path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1895,7 +1913,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler, const std
     {
         uiInterface.InitMessage(_("Booting blsCT threads"));
         threadGroup.create_thread(boost::bind(&AggregationSessionThread));
-        threadGroup.create_thread(boost::bind(&CandidateVerificationThread));
+        candidatesQueue.SetMaxSize(GetArg("-aggregationqueuesize", DEFAULT_AGGREGATION_QUEUE_SIZE));
+        int nVerifyThreads = std::max(1, std::min((int)GetArg("-aggregationverifythreads", DEFAULT_AGGREGATION_VERIFY_THREADS), MAX_AGGREGATION_VERIFY_THREADS));
+        for (int i = 0; i < nVerifyThreads; i++)
+            threadGroup.create_thread(boost::bind(&CandidateVerificationThread));
     }
 #endif
 
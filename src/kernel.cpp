@@ -9,3 +9,73 @@
 #include <timedata.h>
 #include <txdb.h>
 #include <main.h>
+#include <crypto/common.h>
+
+bool GetWeightedStakeTarget(const arith_uint256& bnTarget, CAmount nValueIn, arith_uint256& bnWeightedTarget)
+{
+    bnWeightedTarget = 0;
+
+    if (nValueIn <= 0 || bnTarget == 0)
+        return true;
+
+    // target * nValueIn overflows exactly when target > floor(max / nValueIn)
+    arith_uint256 bnWeight = arith_uint256((uint64_t)nValueIn);
+    if (bnTarget > ~arith_uint256() / bnWeight)
+        return false;
+
+    bnWeightedTarget = bnTarget;
+    bnWeightedTarget *= bnWeight;
+
+    return true;
+}
+
+CStakeKernelSearch::CStakeKernelSearch(const CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int nTxPrevTime, CAmount nValueIn, const COutPoint& prevout)
+{
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits);
+    fTargetOverflow = !GetWeightedStakeTarget(bnTarget, nValueIn, bnWeightedTarget);
+
+    nMinTime = std::max(nTxPrevTime, nTimeBlockFrom + (unsigned int)Params().GetConsensus().nStakeMinAge);
+
+    // Same layout as the CDataStream serialization in CheckStakeKernelHash,
+    // the timestamp goes in the last four bytes
+    unsigned char vchPrefix[STAKE_KERNEL_SIZE - 4];
+    WriteLE64(vchPrefix, pindexPrev->nStakeModifier);
+    WriteLE32(vchPrefix + 8, nTimeBlockFrom);
+    WriteLE32(vchPrefix + 12, nTxPrevTime);
+    memcpy(vchPrefix + 16, prevout.hash.begin(), 32);
+    WriteLE32(vchPrefix + 48, prevout.n);
+
+    shaPrefix.Write(vchPrefix, sizeof(vchPrefix));
+}
+
+bool CStakeKernelSearch::Check(unsigned int nTimeTx, arith_uint256& hashProofOfStake) const
+{
+    unsigned char vchTime[4];
+    WriteLE32(vchTime, nTimeTx);
+
+    unsigned char buf[CSHA256::OUTPUT_SIZE];
+    CSHA256 sha(shaPrefix);
+    sha.Write(vchTime, sizeof(vchTime)).Finalize(buf);
+
+    uint256 hash;
+    sha.Reset().Write(buf, sizeof(buf)).Finalize(hash.begin());
+
+    hashProofOfStake = UintToArith256(hash);
+
+    return fTargetOverflow || hashProofOfStake <= bnWeightedTarget;
+}
+
+bool CStakeKernelSearch::Search(unsigned int nTimeTx, unsigned int nCount, unsigned int& nTimeFound, arith_uint256& hashProofOfStake) const
+{
+    for (unsigned int n = 0; n < nCount && n <= nTimeTx && nTimeTx - n >= nMinTime; n++)
+    {
+        if (Check(nTimeTx - n, hashProofOfStake))
+        {
+            nTimeFound = nTimeTx - n;
+            return true;
+        }
+    }
+
+    return false;
+}
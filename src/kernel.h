@@ -0,0 +1,57 @@
+// Copyright (c) 2012-2013 The PPCoin developers
+// Copyright (c) 2014 The Navcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_KERNEL_H
+#define NAVCOIN_KERNEL_H
+
+#include <amount.h>
+#include <arith_uint256.h>
+#include <crypto/sha256.h>
+
+class CBlockIndex;
+class COutPoint;
+
+/** Size of the serialized stake kernel: modifier, block time, tx time, prevout and timestamp */
+static const unsigned int STAKE_KERNEL_SIZE = 56;
+
+/**
+ * Searches the stake kernel of a single coin over many timestamps.
+ *
+ * Everything in the kernel but the timestamp is fixed for a coin, so the
+ * weighted target and the start of the preimage are computed once. Every
+ * candidate then costs the double SHA-256 of the kernel and a 256-bit
+ * integer comparison. The result matches CheckStakeKernelHash.
+ */
+class CStakeKernelSearch
+{
+public:
+    CStakeKernelSearch(const CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int nTxPrevTime, CAmount nValueIn, const COutPoint& prevout);
+
+    /** Whether the kernel with timestamp nTimeTx meets the weighted target */
+    bool Check(unsigned int nTimeTx, arith_uint256& hashProofOfStake) const;
+
+    /**
+     * Tries nCount timestamps going backward from nTimeTx and returns the
+     * first one which meets the weighted target. Timestamps failing the
+     * transaction time or the min age rules are skipped.
+     */
+    bool Search(unsigned int nTimeTx, unsigned int nCount, unsigned int& nTimeFound, arith_uint256& hashProofOfStake) const;
+
+    /** The lowest timestamp allowed by the transaction time and the min age rules */
+    unsigned int GetMinTime() const { return nMinTime; }
+
+private:
+    //! Hasher with the fixed part of the kernel already written
+    CSHA256 shaPrefix;
+    //! Whether the weighted target does not fit in 256 bits, every hash meets it then
+    bool fTargetOverflow;
+    arith_uint256 bnWeightedTarget;
+    unsigned int nMinTime;
+};
+
+/** Weighted stake target, target * nValueIn. Returns false when the product does not fit in 256 bits. */
+bool GetWeightedStakeTarget(const arith_uint256& bnTarget, CAmount nValueIn, arith_uint256& bnWeightedTarget);
+
+#endif // NAVCOIN_KERNEL_H
@@ -62,27 +62,55 @@ bool CBasicKeyStore::HaveBLSCTBlindingKey(const blsctPublicKey &address) const
 }
 
 bool CBasicKeyStore::GetBLSCTHashId(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey, CKeyID& hashId) const
+{
+    return GetBLSCTHashId(outputKey, spendingKey, std::vector<unsigned char>(), hashId);
+}
+
+bool CBasicKeyStore::GetBLSCTHashId(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey, const std::vector<unsigned char>& viewTag, CKeyID& hashId) const
 {
     if(!privateBlsViewKey.IsValid())
         return false;
 
     try
     {
-        // D' = P - Hs(a*R)*G
-        bls::G1Element t = bls::G1Element::FromByteVector(outputKey);
-        bls::PrivateKey k = privateBlsViewKey.GetKey();
-        t = t * k;
-        Scalar hash_T = Scalar(HashG1Element(t, 0));
-        bls::G1Element dh = bls::PrivateKey::FromBN(hash_T.bn).GetG1Element();
-        dh = dh.Inverse();
-        t = bls::G1Element::FromByteVector(spendingKey);
-        bls::G1Element D_prime = t + dh;
-        hashId = blsctPublicKey(D_prime).GetID();
+        return GetBLSCTHashId(bls::G1Element::FromByteVector(outputKey), [&spendingKey]() { return bls::G1Element::FromByteVector(spendingKey); }, viewTag, hashId);
     }
     catch(...)
     {
         return false;
     }
+}
+
+bool CBasicKeyStore::GetBLSCTHashId(const CTxOut& out, CKeyID& hashId) const
+{
+    if(!privateBlsViewKey.IsValid())
+        return false;
+
+    try
+    {
+        return GetBLSCTHashId(out.GetOutputKey(), [&out]() { return out.GetSpendingKey(); }, out.viewTag, hashId);
+    }
+    catch(...)
+    {
+        return false;
+    }
+}
+
+bool CBasicKeyStore::GetBLSCTHashId(const bls::G1Element& outputKey, const std::function<bls::G1Element()>& getSpendingKey, const std::vector<unsigned char>& viewTag, CKeyID& hashId) const
+{
+    // D' = P - Hs(a*R)*G
+    bls::PrivateKey k = privateBlsViewKey.GetKey();
+    bls::G1Element t = outputKey * k;
+
+    // Most outputs are not ours, a wrong view tag rules them out with a single hash
+    if (!viewTag.empty() && viewTag != CalculateViewTag(t))
+        return false;
+
+    Scalar hash_T = Scalar(HashG1Element(t, 0));
+    bls::G1Element dh = bls::PrivateKey::FromBN(hash_T.bn).GetG1Element();
+    dh = dh.Inverse();
+    bls::G1Element D_prime = getSpendingKey() + dh;
+    hashId = blsctPublicKey(D_prime).GetID();
 
     return true;
 }
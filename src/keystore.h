@@ -8,12 +8,15 @@
 
 #include <blsct/key.h>
 #include <key.h>
+#include <primitives/transaction.h>
 #include <pubkey.h>
 #include <script/script.h>
 #include <script/standard.h>
 #include <sync.h>
 #include <util.h>
 
+#include <functional>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/variant.hpp>
 
@@ -41,8 +44,10 @@ public:
 
     virtual bool HaveBLSCTBlindingKey(const blsctPublicKey &pk) const =0;
     virtual bool GetBLSCTHashId(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey, CKeyID& hashId) const =0;
+    virtual bool GetBLSCTHashId(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey, const std::vector<unsigned char>& viewTag, CKeyID& hashId) const =0;
     virtual bool HaveBLSCTSubAddress(const CKeyID &hashId) const =0;
     virtual bool HaveBLSCTSubAddress(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey) const =0;
+    virtual bool HaveBLSCTSubAddress(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey, const std::vector<unsigned char>& viewTag) const =0;
     virtual bool GetBLSCTBlindingKey(const blsctPublicKey &pk, blsctKey &k) const =0;
     virtual bool GetBLSCTSubAddressIndex(const CKeyID &hashId, std::pair<uint64_t, uint64_t>& index) const =0;
     virtual bool GetBLSCTSubAddressIndex(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey, std::pair<uint64_t, uint64_t>& index) const =0;
@@ -97,6 +102,8 @@ protected:
     blsctDoublePublicKey publicBlsKey;
     blsctKey privateBlsBlindingKey;
 
+    //! D' = P - Hs(a*R)*G. The spending key is only decoded once the view tag matches.
+    bool GetBLSCTHashId(const bls::G1Element& outputKey, const std::function<bls::G1Element()>& getSpendingKey, const std::vector<unsigned char>& viewTag, CKeyID& hashId) const;
 
 public:
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey);
@@ -137,7 +144,30 @@ public:
         return HaveBLSCTSubAddress(hashId);
     }
 
+    //! Same as above, but outputs with a view tag which doesn't match are discarded before deriving the sub address
+    bool HaveBLSCTSubAddress(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey, const std::vector<unsigned char>& viewTag) const
+    {
+        CKeyID hashId;
+        if (!GetBLSCTHashId(outputKey, spendingKey, viewTag, hashId))
+            return false;
+
+        return HaveBLSCTSubAddress(hashId);
+    }
+
+    //! Same as above, using the keys the output keeps decoded
+    bool HaveBLSCTSubAddress(const CTxOut& out) const
+    {
+        CKeyID hashId;
+        if (!GetBLSCTHashId(out, hashId))
+            return false;
+
+        return HaveBLSCTSubAddress(hashId);
+    }
+
+    bool GetBLSCTHashId(const CTxOut& out, CKeyID& hashId) const;
+
     bool GetBLSCTHashId(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey, CKeyID& hashId) const;
+    bool GetBLSCTHashId(const std::vector<unsigned char>& outputKey, const std::vector<unsigned char>& spendingKey, const std::vector<unsigned char>& viewTag, CKeyID& hashId) const;
 
     void GetKeys(std::set<CKeyID> &setAddress) const
     {
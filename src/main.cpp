@@ -18,7 +18,9 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
+#include <indexwriter.h>
 #include <init.h>
+#include <kernel.h>
 #include <merkleblock.h>
 #include <net.h>
 #include <policy/fees.h>
@@ -105,7 +107,7 @@ CBlockIndex* pindexVerifyChainTip = nullptr;
 
 CTxMemPool mempool(::minRelayTxFee);
 FeeFilterRounder filterRounder(::minRelayTxFee);
-CTxMemPool stempool(::minRelayTxFee);
+CTxMemPool stempool(::minRelayTxFee, true);
 
 struct IteratorComparator
 {
@@ -1065,18 +1067,18 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
-            CCoins coins;
-            if (!viewMemPool.GetCoins(txin.prevout.hash, coins))
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin))
             {
-                if (!viewStemPool.GetCoins(txin.prevout.hash, coins)) {
+                if (!viewStemPool.GetCoin(txin.prevout, coin)) {
                     return error("%s: Missing input", __func__);
                 }
             }
-            if (coins.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coins.nHeight;
+                prevheights[txinIndex] = coin.nHeight;
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -1189,6 +1191,8 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state)
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-vout-negative");
         if (txout.nValue > MAX_MONEY)
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-vout-toolarge");
+        if (!txout.viewTag.empty() && txout.viewTag.size() != VIEW_TAG_SIZE)
+            return state.DoS(100, false, REJECT_INVALID, "bad-txns-vout-viewtag");
         nValueOut += txout.nValue;
         if (!MoneyRange(nValueOut))
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-txouttotal-toolarge");
@@ -1234,9 +1238,9 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     if (expired != 0)
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-    std::vector<uint256> vNoSpendsRemaining;
+    std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
-    for(const uint256& removed: vNoSpendsRemaining)
+    for(const COutPoint& removed: vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
 
@@ -1274,8 +1278,8 @@ bool RemoveBLSCTConflicting(CTxMemPool& pool, const CTxIn& txin)
 }
 
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCriticalSection *spcs, CValidationState& state, const CTransaction& tx, bool fLimitFree,
-                              bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee,
-                              std::vector<uint256>& vHashTxnToUncache)
+                              bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee,
+                              std::vector<COutPoint>& vCoinsToUncache)
 {
     const uint256 hash = tx.GetHash();
     AssertLockHeld(cs_main);
@@ -1315,6 +1319,13 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
         return state.DoS(0, false, REJECT_NONSTANDARD, "no-blsct-yet", true);
      }
 
+    // Outputs with a view tag do not deserialize on nodes which predate it
+    if (!IsBLSCTViewTagEnabled(chainActive.Tip(), Params().GetConsensus())) {
+        for (const CTxOut& txout: tx.vout)
+            if (!txout.viewTag.empty())
+                return state.DoS(0, false, REJECT_NONSTANDARD, "no-viewtag-yet", true);
+    }
+
     // Rather not work on nonstandard transactions (unless -testnet/-regtest)
     string reason;
     if (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled))
@@ -1434,21 +1445,19 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
             }
         }
 
-        // do we already have it?
-        bool fHadTxInCache = pcoinsTip->HaveCoinsInCache(hash);
-        if (view.HaveCoins(hash)) {
-            if (!fHadTxInCache)
-                vHashTxnToUncache.push_back(hash);
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
-        }
-
         // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
         for(const CTxIn txin: tx.vin) {
-            if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
-                vHashTxnToUncache.push_back(txin.prevout.hash);
-            if (!view.HaveCoins(txin.prevout.hash)) {
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout))
+                vCoinsToUncache.push_back(txin.prevout);
+            if (!view.HaveCoin(txin.prevout)) {
+                // Are inputs missing because we already have the tx?
+                for (size_t out = 0; out < tx.vout.size(); out++) {
+                    // Optimistically just do efficient check of cache for outputs
+                    if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out))) {
+                        return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+                    }
+                }
+                // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
                 if (pfMissingInputs)
                     *pfMissingInputs = true;
                 return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
@@ -1613,14 +1622,14 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
         // during reorgs to ensure Params().GetConsensus().nCoinbaseMaturity is still met.
         bool fSpendsCoinbase = false;
         for(const CTxIn &txin: tx.vin) {
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-            if (coins->IsCoinBase() || coins->IsCoinStake()) {
+            const Coin &coin = view.AccessCoin(txin.prevout);
+            if (coin.IsCoinBase() || coin.IsCoinStake()) {
                 fSpendsCoinbase = true;
                 break;
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOpsCost, lp);
+        CTxMemPoolEntry entry(tx, nFees, nAcceptTime, dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOpsCost, lp);
         unsigned int nSize = entry.GetTxSize();
 
         // Check that the transaction doesn't have an excessive number of
@@ -1894,28 +1903,34 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CCriticalSection *mpcs, CCritica
     return true;
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CCriticalSection *mpcs, CCriticalSection *spcs, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CCriticalSection *mpcs, CCriticalSection *spcs, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
-    std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, mpcs, spcs, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    std::vector<COutPoint> vCoinsToUncache;
+    bool res = AcceptToMemoryPoolWorker(pool, mpcs, spcs, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, nAbsurdFee, vCoinsToUncache);
     if (res)
         LogPrintf("%s: Successfully added txn %s to %s.\n", __func__, tx.ToString(), (&pool == &mempool) ? "mempool" : "stempool");
     else
     {
         LogPrintf("%s: FAILED to add txn %s to %s (%s).\n", __func__, tx.ToString(), (&pool == &mempool) ? "mempool" : "stempool", state.GetRejectReason());
-        for(const uint256& hashTx: vHashTxToUncache)
-                pcoinsTip->Uncache(hashTx);
+        for(const COutPoint& outpoint: vCoinsToUncache)
+                pcoinsTip->Uncache(outpoint);
     }
     return res;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CCriticalSection *mpcs, CCriticalSection *spcs, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+{
+    return AcceptToMemoryPoolWithTime(pool, mpcs, spcs, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, nAbsurdFee);
+}
+
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes)
 {
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
 
-    if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
+    if (!indexWriter.Sync() || !pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
     return true;
@@ -1929,7 +1944,7 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
+    if (!indexWriter.Sync() || !pblocktree->ReadSpentIndex(key, value))
         return false;
 
     return true;
@@ -1953,19 +1968,31 @@ bool GetAddressHistory(uint160 addressHash, uint160 addressHash2,
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressHistory(addressHash, addressHash2, addressHistory, filter, start, end))
+    if (!indexWriter.Sync() || !pblocktree->ReadAddressHistory(addressHash, addressHash2, addressHistory, filter, start, end))
         return error("unable to get history for address");
 
     return true;
 }
 
+bool GetAddressHistoryCheckpointHash(int nHeight, uint256& hash)
+{
+    LOCK(cs_main);
+
+    if (nHeight < 0 || nHeight > chainActive.Height())
+        return false;
+
+    hash = chainActive[nHeight]->GetBlockHash();
+
+    return true;
+}
+
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start, int end)
 {
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!indexWriter.Sync() || !pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
 
     return true;
@@ -1977,7 +2004,7 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!indexWriter.Sync() || !pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
         return error("unable to get txids for address");
 
     return true;
@@ -2000,7 +2027,7 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
 
     if (fTxIndex) {
         CDiskTxPos postx;
-        if (pblocktree->ReadTxIndex(hash, postx)) {
+        if (indexWriter.ReadTxIndex(hash, postx)) {
             CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
             if (file.IsNull())
                 return error("%s: OpenBlockFile failed", __func__);
@@ -2022,9 +2049,9 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
         int nHeight = -1;
         {
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
+            const Coin& coin = AccessByTxid(view, hash);
+            if (!coin.IsSpent())
+                nHeight = coin.nHeight;
         }
         if (nHeight > 0)
             pindexSlow = chainActive[nHeight];
@@ -2293,24 +2320,14 @@ void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, CTxUndo &txund
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         for(const CTxIn &txin: tx.vin) {
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                assert(false);
             // mark an outpoint spent, and construct undo information
-            txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-            coins->Spend(nPos);
-            if (coins->vout.size() == 0) {
-                CTxInUndo& undo = txundo.vprevout.back();
-                undo.nHeight = coins->nHeight;
-                undo.fCoinBase = coins->fCoinBase;
-                undo.nVersion = coins->nVersion;
-            }
+            txundo.vprevout.emplace_back();
+            bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
+            assert(is_spent);
         }
     }
     // add outputs
-    inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, int nHeight)
@@ -2337,7 +2354,7 @@ int GetSpendHeight(const CStateViewCache& inputs)
 }
 
 namespace Consensus {
-bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CStateViewCache& inputs, int nSpendHeight, std::vector<RangeproofEncodedData>& blsctData, CAmount allowedInPrivate = 0)
+bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CStateViewCache& inputs, int nSpendHeight, std::vector<RangeproofEncodedData>& blsctData, CAmount allowedInPrivate = 0, RangeproofBatch* pRangeproofBatch = nullptr, std::vector<CBLSCTCheck> *pvBLSCTChecks = nullptr, bool fCacheBLSCT = false)
 {
     // This doesn't trigger the DoS code on purpose; if it did, it would make it easier
     // for an attacker to attempt to split the network.
@@ -2349,10 +2366,10 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CState
     for (unsigned int i = 0; i < tx.vin.size(); i++)
     {
         const COutPoint &prevout = tx.vin[i].prevout;
-        const CCoins *coins = inputs.AccessCoins(prevout.hash);
-        assert(coins);
+        const Coin& coin = inputs.AccessCoin(prevout);
+        assert(!coin.IsSpent());
 
-        if (coins->vout[prevout.n].IsBLSCT())
+        if (coin.out.IsBLSCT())
         {
             if (!fHasBLSInput && i > 0)
                 return state.Invalid(false,
@@ -2361,7 +2378,7 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CState
             fHasBLSInput = true;
         }
 
-        if (fHasBLSInput && !coins->vout[prevout.n].IsBLSCT())
+        if (fHasBLSInput && !coin.out.IsBLSCT())
             return state.Invalid(false,
                                  REJECT_INVALID, "bad-mix-bls-inputs",
                                  "transaction mixes bls and legacy inputs");
@@ -2373,16 +2390,16 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CState
 #endif
 
         // If prev is coinbase, check that it's matured
-        if ((coins->IsCoinBase() || coins->IsCoinStake()) && !fTestNet) {
-            if (nSpendHeight - coins->nHeight < ::Params().GetConsensus().nCoinbaseMaturity && nSpendHeight - coins->nHeight > 0)
+        if ((coin.IsCoinBase() || coin.IsCoinStake()) && !fTestNet) {
+            if (nSpendHeight - coin.nHeight < ::Params().GetConsensus().nCoinbaseMaturity && nSpendHeight - coin.nHeight > 0)
                 return state.Invalid(false,
                                      REJECT_INVALID, "bad-txns-premature-spend-of-coinbase",
-                                     strprintf("tried to spend %s at depth %d", coins->IsCoinBase() ?"coinbase":"coinstake",nSpendHeight - coins->nHeight));
+                                     strprintf("tried to spend %s at depth %d", coin.IsCoinBase() ?"coinbase":"coinstake",nSpendHeight - coin.nHeight));
         }
 
         // Check for negative or overflow input values
-        nValueIn += coins->vout[prevout.n].nValue;
-        if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+        nValueIn += coin.out.nValue;
+        if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputvalues-outofrange");
 
     }
@@ -2412,7 +2429,7 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CState
             if (!(pwalletMain && pwalletMain->GetBLSCTViewKey(v)))
                 v = blsctKey(bls::PrivateKey::FromBN(Scalar::Rand().bn));
 
-            if (!tx.IsCoinStake() && !VerifyBLSCT(tx, v.GetKey(), blsctData, inputs, state, false, allowedInPrivate))
+            if (!tx.IsCoinStake() && !VerifyBLSCT(tx, v.GetKey(), blsctData, inputs, state, false, allowedInPrivate, pRangeproofBatch, pvBLSCTChecks, fCacheBLSCT))
                 return false;
         }
         catch(...)
@@ -2427,11 +2444,11 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CState
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CStateViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<RangeproofEncodedData>& blsctData, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks, CAmount allowedInPrivate)
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CStateViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<RangeproofEncodedData>& blsctData, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks, CAmount allowedInPrivate, RangeproofBatch* pRangeproofBatch, std::vector<CBLSCTCheck> *pvBLSCTChecks)
 {
     if (!tx.IsCoinBase())
     {
-        if (!Consensus::CheckTxInputs(tx, state, inputs, GetSpendHeight(inputs), blsctData, allowedInPrivate))
+        if (!Consensus::CheckTxInputs(tx, state, inputs, GetSpendHeight(inputs), blsctData, allowedInPrivate, pRangeproofBatch, pvBLSCTChecks, cacheStore))
             return false;
 
         if (pvChecks)
@@ -2450,10 +2467,10 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CStateVi
         if (fScriptChecks) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
 
-                if (coins->nHeight > 1294597 && coins->nHeight < 2741760)
+                if (coin.nHeight > 1294597 && coin.nHeight < 2741760)
                 {
                     CTransaction txPrev;
                     uint256 hashBlock = uint256();
@@ -2475,7 +2492,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CStateVi
                 }
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, &txdata);
+                CScriptCheck check(coin.out, tx, i, flags, cacheStore, &txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -2487,7 +2504,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CStateVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
+                        CScriptCheck check2(coin.out, tx, i,
                                 flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
@@ -2508,8 +2525,6 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CStateVi
     return true;
 }
 
-namespace {
-
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
@@ -2537,6 +2552,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+namespace {
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -2585,34 +2602,32 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 } // anon namespace
 
 /**
- * Apply the undo operation of a CTxInUndo to the given chain state.
- * @param undo The undo object.
+ * Restore the UTXO in a Coin at a given COutPoint
+ * @param undo The Coin to be restored.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-static bool ApplyTxInUndo(const CTxInUndo& undo, CStateViewCache& view, const COutPoint& out)
+static bool ApplyTxInUndo(Coin&& undo, CStateViewCache& view, const COutPoint& out)
 {
     bool fClean = true;
 
-    CCoinsModifier coins = view.ModifyCoins(out.hash);
-    if (undo.nHeight != 0) {
-        // undo data contains height: this is the last output of the prevout tx being spent
-        if (!coins->IsPruned())
-            fClean = fClean && error("%s: undo data overwriting existing transaction", __func__);
-        coins->Clear();
-        coins->fCoinBase = undo.fCoinBase;
-        coins->nHeight = undo.nHeight;
-        coins->nVersion = undo.nVersion;
-    } else {
-        if (coins->IsPruned())
-            fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
+    if (view.HaveCoin(out)) fClean = false; // overwriting transaction output
+
+    if (undo.nHeight == 0) {
+        // Missing undo metadata (height and coinbase). Older versions included this
+        // information only in undo records for the last spend of a transactions'
+        // outputs. This implies that it must be present for some other output of the same tx.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (!alternate.IsSpent()) {
+            undo.nHeight = alternate.nHeight;
+            undo.fCoinBase = alternate.fCoinBase;
+            undo.fCoinStake = alternate.fCoinStake;
+        } else {
+            return error("%s: undo data adding output to missing transaction", __func__);
+        }
     }
-    if (coins->IsAvailable(out.n))
-        fClean = fClean && error("%s: undo data overwriting existing output", __func__);
-    if (coins->vout.size() < out.n+1)
-        coins->vout.resize(out.n+1);
-    coins->vout[out.n] = undo.txout;
+    view.AddCoin(out, std::move(undo), !fClean);
 
     return fClean;
 }
@@ -2637,7 +2652,6 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         return error("DisconnectBlock(): block and undo data inconsistent");
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > addressHistory;
     std::map<CAddressHistoryKey, CAddressHistoryValue> addressHistoryMap;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
@@ -2784,37 +2798,26 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
 
         // Check that all outputs are available and match the outputs in the block itself
         // exactly.
-        {
-        CCoinsModifier outs = view.ModifyCoins(hash);
-        outs->ClearUnspendable();
-
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-
-        if (outs->vout.size() != outsBlock.vout.size())
-            fClean = fClean && error("DisconnectBlock(): added transaction mismatch? different output vector size");
-
-        if (*outs != outsBlock)
-            fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted %d", *outs != outsBlock);
-
-        // remove outputs
-        outs->Clear();
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (tx.vout[o].IsBLSCT() || !tx.vout[o].scriptPubKey.IsUnspendable()) {
+                COutPoint out(hash, o);
+                Coin coin;
+                bool is_spent = view.SpendCoin(out, &coin);
+                if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || tx.IsCoinBase() != coin.fCoinBase)
+                    fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
+            }
         }
 
         // restore inputs
         if (i > 0) { // not coinbases
-            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock(): transaction and undo data inconsistent");
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                const CTxInUndo &undo = txundo.vprevout[j];
-                if (!ApplyTxInUndo(undo, view, out))
+                if (!ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out))
                     fClean = false;
+                const Coin &undo = view.AccessCoin(out);
 
                 const CTxIn input = tx.vin[j];
 
@@ -3069,22 +3072,27 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         return true;
     }
 
+    CIndexUpdate indexUpdate;
+    indexUpdate.hashBlock = pindex->pprev->GetBlockHash();
+    indexUpdate.fDisconnect = true;
+
     if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to delete address index");
-        }
+        indexUpdate.vAddressIndex.swap(addressIndex);
+        indexUpdate.vAddressHistory.reserve(addressHistoryMap.size());
         for (auto &it: addressHistoryMap)
         {
-            addressHistory.push_back(std::make_pair(it.first, it.second));
-        }
-        if (!pblocktree->EraseAddressHistory(addressHistory)) {
-            return AbortNode(state, "Failed to delete address history");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
+            indexUpdate.vAddressHistory.push_back(std::make_pair(it.first, it.second));
         }
+        indexUpdate.vAddressUnspentIndex.swap(addressUnspentIndex);
     }
 
+    if (fSpentIndex)
+        indexUpdate.vSpentIndex.swap(spentIndex);
+
+    if (fTxIndex || fAddressIndex || fSpentIndex || fTimestampIndex)
+        if (!indexWriter.Push(indexUpdate))
+            return AbortNode(state, "Failed to write block indexes");
+
     return fClean;
 }
 
@@ -3114,12 +3122,18 @@ void static FlushBlockFile(bool fFinalize = false)
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CBLSCTCheck> blsctcheckqueue(16);
 
 void ThreadScriptCheck() {
     RenameThread("navcoin-scriptch");
     scriptcheckqueue.Thread();
 }
 
+void ThreadBLSCTCheck() {
+    RenameThread("navcoin-blsctch");
+    blsctcheckqueue.Thread();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -3444,12 +3458,402 @@ bool TxToConsultationAnswer(std::string strDZeel, uint256 hash, const uint256& b
     return true;
 }
 
+// Address and spent index entries of input j of transaction i, which spends prevout
+static void GetInputIndexEntries(const CTransaction& tx, unsigned int i, size_t j, const CTxOut& prevout, int nHeight, bool fAddress, bool fSpent,
+                                 std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex,
+                                 std::map<CAddressHistoryKey, CAddressHistoryValue>& addressHistoryMap,
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& addressUnspentIndex,
+                                 std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& spentIndex)
+{
+    const uint256 txhash = tx.GetHash();
+    const CTxIn input = tx.vin[j];
+    uint160 hashBytes;
+    int addressType, dummyType;
+
+    if (prevout.scriptPubKey.IsPayToScriptHash()) {
+        vector<unsigned char> hashBytes_(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
+        uint160 hashBytes(hashBytes_);
+        addressType = 2;
+
+        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, txhash, tx.nTime);
+
+        if (addressHistoryMap.count(addressHistoryKey) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKey].stakable += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKey].voting_weight += prevout.nValue * -1;
+    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash() || prevout.scriptPubKey.IsPayToPublicKey()) {
+        CTxDestination destination;
+        ExtractDestination(prevout.scriptPubKey, destination);
+        CNavcoinAddress address(destination);
+        address.GetIndexKey(hashBytes, addressType);
+
+        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, txhash, tx.nTime);
+
+        if (addressHistoryMap.count(addressHistoryKey) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKey].stakable += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKey].voting_weight += prevout.nValue * -1;
+    } else if (prevout.scriptPubKey.IsColdStaking())
+    {
+        CTxDestination destination;
+        uint160 hashBytesSpending, hashBytesStaking;
+        CNavcoinAddress addressStaking, addresssSpending;
+
+        ExtractDestination(prevout.scriptPubKey, destination);
+        CNavcoinAddress address(destination);
+        address.GetSpendingAddress(addresssSpending);
+        address.GetIndexKey(hashBytes, addressType);
+        addresssSpending.GetIndexKey(hashBytesSpending, addressType);
+
+        CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, txhash, tx.nTime);
+        CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, nHeight, i, txhash, tx.nTime);
+
+        if (addressHistoryMap.count(addressHistoryKey) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        if (addressHistoryMap.count(addressHistoryKey2) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKey2].spendable += prevout.nValue * -1;
+
+        address.GetStakingAddress(addressStaking);
+        addressStaking.GetIndexKey(hashBytesStaking, dummyType);
+
+        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, txhash, tx.nTime);
+        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, txhash, tx.nTime);
+
+        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        addressHistoryMap[addressHistoryKeyStaking].stakable += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKeyStaking].voting_weight += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKeyStaking2].stakable += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKeyStaking2].voting_weight += prevout.nValue * -1;
+
+        hashBytes = hashBytesSpending;
+    }
+    else if (prevout.scriptPubKey.IsColdStakingv2())
+    {
+        CTxDestination destination;
+        uint160 hashBytesStaking, hashBytesVoting, hashBytesSpending;
+        CNavcoinAddress addressStaking, addressVoting, addresssSpending;
+
+        ExtractDestination(prevout.scriptPubKey, destination);
+        CNavcoinAddress address(destination);
+        address.GetSpendingAddress(addresssSpending);
+        address.GetIndexKey(hashBytes, addressType);
+        addresssSpending.GetIndexKey(hashBytesSpending, addressType);
+
+        CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, txhash, tx.nTime);
+        CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, nHeight, i, txhash, tx.nTime);
+
+        if (addressHistoryMap.count(addressHistoryKey) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        if (addressHistoryMap.count(addressHistoryKey2) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKey2].spendable += prevout.nValue * -1;
+
+        address.GetStakingAddress(addressStaking);
+        addressStaking.GetIndexKey(hashBytesStaking, dummyType);
+
+        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, txhash, tx.nTime);
+        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, txhash, tx.nTime);
+
+        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        addressHistoryMap[addressHistoryKeyStaking].stakable += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKeyStaking2].stakable += prevout.nValue * -1;
+
+        address.GetVotingAddress(addressVoting);
+        addressVoting.GetIndexKey(hashBytesVoting, dummyType);
+
+        CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), nHeight, i, txhash, tx.nTime);
+        CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, nHeight, i, txhash, tx.nTime);
+
+        if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
+            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+        addressHistoryMap[addressHistoryKeyVoting].voting_weight += prevout.nValue * -1;
+        addressHistoryMap[addressHistoryKeyVoting2].voting_weight += prevout.nValue * -1;
+
+        hashBytes = hashBytesSpending;
+    }
+    else
+    {
+        hashBytes.SetNull();
+        addressType = 0;
+    }
+
+    if (fAddress && addressType > 0) {
+        // record spending activity
+        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, i, txhash, j, true), prevout.nValue * -1));
+
+        // remove address from unspent index
+        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
+    }
+
+    if (fSpent) {
+        // add the spent index to determine the txid and input that spent an output
+        // and to find the amount and address from an input
+        spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, nHeight, prevout.nValue, addressType, hashBytes)));
+    }
+}
+
+// Address index entries of the outputs of transaction i
+static void GetOutputIndexEntries(const CTransaction& tx, unsigned int i, int nHeight,
+                                  std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex,
+                                  std::map<CAddressHistoryKey, CAddressHistoryValue>& addressHistoryMap,
+                                  std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& addressUnspentIndex)
+{
+    const uint256 txhash = tx.GetHash();
+
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut &out = tx.vout[k];
+
+        if (out.scriptPubKey.IsPayToScriptHash()) {
+            vector<unsigned char> hashBytes_(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
+            uint160 hashBytes(hashBytes_);
+
+            // record receiving activity
+            addressIndex.push_back(make_pair(CAddressIndexKey(2, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+            // record unspent output
+            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+
+            CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, txhash, tx.nTime);
+
+            if (addressHistoryMap.count(addressHistoryKey) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
+
+            addressHistoryMap[addressHistoryKey].spendable += out.nValue;
+            addressHistoryMap[addressHistoryKey].stakable += out.nValue;
+            addressHistoryMap[addressHistoryKey].voting_weight += out.nValue;
+        } else if (out.scriptPubKey.IsColdStaking())
+        {
+            uint160 hashBytes, hashBytesStaking, hashBytesSpending;
+            CNavcoinAddress addressSpending, addressStaking;
+            int type = 0;
+            CTxDestination destination;
+            ExtractDestination(out.scriptPubKey, destination);
+            CNavcoinAddress address(destination);
+            address.GetSpendingAddress(addressSpending);
+            address.GetIndexKey(hashBytes, type);
+            addressSpending.GetIndexKey(hashBytesSpending, type);
+
+            // record spending activity
+            addressIndex.push_back(make_pair(CAddressIndexKey(type, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+            // record unspent output
+            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+            CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, txhash, tx.nTime);
+            CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, nHeight, i, txhash, tx.nTime);
+
+            if (addressHistoryMap.count(addressHistoryKey) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            if (addressHistoryMap.count(addressHistoryKey2) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            addressHistoryMap[addressHistoryKey].spendable += out.nValue;
+            addressHistoryMap[addressHistoryKey2].spendable += out.nValue;
+
+            address.GetStakingAddress(addressStaking);
+            addressStaking.GetIndexKey(hashBytesStaking, type);
+
+            CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, txhash, tx.nTime);
+            CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, txhash, tx.nTime);
+
+            if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            addressHistoryMap[addressHistoryKeyStaking].stakable += out.nValue;
+            addressHistoryMap[addressHistoryKeyStaking].voting_weight += out.nValue;
+
+            addressHistoryMap[addressHistoryKeyStaking2].stakable += out.nValue;
+            addressHistoryMap[addressHistoryKeyStaking2].voting_weight += out.nValue;
+        }
+        else if (out.scriptPubKey.IsColdStakingv2())
+        {
+            uint160 hashBytes, hashBytesStaking, hashBytesVoting, hashBytesSpending;
+            CNavcoinAddress addressSpending, addressStaking, addressVoting;
+
+            int type = 0;
+            CTxDestination destination;
+            ExtractDestination(out.scriptPubKey, destination);
+            CNavcoinAddress address(destination);
+            address.GetSpendingAddress(addressSpending);
+            addressSpending.GetIndexKey(hashBytesSpending, type);
+            address.GetIndexKey(hashBytes, type);
+
+            // record spending activity
+            addressIndex.push_back(make_pair(CAddressIndexKey(type, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+            // record unspent output
+            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+            CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), nHeight, i, txhash, tx.nTime);
+            CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, nHeight, i, txhash, tx.nTime);
+
+            if (addressHistoryMap.count(addressHistoryKey) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            addressHistoryMap[addressHistoryKey].spendable += out.nValue;
+
+            if (addressHistoryMap.count(addressHistoryKey2) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            addressHistoryMap[addressHistoryKey2].spendable += out.nValue;
+
+            address.GetVotingAddress(addressVoting);
+            addressVoting.GetIndexKey(hashBytesVoting, type);
+
+            CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), nHeight, i, txhash, tx.nTime);
+            CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, nHeight, i, txhash, tx.nTime);
+
+            if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            addressHistoryMap[addressHistoryKeyVoting].voting_weight += out.nValue;
+
+            if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            addressHistoryMap[addressHistoryKeyVoting2].voting_weight += out.nValue;
+
+            address.GetStakingAddress(addressStaking);
+            addressStaking.GetIndexKey(hashBytesStaking, type);
+
+            CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), nHeight, i, txhash, tx.nTime);
+            CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, nHeight, i, txhash, tx.nTime);
+
+            if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            addressHistoryMap[addressHistoryKeyStaking].stakable += out.nValue;
+
+            if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            addressHistoryMap[addressHistoryKeyStaking2].stakable += out.nValue;
+        }
+        else if (out.scriptPubKey.IsPayToPublicKey() || out.scriptPubKey.IsPayToPublicKeyHash())
+        {
+            uint160 hashBytes;
+            int type = 0;
+            CTxDestination destination;
+            ExtractDestination(out.scriptPubKey, destination);
+            CNavcoinAddress address(destination);
+            address.GetIndexKey(hashBytes, type);
+
+            // record spending activity
+            addressIndex.push_back(make_pair(CAddressIndexKey(type, uint160(hashBytes), nHeight, i, txhash, k, false), out.nValue));
+
+            // record unspent output
+            addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+            CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, nHeight, i, txhash, tx.nTime);
+
+            if (addressHistoryMap.count(addressHistoryKey) == 0)
+                addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
+
+            addressHistoryMap[addressHistoryKey].spendable += out.nValue;
+            addressHistoryMap[addressHistoryKey].stakable += out.nValue;
+            addressHistoryMap[addressHistoryKey].voting_weight += out.nValue;
+        } else {
+            continue;
+        }
+
+    }
+}
+
+bool ReadIndexUpdate(const CBlockIndex* pindex, bool fTx, bool fAddress, bool fSpent, bool fTimestamp,
+                     unsigned int nPrevLogicalTimestamp, CIndexUpdate& update)
+{
+    update = CIndexUpdate();
+    update.hashBlock = pindex->GetBlockHash();
+
+    // The transactions of the genesis block are not connected
+    if (!pindex->pprev)
+        return true;
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus()))
+        return error("%s: failed to read block %s", __func__, update.hashBlock.ToString());
+
+    CBlockUndo blockundo;
+    if (fAddress || fSpent) {
+        CDiskBlockPos pos = pindex->GetUndoPos();
+        if (pos.IsNull() || !UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash()))
+            return error("%s: failed to read undo data of block %s", __func__, update.hashBlock.ToString());
+        if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+            return error("%s: block and undo data of %s inconsistent", __func__, update.hashBlock.ToString());
+    }
+
+    std::map<CAddressHistoryKey, CAddressHistoryValue> addressHistoryMap;
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction &tx = block.vtx[i];
+
+        // The undo data holds the outputs spent by every transaction but the first
+        if ((fAddress || fSpent) && i > 0 && !tx.IsCoinBase())
+        {
+            const CTxUndo &txundo = blockundo.vtxundo[i-1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s: undo data of %s does not match its inputs", __func__, tx.GetHash().ToString());
+
+            for (size_t j = 0; j < tx.vin.size(); j++)
+                GetInputIndexEntries(tx, i, j, txundo.vprevout[j].out, pindex->nHeight, fAddress, fSpent,
+                                     update.vAddressIndex, addressHistoryMap, update.vAddressUnspentIndex, update.vSpentIndex);
+        }
+
+        if (fAddress)
+            GetOutputIndexEntries(tx, i, pindex->nHeight, update.vAddressIndex, addressHistoryMap, update.vAddressUnspentIndex);
+
+        if (fTx)
+            update.vTxIndex.push_back(std::make_pair(tx.GetHash(), pos));
+        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    }
+
+    if (fAddress)
+        update.vAddressHistory.assign(addressHistoryMap.begin(), addressHistoryMap.end());
+
+    if (fTimestamp) {
+        update.fTimestampIndex = true;
+        update.nLogicalTimestamp = std::max(pindex->nTime, nPrevLogicalTimestamp + 1);
+    }
+
+    return true;
+}
+
 // Protected by cs_main
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
+static int64_t nTimeVerifyBLSCT = 0;
+static int64_t nTimeVerifyScripts = 0;
 static int64_t nTimeConnect = 0;
 static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
@@ -3580,10 +3984,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fEnforceBIP30) {
         for(const CTransaction& tx: block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx.GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
-                                 REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx.GetHash(), o))) {
+                    return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
+                                     REJECT_INVALID, "bad-txns-BIP30");
+                }
+            }
         }
     }
 
@@ -3618,6 +4024,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
+
+    uint64_t nKeysDecodedStart, nKeysAvoidedStart;
+    GetG1ElementDecodeStats(nKeysDecodedStart, nKeysAvoidedStart);
     LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
     CBlockUndo blockundo;
@@ -3629,18 +4038,23 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CAmount nBLSCTPublicFees = 0;
     CAmount nBLSCTPrivateFees = 0;
     int nInputs = 0;
+    unsigned int nBLSCTChecks = 0;
     int64_t nSigOpsCost = 0;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > addressHistory;
     std::map<CAddressHistoryKey, CAddressHistoryValue> addressHistoryMap;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
     std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
 
     CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // Declared before its control, whose destructor waits for the checks still writing to it
+    CBLSCTCheckResult blsctResult;
+    CCheckQueueControl<CBLSCTCheck> blsctControl(nScriptCheckThreads ? &blsctcheckqueue : nullptr);
+    // Range proofs of all the private transactions of the block, verified at once after the transaction loop
+    RangeproofBatch rangeproofBatch;
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
 
@@ -3913,7 +4327,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             // be in ConnectBlock because they require the UTXO set
             prevheights.resize(tx.vin.size());
             for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
+                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
             }
 
             // Which orphan pool entries must we evict?
@@ -3936,159 +4350,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             if (fAddressIndex || fSpentIndex)
             {
-                for (size_t j = 0; j < tx.vin.size(); j++) {
-
-                    const CTxIn input = tx.vin[j];
-                    const CTxOut &prevout = view.GetOutputFor(tx.vin[j]);
-                    uint160 hashBytes;
-                    int addressType, dummyType;
-
-                    if (prevout.scriptPubKey.IsPayToScriptHash()) {
-                        vector<unsigned char> hashBytes_(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
-                        uint160 hashBytes(hashBytes_);
-                        addressType = 2;
-
-                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey].voting_weight += prevout.nValue * -1;
-                    } else if (prevout.scriptPubKey.IsPayToPublicKeyHash() || prevout.scriptPubKey.IsPayToPublicKey()) {
-                        CTxDestination destination;
-                        ExtractDestination(prevout.scriptPubKey, destination);
-                        CNavcoinAddress address(destination);
-                        address.GetIndexKey(hashBytes, addressType);
-
-                        CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey].voting_weight += prevout.nValue * -1;
-                    } else if (prevout.scriptPubKey.IsColdStaking())
-                    {
-                        CTxDestination destination;
-                        uint160 hashBytesSpending, hashBytesStaking;
-                        CNavcoinAddress addressStaking, addresssSpending;
-
-                        ExtractDestination(prevout.scriptPubKey, destination);
-                        CNavcoinAddress address(destination);
-                        address.GetSpendingAddress(addresssSpending);
-                        address.GetIndexKey(hashBytes, addressType);
-                        addresssSpending.GetIndexKey(hashBytesSpending, addressType);
-
-                        CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey2].spendable += prevout.nValue * -1;
-
-                        address.GetStakingAddress(addressStaking);
-                        addressStaking.GetIndexKey(hashBytesStaking, dummyType);
-
-                        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKeyStaking].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyStaking].voting_weight += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyStaking2].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyStaking2].voting_weight += prevout.nValue * -1;
-
-                        hashBytes = hashBytesSpending;
-                    }
-                    else if (prevout.scriptPubKey.IsColdStakingv2())
-                    {
-                        CTxDestination destination;
-                        uint160 hashBytesStaking, hashBytesVoting, hashBytesSpending;
-                        CNavcoinAddress addressStaking, addressVoting, addresssSpending;
-
-                        ExtractDestination(prevout.scriptPubKey, destination);
-                        CNavcoinAddress address(destination);
-                        address.GetSpendingAddress(addresssSpending);
-                        address.GetIndexKey(hashBytes, addressType);
-                        addresssSpending.GetIndexKey(hashBytesSpending, addressType);
-
-                        CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKey) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKey].spendable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKey2].spendable += prevout.nValue * -1;
-
-                        address.GetStakingAddress(addressStaking);
-                        addressStaking.GetIndexKey(hashBytesStaking, dummyType);
-
-                        CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKeyStaking].stakable += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyStaking2].stakable += prevout.nValue * -1;
-
-                        address.GetVotingAddress(addressVoting);
-                        addressVoting.GetIndexKey(hashBytesVoting, dummyType);
-
-                        CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), pindex->nHeight, i, txhash, tx.nTime);
-                        CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, pindex->nHeight, i, txhash, tx.nTime);
-
-                        if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
-                            addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                        addressHistoryMap[addressHistoryKeyVoting].voting_weight += prevout.nValue * -1;
-                        addressHistoryMap[addressHistoryKeyVoting2].voting_weight += prevout.nValue * -1;
-
-                        hashBytes = hashBytesSpending;
-                    }
-                    else
-                    {
-                        hashBytes.SetNull();
-                        addressType = 0;
-                    }
-
-                    if (fAddressIndex && addressType > 0) {
-                        // record spending activity
-                        addressIndex.push_back(make_pair(CAddressIndexKey(addressType, hashBytes, pindex->nHeight, i, txhash, j, true), prevout.nValue * -1));
-
-                        // remove address from unspent index
-                        addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(addressType, hashBytes, input.prevout.hash, input.prevout.n), CAddressUnspentValue()));
-                    }
-
-                    if (fSpentIndex) {
-                        // add the spent index to determine the txid and input that spent an output
-                        // and to find the amount and address from an input
-                        spentIndex.push_back(make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(txhash, j, pindex->nHeight, prevout.nValue, addressType, hashBytes)));
-                    }
-                }
+                for (size_t j = 0; j < tx.vin.size(); j++)
+                    GetInputIndexEntries(tx, i, j, view.GetOutputFor(tx.vin[j]), pindex->nHeight, fAddressIndex, fSpentIndex,
+                                         addressIndex, addressHistoryMap, addressUnspentIndex, spentIndex);
             }
         }
 
@@ -4161,12 +4425,18 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             }
 
             std::vector<CScriptCheck> vChecks;
+            std::vector<CBLSCTCheck> vBLSCTChecks;
             std::vector<RangeproofEncodedData> dummyData;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, tx.IsCTOutput()?blsctData[i]:dummyData, txdata[i], nScriptCheckThreads ? &vChecks : nullptr))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, tx.IsCTOutput()?blsctData[i]:dummyData, txdata[i], nScriptCheckThreads ? &vChecks : nullptr, 0, &rangeproofBatch,
+                             nScriptCheckThreads ? &vBLSCTChecks : nullptr))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                              tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
+            nBLSCTChecks += vBLSCTChecks.size();
+            for (CBLSCTCheck& check: vBLSCTChecks)
+                check.SetResult(&blsctResult);
+            blsctControl.Add(vBLSCTChecks);
 
         } else {
             if (tx.nTime < block.nTime && pindex->nHeight > Params().GetConsensus().nCoinbaseTimeActivationHeight)
@@ -4174,166 +4444,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                              tx.nTime, block.nTime);
         }
 
-        if (fAddressIndex) {
-            for (unsigned int k = 0; k < tx.vout.size(); k++) {
-                const CTxOut &out = tx.vout[k];
-
-                if (out.scriptPubKey.IsPayToScriptHash()) {
-                    vector<unsigned char> hashBytes_(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
-                    uint160 hashBytes(hashBytes_);
-
-                    // record receiving activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(2, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(2, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-
-                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue()));
-
-                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
-                    addressHistoryMap[addressHistoryKey].stakable += out.nValue;
-                    addressHistoryMap[addressHistoryKey].voting_weight += out.nValue;
-                } else if (out.scriptPubKey.IsColdStaking())
-                {
-                    uint160 hashBytes, hashBytesStaking, hashBytesSpending;
-                    CNavcoinAddress addressSpending, addressStaking;
-                    int type = 0;
-                    CTxDestination destination;
-                    ExtractDestination(out.scriptPubKey, destination);
-                    CNavcoinAddress address(destination);
-                    address.GetSpendingAddress(addressSpending);
-                    address.GetIndexKey(hashBytes, type);
-                    addressSpending.GetIndexKey(hashBytesSpending, type);
-
-                    // record spending activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(type, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                    CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
-                    addressHistoryMap[addressHistoryKey2].spendable += out.nValue;
-
-                    address.GetStakingAddress(addressStaking);
-                    addressStaking.GetIndexKey(hashBytesStaking, type);
-
-                    CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKeyStaking].stakable += out.nValue;
-                    addressHistoryMap[addressHistoryKeyStaking].voting_weight += out.nValue;
-
-                    addressHistoryMap[addressHistoryKeyStaking2].stakable += out.nValue;
-                    addressHistoryMap[addressHistoryKeyStaking2].voting_weight += out.nValue;
-                }
-                else if (out.scriptPubKey.IsColdStakingv2())
-                {
-                    uint160 hashBytes, hashBytesStaking, hashBytesVoting, hashBytesSpending;
-                    CNavcoinAddress addressSpending, addressStaking, addressVoting;
-
-                    int type = 0;
-                    CTxDestination destination;
-                    ExtractDestination(out.scriptPubKey, destination);
-                    CNavcoinAddress address(destination);
-                    address.GetSpendingAddress(addressSpending);
-                    addressSpending.GetIndexKey(hashBytesSpending, type);
-                    address.GetIndexKey(hashBytes, type);
-
-                    // record spending activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(type, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, uint160(hashBytesSpending), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                    CAddressHistoryKey addressHistoryKey(uint160(hashBytes), uint160(hashBytesSpending), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKey2(hashBytesSpending, hashBytesSpending, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
-
-                    if (addressHistoryMap.count(addressHistoryKey2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKey2].spendable += out.nValue;
-
-                    address.GetVotingAddress(addressVoting);
-                    addressVoting.GetIndexKey(hashBytesVoting, type);
-
-                    CAddressHistoryKey addressHistoryKeyVoting(uint160(hashBytes), uint160(hashBytesVoting), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKeyVoting2(hashBytesVoting, hashBytesVoting, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKeyVoting) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKeyVoting].voting_weight += out.nValue;
-
-                    if (addressHistoryMap.count(addressHistoryKeyVoting2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyVoting2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKeyVoting2].voting_weight += out.nValue;
-
-                    address.GetStakingAddress(addressStaking);
-                    addressStaking.GetIndexKey(hashBytesStaking, type);
-
-                    CAddressHistoryKey addressHistoryKeyStaking(uint160(hashBytes), uint160(hashBytesStaking), pindex->nHeight, i, txhash, tx.nTime);
-                    CAddressHistoryKey addressHistoryKeyStaking2(hashBytesStaking, hashBytesStaking, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKeyStaking) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKeyStaking].stakable += out.nValue;
-
-                    if (addressHistoryMap.count(addressHistoryKeyStaking2) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKeyStaking2, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKeyStaking2].stakable += out.nValue;
-                }
-                else if (out.scriptPubKey.IsPayToPublicKey() || out.scriptPubKey.IsPayToPublicKeyHash())
-                {
-                    uint160 hashBytes;
-                    int type = 0;
-                    CTxDestination destination;
-                    ExtractDestination(out.scriptPubKey, destination);
-                    CNavcoinAddress address(destination);
-                    address.GetIndexKey(hashBytes, type);
-
-                    // record spending activity
-                    addressIndex.push_back(make_pair(CAddressIndexKey(type, uint160(hashBytes), pindex->nHeight, i, txhash, k, false), out.nValue));
-
-                    // record unspent output
-                    addressUnspentIndex.push_back(make_pair(CAddressUnspentKey(type, uint160(hashBytes), txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
-                    CAddressHistoryKey addressHistoryKey(hashBytes, hashBytes, pindex->nHeight, i, txhash, tx.nTime);
-
-                    if (addressHistoryMap.count(addressHistoryKey) == 0)
-                        addressHistoryMap.insert(std::make_pair(addressHistoryKey, CAddressHistoryValue(0, 0, 0, tx.IsCoinBase() || tx.IsCoinStake())));
-
-                    addressHistoryMap[addressHistoryKey].spendable += out.nValue;
-                    addressHistoryMap[addressHistoryKey].stakable += out.nValue;
-                    addressHistoryMap[addressHistoryKey].voting_weight += out.nValue;
-                } else {
-                    continue;
-                }
-
-            }
-        }
+        if (fAddressIndex)
+            GetOutputIndexEntries(tx, i, pindex->nHeight, addressIndex, addressHistoryMap, addressUnspentIndex);
 
         bool fContribution = false;
         CAmount nProposalFee = 0;
@@ -4642,7 +4754,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
                 nMovedToBLS += nCalculatedStakeReward - nStakeReward;
 
-                if (!VerifyBLSCTBalanceOutputs(block.vtx[1], v.GetKey(), blsctData[1], view, state, false, nCalculatedStakeReward - nStakeReward))
+                if (!VerifyBLSCTBalanceOutputs(block.vtx[1], v.GetKey(), blsctData[1], view, state, false, nCalculatedStakeReward - nStakeReward, &rangeproofBatch))
                     return error("%s: Stake %s failed verification of private output: %s\n", __func__, block.vtx[1].GetHash().ToString(), FormatStateMessage(state));
             }
             catch(...)
@@ -4659,11 +4771,31 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (pindex->nPrivateMoneySupply < 0)
         return state.DoS(100, error("ConnectBlock() : private money supply goes in negative"));
 
+    // The BLSCT checks queued so far keep running on the worker threads while the range proofs are batch verified
+    int64_t nTime41 = GetTimeMicros();
+    if (!rangeproofBatch.Verify(state))
+        return error("ConnectBlock(): %s", FormatStateMessage(state));
+
+    if (!blsctControl.Wait()) {
+        std::string strRejectReason = blsctResult.GetRejectReason();
+        return state.DoS(100, error("ConnectBlock(): BLSCT verification failed: %s", strRejectReason), REJECT_INVALID,
+                         strRejectReason.empty() ? "bad-blsct-proof" : strRejectReason);
+    }
+    int64_t nTime42 = GetTimeMicros(); nTimeVerifyBLSCT += nTime42 - nTime41;
+
     if (!control.Wait()) {
         return state.DoS(100, false);
     }
-    int64_t nTime44 = GetTimeMicros(); nTimeVerify += nTime44 - nTime2;
+    int64_t nTime44 = GetTimeMicros(); nTimeVerify += nTime44 - nTime2; nTimeVerifyScripts += nTime44 - nTime42;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime44 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime44 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
+    LogPrint("bench", "      - Verify BLSCT (%u range proofs, %u checks): %.2fms [%.2fs]\n", (unsigned)rangeproofBatch.size(), nBLSCTChecks, 0.001 * (nTime42 - nTime41), nTimeVerifyBLSCT * 0.000001);
+    if (LogAcceptCategory("bench"))
+    {
+        uint64_t nKeysDecoded, nKeysAvoided;
+        GetG1ElementDecodeStats(nKeysDecoded, nKeysAvoided);
+        LogPrint("bench", "      - BLSCT keys: %u decompressed, %u decompressions avoided\n", nKeysDecoded - nKeysDecodedStart, nKeysAvoided - nKeysAvoidedStart);
+    }
+    LogPrint("bench", "      - Verify scripts: %.2fms [%.2fs]\n", 0.001 * (nTime44 - nTime42), nTimeVerifyScripts * 0.000001);
 
     if (fJustCheck)
         return true;
@@ -4687,29 +4819,25 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
+    // The index entries are written in batches by the index writer thread
+    CIndexUpdate indexUpdate;
+    indexUpdate.hashBlock = pindex->GetBlockHash();
+
     if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
+        indexUpdate.vTxIndex.swap(vPos);
 
     if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
+        indexUpdate.vAddressIndex.swap(addressIndex);
+        indexUpdate.vAddressHistory.reserve(addressHistoryMap.size());
         for (auto &it: addressHistoryMap)
         {
-            addressHistory.push_back(std::make_pair(it.first, it.second));
-        }
-        if (!pblocktree->WriteAddressHistory(addressHistory)) {
-            return AbortNode(state, "Failed to write address history");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
-            return AbortNode(state, "Failed to write address unspent index");
+            indexUpdate.vAddressHistory.push_back(std::make_pair(it.first, it.second));
         }
+        indexUpdate.vAddressUnspentIndex.swap(addressUnspentIndex);
     }
 
     if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
+        indexUpdate.vSpentIndex.swap(spentIndex);
 
     if (fTimestampIndex) {
         unsigned int logicalTS = pindex->nTime;
@@ -4717,7 +4845,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
         // retrieve logical timestamp of the previous block
         if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+            if (!indexWriter.GetLogicalTimestamp(pindex->pprev->GetBlockHash(), prevLogicalTS))
                 LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
 
         if (logicalTS <= prevLogicalTS) {
@@ -4725,13 +4853,14 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
         }
 
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
+        indexUpdate.fTimestampIndex = true;
+        indexUpdate.nLogicalTimestamp = logicalTS;
     }
 
+    if (fTxIndex || fAddressIndex || fSpentIndex || fTimestampIndex)
+        if (!indexWriter.Push(indexUpdate))
+            return AbortNode(state, "Failed to write block indexes");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -4852,13 +4981,16 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Typical Coin structures on disk are around 48 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
+        // The indexes must not fall behind the chainstate on disk
+        if (!indexWriter.Sync())
+            return AbortNode(state, "Failed to write block indexes");
         // Flush the chainstate (which may refer to block index entries).
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
@@ -4967,6 +5099,16 @@ void static UpdateTip(CBlockIndex *pindexNew, uint256 statehash, const CChainPar
 
 }
 
+/** Cross-check the incrementally maintained DAO state hash against a full walk of the DAO entries. */
+void static CheckDAOStateHash(CStateViewCache& view, const uint256& statehash, const CBlockIndex* pindex)
+{
+    uint256 fullscanhash = GetDAOStateHashFullScan(view, pindex->nCFLocked, pindex->nCFSupply);
+    if (statehash != fullscanhash)
+        LogPrintf("ERROR: %s: DAO state hash mismatch at height %d: incremental=%s full scan=%s\n", __func__,
+                  pindex->nHeight, statehash.ToString(), fullscanhash.ToString());
+    assert(statehash == fullscanhash);
+}
+
 /** Disconnect chainActive's tip. You probably want to call mempool.removeForReorg and manually re-limit mempool size after this, with cs_main held. */
 bool static DisconnectTip(CValidationState& state, const CChainParams& chainparams, bool fBare = false)
 {
@@ -4986,8 +5128,10 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         if (!VoteStep(state, pindexDelete, true, view))
             return error("DisconnectTip(): VoteStep failed");
         assert(view.Flush());
-        if (GetBoolArg("-debugstatehash", false))
+        if (GetBoolArg("-debugstatehash", false) || GetBoolArg("-checkdaostatehash", false))
             statehash = GetDAOStateHash(view, pindexDelete->pprev->nCFLocked, pindexDelete->pprev->nCFSupply);
+        if (GetBoolArg("-checkdaostatehash", false))
+            CheckDAOStateHash(view, statehash, pindexDelete->pprev);
     }
     LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
 
@@ -5078,8 +5222,10 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
         if (!VoteStep(state, pindexNew, false, view))
             return error("ConnectTip(): VoteStep failed");
         nTime4 = GetTimeMicros(); nTimeConnectTotal += nTime4 - nTime3;
-        if (GetBoolArg("-debugstatehash", false))
+        if (GetBoolArg("-debugstatehash", false) || GetBoolArg("-checkdaostatehash", false))
             statehash = GetDAOStateHash(view, pindexNew->nCFLocked, pindexNew->nCFSupply);
+        if (GetBoolArg("-checkdaostatehash", false))
+            CheckDAOStateHash(view, statehash, pindexNew);
         assert(view.Flush());
     }
     int64_t nTime5 = GetTimeMicros(); nTimeFlush += nTime5 - nTime4;
@@ -5865,6 +6011,12 @@ bool IsExcludeEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& pa
     return (VersionBitsState(pindexPrev, params, Consensus::DEPLOYMENT_EXCLUDE, versionbitscache) == THRESHOLD_ACTIVE);
 }
 
+bool IsBLSCTViewTagEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params)
+{
+    LOCK(cs_main);
+    return (VersionBitsState(pindexPrev, params, Consensus::DEPLOYMENT_BLSCT_VIEWTAG, versionbitscache) == THRESHOLD_ACTIVE);
+}
+
 bool IsVoteCacheStateEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
     LOCK(cs_main);
@@ -6078,14 +6230,15 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
 
     bool fColdStakingEnabled = IsColdStakingEnabled(pindexPrev, Params().GetConsensus());
     bool fColdStakingv2Enabled = IsColdStakingv2Enabled(pindexPrev, Params().GetConsensus());
+    bool fBLSCTViewTagEnabled = IsBLSCTViewTagEnabled(pindexPrev, Params().GetConsensus());
 
-    // Check that all transactions are finalized and no early cold stake
+    // Check that all transactions are finalized and no early cold stake or view tags
     for(const CTransaction& tx: block.vtx) {
         if (!IsFinalTx(tx, nHeight, nLockTimeCutoff)) {
             return state.DoS(10, false, REJECT_INVALID, "bad-txns-nonfinal", false, "non-final transaction");
         }
 
-        if (!fColdStakingEnabled || !fColdStakingv2Enabled)
+        if (!fColdStakingEnabled || !fColdStakingv2Enabled || !fBLSCTViewTagEnabled)
         {
             for (const CTxOut& txout: tx.vout)
             {
@@ -6093,6 +6246,8 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, CBlockIn
                     return state.DoS(100, false, REJECT_INVALID, "cold-staking-not-enabled");
                 if(txout.scriptPubKey.IsColdStakingv2() && !fColdStakingv2Enabled)
                     return state.DoS(100, false, REJECT_INVALID, "cold-staking-v2-not-enabled");
+                if(!txout.viewTag.empty() && !fBLSCTViewTagEnabled)
+                    return state.DoS(100, false, REJECT_INVALID, "bad-txns-vout-viewtag-premature");
             }
         }
     }
@@ -6498,6 +6653,43 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char
     return GetDataDir() / "blocks" / strprintf("%s%05u.dat", prefix, pos.nFile);
 }
 
+/**
+ * The entries loaded from disk at startup are allocated in chunks of
+ * nBlockIndexArenaChunk entries instead of one heap allocation each. Such
+ * entries must not be deleted one by one, see FreeBlockIndex().
+ */
+static std::vector<std::pair<CBlockIndex*, size_t>> vBlockIndexArenas;
+static size_t nBlockIndexArenaUsed = 0;
+static size_t nBlockIndexArenaChunk = 0;
+
+/** Allocate the next entries in chunks of nChunk, or one by one again when 0 */
+void ReserveBlockIndex(size_t nChunk)
+{
+    nBlockIndexArenaChunk = nChunk;
+}
+
+static bool IsArenaBlockIndex(const CBlockIndex* pindex)
+{
+    for (const std::pair<CBlockIndex*, size_t>& arena: vBlockIndexArenas)
+        if (pindex >= arena.first && pindex < arena.first + arena.second)
+            return true;
+    return false;
+}
+
+static void FreeBlockIndex()
+{
+    for(BlockMap::value_type& entry: mapBlockIndex) {
+        if (!IsArenaBlockIndex(entry.second))
+            delete entry.second;
+    }
+    mapBlockIndex.clear();
+
+    for (const std::pair<CBlockIndex*, size_t>& arena: vBlockIndexArenas)
+        delete[] arena.first;
+    vBlockIndexArenas.clear();
+    nBlockIndexArenaUsed = 0;
+}
+
 CBlockIndex * InsertBlockIndex(uint256 hash)
 {
     if (hash.IsNull())
@@ -6509,7 +6701,15 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew;
+    if (nBlockIndexArenaChunk > 0 && (vBlockIndexArenas.empty() || nBlockIndexArenaUsed == vBlockIndexArenas.back().second)) {
+        vBlockIndexArenas.push_back(std::make_pair(new CBlockIndex[nBlockIndexArenaChunk], nBlockIndexArenaChunk));
+        nBlockIndexArenaUsed = 0;
+    }
+    if (!vBlockIndexArenas.empty() && nBlockIndexArenaUsed < vBlockIndexArenas.back().second)
+        pindexNew = &vBlockIndexArenas.back().first[nBlockIndexArenaUsed++];
+    else
+        pindexNew = new CBlockIndex();
     if (!pindexNew)
         throw runtime_error("LoadBlockIndex(): new CBlockIndex failed");
     mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
@@ -6522,9 +6722,14 @@ bool static LoadBlockIndexDB()
 {
     uiInterface.InitMessage(_("Loading block guts..."));
     const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, InsertProposalVotes, InsertPaymentRequestVotes, InsertSupport, InsertConsultationVotes))
+    int64_t nTimeStart = GetTimeMillis();
+    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex, ReserveBlockIndex, InsertProposalVotes, InsertPaymentRequestVotes, InsertSupport, InsertConsultationVotes,
+                                        GetBoolArg("-verifyblockindexhashes", DEFAULT_VERIFY_BLOCK_INDEX_HASHES)))
         return false;
 
+    int64_t nTimeGuts = GetTimeMillis();
+    LogPrintf("%s: loaded %u block index entries in %dms\n", __func__, mapBlockIndex.size(), nTimeGuts - nTimeStart);
+
     boost::this_thread::interruption_point();
 
     uiInterface.InitMessage(_("Loading block index..."));
@@ -6544,14 +6749,42 @@ bool static LoadBlockIndexDB()
         vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
     }
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for(const PAIRTYPE(int, CBlockIndex*)& item: vSortedByHeight)
+
+    int64_t nTimeSort = GetTimeMillis();
+    LogPrintf("%s: sorted %u entries by height in %dms\n", __func__, vSortedByHeight.size(), nTimeSort - nTimeGuts);
+
+    // The work of every block does not depend on its ancestors, so it is
+    // computed over all the cores before being summed up along the chain
+    std::vector<arith_uint256> vBlockProof(vSortedByHeight.size());
+    {
+        int nThreads = std::max(GetNumCores(), 1);
+        size_t nPerThread = (vSortedByHeight.size() + nThreads - 1) / nThreads;
+        boost::thread_group threadGroup;
+        for (int t = 0; t < nThreads; t++)
+        {
+            size_t nBegin = t * nPerThread;
+            size_t nEnd = std::min(nBegin + nPerThread, vSortedByHeight.size());
+            if (nBegin >= nEnd)
+                break;
+            threadGroup.create_thread([&vSortedByHeight, &vBlockProof, nBegin, nEnd]() {
+                for (size_t i = nBegin; i < nEnd; i++)
+                    vBlockProof[i] = GetBlockProof(*vSortedByHeight[i].second);
+            });
+        }
+        threadGroup.join_all();
+    }
+
+    int64_t nTimeProof = GetTimeMillis();
+    LogPrintf("%s: computed the block proofs in %dms\n", __func__, nTimeProof - nTimeSort);
+
+    for (size_t i = 0; i < vSortedByHeight.size(); i++)
     {
         if (++nMapBlockInc % PROGRESS_INTERVAL == 0) {
             // Update the progress
             uiInterface.ShowProgress(_("Loading block index..."),  (int)((float) nMapBlockInc / (float) vSortedByHeight.size() * 50));
         }
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+        CBlockIndex* pindex = vSortedByHeight[i].second;
+        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + vBlockProof[i];
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -6576,6 +6809,8 @@ bool static LoadBlockIndexDB()
             pindexBestHeader = pindex;
     }
 
+    LogPrintf("%s: linked the chain in %dms\n", __func__, GetTimeMillis() - nTimeProof);
+
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
     vinfoBlockFile.resize(nLastBlockFile + 1);
@@ -6643,6 +6878,23 @@ bool static LoadBlockIndexDB()
         return true;
     chainActive.SetTip(it->second);
 
+    // The index writer stores the block each index is synced to
+    for (const std::string& name: CIndexWriter::GetIndexNames())
+    {
+        uint256 hashIndexBest;
+        if (!pblocktree->ReadIndexBestBlock(name, hashIndexBest))
+        {
+            // Written before the index writer existed, when the indexes were always in sync
+            pblocktree->WriteIndexBestBlock(name, chainActive.Tip()->GetBlockHash());
+            continue;
+        }
+
+        BlockMap::iterator mi = mapBlockIndex.find(hashIndexBest);
+        // Ahead of the chain state is fine, those blocks are indexed again when reconnected
+        if (mi == mapBlockIndex.end() || mi->second->nHeight < chainActive.Height())
+            LogPrintf("%s: WARNING: %s is synced to block %s, not to the chain tip. Restart with -reindex to rebuild it\n", __func__, name, hashIndexBest.ToString());
+    }
+
     PruneBlockIndexCandidates();
 
     LogPrintf("%s: hashBestChain=%s height=%d date=%s progress=%f\n", __func__,
@@ -7020,10 +7272,7 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for(BlockMap::value_type& entry: mapBlockIndex) {
-        delete entry.second;
-    }
-    mapBlockIndex.clear();
+    FreeBlockIndex();
     fHavePruned = false;
 }
 
@@ -7509,12 +7758,13 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
                 recentRejects->reset();
             }
 
-            // Use pcoinsTip->HaveCoinsInCache as a quick approximation to exclude
-            // requesting or processing some txs which have already been included in a block
+            // Use pcoinsTip->HaveCoinInCache as a quick approximation to exclude
+            // requesting or processing some txs which have already been included in a block.
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    mapOrphanTransactions.count(inv.hash) ||
-                   pcoinsTip->HaveCoinsInCache(inv.hash);
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
         }
     case MSG_AGGSESSION:
         return mempool.HaveAggregationSession(inv.hash);
@@ -10059,16 +10309,211 @@ ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::D
     return VersionBitsState(chainActive.Tip(), params, pos, versionbitscache);
 }
 
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+
+static std::atomic<bool> fMempoolLoaded(false);
+
+void SetMempoolLoaded(bool fLoaded)
+{
+    fMempoolLoaded = fLoaded;
+}
+
+bool IsMempoolLoaded()
+{
+    return fMempoolLoaded;
+}
+
+// Accepts a batch of the transactions read from the dump holding cs_main, so
+// blocks and peers are not held back for the whole file
+static void LoadMempoolBatch(std::vector<std::pair<CTransaction, int64_t> >& vBatch, bool fStem, int64_t& nLoaded, int64_t& nFailed, int64_t& nExpired)
+{
+    int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    int64_t nNow = GetTime();
+
+    LOCK(cs_main);
+
+    for (const auto& it: vBatch)
+    {
+        const CTransaction& tx = it.first;
+        CValidationState state;
+
+        if (it.second + nExpiryTimeout <= nNow) {
+            nExpired++;
+            continue;
+        }
+
+        if (fStem)
+        {
+            if (stempool.exists(tx.GetHash()))
+                continue;
+
+            if (!AcceptToMemoryPoolWithTime(stempool, &mempool.cs, &stempool.cs, state, tx, false, nullptr, it.second)) {
+                nFailed++;
+                continue;
+            }
+
+            // The stem routes of the last run are gone, so the transaction is
+            // fluffed when its embargo expires
+            int64_t nCurrTime = GetTimeMicros();
+            InsertDandelionEmbargo(tx.GetHash(), 1000000*DANDELION_EMBARGO_MINIMUM+PoissonNextSend(nCurrTime, DANDELION_EMBARGO_AVG_ADD));
+            nLoaded++;
+        }
+        else
+        {
+            if (!AcceptToMemoryPoolWithTime(mempool, &mempool.cs, &stempool.cs, state, tx, false, nullptr, it.second)) {
+                nFailed++;
+                continue;
+            }
+
+            CValidationState dandelionState;
+            AcceptToMemoryPoolWithTime(stempool, &mempool.cs, &stempool.cs, dandelionState, tx, false, nullptr, it.second);
+            nLoaded++;
+        }
+    }
+
+    vBatch.clear();
+}
+
+static bool LoadMempoolEntries(CAutoFile& file, bool fStem, int64_t& nLoaded, int64_t& nFailed, int64_t& nExpired)
+{
+    uint64_t nCount;
+    file >> nCount;
+
+    std::vector<std::pair<CTransaction, int64_t> > vBatch;
+    vBatch.reserve(std::min(nCount, (uint64_t)MEMPOOL_LOAD_BATCH));
+
+    while (nCount--)
+    {
+        CTransaction tx;
+        int64_t nTime;
+        file >> tx;
+        file >> nTime;
+        vBatch.push_back(std::make_pair(tx, nTime));
+
+        if (vBatch.size() == MEMPOOL_LOAD_BATCH || nCount == 0)
+        {
+            LoadMempoolBatch(vBatch, fStem, nLoaded, nFailed, nExpired);
+
+            if (ShutdownRequested())
+                return false;
+        }
+    }
+
+    return true;
+}
+
+bool LoadMempool()
+{
+    FILE* filestr = fopen((GetDataDir() / "mempool.dat").string().c_str(), "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    int64_t nStart = GetTimeMicros();
+    int64_t nLoaded = 0, nFailed = 0, nExpired = 0;
+    int64_t nStemLoaded = 0, nStemFailed = 0, nStemExpired = 0;
+
+    try {
+        uint64_t nVersion;
+        file >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION) {
+            LogPrintf("Unknown mempool file version %u. Continuing anyway.\n", nVersion);
+            return false;
+        }
+
+        // The deltas go first, so they are applied when the transactions are accepted
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+
+        for (const auto& it: mapDeltas) {
+            mempool.PrioritiseTransaction(it.first, it.first.ToString(), it.second.first, it.second.second);
+            stempool.PrioritiseTransaction(it.first, it.first.ToString(), it.second.first, it.second.second);
+        }
+
+        if (!LoadMempoolEntries(file, false, nLoaded, nFailed, nExpired) ||
+            !LoadMempoolEntries(file, true, nStemLoaded, nStemFailed, nStemExpired))
+            return false;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired\n", nLoaded, nFailed, nExpired);
+    LogPrintf("Imported stempool transactions from disk: %i succeeded, %i failed, %i expired\n", nStemLoaded, nStemFailed, nStemExpired);
+    LogPrint("bench", "Loaded mempool in %.2fms\n", 0.001 * (GetTimeMicros() - nStart));
+
+    return true;
+}
+
+bool DumpMempool()
+{
+    int64_t nStart = GetTimeMicros();
+
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    std::vector<TxMempoolInfo> vInfo;
+    std::vector<TxMempoolInfo> vStemInfo;
+
+    {
+        LOCK(mempool.cs);
+        mapDeltas = mempool.mapDeltas;
+        vInfo = mempool.infoAll();
+    }
+
+    // The stempool also holds the transactions of the mempool, only the ones
+    // still in the stem phase are written apart
+    std::set<uint256> setMempool;
+    for (const TxMempoolInfo& info: vInfo)
+        setMempool.insert(info.tx->GetHash());
+
+    for (const TxMempoolInfo& info: stempool.infoAll())
+        if (!setMempool.count(info.tx->GetHash()))
+            vStemInfo.push_back(info);
+
+    int64_t nMid = GetTimeMicros();
+
+    try {
+        FILE* filestr = fopen((GetDataDir() / "mempool.dat.new").string().c_str(), "wb");
+        if (!filestr)
+            return false;
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t nVersion = MEMPOOL_DUMP_VERSION;
+        file << nVersion;
+
+        file << mapDeltas;
+
+        for (const std::vector<TxMempoolInfo>* pvInfo: {&vInfo, &vStemInfo}) {
+            file << (uint64_t)pvInfo->size();
+            for (const TxMempoolInfo& info: *pvInfo) {
+                file << *(info.tx);
+                file << (int64_t)info.nTime;
+            }
+        }
+
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Dumped mempool (%u transactions, %u in the stempool): %gs to copy, %gs to dump\n", vInfo.size(), vStemInfo.size(),
+              (nMid - nStart) * 0.000001, (GetTimeMicros() - nMid) * 0.000001);
+
+    return true;
+}
+
 class CMainCleanup
 {
 public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
-        mapBlockIndex.clear();
+        FreeBlockIndex();
 
         // orphan transactions
         mapOrphanTransactions.clear();
@@ -10366,10 +10811,10 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
 }
 
 
-static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, bool fPrintProofOfStake)
+static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits, unsigned int nTimeBlockFrom, unsigned int nTxPrevTime, CAmount nValueIn, const COutPoint& prevout, unsigned int nTimeTx, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
 
-    if (nTimeTx < txPrev.nTime)  // Transaction timestamp violation
+    if (nTimeTx < nTxPrevTime)  // Transaction timestamp violation
         return error("CheckStakeKernelHash() : nTime violation");
 
 
@@ -10379,13 +10824,9 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
     // Base target
     targetProofOfStake.SetCompact(nBits);
 
-    // Weighted target
-    int64_t nValueIn = txPrev.vout[prevout.n].nValue;
-    arith_uint512 bnWeight = arith_uint512(nValueIn);
-
-    // We need to convert to uint512 to prevent overflow when multiplying by 1st block coins
-    base_uint<512> targetProofOfStake512(targetProofOfStake.GetHex());
-    targetProofOfStake512 *= bnWeight;
+    // Weighted target, when it does not fit in 256 bits every hash meets it
+    arith_uint256 bnWeightedTarget;
+    bool fTargetOverflow = !GetWeightedStakeTarget(targetProofOfStake, nValueIn, bnWeightedTarget);
 
     uint64_t nStakeModifier = pindexPrev->nStakeModifier;
     int nStakeModifierHeight = pindexPrev->nHeight;
@@ -10393,29 +10834,26 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
 
     // Calculate hash
     CDataStream ss(SER_GETHASH, 0);
-    ss << nStakeModifier << nTimeBlockFrom << txPrev.nTime << prevout.hash << prevout.n << nTimeTx;
+    ss << nStakeModifier << nTimeBlockFrom << nTxPrevTime << prevout.hash << prevout.n << nTimeTx;
     hashProofOfStake = UintToArith256(Hash(ss.begin(), ss.end()));
 
-    if (fPrintProofOfStake)
+    if (fPrintProofOfStake && LogAcceptCategory("stakemodifier"))
     {
         LogPrint("stakemodifier","CheckStakeKernelHash() : using modifier 0x%016x at height=%d timestamp=%s for block from timestamp=%s\n",
             nStakeModifier, nStakeModifierHeight,
             DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nStakeModifierTime),
             DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeBlockFrom));
-        LogPrint("stakemodifier","CheckStakeKernelHash() : check modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s bnTarget=%s nBits=%08x nValueIn=%d bnWeight=%s\n",
+        LogPrint("stakemodifier","CheckStakeKernelHash() : check modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s bnTarget=%s nBits=%08x nValueIn=%d\n",
             nStakeModifier,
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
-            hashProofOfStake.ToString(), targetProofOfStake512.ToString(), nBits, nValueIn,bnWeight.ToString());
+            nTimeBlockFrom, nTxPrevTime, prevout.n, nTimeTx,
+            hashProofOfStake.ToString(), fTargetOverflow ? "overflow" : bnWeightedTarget.ToString(), nBits, nValueIn);
     }
 
-    // We need to convert type so it can be compared to target
-    base_uint<512> hashProofOfStake512(hashProofOfStake.GetHex());
-
     // Now check if proof-of-stake hash meets target protocol
-    if (hashProofOfStake512 > targetProofOfStake512)
+    if (!fTargetOverflow && hashProofOfStake > bnWeightedTarget)
       return false;
 
-    if (fDebug && !fPrintProofOfStake)
+    if (fDebug && !fPrintProofOfStake && LogAcceptCategory("stakemodifier"))
     {
         LogPrint("stakemodifier","CheckStakeKernelHash() : using modifier 0x%016x at height=%d timestamp=%s for block from timestamp=%s\n",
             nStakeModifier, nStakeModifierHeight,
@@ -10423,7 +10861,7 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
             DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeBlockFrom));
         LogPrint("stakemodifier","CheckStakeKernelHash() : pass modifier=0x%016x nTimeBlockFrom=%u nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
             nStakeModifier,
-            nTimeBlockFrom, txPrev.nTime, prevout.n, nTimeTx,
+            nTimeBlockFrom, nTxPrevTime, prevout.n, nTimeTx,
             hashProofOfStake.ToString());
     }
 
@@ -10433,7 +10871,7 @@ static bool CheckStakeKernelHashV2(CBlockIndex* pindexPrev, unsigned int nBits,
 bool CheckStakeKernelHash(CBlockIndex* pindexPrev, unsigned int nBits, CBlockIndex& blockFrom, const CTransaction& txPrev, const COutPoint& prevout, unsigned int nTimeTx, arith_uint256& hashProofOfStake, arith_uint256& targetProofOfStake, bool fPrintProofOfStake)
 {
     // if (IsProtocolV2(pindexPrev->nHeight+1))
-        return CheckStakeKernelHashV2(pindexPrev, nBits, blockFrom.GetBlockTime(), txPrev, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, true);
+        return CheckStakeKernelHashV2(pindexPrev, nBits, blockFrom.GetBlockTime(), txPrev.nTime, txPrev.vout[prevout.n].nValue, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, true);
     // else
         // return CheckStakeKernelHashV1(nBits, blockFrom, nTxPrevOffset, txPrev, prevout, nTimeTx, hashProofOfStake, targetProofOfStake, fPrintProofOfStake);
 }
@@ -10495,11 +10933,11 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, const CTransaction& tx, unsigned
     {
         PrecomputedTransactionData txdata(tx);
         const COutPoint &prevout = tx.vin[0].prevout;
-        const CCoins* coins = view.AccessCoins(prevout.hash);
-        assert(coins);
+        const Coin& coin = view.AccessCoin(prevout);
+        assert(!coin.IsSpent());
 
         // Verify signature
-        CScriptCheck check(*coins, tx, 0, SCRIPT_VERIFY_NONE, false, &txdata);
+        CScriptCheck check(coin.out, tx, 0, SCRIPT_VERIFY_NONE, false, &txdata);
         if (pvChecks) {
             pvChecks->push_back(CScriptCheck());
             check.swap(pvChecks->back());
@@ -48,9 +48,11 @@
 static const int64_t MAX_MINT_PROOF_OF_STAKE = 0.1 * COIN;
 
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
 class CBloomFilter;
 class CChainParams;
+struct CIndexUpdate;
 class CInv;
 class CPaymentRequest;
 class CProposal;
@@ -90,6 +92,10 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Transactions accepted at a time while loading the mempool from disk */
+static const unsigned int MEMPOOL_LOAD_BATCH = 100;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -240,6 +246,8 @@ static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = MIN_BLOCKS_TO_KEEP;
 static const unsigned int DEFAULT_CHECKLEVEL = 4;
+/** Whether to recompute the hash of every block index entry on startup */
+static const bool DEFAULT_VERIFY_BLOCK_INDEX_HASHES = false;
 
 /** Fixed delay for Dandelion embargo in seconds */
 static const int64_t EMBARGO_FIXED_DELAY = 10;
@@ -280,6 +288,8 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat) */
 FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
+/** Write the undo data of a block at pos, which is moved to the start of the data */
+bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart);
 /** Translation to a filesystem path */
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
@@ -300,6 +310,8 @@ bool ProcessMessages(CNode* pfrom);
 bool SendMessages(CNode* pto);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the BLSCT checking thread */
+void ThreadBLSCTCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -357,6 +369,18 @@ bool RemoveBLSCTConflicting(CTxMemPool& pool, const CTxIn& txin, CCriticalSectio
 bool AcceptToMemoryPool(CTxMemPool& pool, CCriticalSection *mpcs, CCriticalSection *spcs, CValidationState &state, const CTransaction &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
+/** (try to) add transaction to memory pool with a specified acceptance time **/
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CCriticalSection *mpcs, CCriticalSection *spcs, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
+
+/** Load the mempool and the stempool from disk, accepting the transactions in batches */
+bool LoadMempool();
+/** Dump the mempool and the stempool to disk */
+bool DumpMempool();
+/** Whether the mempool was loaded from disk, so it can be dumped */
+void SetMempoolLoaded(bool fLoaded);
+bool IsMempoolLoaded();
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -401,7 +425,8 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CStateViewCache& i
  * instead of being performed inline.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CStateViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, std::vector<RangeproofEncodedData>& blsctData, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL, CAmount allowedInPrivate = 0);
+                 unsigned int flags, bool cacheStore, std::vector<RangeproofEncodedData>& blsctData, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL, CAmount allowedInPrivate = 0,
+                 RangeproofBatch* pRangeproofBatch = NULL, std::vector<CBLSCTCheck> *pvBLSCTChecks = NULL);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CStateViewCache& inputs, int nHeight);
@@ -466,8 +491,8 @@ private:
 
 public:
     CScriptCheck(): amount(0), ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
+    CScriptCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
+        scriptPubKey(outIn.scriptPubKey), amount(outIn.nValue),
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
@@ -495,8 +520,13 @@ bool GetAddressIndex(uint160 addressHash, int type,
 bool GetAddressHistory(uint160 addressHash, uint160 addressHash2,
                      std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &addressHistory,
                      AddressHistoryFilter filter = AddressHistoryFilter::ALL, int start = 0, int end = 0);
+/** Hash of the active block at nHeight, to tell whether an address history checkpoint is still valid */
+bool GetAddressHistoryCheckpointHash(int nHeight, uint256& hash);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+/** Index entries of an active block, rebuilt from the block and undo files for the given indexes */
+bool ReadIndexUpdate(const CBlockIndex* pindex, bool fTx, bool fAddress, bool fSpent, bool fTimestamp,
+                     unsigned int nPrevLogicalTimestamp, CIndexUpdate& update);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -562,6 +592,9 @@ bool IsColdStakingPoolFeeEnabled(const CBlockIndex* pindexPrev, const Consensus:
 
 bool IsExcludeEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params);
 
+/** Check whether blsCT outputs may carry a view tag. */
+bool IsBLSCTViewTagEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params);
+
 /** When there are blocks in the active chain with missing data, rewind the chainstate and remove them from the block index */
 bool RewindBlockIndex(const CChainParams& params);
 
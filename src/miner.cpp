@@ -624,6 +624,46 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemP
 }
 
 void BlockAssembler::addCombinedBLSCT(const CStateViewCache& inputs)
+{
+    CTransaction combinedTx;
+    CValidationState state;
+
+    {
+        LOCK(stempool.cs);
+
+        if (stempool.blsctAggregate.empty())
+            return;
+
+        if (!stempool.blsctAggregate.GetCombined(combinedTx, inputs, state))
+        {
+            LogPrint("blsct", "%s: Could not use the combined stempool transaction: %s\n", __func__, FormatStateMessage(state));
+            combineStempoolBLSCT(inputs);
+            return;
+        }
+    }
+
+    if (!inputs.HaveInputs(combinedTx))
+    {
+        LogPrint("blsct", "%s: Missing inputs of the combined stempool transaction\n", __func__);
+        combineStempoolBLSCT(inputs);
+        return;
+    }
+
+    CAmount nMovedToPublic = inputs.GetValueIn(combinedTx) - combinedTx.GetValueOut();
+
+    if (chainActive.Tip()->nPrivateMoneySupply + nMovedToPublic < 0)
+    {
+        error("%s: Did not add BLS transactions to block, it would bring the private pool in negative!", __func__);
+        return;
+    }
+
+    nFees += combinedTx.GetFee();
+    pblock->vtx.push_back(combinedTx);
+}
+
+// Combines the stempool transactions whose inputs are available, for when the
+// transaction kept by the stempool can not be used as it is
+void BlockAssembler::combineStempoolBLSCT(const CStateViewCache& inputs)
 {
     std::set<CTransaction> setToCombine;
     std::vector<RangeproofEncodedData> blsctData;
@@ -631,9 +671,11 @@ void BlockAssembler::addCombinedBLSCT(const CStateViewCache& inputs)
 
     CAmount nMovedToPublic = 0;
 
+    LOCK(stempool.cs);
+
     for (auto &it: stempool.mapTx)
     {
-        CTransaction tx = it.GetTx();
+        const CTransaction& tx = it.GetTx();
 
         if (!tx.IsBLSInput())
             continue;
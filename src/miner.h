@@ -191,7 +191,9 @@ private:
     void addPriorityTxs(bool fProofOfStake, int blockTime);
     /** Add transactions based on feerate including unconfirmed ancestors */
     void addPackageTxs();
+    /** Add the stempool BLS input transactions, combined in one transaction */
     void addCombinedBLSCT(const CStateViewCache& inputs);
+    void combineStempoolBLSCT(const CStateViewCache& inputs);
 
     // helper function for addPriorityTxs
     /** Test if tx will still "fit" in the block */
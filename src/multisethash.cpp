@@ -0,0 +1,76 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <multisethash.h>
+
+#include <crypto/common.h>
+#include <hash.h>
+
+/** Expand a 256-bit element digest to the 2048-bit group element it stands for. */
+static void ExpandElement(const uint256& element, unsigned char out[CMultisetHash::SIZE])
+{
+    for (unsigned char i = 0; i < CMultisetHash::SIZE / CSHA256::OUTPUT_SIZE; i++)
+        CSHA256().Write(element.begin(), element.size()).Write(&i, 1).Finalize(out + i * CSHA256::OUTPUT_SIZE);
+}
+
+bool CMultisetHash::IsNull() const
+{
+    for (size_t i = 0; i < SIZE; i++)
+        if (data[i] != 0)
+            return false;
+    return true;
+}
+
+void CMultisetHash::Add(const unsigned char* b)
+{
+    uint64_t carry = 0;
+    for (size_t i = 0; i < SIZE; i += 4) {
+        carry += (uint64_t)ReadLE32(data + i) + ReadLE32(b + i);
+        WriteLE32(data + i, (uint32_t)carry);
+        carry >>= 32;
+    }
+}
+
+void CMultisetHash::Sub(const unsigned char* b)
+{
+    int64_t borrow = 0;
+    for (size_t i = 0; i < SIZE; i += 4) {
+        borrow += (int64_t)ReadLE32(data + i) - ReadLE32(b + i);
+        WriteLE32(data + i, (uint32_t)borrow);
+        borrow = borrow < 0 ? -1 : 0;
+    }
+}
+
+CMultisetHash& CMultisetHash::Insert(const uint256& element)
+{
+    unsigned char expanded[SIZE];
+    ExpandElement(element, expanded);
+    Add(expanded);
+    return *this;
+}
+
+CMultisetHash& CMultisetHash::Remove(const uint256& element)
+{
+    unsigned char expanded[SIZE];
+    ExpandElement(element, expanded);
+    Sub(expanded);
+    return *this;
+}
+
+CMultisetHash& CMultisetHash::operator+=(const CMultisetHash& b)
+{
+    Add(b.data);
+    return *this;
+}
+
+CMultisetHash& CMultisetHash::operator-=(const CMultisetHash& b)
+{
+    Sub(b.data);
+    return *this;
+}
+
+uint256 CMultisetHash::Finalize() const
+{
+    return Hash(data, data + SIZE);
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef NAVCOIN_MULTISETHASH_H
+#define NAVCOIN_MULTISETHASH_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Order-independent hash of a multiset of elements.
+ *
+ * Each element digest is expanded to a 2048-bit value and the multiset is
+ * represented by the sum of the expanded values modulo 2^2048 (MSet-Add-Hash).
+ * Insertions and removals are O(1) and commute, and the difference between two
+ * states can be carried around as another CMultisetHash and added later, which
+ * is what lets layered caches push their changes down to their parent view.
+ */
+class CMultisetHash
+{
+public:
+    static const size_t SIZE = 256;
+
+    CMultisetHash() { SetNull(); }
+
+    void SetNull() { memset(data, 0, sizeof(data)); }
+    bool IsNull() const;
+
+    /** Add an element, identified by its 256-bit digest. */
+    CMultisetHash& Insert(const uint256& element);
+
+    /** Remove an element, identified by its 256-bit digest. */
+    CMultisetHash& Remove(const uint256& element);
+
+    CMultisetHash& operator+=(const CMultisetHash& b);
+    CMultisetHash& operator-=(const CMultisetHash& b);
+
+    friend bool operator==(const CMultisetHash& a, const CMultisetHash& b) { return memcmp(a.data, b.data, sizeof(a.data)) == 0; }
+    friend bool operator!=(const CMultisetHash& a, const CMultisetHash& b) { return !(a == b); }
+
+    /** Compact 256-bit commitment to the current multiset. */
+    uint256 Finalize() const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(FLATDATA(data));
+    }
+
+private:
+    //! Little-endian 2048-bit accumulator
+    unsigned char data[SIZE];
+
+    void Add(const unsigned char* b);
+    void Sub(const unsigned char* b);
+};
+
+#endif // NAVCOIN_MULTISETHASH_H
@@ -5,9 +5,13 @@
 
 #include <primitives/transaction.h>
 #include <hash.h>
+#include <memusage.h>
 #include <tinyformat.h>
 #include <utilstrencodings.h>
 
+#include <atomic>
+#include <stdexcept>
+
 std::string COutPoint::ToString() const
 {
     return strprintf("COutPoint(%s, %u)", hash.ToString().substr(0,10), n);
@@ -55,7 +59,131 @@ CTxOut::CTxOut(const CAmount& nValueIn, CScript scriptPubKeyIn, const bls::G1Ele
     ephemeralKey = ephemeralKeyIn.Serialize();
     outputKey = outputKeyIn.Serialize();
     spendingKey = spendingKeyIn.Serialize();
+    SetBulletproof(bpIn);
+}
+
+CTxOut::CTxOut(const CTxOut& txout) : nValue(txout.nValue), scriptPubKey(txout.scriptPubKey), bp(txout.bp),
+    ephemeralKey(txout.ephemeralKey), outputKey(txout.outputKey), spendingKey(txout.spendingKey), viewTag(txout.viewTag),
+    bpDecoded(std::atomic_load(&txout.bpDecoded)), ephemeralKeyDecoded(std::atomic_load(&txout.ephemeralKeyDecoded)),
+    outputKeyDecoded(std::atomic_load(&txout.outputKeyDecoded)), spendingKeyDecoded(std::atomic_load(&txout.spendingKeyDecoded))
+{
+}
+
+CTxOut& CTxOut::operator=(const CTxOut& txout)
+{
+    if (this != &txout)
+    {
+        nValue = txout.nValue;
+        scriptPubKey = txout.scriptPubKey;
+        bp = txout.bp;
+        ephemeralKey = txout.ephemeralKey;
+        outputKey = txout.outputKey;
+        spendingKey = txout.spendingKey;
+        viewTag = txout.viewTag;
+        std::atomic_store(&bpDecoded, std::atomic_load(&txout.bpDecoded));
+        std::atomic_store(&ephemeralKeyDecoded, std::atomic_load(&txout.ephemeralKeyDecoded));
+        std::atomic_store(&outputKeyDecoded, std::atomic_load(&txout.outputKeyDecoded));
+        std::atomic_store(&spendingKeyDecoded, std::atomic_load(&txout.spendingKeyDecoded));
+    }
+    return *this;
+}
+
+std::shared_ptr<const BulletproofsRangeproof> CTxOut::GetBulletproofRef() const
+{
+    std::shared_ptr<const BulletproofsRangeproof> ret = std::atomic_load(&bpDecoded);
+    if (ret)
+        return ret;
+
+    if (bp.size() == 0)
+    {
+        static const std::shared_ptr<const BulletproofsRangeproof> empty = std::make_shared<const BulletproofsRangeproof>();
+        return empty;
+    }
+
+    // Concurrent callers might decode twice, but all of them get an equivalent proof.
+    ret = std::make_shared<const BulletproofsRangeproof>(bp);
+    std::atomic_store(&bpDecoded, ret);
+    return ret;
+}
+
+void CTxOut::SetBulletproof(const BulletproofsRangeproof& bpIn)
+{
     bp = bpIn.GetVch();
+    std::atomic_store(&bpDecoded, std::make_shared<const BulletproofsRangeproof>(bpIn));
+}
+
+void CTxOut::SetBulletproof(const std::vector<uint8_t>& bpIn)
+{
+    bp = bpIn;
+    std::atomic_store(&bpDecoded, std::shared_ptr<const BulletproofsRangeproof>());
+}
+
+size_t CTxOut::DecodedBulletproofUsage() const
+{
+    std::shared_ptr<const BulletproofsRangeproof> decoded = std::atomic_load(&bpDecoded);
+    if (!decoded)
+        return 0;
+    return memusage::MallocUsage(sizeof(BulletproofsRangeproof)) + memusage::DynamicUsage(decoded->V) +
+           memusage::DynamicUsage(decoded->L) + memusage::DynamicUsage(decoded->R);
+}
+
+static std::atomic<uint64_t> nG1ElementDecoded(0);
+static std::atomic<uint64_t> nG1ElementDecodeAvoided(0);
+
+void GetG1ElementDecodeStats(uint64_t& nDecoded, uint64_t& nAvoided)
+{
+    nDecoded = nG1ElementDecoded;
+    nAvoided = nG1ElementDecodeAvoided;
+}
+
+bls::G1Element CTxOut::GetDecodedKey(std::shared_ptr<const CDecodedG1Element>& decoded, const std::vector<uint8_t>& vch)
+{
+    std::shared_ptr<const CDecodedG1Element> ret = std::atomic_load(&decoded);
+
+    // The keys are public members, so the cached point is only trusted while its bytes match
+    if (ret && ret->vch == vch)
+    {
+        nG1ElementDecodeAvoided++;
+        return ret->point;
+    }
+
+    // Like FromBytes on the vector data, only the first bytes of a longer key are read
+    if (vch.size() < bls::G1Element::SIZE)
+        throw std::length_error("CTxOut::GetDecodedKey(): key is too short");
+
+    bls::G1Element point = bls::G1Element::FromBytes(vch.data());
+    nG1ElementDecoded++;
+
+    // Concurrent callers might decode twice, but all of them get the same point.
+    std::atomic_store(&decoded, std::make_shared<const CDecodedG1Element>(vch, point));
+    return point;
+}
+
+bls::G1Element CTxOut::GetEphemeralKey() const
+{
+    return GetDecodedKey(ephemeralKeyDecoded, ephemeralKey);
+}
+
+bls::G1Element CTxOut::GetOutputKey() const
+{
+    return GetDecodedKey(outputKeyDecoded, outputKey);
+}
+
+bls::G1Element CTxOut::GetSpendingKey() const
+{
+    return GetDecodedKey(spendingKeyDecoded, spendingKey);
+}
+
+size_t CTxOut::DecodedKeysUsage() const
+{
+    size_t nUsage = 0;
+    for (const std::shared_ptr<const CDecodedG1Element>* p: {&ephemeralKeyDecoded, &outputKeyDecoded, &spendingKeyDecoded})
+    {
+        std::shared_ptr<const CDecodedG1Element> decoded = std::atomic_load(p);
+        if (decoded)
+            nUsage += memusage::MallocUsage(sizeof(CDecodedG1Element)) + memusage::DynamicUsage(decoded->vch);
+    }
+    return nUsage;
 }
 
 uint256 CTxOut::GetHash() const
@@ -75,7 +203,7 @@ std::string CTxOut::ToString() const
                          spendingKey.size()>0 ? strprintf(" spendingKey=%s",HexStr(spendingKey)):"",
                          outputKey.size()>0 ? strprintf(" outputKey=%s",HexStr(outputKey)):"",
                          ephemeralKey.size()>0 ? strprintf(" ephemeralKey=%s",HexStr(ephemeralKey)):"",
-                         GetBulletproof().V.size()>0 ? " rangeProof=1":"");
+                         HasRangeProof() ? " rangeProof=1":"");
     }
 }
 
@@ -15,6 +15,8 @@
 #include <uint256.h>
 #include <univalue/include/univalue.h>
 
+#include <memory>
+
 #define TX_BLS_INPUT_FLAG 0x10
 #define TX_BLS_CT_FLAG 0x20
 
@@ -151,6 +153,18 @@ public:
     std::string ToString() const;
 };
 
+/** A point together with the bytes it was decoded from. A cached point is only used while they still match. */
+struct CDecodedG1Element
+{
+    std::vector<uint8_t> vch;
+    bls::G1Element point;
+
+    CDecodedG1Element(const std::vector<uint8_t>& vchIn, const bls::G1Element& pointIn) : vch(vchIn), point(pointIn) {}
+};
+
+/** Number of BLSCT output keys decompressed so far, and of decompressions avoided by their cache. */
+void GetG1ElementDecodeStats(uint64_t& nDecoded, uint64_t& nAvoided);
+
 /** An output of a transaction.  It contains the public key that the next input
  * must be able to sign with to claim it.
  */
@@ -163,6 +177,8 @@ public:
     std::vector<uint8_t> ephemeralKey;
     std::vector<uint8_t> outputKey;
     std::vector<uint8_t> spendingKey;
+    //! Short hash of the shared key, lets the receiver discard outputs which are not for it before any recovery.
+    std::vector<uint8_t> viewTag;
 
     CTxOut()
     {
@@ -172,6 +188,11 @@ public:
     CTxOut(const CAmount& nValueIn, CScript scriptPubKeyIn);
     CTxOut(const CAmount& nValueIn, CScript scriptPubKeyIn, const bls::G1Element& ephemeralKeyIn, const bls::G1Element& outputKeyIn, const bls::G1Element& spendingKeyIn, const BulletproofsRangeproof& bpIn);
 
+    CTxOut(const CTxOut& txout);
+    CTxOut(CTxOut&& txout) = default;
+    CTxOut& operator=(const CTxOut& txout);
+    CTxOut& operator=(CTxOut&& txout) = default;
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -179,15 +200,20 @@ public:
         if (ser_action.ForRead())
         {
             READWRITE(nValue);
-            if (nValue == ~(uint64_t)0)
+            if (nValue == ~(uint64_t)0 || nValue == ~(uint64_t)1)
             {
+                bool fViewTag = nValue == ~(uint64_t)1;
                 READWRITE(nValue);
                 READWRITE(ephemeralKey);
                 READWRITE(outputKey);
                 READWRITE(spendingKey);
+                if (fViewTag)
+                    READWRITE(viewTag);
                 BulletproofsRangeproof bp_;
                 READWRITE(bp_);
                 bp = bp_.GetVch();
+                // Keep the proof we just decoded, validation needs it right away
+                bpDecoded = std::make_shared<const BulletproofsRangeproof>(std::move(bp_));
             }
             READWRITE(*(CScriptBase*)(&scriptPubKey));
         }
@@ -195,14 +221,25 @@ public:
         {
             if (IsBLSCT())
             {
-                CAmount nMarker = ~(uint64_t)0;
+                // Outputs with a view tag use their own marker, so the older ones keep their serialization
+                CAmount nMarker = viewTag.empty() ? ~(uint64_t)0 : ~(uint64_t)1;
                 READWRITE(nMarker);
                 READWRITE(nValue);
                 READWRITE(ephemeralKey);
                 READWRITE(outputKey);
                 READWRITE(spendingKey);
-                BulletproofsRangeproof bp_(bp);
-                READWRITE(bp_);
+                if (!viewTag.empty())
+                    READWRITE(viewTag);
+                if (bp.empty())
+                {
+                    BulletproofsRangeproof bp_;
+                    READWRITE(bp_);
+                }
+                else
+                {
+                    // bp already holds the serialized proof, no need to decode it
+                    READWRITE(REF(CFlatData(bp)));
+                }
             }
             else
             {
@@ -219,15 +256,36 @@ public:
         ephemeralKey.clear();
         outputKey.clear();
         spendingKey.clear();
+        viewTag.clear();
+        SetBulletproof(std::vector<uint8_t>());
     }
 
+    //! Decoded range proof. bp is parsed at most once and the result is shared between the copies of this output.
+    std::shared_ptr<const BulletproofsRangeproof> GetBulletproofRef() const;
+
     BulletproofsRangeproof GetBulletproof() const
     {
-        if (bp.size() == 0)
-            return BulletproofsRangeproof();
-        return BulletproofsRangeproof(bp);
+        return *GetBulletproofRef();
     }
 
+    //! Replace the range proof, keeping its decoded form.
+    void SetBulletproof(const BulletproofsRangeproof& bpIn);
+
+    //! Replace the serialized range proof. It will be decoded again on first use.
+    void SetBulletproof(const std::vector<uint8_t>& bpIn);
+
+    //! Memory used by the decoded range proof, if it has been decoded.
+    size_t DecodedBulletproofUsage() const;
+
+    //! Decoded ephemeralKey, outputKey and spendingKey. Every key is decompressed at most once and
+    //! shared between the copies of this output. They throw like bls::G1Element::FromBytes.
+    bls::G1Element GetEphemeralKey() const;
+    bls::G1Element GetOutputKey() const;
+    bls::G1Element GetSpendingKey() const;
+
+    //! Memory used by the decoded keys.
+    size_t DecodedKeysUsage() const;
+
     bool IsBLSCT() const
     {
         return ephemeralKey.size() > 0 || spendingKey.size() > 0 || outputKey.size() > 0;
@@ -235,7 +293,8 @@ public:
 
     bool HasRangeProof() const
     {
-        return GetBulletproof().V.size() > 0;
+        // The serialized proof starts with the compact size of V, so there is no need to decode it.
+        return bp.size() > 0 && bp[0] != 0;
     }
 
     bool IsNull() const
@@ -324,6 +383,7 @@ public:
                 a.ephemeralKey == b.ephemeralKey &&
                 a.outputKey    == b.outputKey &&
                 a.spendingKey  == b.spendingKey &&
+                a.viewTag      == b.viewTag &&
                 a.bp           == b.bp);
     }
 
@@ -338,6 +398,17 @@ public:
     }
 
     std::string ToString() const;
+
+private:
+    //! Decoded form of bp, only accessed atomically through GetBulletproofRef and SetBulletproof.
+    mutable std::shared_ptr<const BulletproofsRangeproof> bpDecoded;
+
+    //! Decoded keys, only accessed atomically through GetDecodedKey.
+    mutable std::shared_ptr<const CDecodedG1Element> ephemeralKeyDecoded;
+    mutable std::shared_ptr<const CDecodedG1Element> outputKeyDecoded;
+    mutable std::shared_ptr<const CDecodedG1Element> spendingKeyDecoded;
+
+    static bls::G1Element GetDecodedKey(std::shared_ptr<const CDecodedG1Element>& decoded, const std::vector<uint8_t>& vch);
 };
 
 class CTxInWitness
@@ -11,6 +11,7 @@
 #include "coins.h"
 #include "consensus/validation.h"
 #include "consensus/daoconsensusparams.h"
+#include "indexbuilder.h"
 #include "main.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
@@ -742,6 +743,8 @@ UniValue getblockhashes(const UniValue& params, bool fHelp)
     if (fActiveOnly)
         LOCK(cs_main);
 
+    EnsureIndexSynced("timestampindex");
+
     if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
@@ -934,6 +937,23 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0), nTotalColdAmount(0), nTotalColdv2Amount(0) {}
 };
 
+static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        const CTxOut &out = output.second.out;
+        stats.nTransactionOutputs++;
+        ss << VARINT(output.first + 1);
+        ss << out;
+        stats.nTotalAmount += out.nValue;
+        if (out.scriptPubKey.IsColdStaking()) stats.nTotalColdAmount += out.nValue;
+        if (out.scriptPubKey.IsColdStakingv2()) stats.nTotalColdv2Amount += out.nValue;
+    }
+    ss << VARINT(0);
+}
+
 //! Calculate statistics about the unspent transaction output set
 static bool GetUTXOStats(CStateView *view, CCoinsStats &stats)
 {
@@ -946,38 +966,29 @@ static bool GetUTXOStats(CStateView *view, CCoinsStats &stats)
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
-    CAmount nTotalColdAmount = 0;
-    CAmount nTotalColdv2Amount = 0;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        uint256 key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coins)) {
-            stats.nTransactions++;
-            ss << key;
-            for (unsigned int i=0; i<coins.vout.size(); i++) {
-                const CTxOut &out = coins.vout[i];
-                if (!out.IsNull()) {
-                    stats.nTransactionOutputs++;
-                    ss << VARINT(i+1);
-                    ss << out;
-                    nTotalAmount += out.nValue;
-                    if (out.scriptPubKey.IsColdStaking()) nTotalColdAmount += out.nValue;
-                    if (out.scriptPubKey.IsColdStakingv2()) nTotalColdv2Amount += out.nValue;
-                }
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(stats, ss, prevkey, outputs);
+                outputs.clear();
             }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
             stats.nSerializedSize += 32 + pcursor->GetValueSize();
-            ss << VARINT(0);
         } else {
             return error("%s: unable to read value", __func__);
         }
         pcursor->Next();
     }
+    if (!outputs.empty()) {
+        ApplyStats(stats, ss, prevkey, outputs);
+    }
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
-    stats.nTotalColdAmount = nTotalColdAmount;
-    stats.nTotalColdv2Amount = nTotalColdv2Amount;
     return true;
 }
 
@@ -1027,6 +1038,10 @@ UniValue getcfunddbstatehash(const UniValue& params, bool fHelp)
         throw runtime_error(
                 "getcfunddbstatehash\n"
                 "\nReturns the hash of the Cfund DB current state.\n"
+                "\nThe hash commits to the locked and available fund amounts, an order-independent\n"
+                "multiset hash of the proposals, payment requests, consultations, answers and votes,\n"
+                "and the consensus parameters. It differs from the one returned by earlier versions\n"
+                "for the same state, so it should only be compared between nodes running this version.\n"
                 "\nResult\n"
                 "\"hex\"      (string) the hash hex encoded\n"
                 "\nExamples\n"
@@ -1341,7 +1356,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
                                                                                                        "        ,...\n"
                                                                                                        "     ]\n"
                                                                                                        "  },\n"
-                                                                                                       "  \"version\" : n,            (numeric) The version\n"
                                                                                                        "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
                                                                                                        "}\n"
 
@@ -1365,33 +1379,30 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
-    CCoins coins;
+    COutPoint out(hash, n);
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CStateViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out)) // TODO: filtering spent coins should be done by the CStateViewMemPool
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CStateViewMemPool
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin))
             return NullUniValue;
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex *pindex = it->second;
     ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT)
         ret.pushKV("confirmations", 0);
     else
-        ret.pushKV("confirmations", pindex->nHeight - coins.nHeight + 1);
-    ret.pushKV("value", ValueFromAmount(coins.vout[n].nValue));
+        ret.pushKV("confirmations", (int64_t)(pindex->nHeight - coin.nHeight + 1));
+    ret.pushKV("value", ValueFromAmount(coin.out.nValue));
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.pushKV("scriptPubKey", o);
-    ret.pushKV("version", coins.nVersion);
-    ret.pushKV("coinbase", coins.fCoinBase);
+    ret.pushKV("coinbase", (bool)coin.fCoinBase);
 
     return ret;
 }
@@ -1569,6 +1580,7 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     BIP9SoftForkDescPushBack(bip9_softforks, "dao_consensus", consensusParams, Consensus::DEPLOYMENT_DAO_CONSENSUS);
     BIP9SoftForkDescPushBack(bip9_softforks, "coldstaking_v2", consensusParams, Consensus::DEPLOYMENT_COLDSTAKING_V2);
     BIP9SoftForkDescPushBack(bip9_softforks, "exclude", consensusParams, Consensus::DEPLOYMENT_EXCLUDE);
+    BIP9SoftForkDescPushBack(bip9_softforks, "blsct_viewtag", consensusParams, Consensus::DEPLOYMENT_BLSCT_VIEWTAG);
     obj.pushKV("softforks",      softforks);
     obj.pushKV("bip9_softforks", bip9_softforks);
 
@@ -1713,6 +1725,11 @@ UniValue mempoolInfoToJSON()
     ret.pushKV("maxmempool", (int64_t) maxmempool);
     ret.pushKV("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK()));
 
+    uint64_t nDecoded, nAvoided;
+    GetG1ElementDecodeStats(nDecoded, nAvoided);
+    ret.pushKV("blsctkeydecompressions", nDecoded);
+    ret.pushKV("blsctkeydecompressionsavoided", nAvoided);
+
     return ret;
 }
 
@@ -1737,7 +1754,9 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
                 "  \"bytes\": xxxxx,              (numeric) Sum of all tx sizes\n"
                 "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
                 "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
-                "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
+                "  \"mempoolminfee\": xxxxx,      (numeric) Minimum fee for tx to be accepted\n"
+                "  \"blsctkeydecompressions\": xxxxx,        (numeric) BLSCT output keys decompressed since startup\n"
+                "  \"blsctkeydecompressionsavoided\": xxxxx  (numeric) Uses of BLSCT output keys served from their decoded form\n"
                 "}\n"
                 "\nExamples:\n"
                 + HelpExampleCli("getmempoolinfo", "")
@@ -1767,6 +1786,26 @@ UniValue getstempoolinfo(const UniValue& params, bool fHelp)
     return stempoolInfoToJSON();
 }
 
+UniValue savemempool(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+                "savemempool\n"
+                "\nDumps the mempool and the dandelion stem pool to disk.\n"
+                "\nExamples:\n"
+                + HelpExampleCli("savemempool", "")
+                + HelpExampleRpc("savemempool", "")
+                );
+
+    if (!IsMempoolLoaded())
+        throw JSONRPCError(RPC_MISC_ERROR, "The mempool was not loaded yet");
+
+    if (!DumpMempool())
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump mempool to disk");
+
+    return NullUniValue;
+}
+
 UniValue getproposal(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -1940,6 +1979,96 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
     return NullUniValue;
 }
 
+void EnsureIndexSynced(const std::string& name)
+{
+    int nHeight;
+    if (!indexBuilder.IsBuilding(name, nHeight))
+        return;
+
+    int nTip;
+    {
+        LOCK(cs_main);
+        nTip = chainActive.Height();
+    }
+
+    throw JSONRPCError(RPC_IN_WARMUP, strprintf("The %s is syncing, %d of %d blocks indexed", name, std::max(nHeight, 0), nTip));
+}
+
+UniValue getindexinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+                "getindexinfo\n"
+                "\nReturns the state of the optional indexes.\n"
+                "\nResult:\n"
+                "{\n"
+                "  \"name\": {                (object) txindex, addressindex, spentindex or timestampindex\n"
+                "    \"status\": \"xxxx\",       (string) enabled, disabled, syncing, dropping or failed\n"
+                "    \"height\": n,            (numeric, optional) the last block indexed while syncing\n"
+                "    \"progress\": xxx.xxx,    (numeric, optional) fraction of the chain indexed while syncing\n"
+                "  },\n"
+                "  ...\n"
+                "}\n"
+                "\nExamples:\n"
+                + HelpExampleCli("getindexinfo", "")
+                + HelpExampleRpc("getindexinfo", "")
+                );
+
+    std::map<std::string, CIndexBuildStatus> mapStatus = indexBuilder.GetStatus();
+
+    LOCK(cs_main);
+
+    UniValue ret(UniValue::VOBJ);
+
+    for (const std::string& name: CIndexBuilder::GetNames())
+    {
+        UniValue obj(UniValue::VOBJ);
+        std::map<std::string, CIndexBuildStatus>::iterator it = mapStatus.find(name);
+
+        if (it == mapStatus.end()) {
+            obj.pushKV("status", CIndexBuilder::IsEnabled(name) ? "enabled" : "disabled");
+        } else if (it->second.fFailed) {
+            obj.pushKV("status", "failed");
+        } else if (it->second.fDropping) {
+            obj.pushKV("status", "dropping");
+        } else {
+            int nHeight = std::max(it->second.nHeight, 0);
+            obj.pushKV("status", "syncing");
+            obj.pushKV("height", nHeight);
+            obj.pushKV("progress", chainActive.Height() > 0 ? (double)nHeight / chainActive.Height() : 0.0);
+        }
+
+        ret.pushKV(name, obj);
+    }
+
+    return ret;
+}
+
+UniValue setindex(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+                "setindex \"name\" enable\n"
+                "\nBuilds or drops one of the optional indexes in the background, while the node keeps running.\n"
+                "The index answers queries once it is synced, see getindexinfo. The change is kept after a restart,\n"
+                "unless the matching command line option says otherwise.\n"
+                "\nArguments:\n"
+                "1. \"name\"       (string, required) txindex, addressindex, spentindex or timestampindex\n"
+                "2. enable       (boolean, required) true to build the index, false to drop it\n"
+                "\nExamples:\n"
+                + HelpExampleCli("setindex", "\"addressindex\" true")
+                + HelpExampleRpc("setindex", "\"addressindex\", true")
+                );
+
+    std::string name = params[0].get_str();
+    std::string strError;
+
+    if (!(params[1].get_bool() ? indexBuilder.Build(name, strError) : indexBuilder.Drop(name, strError)))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strError);
+
+    return NullUniValue;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -1954,6 +2083,7 @@ static const CRPCCommand commands[] =
   { "blockchain",         "getblockheader",         &getblockheader,         true  },
   { "blockchain",         "getchaintips",           &getchaintips,           true  },
   { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
+  { "blockchain",         "getindexinfo",           &getindexinfo,           true  },
   { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true  },
   { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true  },
   { "blockchain",         "getmempoolentry",        &getmempoolentry,        true  },
@@ -1964,6 +2094,8 @@ static const CRPCCommand commands[] =
   { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
   { "blockchain",         "gettxout",               &gettxout,               true  },
   { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
+  { "blockchain",         "savemempool",            &savemempool,            true  },
+  { "blockchain",         "setindex",               &setindex,               true  },
   { "blockchain",         "verifychain",            &verifychain,            true  },
   { "dao",                "listconsultations",      &listconsultations,      true  },
   { "dao",                "getconsultation",        &getconsultation,        true  },
@@ -141,6 +141,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblockhashes", 0 },
     { "getblockhashes", 1 },
     { "getblockhashes", 2 },
+    { "setindex", 1 },
     { "getspentinfo", 0},
     { "getaddresstxids", 0},
     { "getaddressbalance", 0},
@@ -148,6 +149,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getaddressdeltas", 0},
     { "getaddressutxos", 0},
     { "getaddressmempool", 0},
+    { "getstakehistory", 0 },
+    { "getstakehistory", 1 },
+    { "getstakehistory", 2 },
     { "staking", 0 },
     { "setexclude", 0 },
     { "coinbaseoutputs", 0 },
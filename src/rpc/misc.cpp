@@ -6,12 +6,14 @@
 #include <base58.h>
 #include <blsct/key.h>
 #include <clientversion.h>
+#include <indexwriter.h>
 #include <init.h>
 #include <main.h>
 #include <net.h>
 #include <netbase.h>
 #include <rpc/server.h>
 #include <timedata.h>
+#include <txdb.h>
 #include <txmempool.h>
 #include <util.h>
 #include <utilstrencodings.h>
@@ -902,6 +904,8 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<uint160, int> > addresses;
 
+    EnsureIndexSynced("addressindex");
+
     if (!getAddressesFromParams(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
@@ -1005,6 +1009,8 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<uint160, int> > addresses;
 
+    EnsureIndexSynced("addressindex");
+
     if (!getAddressesFromParams(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
@@ -1098,6 +1104,8 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<std::pair<uint160, uint160>, AddressHistoryFilter>> addresses;
 
+    EnsureIndexSynced("addressindex");
+
     if (!getAddressesFromParamsForHistory(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
@@ -1203,68 +1211,89 @@ UniValue getaddresshistory(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<std::pair<uint160, uint160>, AddressHistoryFilter>> addresses;
 
+    EnsureIndexSynced("addressindex");
+
     if (!getAddressesFromParamsForHistory(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > addressHistory;
-
-    for (std::vector<std::pair<std::pair<uint160, uint160>, AddressHistoryFilter>>::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressHistory((*it).first.first, (*it).first.second, addressHistory, (*it).second)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
+    if (!fAddressIndex) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
-    std::sort(addressHistory.begin(), addressHistory.end(), [](const std::pair<CAddressHistoryKey, CAddressHistoryValue> &a, const std::pair<CAddressHistoryKey, CAddressHistoryValue> &b) -> bool
-    {
-        auto a_ = a.first;
-        auto b_ = b.first;
-
-        if (a_.blockHeight == b_.blockHeight) {
-            return a_.txindex < b_.txindex;
-        } else {
-            return a_.blockHeight < b_.blockHeight;
-        }
-    });
-    
-    struct balStruct 
+    struct balStruct
     {
         CAmount spendable;
         CAmount stakable;
         CAmount voting_weight;
     };
-    
+
     std::map<CNavcoinAddress, balStruct> balance;
 
-    UniValue result(UniValue::VARR);
+    // One cursor per address, positioned at the start of the range with the
+    // balance up to there, whose entries are merged by height and txindex
+    std::vector<std::unique_ptr<CAddressHistoryCursor>> cursors;
+
+    if (!indexWriter.Sync())
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to write block indexes");
+
+    for (std::vector<std::pair<std::pair<uint160, uint160>, AddressHistoryFilter>>::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        cursors.emplace_back(new CAddressHistoryCursor(*pblocktree, (*it).first.first, (*it).first.second, (*it).second, GetAddressHistoryCheckpointHash));
+        if (!cursors.back()->Seek(range ? start : 0)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
 
-    for (std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> >::const_iterator it=addressHistory.begin(); it!=addressHistory.end(); it++) {
         CNavcoinAddress address;
-        address.Set(CKeyID((*it).first.hashBytes2));
+        address.Set(CKeyID((*it).first.second));
 
         if (balance.count(address) == 0) {
             balance.insert(std::make_pair(address, (struct balStruct){.spendable = 0, .stakable = 0, .voting_weight = 0}));
         }
-       
-        balance[address].spendable += (*it).second.spendable;
-        balance[address].stakable += (*it).second.stakable;
-        balance[address].voting_weight += (*it).second.voting_weight;
-        
-        if (!(!range || (range && (*it).first.blockHeight >= start && (*it).first.blockHeight <= end)))
-            continue;
+
+        balance[address].spendable += cursors.back()->GetSpendable();
+        balance[address].stakable += cursors.back()->GetStakable();
+        balance[address].voting_weight += cursors.back()->GetVotingWeight();
+    }
+
+    UniValue result(UniValue::VARR);
+
+    while (true) {
+        CAddressHistoryCursor* next = nullptr;
+
+        for (auto& cursor: cursors) {
+            if (!cursor->Valid(range ? end : 0))
+                continue;
+            if (next == nullptr ||
+                cursor->GetKey().blockHeight < next->GetKey().blockHeight ||
+                (cursor->GetKey().blockHeight == next->GetKey().blockHeight && cursor->GetKey().txindex < next->GetKey().txindex))
+                next = cursor.get();
+        }
+
+        if (next == nullptr)
+            break;
+
+        const CAddressHistoryKey& key = next->GetKey();
+        CAddressHistoryValue value = next->GetValue();
+
+        CNavcoinAddress address;
+        address.Set(CKeyID(key.hashBytes2));
+
+        balance[address].spendable += value.spendable;
+        balance[address].stakable += value.stakable;
+        balance[address].voting_weight += value.voting_weight;
 
         UniValue entry(UniValue::VOBJ);
-        entry.pushKV("block", (*it).first.blockHeight);
-        entry.pushKV("txindex", (uint64_t)(*it).first.txindex);
-        entry.pushKV("time", (uint64_t)(*it).first.time);
-        entry.pushKV("txid", (*it).first.txhash.ToString());
+        entry.pushKV("block", key.blockHeight);
+        entry.pushKV("txindex", (uint64_t)key.txindex);
+        entry.pushKV("time", (uint64_t)key.time);
+        entry.pushKV("txid", key.txhash.ToString());
         entry.pushKV("address", address.ToString());
 
         UniValue changes(UniValue::VOBJ);
-        changes.pushKV("balance", (*it).second.spendable);
-        changes.pushKV("stakable", (*it).second.stakable);
-        changes.pushKV("voting_weight", (*it).second.voting_weight);
-        changes.pushKV("flags", (*it).second.flags);
+        changes.pushKV("balance", value.spendable);
+        changes.pushKV("stakable", value.stakable);
+        changes.pushKV("voting_weight", value.voting_weight);
+        changes.pushKV("flags", value.flags);
         entry.pushKV("changes", changes);
 
         UniValue balanceObj(UniValue::VOBJ);
@@ -1274,6 +1303,10 @@ UniValue getaddresshistory(const UniValue& params, bool fHelp)
         entry.pushKV("result", balanceObj);
 
         result.push_back(entry);
+
+        if (!next->Next()) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read the address history");
+        }
     }
 
     return result;
@@ -1308,6 +1341,8 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
 
     std::vector<std::pair<uint160, int> > addresses;
 
+    EnsureIndexSynced("addressindex");
+
     if (!getAddressesFromParams(params, addresses)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
@@ -1399,6 +1434,8 @@ UniValue getspentinfo(const UniValue& params, bool fHelp)
     CSpentIndexKey key(txid, outputIndex);
     CSpentIndexValue value;
 
+    EnsureIndexSynced("spentindex");
+
     if (!GetSpentIndex(key, value)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
     }
@@ -0,0 +1,135 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txdb.h>
+
+#include <test/test_navcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addresshistory_tests, BasicTestingSetup)
+
+static int nReorgHeight = -1;
+
+static bool GetTestBlockHash(int nHeight, uint256& hash)
+{
+    hash = ArithToUint256(arith_uint256(nHeight + (nHeight >= nReorgHeight && nReorgHeight >= 0 ? 1000000 : 0)));
+    return true;
+}
+
+// Balances right before nStart, walked from genesis
+static void GetExpectedBalance(const std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> >& vHistory, int nStart, CAmount& spendable, CAmount& stakable)
+{
+    spendable = stakable = 0;
+    for (const auto& it: vHistory) {
+        if (it.first.blockHeight >= nStart)
+            break;
+        spendable += it.second.spendable;
+        stakable += it.second.stakable;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(address_history_cursor)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    uint160 addressHash(std::vector<unsigned char>(20, 1));
+    uint160 addressHash2(std::vector<unsigned char>(20, 2));
+
+    // Several entries per block, enough for a few checkpoints, written block
+    // by block as the index writer does
+    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > vHistory;
+    std::vector<CIndexUpdate> vUpdates;
+    for (int nHeight = 1; nHeight <= 1000; nHeight++) {
+        CIndexUpdate update;
+        BOOST_CHECK(GetTestBlockHash(nHeight, update.hashBlock));
+        for (int i = 0; i < 3; i++) {
+            vHistory.push_back(std::make_pair(CAddressHistoryKey(addressHash, addressHash2, nHeight, i, uint256(), nHeight),
+                                              CAddressHistoryValue(nHeight * 10 + i, i - 1, 0, 0)));
+            update.vAddressHistory.push_back(vHistory.back());
+        }
+        vUpdates.push_back(update);
+        if (nHeight % 100 == 0) {
+            BOOST_CHECK(db.WriteIndexUpdates(vUpdates));
+            vUpdates.clear();
+        }
+    }
+
+    nReorgHeight = -1;
+
+    // The checkpoints are written along with the entries
+    std::vector<std::pair<int, CAddressHistoryCheckpoint> > vCheckpoints;
+    BOOST_CHECK(db.ReadAddressHistoryCheckpoints(addressHash, addressHash2, 1001, vCheckpoints));
+    BOOST_CHECK_EQUAL(vCheckpoints.size(), 2U);
+    for (const auto& it: vCheckpoints) {
+        CAmount spendable, stakable;
+        GetExpectedBalance(vHistory, it.first + 1, spendable, stakable);
+        BOOST_CHECK_EQUAL(it.second.spendable, spendable);
+        BOOST_CHECK_EQUAL(it.second.stakable, stakable);
+    }
+
+    for (int nStart: {1, 2, 333, 334, 999, 1001}) {
+        CAddressHistoryCursor cursor(db, addressHash, addressHash2, AddressHistoryFilter::ALL, GetTestBlockHash);
+        BOOST_CHECK(cursor.Seek(nStart));
+
+        CAmount spendable, stakable;
+        GetExpectedBalance(vHistory, nStart, spendable, stakable);
+        BOOST_CHECK_EQUAL(cursor.GetSpendable(), spendable);
+        BOOST_CHECK_EQUAL(cursor.GetStakable(), stakable);
+        BOOST_CHECK_EQUAL(cursor.Valid(), nStart <= 1000);
+        if (cursor.Valid())
+            BOOST_CHECK_EQUAL(cursor.GetKey().blockHeight, nStart);
+
+        // The filtered out fields stay at zero
+        CAddressHistoryCursor cursorStakable(db, addressHash, addressHash2, AddressHistoryFilter::STAKABLE, GetTestBlockHash);
+        BOOST_CHECK(cursorStakable.Seek(nStart));
+        BOOST_CHECK_EQUAL(cursorStakable.GetSpendable(), 0);
+        BOOST_CHECK_EQUAL(cursorStakable.GetStakable(), stakable);
+    }
+
+    // Reading does not write any checkpoint
+    std::vector<std::pair<int, CAddressHistoryCheckpoint> > vCheckpointsAfter;
+    BOOST_CHECK(db.ReadAddressHistoryCheckpoints(addressHash, addressHash2, 1001, vCheckpointsAfter));
+    BOOST_CHECK_EQUAL(vCheckpointsAfter.size(), vCheckpoints.size());
+
+    // Disconnecting a block erases the checkpoint at its height
+    CIndexUpdate disconnect;
+    disconnect.fDisconnect = true;
+    for (const auto& it: vHistory)
+        if (it.first.blockHeight == vCheckpoints.back().first)
+            disconnect.vAddressHistory.push_back(it);
+    BOOST_CHECK(db.WriteIndexUpdates(std::vector<CIndexUpdate>(1, disconnect)));
+    vCheckpointsAfter.clear();
+    BOOST_CHECK(db.ReadAddressHistoryCheckpoints(addressHash, addressHash2, 1001, vCheckpointsAfter));
+    BOOST_CHECK_EQUAL(vCheckpointsAfter.size(), vCheckpoints.size() - 1);
+
+    // Connecting it again brings the checkpoint back
+    CIndexUpdate connect;
+    connect.hashBlock = vCheckpoints.back().second.blockHash;
+    connect.vAddressHistory = disconnect.vAddressHistory;
+    BOOST_CHECK(db.WriteIndexUpdates(std::vector<CIndexUpdate>(1, connect)));
+    vCheckpointsAfter.clear();
+    BOOST_CHECK(db.ReadAddressHistoryCheckpoints(addressHash, addressHash2, 1001, vCheckpointsAfter));
+    BOOST_CHECK_EQUAL(vCheckpointsAfter.size(), vCheckpoints.size());
+
+    // Checkpoints from blocks which are no longer active are ignored
+    nReorgHeight = 500;
+    CAddressHistoryCursor cursor(db, addressHash, addressHash2, AddressHistoryFilter::ALL, GetTestBlockHash);
+    BOOST_CHECK(cursor.Seek(900));
+    CAmount spendable, stakable;
+    GetExpectedBalance(vHistory, 900, spendable, stakable);
+    BOOST_CHECK_EQUAL(cursor.GetSpendable(), spendable);
+
+    // Walking the range adds every entry to the balance
+    int nCount = 0;
+    while (cursor.Valid(950)) {
+        BOOST_CHECK(cursor.Next());
+        nCount++;
+    }
+    BOOST_CHECK_EQUAL(nCount, 51 * 3);
+    GetExpectedBalance(vHistory, 951, spendable, stakable);
+    BOOST_CHECK_EQUAL(cursor.GetSpendable(), spendable);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
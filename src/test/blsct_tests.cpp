@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <blsct/aggregationsession.h>
 #include <blsct/transaction.h>
 #include <chainparams.h>
 #include <coins.h>
@@ -14,6 +15,8 @@
 
 #include <vector>
 #include <map>
+#include <memory>
+#include <set>
 
 #include <boost/test/unit_test.hpp>
 
@@ -86,9 +89,33 @@ BOOST_AUTO_TEST_CASE(blsct)
     std::vector<bls::G2Element> vBLSSignatures;
     bls::G1Element nonce;
 
-    BOOST_CHECK(CreateBLSCTOutput(bk, nonce, prevTx.vout[1], destKey, 10*COIN, "", gammaPrevOut, strFailReason, false, vBLSSignatures));
-
-    view.ModifyCoins(prevTx.GetHash())->FromTx(prevTx, 0);
+    BOOST_CHECK(CreateBLSCTOutput(bk, nonce, prevTx.vout[1], destKey, 10*COIN, "", gammaPrevOut, strFailReason, false, vBLSSignatures, true));
+
+    AddCoins(view, prevTx, 0);
+
+    // View tag
+    BOOST_CHECK(prevTx.vout[1].viewTag.size() == VIEW_TAG_SIZE);
+    BOOST_CHECK(pwalletMain->HaveBLSCTSubAddress(prevTx.vout[1].outputKey, prevTx.vout[1].spendingKey, prevTx.vout[1].viewTag));
+    std::vector<unsigned char> wrongViewTag = prevTx.vout[1].viewTag;
+    wrongViewTag[0] ^= 1;
+    BOOST_CHECK(!pwalletMain->HaveBLSCTSubAddress(prevTx.vout[1].outputKey, prevTx.vout[1].spendingKey, wrongViewTag));
+
+    CDataStream ssViewTag(SER_NETWORK, PROTOCOL_VERSION);
+    ssViewTag << prevTx.vout[1];
+    CTxOut viewTagOut;
+    ssViewTag >> viewTagOut;
+    BOOST_CHECK(viewTagOut == prevTx.vout[1]);
+
+    // The range proof still verifies when a non matching view tag skips the amount recovery
+    std::vector<std::pair<int, BulletproofsRangeproof>> tagProofs;
+    tagProofs.push_back(std::make_pair(1, prevTx.vout[1].GetBulletproof()));
+    std::vector<bls::G1Element> tagNonces;
+    tagNonces.push_back(nonce);
+    std::vector<RangeproofEncodedData> tagData;
+    BOOST_CHECK(VerifyBulletproof(tagProofs, tagData, tagNonces, false, std::vector<bool>(1, true)));
+    BOOST_CHECK(tagData.size() == 1 && tagData[0].amount == 10*COIN);
+    BOOST_CHECK(VerifyBulletproof(tagProofs, tagData, tagNonces, false, std::vector<bool>(1, false)));
+    BOOST_CHECK(tagData.size() == 0);
 
     CMutableTransaction spendingTx;
 
@@ -149,6 +176,84 @@ BOOST_AUTO_TEST_CASE(blsct)
     BOOST_CHECK(vData[0].message == "test2test2test2test2test2test2test2test2test2test2test");
     BOOST_CHECK(vData[0].amount == 10*COIN);
 
+    // Same transaction, with the proofs checked by a deferred CBLSCTCheck
+    {
+        CTransaction txToCheck(spendingTx);
+        std::vector<CBLSCTCheck> vChecks;
+        std::vector<RangeproofEncodedData> vDataDeferred;
+        state = CValidationState();
+        BOOST_CHECK(VerifyBLSCT(txToCheck, viewKey, vDataDeferred, view, state, false, 0, nullptr, &vChecks));
+        BOOST_CHECK(vChecks.size() == 1);
+        BOOST_CHECK(vDataDeferred.empty());
+        BOOST_CHECK(vChecks[0]());
+        BOOST_CHECK(vDataDeferred.size() == 1);
+        BOOST_CHECK(vDataDeferred[0].amount == 10*COIN);
+    }
+
+    // A deferred check which fails reports its reason through the shared result
+    {
+        CMutableTransaction badTx(spendingTx);
+        std::vector<uint8_t> otherMsg(balanceMsg.begin(), balanceMsg.end());
+        otherMsg.push_back(0);
+        badTx.vchBalanceSig = bls::BasicSchemeMPL::Sign(balanceSigningKey, otherMsg).Serialize();
+        CTransaction txToCheck(badTx);
+        std::vector<CBLSCTCheck> vChecks;
+        std::vector<RangeproofEncodedData> vDataDeferred;
+        CBLSCTCheckResult result;
+        state = CValidationState();
+        BOOST_CHECK(VerifyBLSCT(txToCheck, viewKey, vDataDeferred, view, state, false, 0, nullptr, &vChecks));
+        BOOST_CHECK(vChecks.size() == 1);
+        vChecks[0].SetResult(&result);
+        BOOST_CHECK(result.GetRejectReason().empty());
+        BOOST_CHECK(!vChecks[0]());
+        BOOST_CHECK_EQUAL(result.GetRejectReason(), "invalid-balanceproof");
+    }
+
+    // Validity cache. The balance check fails against a changed input value, unless the
+    // transaction was cached as valid, as happens when it enters the mempool first.
+    {
+        CTransaction txToCache(spendingTx);
+        std::vector<RangeproofEncodedData> vDataCached;
+        auto setPrevValue = [&](const CAmount& nValue) {
+            CTxOut out = prevTx.vout[0];
+            out.nValue = nValue;
+            view.AddCoin(COutPoint(prevTx.GetHash(), 0), Coin(std::move(out), 0, false, false), true);
+        };
+
+        setPrevValue(9*COIN);
+        state = CValidationState();
+        BOOST_CHECK(!VerifyBLSCT(txToCache, viewKey, vDataCached, view, state));
+        setPrevValue(10*COIN);
+
+        state = CValidationState();
+        BOOST_CHECK(VerifyBLSCT(txToCache, viewKey, vDataCached, view, state, false, 0, nullptr, nullptr, true));
+
+        // A different mix fee is a different entry
+        setPrevValue(9*COIN);
+        state = CValidationState();
+        BOOST_CHECK(!VerifyBLSCT(txToCache, viewKey, vDataCached, view, state, false, 1));
+
+        // Cached, the amounts are still recovered
+        vDataCached.clear();
+        state = CValidationState();
+        BOOST_CHECK(VerifyBLSCT(txToCache, viewKey, vDataCached, view, state, false, 0, nullptr, nullptr, true));
+        BOOST_CHECK(vDataCached.size() == 1);
+        BOOST_CHECK(vDataCached[0].amount == 10*COIN);
+
+        // Used by a block, which erases the entry
+        std::vector<CBLSCTCheck> vChecks;
+        RangeproofBatch batch;
+        state = CValidationState();
+        BOOST_CHECK(VerifyBLSCT(txToCache, viewKey, vDataCached, view, state, false, 0, &batch, &vChecks));
+        BOOST_CHECK(batch.empty());
+        BOOST_CHECK(vChecks.size() == 1);
+        BOOST_CHECK(vChecks[0]());
+
+        state = CValidationState();
+        BOOST_CHECK(!VerifyBLSCT(txToCache, viewKey, vDataCached, view, state));
+        setPrevValue(10*COIN);
+    }
+
     vBLSSignatures.clear();
     spendingTx.vchTxSig.clear();
     spendingTx.vchBalanceSig.clear();
@@ -294,6 +399,303 @@ BOOST_AUTO_TEST_CASE(blsct)
     state = CValidationState();
     BOOST_CHECK(!VerifyBLSCT(spendingTx, viewKey, vData, view, state));
     BOOST_CHECK(state.GetRejectReason() == "invalid-balanceproof");
+
+    {
+        CTransaction txToCheck(spendingTx);
+        std::vector<CBLSCTCheck> vChecks;
+        state = CValidationState();
+        BOOST_CHECK(VerifyBLSCT(txToCheck, viewKey, vData, view, state, false, 0, nullptr, &vChecks));
+        BOOST_CHECK(vChecks.size() == 1);
+        BOOST_CHECK(!vChecks[0]());
+        BOOST_CHECK(vChecks[0].GetRejectReason() == "invalid-balanceproof");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blsct_decoded_keys)
+{
+    bls::PrivateKey k1 = bls::PrivateKey::FromBN(Scalar::Rand().bn);
+    bls::PrivateKey k2 = bls::PrivateKey::FromBN(Scalar::Rand().bn);
+
+    CTxOut out;
+    out.outputKey = k1.GetG1Element().Serialize();
+    out.spendingKey = k2.GetG1Element().Serialize();
+
+    uint64_t nDecoded, nAvoided, nDecoded2, nAvoided2;
+    GetG1ElementDecodeStats(nDecoded, nAvoided);
+
+    BOOST_CHECK(out.GetOutputKey() == k1.GetG1Element());
+    BOOST_CHECK(out.GetOutputKey() == k1.GetG1Element());
+
+    // Copies share the decoded point
+    CTxOut copy = out;
+    BOOST_CHECK(copy.GetOutputKey() == k1.GetG1Element());
+
+    GetG1ElementDecodeStats(nDecoded2, nAvoided2);
+    BOOST_CHECK(nDecoded2 - nDecoded >= 1);
+    BOOST_CHECK(nAvoided2 - nAvoided >= 2);
+
+    // Changing the bytes decodes the new key
+    copy.outputKey = out.spendingKey;
+    BOOST_CHECK(copy.GetOutputKey() == k2.GetG1Element());
+    BOOST_CHECK(out.GetOutputKey() == k1.GetG1Element());
+    BOOST_CHECK(copy.GetSpendingKey() == out.GetSpendingKey());
+
+    copy.ephemeralKey.clear();
+    BOOST_CHECK_THROW(copy.GetEphemeralKey(), std::length_error);
+}
+
+BOOST_AUTO_TEST_CASE(blsct_candidate_verification_pool)
+{
+    CandidateVerificationPool pool;
+    pool.SetMaxSize(3);
+
+    for (unsigned char i = 0; i < 5; i++)
+    {
+        EncryptedCandidateTransaction etx;
+        etx.vData.push_back(i);
+        etx.nTime = GetTimeMillis();
+        BOOST_CHECK(pool.Push(etx) == (i < 3));
+    }
+
+    BOOST_CHECK(pool.size() == 3);
+
+    std::vector<EncryptedCandidateTransaction> vBatch;
+    BOOST_CHECK(pool.PopBatch(vBatch, 2, 0));
+    BOOST_CHECK(vBatch.size() == 2);
+    BOOST_CHECK(vBatch[0].vData[0] == 0 && vBatch[1].vData[0] == 1);
+    pool.BatchDone(vBatch, 1, 1000);
+
+    BOOST_CHECK(pool.PopBatch(vBatch, 2, 0));
+    BOOST_CHECK(vBatch.size() == 1);
+    BOOST_CHECK(!pool.PopBatch(vBatch, 2, 0));
+
+    UniValue stats = pool.GetStats();
+    BOOST_CHECK(find_value(stats, "received").get_int() == 5);
+    BOOST_CHECK(find_value(stats, "dropped").get_int() == 2);
+    BOOST_CHECK(find_value(stats, "accepted").get_int() == 1);
+    BOOST_CHECK(find_value(stats, "rejected").get_int() == 1);
+    BOOST_CHECK(find_value(stats, "peakQueueSize").get_int() == 3);
+}
+
+BOOST_AUTO_TEST_CASE(blsct_aggregate)
+{
+    bls::G2Element sig = bls::BasicSchemeMPL::Sign(bls::PrivateKey::FromBN(Scalar::Rand().bn), balanceMsg);
+
+    CMutableTransaction tx1;
+    tx1.nVersion |= TX_BLS_INPUT_FLAG;
+    tx1.vin.push_back(CTxIn(COutPoint(GetRandHash(), 0)));
+    tx1.vout.push_back(CTxOut(0, CScript() << OP_TRUE));
+    tx1.vout.push_back(CTxOut(1000, CScript(OP_RETURN)));
+    tx1.vchBalanceSig = sig.Serialize();
+
+    CMutableTransaction tx2 = tx1;
+    tx2.vin[0].prevout = COutPoint(GetRandHash(), 1);
+    tx2.vout[0].nValue = 1;
+
+    // Spends the same input as tx1
+    CMutableTransaction tx3 = tx2;
+    tx3.vin.push_back(tx1.vin[0]);
+    tx3.vout[0].nValue = 2;
+
+    // Not a BLS input transaction
+    CMutableTransaction tx4 = tx2;
+    tx4.nVersion &= ~TX_BLS_INPUT_FLAG;
+
+    CBLSCTAggregate aggregate;
+    BOOST_CHECK(aggregate.Add(std::make_shared<const CTransaction>(tx1)));
+    BOOST_CHECK(!aggregate.Add(std::make_shared<const CTransaction>(tx1)));
+    BOOST_CHECK(aggregate.Add(std::make_shared<const CTransaction>(tx2)));
+    BOOST_CHECK(!aggregate.Add(std::make_shared<const CTransaction>(tx3)));
+    BOOST_CHECK(!aggregate.Add(std::make_shared<const CTransaction>(tx4)));
+    BOOST_CHECK(aggregate.size() == 2);
+    BOOST_CHECK(aggregate.IsRejected(tx3.GetHash()));
+    BOOST_CHECK(!aggregate.IsRejected(tx4.GetHash()));
+
+    CStateView coinsDummy;
+    CStateViewCache view(&coinsDummy);
+    CValidationState state;
+    CTransaction combinedTx;
+
+    // tx3 still conflicts with tx1
+    aggregate.Remove(tx2.GetHash());
+    BOOST_CHECK(aggregate.size() == 1);
+    BOOST_CHECK(aggregate.IsRejected(tx3.GetHash()));
+
+    // Even the only member needs its inputs, and is found once they are there
+    BOOST_CHECK(!aggregate.GetCombined(combinedTx, view, state));
+    BOOST_CHECK(state.GetRejectReason() == "inputs-not-available");
+
+    for (auto& in: tx3.vin)
+        view.AddCoin(in.prevout, Coin(CTxOut(1000, CScript() << OP_TRUE), 1, false, false), false);
+
+    state = CValidationState();
+    BOOST_CHECK(aggregate.GetCombined(combinedTx, view, state));
+    BOOST_CHECK(combinedTx == CTransaction(tx1));
+
+    // and is added once tx1 leaves
+    aggregate.Remove(tx1.GetHash());
+    BOOST_CHECK(aggregate.Has(tx3.GetHash()));
+    BOOST_CHECK(!aggregate.IsRejected(tx3.GetHash()));
+    BOOST_CHECK(aggregate.GetCombined(combinedTx, view, state));
+    BOOST_CHECK(combinedTx == CTransaction(tx3));
+
+    aggregate.clear();
+    BOOST_CHECK(aggregate.empty());
+    BOOST_CHECK(!aggregate.GetCombined(combinedTx, view, state));
+}
+
+// Spends two private outputs added to view into two private outputs plus the fee
+static CTransaction CreateBLSCTTransaction(CStateViewCache& view, const bls::PrivateKey& viewKey, const bls::PrivateKey& spendKey, CAmount nFee)
+{
+    bls::G1Element S = spendKey.GetG1Element();
+    bls::G1Element V = S * viewKey;
+    blsctDoublePublicKey destKey(V, S);
+
+    Scalar gammaIns, gammaOuts;
+    std::string strFailReason;
+    std::vector<bls::G2Element> vBLSSignatures;
+    bls::G1Element nonce;
+
+    CMutableTransaction prevTx;
+    prevTx.vout.resize(2);
+
+    std::vector<bls::PrivateKey> vBlindingKeys;
+
+    for (size_t i = 0; i < prevTx.vout.size(); i++)
+    {
+        vBlindingKeys.push_back(bls::PrivateKey::FromBN(Scalar::Rand().bn));
+        BOOST_CHECK(CreateBLSCTOutput(vBlindingKeys[i], nonce, prevTx.vout[i], destKey, 10*COIN, "", gammaIns, strFailReason, false, vBLSSignatures));
+    }
+
+    AddCoins(view, prevTx, 0);
+
+    CMutableTransaction tx;
+    tx.nVersion |= TX_BLS_CT_FLAG | TX_BLS_INPUT_FLAG;
+    tx.vin.resize(2);
+    tx.vout.resize(3);
+
+    BOOST_CHECK(CreateBLSCTOutput(bls::PrivateKey::FromBN(Scalar::Rand().bn), nonce, tx.vout[0], destKey, 12*COIN, "", gammaOuts, strFailReason, true, vBLSSignatures));
+    BOOST_CHECK(CreateBLSCTOutput(bls::PrivateKey::FromBN(Scalar::Rand().bn), nonce, tx.vout[1], destKey, 8*COIN-nFee, "", gammaOuts, strFailReason, true, vBLSSignatures));
+    tx.vout[2] = CTxOut(nFee, CScript(OP_RETURN));
+
+    for (size_t i = 0; i < tx.vin.size(); i++)
+    {
+        tx.vin[i].prevout = COutPoint(prevTx.GetHash(), i);
+
+        // P = H(r*V)*G + S
+        Scalar sk = Scalar(HashG1Element(vBlindingKeys[i] * V, 0)) + Scalar(spendKey);
+        SignBLSInput(bls::PrivateKey::FromBN(sk.bn), tx.vin[i], vBLSSignatures);
+    }
+
+    Scalar diff = gammaIns-gammaOuts;
+    tx.vchBalanceSig = bls::BasicSchemeMPL::Sign(bls::PrivateKey::FromBN(diff.bn), balanceMsg).Serialize();
+    tx.vchTxSig = bls::AugSchemeMPL::Aggregate(vBLSSignatures).Serialize();
+
+    return tx;
+}
+
+// Both combine the same transactions, in whichever order their inputs and outputs were shuffled
+static bool SameCombination(const CTransaction& a, const CTransaction& b)
+{
+    std::multiset<CTxIn> setInA(a.vin.begin(), a.vin.end()), setInB(b.vin.begin(), b.vin.end());
+    std::multiset<CTxOut> setOutA(a.vout.begin(), a.vout.end()), setOutB(b.vout.begin(), b.vout.end());
+
+    return a.nVersion == b.nVersion && setInA == setInB && setOutA == setOutB &&
+           a.vchBalanceSig == b.vchBalanceSig && a.vchTxSig == b.vchTxSig;
+}
+
+static std::vector<unsigned char> SumSignatures(const std::vector<std::vector<unsigned char>>& vSigs)
+{
+    bls::G2Element sum = bls::G2Element::Infinity();
+    for (auto& it: vSigs)
+        sum = sum + bls::G2Element::FromByteVector(it);
+    return sum.Serialize();
+}
+
+BOOST_AUTO_TEST_CASE(blsct_aggregate_combine)
+{
+    CStateView coinsDummy;
+    CStateViewCache view(&coinsDummy);
+
+    bls::PrivateKey viewKey = bls::PrivateKey::FromBN(Scalar::Rand().bn);
+    bls::PrivateKey spendKey = bls::PrivateKey::FromBN(Scalar::Rand().bn);
+
+    CTransaction tx1 = CreateBLSCTTransaction(view, viewKey, spendKey, 10000);
+    CTransaction tx2 = CreateBLSCTTransaction(view, viewKey, spendKey, 20000);
+    CTransaction tx3 = CreateBLSCTTransaction(view, viewKey, spendKey, 30000);
+
+    CBLSCTAggregate aggregate;
+    BOOST_CHECK(aggregate.Add(std::make_shared<const CTransaction>(tx1)));
+    BOOST_CHECK(aggregate.Add(std::make_shared<const CTransaction>(tx2)));
+    BOOST_CHECK(aggregate.Add(std::make_shared<const CTransaction>(tx3)));
+
+    CValidationState state;
+    CTransaction combinedTx, expectedTx;
+    std::vector<RangeproofEncodedData> vData;
+
+    std::set<CTransaction> setTx;
+    setTx.insert(tx1);
+    setTx.insert(tx2);
+    setTx.insert(tx3);
+    BOOST_CHECK(CombineBLSCTTransactions(setTx, expectedTx, view, state));
+
+    // Missing inputs do not make the combination fail for good
+    CStateViewCache emptyView(&coinsDummy);
+    CValidationState missingState;
+    BOOST_CHECK(!aggregate.GetCombined(combinedTx, emptyView, missingState));
+    BOOST_CHECK(missingState.GetRejectReason() == "inputs-not-available");
+
+    BOOST_CHECK(aggregate.GetCombined(combinedTx, view, state));
+    BOOST_CHECK(SameCombination(combinedTx, expectedTx));
+    BOOST_CHECK(combinedTx.GetValueOut() == 60000);
+    BOOST_CHECK(combinedTx.vchBalanceSig == SumSignatures({tx1.vchBalanceSig, tx2.vchBalanceSig, tx3.vchBalanceSig}));
+    BOOST_CHECK(combinedTx.vchTxSig == SumSignatures({tx1.vchTxSig, tx2.vchTxSig, tx3.vchTxSig}));
+    BOOST_CHECK(VerifyBLSCT(combinedTx, viewKey, vData, view, state));
+
+    // The signatures of a removed member are taken out of the sums
+    aggregate.Remove(tx2.GetHash());
+    setTx.erase(tx2);
+    BOOST_CHECK(CombineBLSCTTransactions(setTx, expectedTx, view, state));
+
+    BOOST_CHECK(aggregate.GetCombined(combinedTx, view, state));
+    BOOST_CHECK(SameCombination(combinedTx, expectedTx));
+    BOOST_CHECK(combinedTx.GetValueOut() == 40000);
+    BOOST_CHECK(combinedTx.vchBalanceSig == SumSignatures({tx1.vchBalanceSig, tx3.vchBalanceSig}));
+    BOOST_CHECK(combinedTx.vchTxSig == SumSignatures({tx1.vchTxSig, tx3.vchTxSig}));
+    BOOST_CHECK(VerifyBLSCT(combinedTx, viewKey, vData, view, state));
+
+    // A member with a wrong balance signature makes the combination fail until it is removed
+    CMutableTransaction badTx = CreateBLSCTTransaction(view, viewKey, spendKey, 10000);
+    badTx.vchBalanceSig = bls::BasicSchemeMPL::Sign(bls::PrivateKey::FromBN(Scalar::Rand().bn), balanceMsg).Serialize();
+    BOOST_CHECK(aggregate.Add(std::make_shared<const CTransaction>(badTx)));
+
+    CValidationState failState;
+    BOOST_CHECK(!aggregate.GetCombined(combinedTx, view, failState));
+    std::string strRejectReason = failState.GetRejectReason();
+    BOOST_CHECK(!strRejectReason.empty());
+
+    failState = CValidationState();
+    BOOST_CHECK(!aggregate.GetCombined(combinedTx, view, failState));
+    BOOST_CHECK(failState.GetRejectReason() == strRejectReason);
+
+    aggregate.Remove(badTx.GetHash());
+    BOOST_CHECK(aggregate.GetCombined(combinedTx, view, state));
+    BOOST_CHECK(SameCombination(combinedTx, expectedTx));
+
+    // A verified combination is still checked against the inputs it is given
+    missingState = CValidationState();
+    BOOST_CHECK(!aggregate.GetCombined(combinedTx, emptyView, missingState));
+    BOOST_CHECK(missingState.GetRejectReason() == "inputs-not-available");
+
+    // Spending the inputs of tx1 with another fee, it joins once tx1 leaves
+    CMutableTransaction conflictTx = tx1;
+    conflictTx.vout[2].nValue += 1;
+    BOOST_CHECK(!aggregate.Add(std::make_shared<const CTransaction>(conflictTx)));
+    BOOST_CHECK(aggregate.IsRejected(conflictTx.GetHash()));
+
+    aggregate.Remove(tx1.GetHash());
+    BOOST_CHECK(aggregate.Has(conflictTx.GetHash()));
+    BOOST_CHECK(aggregate.size() == 2);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
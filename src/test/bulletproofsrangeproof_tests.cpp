@@ -3,6 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "blsct/bulletproofs.h"
+#include "blsct/multiexp.h"
+#include "blsct/verification.h"
+#include "primitives/transaction.h"
+#include "streams.h"
+#include "version.h"
 #include "test/test_navcoin.h"
 
 #include <map>
@@ -153,4 +158,160 @@ BOOST_AUTO_TEST_CASE(RangeProofTest)
     BOOST_CHECK(!TestRange(vOutOfRange, nonce));
 }
 
+BOOST_AUTO_TEST_CASE(CachedRangeProofTest)
+{
+    bls::G1Element nonce = bls::G1Element::Infinity();
+
+    std::vector<Scalar> values;
+    values.push_back(Scalar(1000));
+
+    BulletproofsRangeproof bprp;
+    bprp.Prove(values, nonce, {1, 2, 3, 4});
+
+    CTxOut txout(0, CScript(), nonce, nonce, nonce, bprp);
+    BOOST_CHECK(txout.HasRangeProof());
+    BOOST_CHECK(txout.bp == bprp.GetVch());
+
+    // Copies share the decoded proof
+    CTxOut txoutCopy = txout;
+    BOOST_CHECK(txoutCopy.GetBulletproofRef() == txout.GetBulletproofRef());
+
+    // Round trip keeps the serialized proof untouched
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << txout;
+    CTxOut txoutRead;
+    ss >> txoutRead;
+    BOOST_CHECK(txoutRead == txout);
+    BOOST_CHECK(txoutRead.GetBulletproofRef()->GetValueCommitments() == bprp.GetValueCommitments());
+
+    CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION), ss2(SER_NETWORK, PROTOCOL_VERSION);
+    ss1 << txout;
+    ss2 << txoutRead;
+    BOOST_CHECK(ss1.str() == ss2.str());
+
+    txoutRead.SetNull();
+    BOOST_CHECK(!txoutRead.HasRangeProof());
+    BOOST_CHECK(txoutRead.GetBulletproofRef()->GetValueCommitments().empty());
+}
+
+BOOST_AUTO_TEST_CASE(RangeproofBatchTest)
+{
+    bls::G1Element nonce = bls::G1Element::Infinity();
+    RangeproofBatch batch;
+
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        std::vector<Scalar> values;
+        values.push_back(Scalar(1000 + i));
+
+        BulletproofsRangeproof bprp;
+        bprp.Prove(values, nonce);
+
+        std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
+        proofs.push_back(std::make_pair(0, bprp));
+        batch.Add(uint256S(strprintf("%d", i)), proofs);
+    }
+
+    CValidationState state;
+    BOOST_CHECK_EQUAL(batch.size(), 3);
+    BOOST_CHECK(batch.Verify(state));
+
+    std::vector<Scalar> values;
+    values.push_back(Scalar(5));
+
+    BulletproofsRangeproof bprp;
+    bprp.Prove(values, nonce);
+    bprp.taux = bprp.taux + Scalar(1);
+
+    std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
+    proofs.push_back(std::make_pair(0, bprp));
+    batch.Add(uint256S("ff"), proofs);
+
+    BOOST_CHECK(!batch.Verify(state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "invalid-rangeproof");
+
+    batch.clear();
+    BOOST_CHECK(batch.empty());
+    BOOST_CHECK(batch.Verify(state));
+}
+
+BOOST_AUTO_TEST_CASE(MultiExpTest)
+{
+    BulletproofsRangeproof::Init();
+
+    std::vector<MultiexpData> multiexp_data;
+
+    for (unsigned int i = 0; i < 16; i++)
+        multiexp_data.push_back(MultiexpData(NativeToG1Element(BulletproofsRangeproof::GiNative[i]), Scalar::Rand()));
+
+    BOOST_CHECK(MultiExp(multiexp_data) == MultiExpLegacy(multiexp_data));
+
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        G1 native;
+        G1ElementToNative(native, multiexp_data[i].base);
+        BOOST_CHECK(native == BulletproofsRangeproof::GiNative[i]);
+    }
+
+    // Fixed-base tables
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        Scalar s = Scalar::Rand();
+        BOOST_CHECK(BulletproofsRangeproof::MulG(s) == BulletproofsRangeproof::G*s.bn);
+        BOOST_CHECK(BulletproofsRangeproof::MulH(s) == BulletproofsRangeproof::H*s.bn);
+    }
+
+    // Scalar conversions
+    for (unsigned int i = 0; i < 16; i++)
+    {
+        Scalar s = Scalar::Rand(), s2;
+        Fr native;
+        ScalarToNative(native, s);
+        NativeToScalar(s2, native);
+        BOOST_CHECK(s == s2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultiExpPippengerTest)
+{
+    BulletproofsRangeproof::Init();
+
+    size_t n = BulletproofsRangeproof::GiNative.size();
+
+    std::vector<G1> bases(n);
+    std::vector<Fr> exps(n);
+
+    for (size_t i = 0; i < n; i++)
+    {
+        bases[i] = i % 2 ? BulletproofsRangeproof::HiNative[i] : BulletproofsRangeproof::GiNative[i];
+        ScalarToNative(exps[i], Scalar::Rand());
+    }
+
+    // Edge scalars
+    exps[0] = 0;
+    exps[1] = 1;
+    exps[2] = -1;
+
+    for (size_t m: {(size_t)0, (size_t)1, (size_t)3, (size_t)17, (size_t)255, n})
+    {
+        G1 expected, out;
+        MultiExpStraus(expected, bases.data(), exps.data(), m);
+
+        // Every window size, including ones which do not divide the bit length
+        for (size_t c = 1; c <= 16; c += (m > 17 ? 5 : 1))
+        {
+            MultiExpPippenger(out, bases.data(), exps.data(), m, c);
+            BOOST_CHECK(out == expected);
+        }
+
+        MultiExpPippenger(out, bases.data(), exps.data(), m, 0, 4);
+        BOOST_CHECK(out == expected);
+
+        MultiExpAdaptive(out, bases.data(), exps.data(), m);
+        BOOST_CHECK(out == expected);
+    }
+
+    BOOST_CHECK(MultiExpPippengerWindow(16) < MultiExpPippengerWindow(65536));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -412,7 +412,18 @@ BOOST_AUTO_TEST_CASE(cfunddb_state)
             result_p.insert(std::make_pair(hash2, validProposal2));
         }
 
+        // The incrementally maintained DAO state commitment matches a full walk at every layer
+        CMultisetHash commitment, fullScanCommitment;
+        BOOST_CHECK(view.GetDAOStateCommitment(commitment));
+        BOOST_CHECK(ComputeDAOStateCommitment(view, fullScanCommitment));
+        BOOST_CHECK(commitment == fullScanCommitment);
+
         BOOST_CHECK(base->Flush());
+
+        BOOST_CHECK(pcoinsdbview->GetDAOStateCommitment(commitment));
+        BOOST_CHECK(ComputeDAOStateCommitment(*pcoinsdbview, fullScanCommitment));
+        BOOST_CHECK(commitment == fullScanCommitment);
+        BOOST_CHECK(commitment.Finalize() == fullScanCommitment.Finalize());
     }
 
     CProposal proposal;
@@ -4,8 +4,11 @@
 
 #include <coins.h>
 #include <random.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
+#include <txdb.h>
 #include <uint256.h>
+#include <undo.h>
 #include <utilstrencodings.h>
 #include <test/test_navcoin.h>
 #include <main.h>
@@ -18,32 +21,38 @@
 
 namespace
 {
+bool operator==(const Coin &a, const Coin &b) {
+    // Empty Coin objects are always equal.
+    if (a.IsSpent() && b.IsSpent()) return true;
+    return a.fCoinBase == b.fCoinBase &&
+           a.nHeight == b.nHeight &&
+           a.out == b.out;
+}
+
 class CStateViewTest : public CStateView
 {
     uint256 hashBestBlock_;
-    std::map<uint256, CCoins> map_;
-    std::map<uint256, CProposal> mapP_;
-    std::map<uint256, CPaymentRequest> mapPR_;
+    std::map<COutPoint, Coin> map_;
 
 public:
-    bool GetCoins(const uint256& txid, CCoins& coins) const
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
     {
-        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        std::map<COutPoint, Coin>::const_iterator it = map_.find(outpoint);
         if (it == map_.end()) {
             return false;
         }
-        coins = it->second;
-        if (coins.IsPruned() && insecure_rand() % 2 == 0) {
+        coin = it->second;
+        if (coin.IsSpent() && insecure_rand() % 2 == 0) {
             // Randomly return false in case of an empty entry.
             return false;
         }
         return true;
     }
 
-    bool HaveCoins(const uint256& txid) const
+    bool HaveCoin(const COutPoint& outpoint) const
     {
-        CCoins coins;
-        return GetCoins(txid, coins);
+        Coin coin;
+        return GetCoin(outpoint, coin);
     }
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
@@ -56,8 +65,8 @@ public:
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CStateViewDB is to only write dirty entries.
-                map_[it->first] = it->second.coins;
-                if (it->second.coins.IsPruned() && insecure_rand() % 3 == 0) {
+                map_[it->first] = it->second.coin;
+                if (it->second.coin.IsSpent() && insecure_rand() % 3 == 0) {
                     // Randomly delete empty entries on write.
                     map_.erase(it->first);
                 }
@@ -79,9 +88,12 @@ public:
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
         size_t ret = memusage::DynamicUsage(cacheCoins);
+        size_t count = 0;
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
-            ret += it->second.coins.DynamicMemoryUsage();
+            ret += it->second.coin.DynamicMemoryUsage();
+            ++count;
         }
+        BOOST_CHECK_EQUAL(GetCacheSize(), count);
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
     }
 
@@ -96,7 +108,7 @@ static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 // This is a large randomized insert/remove simulation test on a variable-size
 // stack of caches on top of CStateViewTest.
 //
-// It will randomly create/update/delete CCoins entries to a tip of caches, with
+// It will randomly create/update/delete Coin entries to a tip of caches, with
 // txids picked from a limited list of random 256-bit hashes. Occasionally, a
 // new tip is added to the stack of caches, or the tip is flushed and removed.
 //
@@ -108,13 +120,15 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool removed_all_caches = false;
     bool reached_4_caches = false;
     bool added_an_entry = false;
+    bool added_an_unspendable_entry = false;
     bool removed_an_entry = false;
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
+    bool uncached_an_entry = false;
 
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CStateViewTest base; // A CStateViewTest at the bottom.
@@ -132,36 +146,51 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
         // Do a random modification.
         {
             uint256 txid = txids[insecure_rand() % txids.size()]; // txid we're going to modify in this iteration.
-            CCoins& coins = result[txid];
-            CCoinsModifier entry = stack.back()->ModifyCoins(txid);
-            BOOST_CHECK(coins == *entry);
-            if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
-                if (coins.IsPruned()) {
-                    added_an_entry = true;
+            Coin& coin = result[COutPoint(txid, 0)];
+            const Coin& entry = (insecure_rand() % 500 == 0) ? AccessByTxid(*stack.back(), txid) : stack.back()->AccessCoin(COutPoint(txid, 0));
+            BOOST_CHECK(coin == entry);
+
+            if (insecure_rand() % 5 == 0 || coin.IsSpent()) {
+                Coin newcoin;
+                newcoin.out.nValue = insecure_rand();
+                newcoin.nHeight = 1;
+                if (insecure_rand() % 16 == 0 && coin.IsSpent()) {
+                    newcoin.out.scriptPubKey.assign(1 + (insecure_rand() & 0x3F), OP_RETURN);
+                    BOOST_CHECK(newcoin.out.scriptPubKey.IsUnspendable());
+                    added_an_unspendable_entry = true;
                 } else {
-                    updated_an_entry = true;
+                    newcoin.out.scriptPubKey.assign(insecure_rand() & 0x3F, 0); // Random sizes so we can test memory usage accounting
+                    (coin.IsSpent() ? added_an_entry : updated_an_entry) = true;
+                    coin = newcoin;
                 }
-                coins.nVersion = insecure_rand();
-                coins.vout.resize(1);
-                coins.vout[0].nValue = insecure_rand();
-                *entry = coins;
+                stack.back()->AddCoin(COutPoint(txid, 0), std::move(newcoin), !coin.IsSpent() || insecure_rand() & 1);
             } else {
-                coins.Clear();
-                entry->Clear();
                 removed_an_entry = true;
+                coin.Clear();
+                stack.back()->SpendCoin(COutPoint(txid, 0));
             }
         }
 
+        // One every 10 iterations, remove a random entry from the cache
+        if (insecure_rand() % 10 == 0) {
+            COutPoint out(txids[insecure_rand() % txids.size()], 0);
+            int cacheid = insecure_rand() % stack.size();
+            stack[cacheid]->Uncache(out);
+            uncached_an_entry |= !stack[cacheid]->HaveCoinInCache(out);
+        }
+
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
-                    found_an_entry = true;
-                } else {
-                    BOOST_CHECK(it->second.IsPruned());
+            for (auto it = result.begin(); it != result.end(); it++) {
+                bool have = stack.back()->HaveCoin(it->first);
+                const Coin& coin = stack.back()->AccessCoin(it->first);
+                BOOST_CHECK(have == !coin.IsSpent());
+                BOOST_CHECK(coin == it->second);
+                if (coin.IsSpent()) {
                     missed_an_entry = true;
+                } else {
+                    BOOST_CHECK(stack.back()->HaveCoinInCache(it->first));
+                    found_an_entry = true;
                 }
             }
             for(const CStateViewCacheTest *test: stack) {
@@ -210,10 +239,12 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(removed_all_caches);
     BOOST_CHECK(reached_4_caches);
     BOOST_CHECK(added_an_entry);
+    BOOST_CHECK(added_an_unspendable_entry);
     BOOST_CHECK(removed_an_entry);
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
+    BOOST_CHECK(uncached_an_entry);
 }
 
 // This test is similar to the previous test
@@ -225,7 +256,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 {
     bool spent_a_duplicate_coinbase = false;
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CStateViewTest base; // A CStateViewTest at the bottom.
@@ -243,7 +274,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             tx.vin.resize(1);
             tx.vout.resize(1);
             tx.vout[0].nValue = i; //Keep txs unique unless intended to duplicate
-            unsigned int height = insecure_rand();
+            unsigned int height = insecure_rand() & 0x3FFFFFFF; // Fits in the height bitfield of Coin
 
             // 1/10 times create a coinbase
             if (insecure_rand() % 10 == 0 || coinbaseids.size() < 10) {
@@ -278,8 +309,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
                 tx.vin[0].prevout.n = 0;
 
                 // Update the expected result of prevouthash to know these coins are spent
-                CCoins& oldcoins = result[prevouthash];
-                oldcoins.Clear();
+                result[tx.vin[0].prevout].Clear();
 
                 // It is of particular importance here that once we spend a coinbase tx hash
                 // it is no longer available to be duplicated (or spent again)
@@ -299,21 +329,19 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             alltxids.insert(tx.GetHash());
 
             // Update the expected result to know about the new output coins
-            CCoins &coins = result[tx.GetHash()];
-            coins.FromTx(tx, height);
+            CTransaction txConst(tx);
+            result[COutPoint(txConst.GetHash(), 0)] = Coin(txConst.vout[0], height, txConst.IsCoinBase(), false);
 
-            UpdateCoins(tx, *(stack.back()), height);
+            UpdateCoins(txConst, *(stack.back()), height);
         }
 
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
-                 } else {
-                    BOOST_CHECK(it->second.IsPruned());
-                 }
+            for (auto it = result.begin(); it != result.end(); it++) {
+                bool have = stack.back()->HaveCoin(it->first);
+                const Coin& coin = stack.back()->AccessCoin(it->first);
+                BOOST_CHECK(have == !coin.IsSpent());
+                BOOST_CHECK(coin == it->second);
             }
         }
 
@@ -354,53 +382,36 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 BOOST_AUTO_TEST_CASE(ccoins_serialization)
 {
     // Good example
-    CDataStream ss1(ParseHex("0104835800816115944e077fe7c803cfa57f29b36bf87c1d358bb85e"), SER_DISK, CLIENT_VERSION);
-    CCoins cc1;
+    CDataStream ss1(ParseHex("97f23c835800816115944e077fe7c803cfa57f29b36bf87c1d35"), SER_DISK, CLIENT_VERSION);
+    Coin cc1;
     ss1 >> cc1;
-    BOOST_CHECK_EQUAL(cc1.nVersion, 1);
     BOOST_CHECK_EQUAL(cc1.fCoinBase, false);
     BOOST_CHECK_EQUAL(cc1.nHeight, 203998);
-    BOOST_CHECK_EQUAL(cc1.vout.size(), 2);
-    BOOST_CHECK_EQUAL(cc1.IsAvailable(0), false);
-    BOOST_CHECK_EQUAL(cc1.IsAvailable(1), true);
-    BOOST_CHECK_EQUAL(cc1.vout[1].nValue, 60000000000ULL);
-    BOOST_CHECK_EQUAL(HexStr(cc1.vout[1].scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))))));
+    BOOST_CHECK_EQUAL(cc1.out.nValue, 60000000000ULL);
+    BOOST_CHECK_EQUAL(HexStr(cc1.out.scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("816115944e077fe7c803cfa57f29b36bf87c1d35"))))));
 
     // Good example
-    CDataStream ss2(ParseHex("0109044086ef97d5790061b01caab50f1b8e9c50a5057eb43c2d9563a4eebbd123008c988f1a4a4de2161e0f50aac7f17e7f9555caa486af3b"), SER_DISK, CLIENT_VERSION);
-    CCoins cc2;
+    CDataStream ss2(ParseHex("8ddf77bbd123008c988f1a4a4de2161e0f50aac7f17e7f9555caa4"), SER_DISK, CLIENT_VERSION);
+    Coin cc2;
     ss2 >> cc2;
-    BOOST_CHECK_EQUAL(cc2.nVersion, 1);
     BOOST_CHECK_EQUAL(cc2.fCoinBase, true);
     BOOST_CHECK_EQUAL(cc2.nHeight, 120891);
-    BOOST_CHECK_EQUAL(cc2.vout.size(), 17);
-    for (int i = 0; i < 17; i++) {
-        BOOST_CHECK_EQUAL(cc2.IsAvailable(i), i == 4 || i == 16);
-    }
-    BOOST_CHECK_EQUAL(cc2.vout[4].nValue, 234925952);
-    BOOST_CHECK_EQUAL(HexStr(cc2.vout[4].scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("61b01caab50f1b8e9c50a5057eb43c2d9563a4ee"))))));
-    BOOST_CHECK_EQUAL(cc2.vout[16].nValue, 110397);
-    BOOST_CHECK_EQUAL(HexStr(cc2.vout[16].scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("8c988f1a4a4de2161e0f50aac7f17e7f9555caa4"))))));
+    BOOST_CHECK_EQUAL(cc2.out.nValue, 110397);
+    BOOST_CHECK_EQUAL(HexStr(cc2.out.scriptPubKey), HexStr(GetScriptForDestination(CKeyID(uint160(ParseHex("8c988f1a4a4de2161e0f50aac7f17e7f9555caa4"))))));
 
     // Smallest possible example
-    CDataStream ssx(SER_DISK, CLIENT_VERSION);
-    BOOST_CHECK_EQUAL(HexStr(ssx.begin(), ssx.end()), "");
-
-    CDataStream ss3(ParseHex("0002000600"), SER_DISK, CLIENT_VERSION);
-    CCoins cc3;
+    CDataStream ss3(ParseHex("000006"), SER_DISK, CLIENT_VERSION);
+    Coin cc3;
     ss3 >> cc3;
-    BOOST_CHECK_EQUAL(cc3.nVersion, 0);
     BOOST_CHECK_EQUAL(cc3.fCoinBase, false);
     BOOST_CHECK_EQUAL(cc3.nHeight, 0);
-    BOOST_CHECK_EQUAL(cc3.vout.size(), 1);
-    BOOST_CHECK_EQUAL(cc3.IsAvailable(0), true);
-    BOOST_CHECK_EQUAL(cc3.vout[0].nValue, 0);
-    BOOST_CHECK_EQUAL(cc3.vout[0].scriptPubKey.size(), 0);
+    BOOST_CHECK_EQUAL(cc3.out.nValue, 0);
+    BOOST_CHECK_EQUAL(cc3.out.scriptPubKey.size(), 0);
 
     // scriptPubKey that ends beyond the end of the stream
-    CDataStream ss4(ParseHex("0002000800"), SER_DISK, CLIENT_VERSION);
+    CDataStream ss4(ParseHex("000007"), SER_DISK, CLIENT_VERSION);
     try {
-        CCoins cc4;
+        Coin cc4;
         ss4 >> cc4;
         BOOST_CHECK_MESSAGE(false, "We should have thrown");
     } catch (const std::ios_base::failure& e) {
@@ -411,13 +422,247 @@ BOOST_AUTO_TEST_CASE(ccoins_serialization)
     uint64_t x = 3000000000ULL;
     tmp << VARINT(x);
     BOOST_CHECK_EQUAL(HexStr(tmp.begin(), tmp.end()), "8a95c0bb00");
-    CDataStream ss5(ParseHex("0002008a95c0bb0000"), SER_DISK, CLIENT_VERSION);
+    CDataStream ss5(ParseHex("00008a95c0bb00"), SER_DISK, CLIENT_VERSION);
     try {
-        CCoins cc5;
+        Coin cc5;
         ss5 >> cc5;
         BOOST_CHECK_MESSAGE(false, "We should have thrown");
     } catch (const std::ios_base::failure& e) {
     }
+
+    // The coinstake flag is not stored, it only lives in the cache
+    Coin cc6(CTxOut(1000, CScript() << OP_TRUE), 5, false, true);
+    CDataStream ss6(SER_DISK, CLIENT_VERSION);
+    ss6 << cc6;
+    Coin cc7;
+    ss6 >> cc7;
+    BOOST_CHECK_EQUAL(cc7.nHeight, 5);
+    BOOST_CHECK_EQUAL(cc7.fCoinStake, false);
+    BOOST_CHECK(cc7.out == cc6.out);
+}
+
+namespace
+{
+
+//! Per-transaction utxo record of older versions, as they wrote it under 'c'
+class CLegacyCoins
+{
+public:
+    bool fCoinBase;
+    //! spent outputs are null, the last one is not
+    std::vector<CTxOut> vout;
+    int nHeight;
+
+    CLegacyCoins(bool fCoinBaseIn, const std::vector<CTxOut>& voutIn, int nHeightIn) :
+        fCoinBase(fCoinBaseIn), vout(voutIn), nHeight(nHeightIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s, int nType, int nVersion) const {
+        unsigned int nMaskSize = 0, nMaskCode = 0;
+        for (unsigned int b = 0; 2+b*8 < vout.size(); b++) {
+            bool fZero = true;
+            for (unsigned int i = 0; i < 8 && 2+b*8+i < vout.size(); i++)
+                if (!vout[2+b*8+i].IsNull())
+                    fZero = false;
+            if (!fZero) {
+                nMaskSize = b + 1;
+                nMaskCode++;
+            }
+        }
+        bool fFirst = vout.size() > 0 && !vout[0].IsNull();
+        bool fSecond = vout.size() > 1 && !vout[1].IsNull();
+        unsigned int nCode = 8*(nMaskCode - (fFirst || fSecond ? 0 : 1)) + (fCoinBase ? 1 : 0) + (fFirst ? 2 : 0) + (fSecond ? 4 : 0);
+        unsigned int nVersionDummy = 1;
+        ::Serialize(s, VARINT(nVersionDummy), nType, nVersion);
+        ::Serialize(s, VARINT(nCode), nType, nVersion);
+        for (unsigned int b = 0; b < nMaskSize; b++) {
+            unsigned char chAvail = 0;
+            for (unsigned int i = 0; i < 8 && 2+b*8+i < vout.size(); i++)
+                if (!vout[2+b*8+i].IsNull())
+                    chAvail |= (1 << i);
+            ::Serialize(s, chAvail, nType, nVersion);
+        }
+        for (unsigned int i = 0; i < vout.size(); i++) {
+            if (!vout[i].IsNull())
+                ::Serialize(s, CTxOutCompressor(REF(vout[i])), nType, nVersion);
+        }
+        ::Serialize(s, VARINT(nHeight), nType, nVersion);
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const {
+        CSizeComputer s(nType, nVersion);
+        Serialize(s, nType, nVersion);
+        return s.size();
+    }
+};
+
+class CStateViewDBLegacy : public CStateViewDB
+{
+public:
+    CStateViewDBLegacy() : CStateViewDB(1 << 20, true) {}
+
+    void WriteLegacyCoins(const uint256& txid, const CLegacyCoins& coins) {
+        BOOST_CHECK(db.Write(std::make_pair('c', txid), coins));
+    }
+
+    bool HaveLegacyCoins() {
+        boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+        pcursor->Seek(std::make_pair('c', uint256()));
+        std::pair<char, uint256> key;
+        return pcursor->Valid() && pcursor->GetKey(key) && key.first == 'c';
+    }
+};
+
+}
+
+BOOST_AUTO_TEST_CASE(coins_upgrade)
+{
+    CStateViewDBLegacy db;
+
+    std::vector<uint256> vTxid;
+    std::vector<CLegacyCoins> vCoins;
+
+    // A coinbase, a transaction with outputs spent in both the header and the
+    // mask bytes, and one with an unspendable output, which is not kept
+    std::vector<CTxOut> vout(1, CTxOut(50 * COIN, CScript() << OP_TRUE));
+    vCoins.push_back(CLegacyCoins(true, vout, 10));
+
+    vout.clear();
+    for (int i = 0; i < 12; i++)
+        vout.push_back(CTxOut(i * CENT + 1, CScript() << i << OP_EQUAL));
+    for (int i: {1, 3, 5, 6, 7, 8, 9})
+        vout[i].SetNull();
+    vCoins.push_back(CLegacyCoins(false, vout, 2000));
+
+    vout.assign(3, CTxOut());
+    vout[1] = CTxOut(0, CScript() << OP_RETURN);
+    vout[2] = CTxOut(COIN, CScript() << OP_TRUE);
+    vCoins.push_back(CLegacyCoins(false, vout, 300000));
+
+    for (const CLegacyCoins& coins: vCoins) {
+        vTxid.push_back(GetRandHash());
+        db.WriteLegacyCoins(vTxid.back(), coins);
+    }
+
+    BOOST_CHECK(db.HaveLegacyCoins());
+    BOOST_CHECK(db.Upgrade());
+    BOOST_CHECK(!db.HaveLegacyCoins());
+
+    size_t nCoins = 0;
+    for (size_t i = 0; i < vCoins.size(); i++) {
+        for (size_t n = 0; n < vCoins[i].vout.size(); n++) {
+            const CTxOut& out = vCoins[i].vout[n];
+            COutPoint outpoint(vTxid[i], n);
+            Coin coin;
+
+            if (out.IsNull() || out.scriptPubKey.IsUnspendable()) {
+                BOOST_CHECK(!db.HaveCoin(outpoint));
+                continue;
+            }
+
+            BOOST_CHECK(db.GetCoin(outpoint, coin));
+            BOOST_CHECK(coin.out == out);
+            BOOST_CHECK_EQUAL(coin.nHeight, vCoins[i].nHeight);
+            BOOST_CHECK_EQUAL(coin.fCoinBase, vCoins[i].fCoinBase);
+            nCoins++;
+        }
+    }
+    BOOST_CHECK_EQUAL(nCoins, 7);
+
+    // Nothing left to convert
+    BOOST_CHECK(db.Upgrade());
+}
+
+// Signs every input of tx, which spends outputs paying to key
+static void SignSpend(CMutableTransaction& tx, const CKey& key)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    for (unsigned int j = 0; j < tx.vin.size(); j++) {
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, tx, j, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[j].scriptSig = CScript() << vchSig;
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(disconnect_old_undo, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // A transaction with two outputs, both spent later by the same input list
+    // as a coinbase output
+    CMutableTransaction txSplit;
+    txSplit.vin.resize(1);
+    txSplit.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    txSplit.vout.assign(2, CTxOut(coinbaseTxns[0].vout[0].nValue / 2 - CENT, scriptPubKey));
+    SignSpend(txSplit, coinbaseKey);
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(1, txSplit), scriptPubKey);
+    int nSplitHeight = chainActive.Height();
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(3);
+    txSpend.vin[0].prevout = COutPoint(txSplit.GetHash(), 0);
+    txSpend.vin[1].prevout = COutPoint(txSplit.GetHash(), 1);
+    txSpend.vin[2].prevout = COutPoint(coinbaseTxns[1].GetHash(), 0);
+    txSpend.vout.assign(1, CTxOut(COIN, scriptPubKey));
+    SignSpend(txSpend, coinbaseKey);
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, txSpend), scriptPubKey);
+
+    LOCK(cs_main);
+    CBlockIndex* pindex = chainActive.Tip();
+    BOOST_CHECK(pindex->GetBlockHash() == block.GetHash());
+
+    // Older versions only stored the height and coinbase flag with the last
+    // spend of the outputs of a transaction. The inputs are restored backwards,
+    // so the one of the second output comes first
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    std::vector<Coin>& vprevout = blockundo.vtxundo[0].vprevout;
+    vprevout.push_back(Coin(txSplit.vout[0], 0, false, false));
+    vprevout.push_back(Coin(txSplit.vout[1], nSplitHeight, false, false));
+    vprevout.push_back(Coin(coinbaseTxns[1].vout[0], 2, true, false));
+
+    // Written over the current undo data, which is longer
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    pos.nPos -= MESSAGE_START_SIZE + sizeof(unsigned int);
+    BOOST_CHECK(UndoWriteToDisk(blockundo, pos, pindex->pprev->GetBlockHash(), Params().MessageStart()));
+    BOOST_CHECK(pos == pindex->GetUndoPos());
+
+    {
+        CStateViewCache view(pcoinsTip);
+        CValidationState state;
+        bool fClean = false;
+        BOOST_CHECK(DisconnectBlock(block, state, pindex, view, &fClean));
+        BOOST_CHECK(fClean);
+
+        for (unsigned int n = 0; n < 2; n++) {
+            const Coin& coin = view.AccessCoin(COutPoint(txSplit.GetHash(), n));
+            BOOST_CHECK(!coin.IsSpent());
+            BOOST_CHECK_EQUAL(coin.nHeight, nSplitHeight);
+            BOOST_CHECK(!coin.fCoinBase);
+        }
+
+        const Coin& coin = view.AccessCoin(COutPoint(coinbaseTxns[1].GetHash(), 0));
+        BOOST_CHECK_EQUAL(coin.nHeight, 2);
+        BOOST_CHECK(coin.fCoinBase);
+    }
+
+    // Without any record holding the height, the outputs can not be restored
+    vprevout[1].nHeight = 0;
+    pos.nPos -= MESSAGE_START_SIZE + sizeof(unsigned int);
+    BOOST_CHECK(UndoWriteToDisk(blockundo, pos, pindex->pprev->GetBlockHash(), Params().MessageStart()));
+
+    {
+        CStateViewCache view(pcoinsTip);
+        CValidationState state;
+        bool fClean = true;
+        BOOST_CHECK(DisconnectBlock(block, state, pindex, view, &fClean));
+        BOOST_CHECK(!fClean);
+        BOOST_CHECK(!view.HaveCoin(COutPoint(txSplit.GetHash(), 0)));
+        BOOST_CHECK(!view.HaveCoin(COutPoint(txSplit.GetHash(), 1)));
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <hash.h>
+#include <multisethash.h>
+#include <random.h>
 #include <utilstrencodings.h>
 #include <test/test_navcoin.h>
 
@@ -106,6 +108,8 @@ BOOST_AUTO_TEST_CASE(siphash)
     BOOST_CHECK_EQUAL(hasher.Finalize(),  0xe612a3cb9ecba951ull);
 
     BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, uint256S("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100")), 0x7127512f72f27cceull);
+    // Same as the SipHash of the 32 bytes of the uint256 followed by the 4 bytes of the integer
+    BOOST_CHECK_EQUAL(SipHashUint256Extra(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, uint256S("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100"), 0x23222120UL), siphash_4_2_testvec[36]);
 
     // Check test vectors from spec, one byte at a time
     CSipHasher hasher2(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL);
@@ -124,4 +128,46 @@ BOOST_AUTO_TEST_CASE(siphash)
     }
 }
 
+BOOST_AUTO_TEST_CASE(multisethash)
+{
+    uint256 a = GetRandHash(), b = GetRandHash(), c = GetRandHash();
+
+    CMultisetHash empty;
+    BOOST_CHECK(empty.IsNull());
+
+    // Order independence
+    CMultisetHash abc, cba;
+    abc.Insert(a).Insert(b).Insert(c);
+    cba.Insert(c).Insert(b).Insert(a);
+    BOOST_CHECK(abc == cba);
+    BOOST_CHECK(abc.Finalize() == cba.Finalize());
+    BOOST_CHECK(abc.Finalize() != empty.Finalize());
+
+    // Multiplicity matters
+    CMultisetHash aab;
+    aab.Insert(a).Insert(a).Insert(b);
+    CMultisetHash ab;
+    ab.Insert(a).Insert(b);
+    BOOST_CHECK(aab != ab);
+
+    // Removal undoes insertion
+    abc.Remove(b);
+    CMultisetHash ac;
+    ac.Insert(c).Insert(a);
+    BOOST_CHECK(abc == ac);
+    abc.Remove(a).Remove(c);
+    BOOST_CHECK(abc.IsNull());
+
+    // Deltas can be accumulated separately and combined
+    CMultisetHash delta;
+    delta.Remove(a).Insert(b);
+    CMultisetHash state = ac;
+    state += delta;
+    CMultisetHash expected;
+    expected.Insert(b).Insert(c);
+    BOOST_CHECK(state == expected);
+    state -= delta;
+    BOOST_CHECK(state == ac);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
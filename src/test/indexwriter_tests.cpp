@@ -0,0 +1,304 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <hash.h>
+#include <indexbuilder.h>
+#include <indexwriter.h>
+#include <main.h>
+#include <script/sign.h>
+#include <script/standard.h>
+#include <utiltime.h>
+
+#include <test/test_navcoin.h>
+
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(indexwriter_tests, BasicTestingSetup)
+
+// Hashes of the serialized entries, to compare them whatever their order
+template<typename K, typename V>
+static std::set<uint256> GetEntrySet(const std::vector<std::pair<K, V> >& vEntries)
+{
+    std::set<uint256> setEntries;
+
+    for (const auto& it: vEntries)
+        setEntries.insert(SerializeHash(it));
+
+    return setEntries;
+}
+
+BOOST_AUTO_TEST_CASE(index_writer)
+{
+    CBlockTreeDB db(1 << 20, true);
+    CIndexWriter writer;
+
+    bool fTxIndexOld = fTxIndex;
+    bool fAddressIndexOld = fAddressIndex;
+    bool fSpentIndexOld = fSpentIndex;
+    fTxIndex = true;
+    fAddressIndex = true;
+
+    uint160 addressHash(std::vector<unsigned char>(20, 1));
+    uint160 addressHash2(std::vector<unsigned char>(20, 2));
+
+    writer.Start(&db);
+
+    for (int nHeight = 1; nHeight <= 100; nHeight++) {
+        CIndexUpdate update;
+        update.hashBlock = ArithToUint256(arith_uint256(nHeight));
+        update.vTxIndex.push_back(std::make_pair(ArithToUint256(arith_uint256(nHeight + 1000)), CDiskTxPos(CDiskBlockPos(0, nHeight), 80)));
+        update.vAddressHistory.push_back(std::make_pair(CAddressHistoryKey(addressHash, addressHash2, nHeight, 0, update.hashBlock, nHeight),
+                                                        CAddressHistoryValue(nHeight, 0, 0, 0)));
+        update.fTimestampIndex = true;
+        update.nLogicalTimestamp = nHeight;
+        BOOST_CHECK(writer.Push(update));
+    }
+
+    // The last logical timestamp is known without reading the database
+    unsigned int nLogicalTimestamp = 0;
+    BOOST_CHECK(writer.GetLogicalTimestamp(ArithToUint256(arith_uint256(100)), nLogicalTimestamp));
+    BOOST_CHECK_EQUAL(nLogicalTimestamp, 100);
+
+    // Transactions are found whether they are written or not
+    CDiskTxPos pos;
+    BOOST_CHECK(writer.ReadTxIndex(ArithToUint256(arith_uint256(1100)), pos));
+    BOOST_CHECK_EQUAL(pos.nPos, 100);
+
+    BOOST_CHECK(writer.Sync());
+    BOOST_CHECK_EQUAL(writer.GetPending(), 0);
+
+    BOOST_CHECK(db.ReadTxIndex(ArithToUint256(arith_uint256(1050)), pos));
+    BOOST_CHECK_EQUAL(pos.nPos, 50);
+    BOOST_CHECK(writer.ReadTxIndex(ArithToUint256(arith_uint256(1050)), pos));
+    BOOST_CHECK_EQUAL(pos.nPos, 50);
+    BOOST_CHECK(!writer.ReadTxIndex(ArithToUint256(arith_uint256(2000)), pos));
+
+    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > vHistory;
+    BOOST_CHECK(db.ReadAddressHistory(addressHash, addressHash2, vHistory));
+    BOOST_CHECK_EQUAL(vHistory.size(), 100);
+
+    // Every index stores the block it is synced to
+    uint256 hashBest;
+    BOOST_CHECK(db.ReadIndexBestBlock("txindex", hashBest));
+    BOOST_CHECK(hashBest == ArithToUint256(arith_uint256(100)));
+    BOOST_CHECK(db.ReadIndexBestBlock("addressindex", hashBest));
+    BOOST_CHECK(hashBest == ArithToUint256(arith_uint256(100)));
+    BOOST_CHECK(!db.ReadIndexBestBlock("spentindex", hashBest));
+
+    // Disconnecting the last block erases its entries and moves the best block back
+    CIndexUpdate update;
+    update.hashBlock = ArithToUint256(arith_uint256(99));
+    update.fDisconnect = true;
+    update.vAddressHistory.push_back(vHistory.back());
+    BOOST_CHECK(writer.Push(update));
+
+    // Indexes switched on or off once an update is queued keep their best block
+    fTxIndex = false;
+    fSpentIndex = true;
+
+    // Stopping the writer writes what is still queued
+    writer.Stop();
+
+    vHistory.clear();
+    BOOST_CHECK(db.ReadAddressHistory(addressHash, addressHash2, vHistory));
+    BOOST_CHECK_EQUAL(vHistory.size(), 99);
+    BOOST_CHECK(db.ReadIndexBestBlock("addressindex", hashBest));
+    BOOST_CHECK(hashBest == ArithToUint256(arith_uint256(99)));
+    BOOST_CHECK(db.ReadIndexBestBlock("txindex", hashBest));
+    BOOST_CHECK(hashBest == ArithToUint256(arith_uint256(99)));
+    BOOST_CHECK(!db.ReadIndexBestBlock("spentindex", hashBest));
+
+    fTxIndex = fTxIndexOld;
+    fAddressIndex = fAddressIndexOld;
+    fSpentIndex = fSpentIndexOld;
+}
+
+BOOST_AUTO_TEST_CASE(index_erase)
+{
+    CBlockTreeDB db(1 << 20, true);
+
+    uint160 addressHash(std::vector<unsigned char>(20, 1));
+
+    std::vector<CIndexUpdate> vUpdates;
+    for (int nHeight = 1; nHeight <= 50; nHeight++) {
+        CIndexUpdate update;
+        update.hashBlock = ArithToUint256(arith_uint256(nHeight));
+        update.vTxIndex.push_back(std::make_pair(ArithToUint256(arith_uint256(nHeight + 1000)), CDiskTxPos(CDiskBlockPos(0, nHeight), 80)));
+        update.vAddressHistory.push_back(std::make_pair(CAddressHistoryKey(addressHash, addressHash, nHeight, 0, update.hashBlock, nHeight),
+                                                        CAddressHistoryValue(nHeight, 0, 0, 0)));
+        update.vIndexes = {"txindex", "addressindex"};
+        vUpdates.push_back(update);
+    }
+    BOOST_CHECK(db.WriteIndexUpdates(vUpdates));
+
+    // Dropped in batches, leaving the other indexes alone
+    bool fDone = false;
+    int nBatches = 0;
+    while (!fDone && nBatches < 100) {
+        BOOST_CHECK(db.EraseIndex("addressindex", 20, fDone));
+        nBatches++;
+    }
+    BOOST_CHECK_EQUAL(nBatches, 3);
+
+    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > vHistory;
+    BOOST_CHECK(db.ReadAddressHistory(addressHash, addressHash, vHistory));
+    BOOST_CHECK(vHistory.empty());
+
+    uint256 hashBest;
+    BOOST_CHECK(!db.ReadIndexBestBlock("addressindex", hashBest));
+    BOOST_CHECK(db.ReadIndexBestBlock("txindex", hashBest));
+
+    CDiskTxPos pos;
+    BOOST_CHECK(db.ReadTxIndex(ArithToUint256(arith_uint256(1025)), pos));
+
+    BOOST_CHECK(!db.EraseIndex("unknownindex", 20, fDone));
+}
+
+BOOST_FIXTURE_TEST_CASE(index_undo_entries, TestChain100Setup)
+{
+    bool fTxIndexOld = fTxIndex;
+    bool fAddressIndexOld = fAddressIndex;
+    bool fSpentIndexOld = fSpentIndex;
+    bool fTimestampIndexOld = fTimestampIndex;
+    fTxIndex = true;
+    fAddressIndex = true;
+    fSpentIndex = true;
+    fTimestampIndex = true;
+
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CScript scriptPubKeyHash = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+
+    // Spends a coinbase to both kinds of indexed outputs
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKeyHash;
+    spend.vout[1].nValue = 5*CENT;
+    spend.vout[1].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, spend), scriptPubKeyHash);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    // The index writer is not running, so ConnectBlock wrote its entries right
+    // away, and they are the only ones as the indexes were off before
+    CIndexUpdate update;
+    BOOST_CHECK(ReadIndexUpdate(chainActive.Tip(), true, true, true, true, 0, update));
+    BOOST_CHECK(update.hashBlock == block.GetHash());
+
+    BOOST_CHECK_EQUAL(update.vTxIndex.size(), 2);
+    for (const auto& it: update.vTxIndex) {
+        CDiskTxPos pos;
+        BOOST_CHECK(pblocktree->ReadTxIndex(it.first, pos));
+        BOOST_CHECK(SerializeHash(pos) == SerializeHash(it.second));
+    }
+
+    BOOST_CHECK_EQUAL(update.vSpentIndex.size(), 1);
+    for (const auto& it: update.vSpentIndex) {
+        CSpentIndexKey key = it.first;
+        CSpentIndexValue value;
+        BOOST_CHECK(pblocktree->ReadSpentIndex(key, value));
+        BOOST_CHECK(SerializeHash(value) == SerializeHash(it.second));
+    }
+
+    std::set<std::pair<unsigned int, uint160> > setAddresses;
+    for (const auto& it: update.vAddressIndex)
+        setAddresses.insert(std::make_pair(it.first.type, it.first.hashBytes));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspentIndex;
+    for (const auto& it: setAddresses) {
+        BOOST_CHECK(pblocktree->ReadAddressIndex(it.second, it.first, vAddressIndex));
+        BOOST_CHECK(pblocktree->ReadAddressUnspentIndex(it.second, it.first, vAddressUnspentIndex));
+    }
+    BOOST_CHECK(!update.vAddressIndex.empty());
+    BOOST_CHECK(GetEntrySet(vAddressIndex) == GetEntrySet(update.vAddressIndex));
+
+    // The spent coinbase comes as a removal, which leaves nothing behind
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspent;
+    for (const auto& it: update.vAddressUnspentIndex)
+        if (!it.second.IsNull())
+            vUnspent.push_back(it);
+    BOOST_CHECK_EQUAL(vUnspent.size() + 1, update.vAddressUnspentIndex.size());
+    BOOST_CHECK(GetEntrySet(vAddressUnspentIndex) == GetEntrySet(vUnspent));
+
+    std::set<std::pair<uint160, uint160> > setHistories;
+    for (const auto& it: update.vAddressHistory)
+        setHistories.insert(std::make_pair(it.first.hashBytes, it.first.hashBytes2));
+
+    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > vAddressHistory;
+    for (const auto& it: setHistories)
+        BOOST_CHECK(pblocktree->ReadAddressHistory(it.first, it.second, vAddressHistory));
+    BOOST_CHECK(!update.vAddressHistory.empty());
+    BOOST_CHECK(GetEntrySet(vAddressHistory) == GetEntrySet(update.vAddressHistory));
+
+    unsigned int nLogicalTimestamp = 0;
+    BOOST_CHECK(pblocktree->ReadTimestampBlockIndex(block.GetHash(), nLogicalTimestamp));
+    BOOST_CHECK_EQUAL(nLogicalTimestamp, update.nLogicalTimestamp);
+
+    fTxIndex = fTxIndexOld;
+    fAddressIndex = fAddressIndexOld;
+    fSpentIndex = fSpentIndexOld;
+    fTimestampIndex = fTimestampIndexOld;
+}
+
+BOOST_FIXTURE_TEST_CASE(index_builder_restart, TestChain100Setup)
+{
+    bool fAddressIndexOld = fAddressIndex;
+    fAddressIndex = false;
+
+    // Long enough for the build to take more than one batch
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 2 * INDEX_BUILDER_BATCH + 50; i++)
+        CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+
+    std::string strError;
+    CIndexBuilder builder;
+
+    BOOST_CHECK(builder.Build("addressindex", strError));
+    BOOST_CHECK(!builder.Build("addressindex", strError));
+    builder.Start();
+
+    // Switched off while it runs, then requested again
+    MilliSleep(10);
+    BOOST_CHECK(builder.Drop("addressindex", strError));
+    BOOST_CHECK(!fAddressIndex);
+    BOOST_CHECK(builder.Build("addressindex", strError));
+
+    for (int i = 0; i < 3000 && !CIndexBuilder::IsEnabled("addressindex"); i++)
+        MilliSleep(10);
+
+    builder.Stop();
+
+    BOOST_CHECK(CIndexBuilder::IsEnabled("addressindex"));
+    BOOST_CHECK(builder.GetStatus().empty());
+
+    uint256 hashBest;
+    BOOST_CHECK(pblocktree->ReadIndexBestBlock("addressindex", hashBest));
+    BOOST_CHECK(hashBest == chainActive.Tip()->GetBlockHash());
+
+    bool fBuilding = true;
+    BOOST_CHECK(pblocktree->ReadFlag("addressindexbuilding", fBuilding));
+    BOOST_CHECK(!fBuilding);
+
+    // Every coinbase is indexed once
+    uint160 hashBytes(coinbaseKey.GetPubKey().GetID());
+    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > vHistory;
+    BOOST_CHECK(pblocktree->ReadAddressHistory(hashBytes, hashBytes, vHistory));
+    BOOST_CHECK_EQUAL(vHistory.size(), chainActive.Height());
+
+    fAddressIndex = fAddressIndexOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,91 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <kernel.h>
+#include <main.h>
+#include <primitives/transaction.h>
+
+#include <test/test_navcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(kernel_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(weighted_stake_target)
+{
+    arith_uint256 bnTarget, bnWeighted;
+
+    // Compare against the 512 bit product
+    std::vector<uint32_t> vBits = {0x1b00ffff, 0x1d00ffff, 0x1f00ffff, 0x207fffff};
+    std::vector<CAmount> vValues = {0, 1, COIN, 1000 * COIN, MAX_MONEY};
+
+    for (uint32_t nBits: vBits)
+    {
+        bnTarget.SetCompact(nBits);
+
+        for (CAmount nValue: vValues)
+        {
+            arith_uint512 bnTarget512(bnTarget.GetHex());
+            bnTarget512 *= arith_uint512(nValue);
+
+            bool fFits = GetWeightedStakeTarget(bnTarget, nValue, bnWeighted);
+            BOOST_CHECK_EQUAL(fFits, bnTarget512.bits() <= 256);
+            if (fFits)
+                BOOST_CHECK_EQUAL(arith_uint512(bnWeighted.GetHex()).GetHex(), bnTarget512.GetHex());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_kernel_search)
+{
+    CBlockIndex indexPrev;
+    indexPrev.nHeight = 100000;
+    indexPrev.nTime = 1600000000;
+    indexPrev.nStakeModifier = 0x0123456789abcdef;
+
+    CBlockIndex indexFrom;
+    indexFrom.nTime = 1500000000;
+
+    CMutableTransaction mtx;
+    mtx.nTime = 1500000000;
+    mtx.vout.push_back(CTxOut(1000 * COIN, CScript()));
+    CTransaction txPrev(mtx);
+    COutPoint prevout(txPrev.GetHash(), 0);
+
+    // From a target no kernel meets to one every kernel meets
+    std::vector<uint32_t> vBits = {0x1b00ffff, 0x1e00ffff, 0x1f00ffff, 0x207fffff};
+
+    for (uint32_t nBits: vBits)
+    {
+        CStakeKernelSearch kernelSearch(&indexPrev, nBits, indexFrom.GetBlockTime(), txPrev.nTime, txPrev.vout[0].nValue, prevout);
+
+        unsigned int nFirstFound = 0;
+        for (unsigned int n = 0; n < 256; n++)
+        {
+            unsigned int nTimeTx = indexPrev.nTime - n;
+            arith_uint256 hash, hashExpected, target;
+
+            bool fExpected = CheckStakeKernelHash(&indexPrev, nBits, indexFrom, txPrev, prevout, nTimeTx, hashExpected, target);
+            BOOST_CHECK_EQUAL(kernelSearch.Check(nTimeTx, hash), fExpected);
+            BOOST_CHECK(hash == hashExpected);
+
+            if (fExpected && nFirstFound == 0)
+                nFirstFound = nTimeTx;
+        }
+
+        unsigned int nTimeFound = 0;
+        arith_uint256 hash;
+        BOOST_CHECK_EQUAL(kernelSearch.Search(indexPrev.nTime, 256, nTimeFound, hash), nFirstFound != 0);
+        BOOST_CHECK_EQUAL(nTimeFound, nFirstFound);
+    }
+
+    // Timestamps before the min age are never tried
+    CStakeKernelSearch kernelSearch(&indexPrev, 0x207fffff, indexPrev.nTime, txPrev.nTime, txPrev.vout[0].nValue, prevout);
+    unsigned int nTimeFound;
+    arith_uint256 hash;
+    BOOST_CHECK(!kernelSearch.Search(indexPrev.nTime, 60, nTimeFound, hash));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,120 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <consensus/validation.h>
+#include <main.h>
+#include <script/interpreter.h>
+#include <txmempool.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <test/test_navcoin.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mempoolpersist_tests, TestChain100Setup)
+
+// Spends the first output of a mature coinbase of the test chain
+static CMutableTransaction SpendCoinbase(const CTransaction& coinbase, const CKey& key)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbase.GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = coinbase.vout[0].nValue - CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    return spend;
+}
+
+BOOST_AUTO_TEST_CASE(mempool_persist)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Matures the coinbases spent below
+    for (int i = 0; i < 3; i++)
+        CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+
+    int64_t nNow = GetTime();
+    int64_t nExpiry = DEFAULT_MEMPOOL_EXPIRY * 60 * 60;
+    SetMockTime(nNow);
+
+    CTransaction txNormal = SpendCoinbase(coinbaseTxns[0], coinbaseKey);
+    CTransaction txStem = SpendCoinbase(coinbaseTxns[1], coinbaseKey);
+    CTransaction txPrioritised = SpendCoinbase(coinbaseTxns[2], coinbaseKey);
+    CTransaction txExpiring = SpendCoinbase(coinbaseTxns[3], coinbaseKey);
+
+    {
+        LOCK(cs_main);
+        CValidationState state;
+
+        mempool.PrioritiseTransaction(txPrioritised.GetHash(), txPrioritised.GetHash().ToString(), 0, 10 * CENT);
+
+        BOOST_CHECK(AcceptToMemoryPool(mempool, &mempool.cs, &stempool.cs, state, txNormal, false, nullptr, true, 0));
+        BOOST_CHECK(AcceptToMemoryPool(stempool, &mempool.cs, &stempool.cs, state, txNormal, false, nullptr, true, 0));
+        BOOST_CHECK(AcceptToMemoryPool(stempool, &mempool.cs, &stempool.cs, state, txStem, false, nullptr, true, 0));
+        BOOST_CHECK(AcceptToMemoryPool(mempool, &mempool.cs, &stempool.cs, state, txPrioritised, false, nullptr, true, 0));
+        BOOST_CHECK(AcceptToMemoryPoolWithTime(mempool, &mempool.cs, &stempool.cs, state, txExpiring, false, nullptr, nNow - nExpiry + 60));
+    }
+
+    BOOST_CHECK_EQUAL(mempool.size(), 3);
+    BOOST_CHECK_EQUAL(stempool.size(), 2);
+
+    BOOST_CHECK(DumpMempool());
+    BOOST_CHECK(boost::filesystem::exists(GetDataDir() / "mempool.dat"));
+
+    mempool.clear();
+    stempool.clear();
+    mempool.ClearPrioritisation(txPrioritised.GetHash());
+
+    // The transaction which was close to expiring is too old by now
+    SetMockTime(nNow + 120);
+    BOOST_CHECK(LoadMempool());
+
+    BOOST_CHECK(mempool.exists(txNormal.GetHash()));
+    BOOST_CHECK(mempool.exists(txPrioritised.GetHash()));
+    BOOST_CHECK(!mempool.exists(txStem.GetHash()));
+    BOOST_CHECK(!mempool.exists(txExpiring.GetHash()));
+    BOOST_CHECK_EQUAL(mempool.size(), 2);
+
+    // The mempool entries are relayed through the stempool too, the stem ones stay there
+    BOOST_CHECK(stempool.exists(txStem.GetHash()));
+    BOOST_CHECK(stempool.exists(txNormal.GetHash()));
+    BOOST_CHECK(!stempool.exists(txExpiring.GetHash()));
+
+    // The entry times and fee deltas are kept
+    BOOST_CHECK_EQUAL(mempool.info(txNormal.GetHash()).nTime, nNow);
+    BOOST_CHECK_EQUAL(stempool.info(txStem.GetHash()).nTime, nNow);
+
+    {
+        LOCK(mempool.cs);
+        BOOST_CHECK(!mempool.mapDeltas.count(txNormal.GetHash()));
+        BOOST_CHECK_EQUAL(mempool.mapDeltas[txPrioritised.GetHash()].second, 10 * CENT);
+
+        CTxMemPool::txiter it = mempool.mapTx.find(txPrioritised.GetHash());
+        BOOST_CHECK(it != mempool.mapTx.end());
+        BOOST_CHECK_EQUAL(it->GetModifiedFee(), it->GetFee() + 10 * CENT);
+
+        it = mempool.mapTx.find(txNormal.GetHash());
+        BOOST_CHECK_EQUAL(it->GetModifiedFee(), it->GetFee());
+    }
+
+    mempool.clear();
+    stempool.clear();
+    mempool.ClearPrioritisation(txPrioritised.GetHash());
+    stempool.ClearPrioritisation(txPrioritised.GetHash());
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -62,7 +62,10 @@ TestingSetup::TestingSetup(const std::string& chainName) : BasicTestingSetup(cha
         InitBlockIndex(chainparams);
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
+        {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadBLSCTCheck);
+        }
         RegisterNodeSignals(GetNodeSignals());
 }
 
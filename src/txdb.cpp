@@ -8,15 +8,23 @@
 
 #include <chainparams.h>
 #include <hash.h>
+#include <init.h>
 #include <pow.h>
 #include <uint256.h>
+#include <util.h>
+#include <utiltime.h>
 
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <set>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
 
 using namespace std;
 
+static const char DB_COIN = 'U';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
@@ -24,6 +32,7 @@ static const char DB_PROPINDEX = 'o';
 static const char DB_PREQINDEX = 'r';
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSHISTORY = 'h';
+static const char DB_ADDRESSHISTORYCHECKPOINT = 'H';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
@@ -37,20 +46,61 @@ static const char DB_CONSENSUSINDEX = 'p';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_FLAG = 'F';
+static const char DB_INDEX_BEST_BLOCK = 'I';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 static const char DB_EXCLUDE_VOTES = 'X';
+static const char DB_DAO_STATE_COMMITMENT = 'd';
+
+namespace {
+
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN)  {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(key);
+        READWRITE(outpoint->hash);
+        READWRITE(VARINT(outpoint->n));
+    }
+};
+
+}
 
 CStateViewDB::CStateViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, false, 64)
 {
+    // The DAO state commitment is stored together with the best block it
+    // belongs to. Chain states written before it was introduced, or written
+    // since by a version which does not maintain it, need a one-time full walk
+    // of the DAO entries; from then on it is kept up to date by BatchWrite.
+    std::pair<uint256, CMultisetHash> stored;
+    uint256 hashBestBlock = GetBestBlock();
+    if (!db.Read(DB_DAO_STATE_COMMITMENT, stored) || stored.first != hashBestBlock)
+    {
+        CMultisetHash commitment;
+        int64_t nStart = GetTimeMillis();
+        if (ComputeDAOStateCommitment(*this, commitment))
+        {
+            db.Write(DB_DAO_STATE_COMMITMENT, std::make_pair(hashBestBlock, commitment), true);
+            LogPrintf("%s: Built DAO state commitment %s in %dms\n", __func__, commitment.Finalize().ToString(), GetTimeMillis() - nStart);
+        }
+        else
+        {
+            LogPrintf("%s: Could not build the DAO state commitment\n", __func__);
+        }
+    }
 }
 
-bool CStateViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair(DB_COINS, txid), coins);
+bool CStateViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    return db.Read(CoinEntry(&outpoint), coin);
 }
 
-bool CStateViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair(DB_COINS, txid));
+bool CStateViewDB::HaveCoin(const COutPoint &outpoint) const {
+    return db.Exists(CoinEntry(&outpoint));
 }
 
 bool CStateViewDB::GetProposal(const uint256 &pid, CProposal &proposal) const {
@@ -108,6 +158,14 @@ uint256 CStateViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
+bool CStateViewDB::GetDAOStateCommitment(CMultisetHash& commitment) const {
+    std::pair<uint256, CMultisetHash> stored;
+    if (!db.Read(DB_DAO_STATE_COMMITMENT, stored) || stored.first != GetBestBlock())
+        return false;
+    commitment = stored.second;
+    return true;
+}
+
 int CStateViewDB::GetExcludeVotes() const {
     int ret = -1;
     if (!db.Read(DB_EXCLUDE_VOTES, ret))
@@ -249,17 +307,19 @@ bool CStateViewDB::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
                               CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                               CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
                               CConsensusParameterMap &mapConsensus,
-                              const uint256 &hashBlock, const int &nExcludeVotes) {
+                              const uint256 &hashBlock, const int &nExcludeVotes,
+                              const CMultisetHash& daoStateDelta) {
 
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(make_pair(DB_COINS, it->first));
+            CoinEntry entry(&it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
             else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
+                batch.Write(entry, it->second.coin);
             changed++;
         }
         count++;
@@ -345,6 +405,20 @@ bool CStateViewDB::BatchWrite(CCoinsMap &mapCoins, CProposalMap &mapProposals,
     if (nExcludeVotes != -1)
         batch.Write(DB_EXCLUDE_VOTES, nExcludeVotes);
 
+    // The commitment moves along with the best block even when the DAO
+    // entries did not change, so it is only rebuilt after a mismatch.
+    if (!daoStateDelta.IsNull() || !hashBlock.IsNull())
+    {
+        std::pair<uint256, CMultisetHash> stored;
+        if (db.Read(DB_DAO_STATE_COMMITMENT, stored) && stored.first == GetBestBlock())
+        {
+            stored.second += daoStateDelta;
+            if (!hashBlock.IsNull())
+                stored.first = hashBlock;
+            batch.Write(DB_DAO_STATE_COMMITMENT, stored);
+        }
+    }
+
     LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
@@ -378,25 +452,31 @@ CStateViewCursor *CStateViewDB::Cursor() const
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COINS);
+    i->pcursor->Seek(DB_COIN);
     // Cache key of first record
-    i->pcursor->GetKey(i->keyTmp);
+    if (i->pcursor->Valid()) {
+        CoinEntry entry(&i->keyTmp.second);
+        i->pcursor->GetKey(entry);
+        i->keyTmp.first = entry.key;
+    } else {
+        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+    }
     return i;
 }
 
-bool CStateViewDBCursor::GetKey(uint256 &key) const
+bool CStateViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COINS) {
+    if (keyTmp.first == DB_COIN) {
         key = keyTmp.second;
         return true;
     }
     return false;
 }
 
-bool CStateViewDBCursor::GetValue(CCoins &coins) const
+bool CStateViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coins);
+    return pcursor->GetValue(coin);
 }
 
 unsigned int CStateViewDBCursor::GetValueSize() const
@@ -406,14 +486,144 @@ unsigned int CStateViewDBCursor::GetValueSize() const
 
 bool CStateViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COINS;
+    return keyTmp.first == DB_COIN;
 }
 
 void CStateViewDBCursor::Next()
 {
     pcursor->Next();
-    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp))
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else {
+        keyTmp.first = entry.key;
+    }
+}
+
+namespace {
+
+//! Legacy class to deserialize the per-transaction records of older chain
+//! states, see the former CCoins, without a reindex.
+class CCoins
+{
+public:
+    //! whether transaction is a coinbase
+    bool fCoinBase;
+
+    //! unspent transaction outputs; spent outputs are .IsNull(); spent outputs at the end of the array are dropped
+    std::vector<CTxOut> vout;
+
+    //! at which height this transaction was included in the active block chain
+    int nHeight;
+
+    //! empty constructor
+    CCoins() : fCoinBase(false), vout(0), nHeight(0) { }
+
+    template<typename Stream>
+    void Unserialize(Stream &s, int nType, int nVersion) {
+        unsigned int nCode = 0;
+        // version
+        unsigned int nVersionDummy;
+        ::Unserialize(s, VARINT(nVersionDummy), nType, nVersion);
+        // header code
+        ::Unserialize(s, VARINT(nCode), nType, nVersion);
+        fCoinBase = nCode & 1;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 2) != 0;
+        vAvail[1] = (nCode & 4) != 0;
+        unsigned int nMaskCode = (nCode / 8) + ((nCode & 6) != 0 ? 0 : 1);
+        // spentness bitmask
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail, nType, nVersion);
+            for (unsigned int p = 0; p < 8; p++) {
+                bool f = (chAvail & (1 << p)) != 0;
+                vAvail.push_back(f);
+            }
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        // txouts themself
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])), nType, nVersion);
+        }
+        // coinbase height
+        ::Unserialize(s, VARINT(nHeight), nType, nVersion);
+    }
+};
+
+}
+
+/** Upgrade the database from older formats.
+ *
+ * Currently implemented: from the per-transaction utxo records to per-output ones.
+ */
+bool CStateViewDB::Upgrade() {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(make_pair(DB_COINS, uint256()));
+    if (!pcursor->Valid()) {
+        return true;
+    }
+
+    int64_t count = 0;
+    int64_t nStart = GetTimeMillis();
+    LogPrintf("Upgrading utxo-set database...\n");
+    LogPrintf("[0%%]...");
+    uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    int reportDone = 0;
+    std::pair<char, uint256> key;
+    std::pair<char, uint256> prev_key = make_pair(DB_COINS, uint256());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        if (pcursor->GetKey(key) && key.first == DB_COINS) {
+            if (count++ % 256 == 0) {
+                uint32_t high = 0x100 * *key.second.begin() + *(key.second.begin() + 1);
+                int percentageDone = (int)(high * 100.0 / 65536.0 + 0.5);
+                uiInterface.ShowProgress(_("Upgrading UTXO database"), percentageDone);
+                if (reportDone < percentageDone/10) {
+                    // report max. every 10% step
+                    LogPrintf("[%d%%]...", percentageDone);
+                    reportDone = percentageDone/10;
+                }
+            }
+            CCoins old_coins;
+            if (!pcursor->GetValue(old_coins)) {
+                return error("%s: cannot parse CCoins record", __func__);
+            }
+            COutPoint outpoint(key.second, 0);
+            for (size_t i = 0; i < old_coins.vout.size(); ++i) {
+                if (!old_coins.vout[i].IsNull() && (old_coins.vout[i].IsBLSCT() || !old_coins.vout[i].scriptPubKey.IsUnspendable())) {
+                    Coin newcoin(std::move(old_coins.vout[i]), old_coins.nHeight, old_coins.fCoinBase, false);
+                    outpoint.n = i;
+                    CoinEntry entry(&outpoint);
+                    batch.Write(entry, newcoin);
+                }
+            }
+            batch.Erase(key);
+            if (batch.SizeEstimate() > batch_size) {
+                db.WriteBatch(batch);
+                batch.Clear();
+                db.CompactRange(prev_key, key);
+                prev_key = key;
+            }
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+    db.WriteBatch(batch);
+    db.CompactRange(make_pair(DB_COINS, uint256()), key);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("[%s].\n", ShutdownRequested() ? "CANCELLED" : "DONE");
+    LogPrint("bench", "Upgraded %d utxo-set records in %dms\n", count, GetTimeMillis() - nStart);
+    return !ShutdownRequested();
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -695,8 +905,11 @@ bool CBlockTreeDB::WriteAddressHistory(const std::vector<std::pair<CAddressHisto
 
 bool CBlockTreeDB::EraseAddressHistory(const std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue > >&vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+    for (std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         batch.Erase(make_pair(DB_ADDRESSHISTORY, it->first));
+        // A checkpoint at this height counted the entry
+        batch.Erase(make_pair(DB_ADDRESSHISTORYCHECKPOINT, CAddressHistoryIteratorHeightKey(it->first.hashBytes, it->first.hashBytes2, it->first.blockHeight)));
+    }
     return WriteBatch(batch);
 }
 
@@ -727,9 +940,8 @@ bool CBlockTreeDB::ReadAddressHistory(uint160 addressHash, uint160 addressHash2,
                     nValue.stakable = 0;
                 if (!(filter & AddressHistoryFilter::VOTING_WEIGHT))
                     nValue.voting_weight = 0;
-                if (filter & AddressHistoryFilter::GENERATED_FILTER && !(nValue.flags & AddressHistoryFlag::GENERATED_FLAG))
-                    continue;
-                addressIndex.push_back(make_pair(key.second, nValue));
+                if (!(filter & AddressHistoryFilter::GENERATED_FILTER && !(nValue.flags & AddressHistoryFlag::GENERATED_FLAG)))
+                    addressIndex.push_back(make_pair(key.second, nValue));
                 pcursor->Next();
             } else {
                 return error("failed to get address history value");
@@ -742,6 +954,129 @@ bool CBlockTreeDB::ReadAddressHistory(uint160 addressHash, uint160 addressHash2,
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressHistoryCheckpoints(uint160 addressHash, uint160 addressHash2, int end,
+                                                 std::vector<std::pair<int, CAddressHistoryCheckpoint> > &vect) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_ADDRESSHISTORYCHECKPOINT, CAddressHistoryIteratorHeightKey(addressHash, addressHash2, 0)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressHistoryIteratorHeightKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_ADDRESSHISTORYCHECKPOINT && key.second.hashBytes == addressHash && key.second.hashBytes2 == addressHash2) {
+            if (key.second.blockHeight >= end) {
+                break;
+            }
+            CAddressHistoryCheckpoint checkpoint;
+            if (pcursor->GetValue(checkpoint)) {
+                vect.push_back(make_pair(key.second.blockHeight, checkpoint));
+                pcursor->Next();
+            } else {
+                return error("failed to get address history checkpoint");
+            }
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+CAddressHistoryCursor::CAddressHistoryCursor(CBlockTreeDB& dbIn, uint160 addressHashIn, uint160 addressHash2In, AddressHistoryFilter filterIn,
+                                             boost::function<bool(int, uint256&)> fnGetBlockHashIn) :
+    db(dbIn), pcursor(dbIn.NewIterator()), addressHash(addressHashIn), addressHash2(addressHash2In), filter(filterIn),
+    fnGetBlockHash(fnGetBlockHashIn), fValid(false)
+{
+}
+
+bool CAddressHistoryCursor::ReadEntry()
+{
+    fValid = false;
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressHistoryKey> keyDB;
+        if (!pcursor->GetKey(keyDB) || keyDB.first != DB_ADDRESSHISTORY || keyDB.second.hashBytes != addressHash || keyDB.second.hashBytes2 != addressHash2)
+            return true;
+        if (!pcursor->GetValue(value))
+            return error("failed to get address history value");
+        if (filter & AddressHistoryFilter::GENERATED_FILTER && !(value.flags & AddressHistoryFlag::GENERATED_FLAG)) {
+            pcursor->Next();
+            continue;
+        }
+        key = keyDB.second;
+        fValid = true;
+        return true;
+    }
+
+    return true;
+}
+
+bool CAddressHistoryCursor::Seek(int nHeight)
+{
+    balance.SetNull();
+    int nFrom = 0;
+
+    if (nHeight > 0 && UseCheckpoints()) {
+        std::vector<std::pair<int, CAddressHistoryCheckpoint> > vCheckpoints;
+        if (!db.ReadAddressHistoryCheckpoints(addressHash, addressHash2, nHeight, vCheckpoints))
+            return false;
+
+        // The latest checkpoint below nHeight whose block is still active
+        for (std::vector<std::pair<int, CAddressHistoryCheckpoint> >::reverse_iterator it = vCheckpoints.rbegin(); it != vCheckpoints.rend(); it++) {
+            uint256 hash;
+            if (fnGetBlockHash(it->first, hash) && hash == it->second.blockHash) {
+                balance = it->second;
+                nFrom = it->first + 1;
+                break;
+            }
+        }
+    }
+
+    pcursor->Seek(make_pair(DB_ADDRESSHISTORY, CAddressHistoryIteratorHeightKey(addressHash, addressHash2, nFrom)));
+
+    if (!ReadEntry())
+        return false;
+
+    while (Valid() && key.blockHeight < nHeight) {
+        if (!Next())
+            return false;
+    }
+
+    return true;
+}
+
+bool CAddressHistoryCursor::Valid(int nEnd) const
+{
+    return fValid && (nEnd <= 0 || key.blockHeight <= nEnd);
+}
+
+CAddressHistoryValue CAddressHistoryCursor::GetValue() const
+{
+    CAddressHistoryValue ret = value;
+    if (!(filter & AddressHistoryFilter::SPENDABLE))
+        ret.spendable = 0;
+    if (!(filter & AddressHistoryFilter::STAKABLE))
+        ret.stakable = 0;
+    if (!(filter & AddressHistoryFilter::VOTING_WEIGHT))
+        ret.voting_weight = 0;
+    return ret;
+}
+
+bool CAddressHistoryCursor::Next()
+{
+    if (!fValid)
+        return true;
+
+    balance.spendable += value.spendable;
+    balance.stakable += value.stakable;
+    balance.voting_weight += value.voting_weight;
+
+    pcursor->Next();
+    return ReadEntry();
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
@@ -791,6 +1126,189 @@ bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &lt
     return true;
 }
 
+bool CBlockTreeDB::WriteIndexUpdates(const std::vector<CIndexUpdate>& vUpdates) {
+    if (vUpdates.empty())
+        return true;
+
+    CDBBatch batch(*this);
+    std::map<std::string, uint256> mapBestBlock;
+
+    // The address pairs with new history entries and the blocks these are in,
+    // to checkpoint their balances once the entries are written
+    std::set<std::pair<uint160, uint160> > setHistoryAddresses;
+    std::map<int, uint256> mapHistoryBlocks;
+
+    // The batch applies the operations in order, so a block disconnected after
+    // being connected leaves the entries as they were
+    for (const CIndexUpdate& update: vUpdates) {
+        for (auto& it: update.vTxIndex)
+            batch.Write(make_pair(DB_TXINDEX, it.first), it.second);
+
+        for (auto& it: update.vAddressIndex) {
+            if (update.fDisconnect)
+                batch.Erase(make_pair(DB_ADDRESSINDEX, it.first));
+            else
+                batch.Write(make_pair(DB_ADDRESSINDEX, it.first), it.second);
+        }
+
+        for (auto& it: update.vAddressHistory) {
+            if (update.fDisconnect) {
+                batch.Erase(make_pair(DB_ADDRESSHISTORY, it.first));
+                batch.Erase(make_pair(DB_ADDRESSHISTORYCHECKPOINT, CAddressHistoryIteratorHeightKey(it.first.hashBytes, it.first.hashBytes2, it.first.blockHeight)));
+                mapHistoryBlocks.erase(it.first.blockHeight);
+            } else {
+                batch.Write(make_pair(DB_ADDRESSHISTORY, it.first), it.second);
+                setHistoryAddresses.insert(std::make_pair(it.first.hashBytes, it.first.hashBytes2));
+                mapHistoryBlocks[it.first.blockHeight] = update.hashBlock;
+            }
+        }
+
+        for (auto& it: update.vAddressUnspentIndex) {
+            if (it.second.IsNull())
+                batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it.first));
+            else
+                batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it.first), it.second);
+        }
+
+        for (auto& it: update.vSpentIndex) {
+            if (it.second.IsNull())
+                batch.Erase(make_pair(DB_SPENTINDEX, it.first));
+            else
+                batch.Write(make_pair(DB_SPENTINDEX, it.first), it.second);
+        }
+
+        if (update.fTimestampIndex) {
+            batch.Write(make_pair(DB_TIMESTAMPINDEX, CTimestampIndexKey(update.nLogicalTimestamp, update.hashBlock)), 0);
+            batch.Write(make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(update.hashBlock)), CTimestampBlockIndexValue(update.nLogicalTimestamp));
+        }
+
+        for (const std::string& name: update.vIndexes)
+            mapBestBlock[name] = update.hashBlock;
+    }
+
+    for (auto& it: mapBestBlock)
+        batch.Write(make_pair(DB_INDEX_BEST_BLOCK, it.first), it.second);
+
+    if (!WriteBatch(batch))
+        return false;
+
+    // The checkpoints only save walking over entries, so they do not need to
+    // be written atomically with them
+    return setHistoryAddresses.empty() || WriteAddressHistoryCheckpoints(setHistoryAddresses, mapHistoryBlocks);
+}
+
+bool CBlockTreeDB::WriteAddressHistoryCheckpoints(const std::set<std::pair<uint160, uint160> >& setAddresses, const std::map<int, uint256>& mapBlockHash) {
+    CDBBatch batch(*this);
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    for (const std::pair<uint160, uint160>& address: setAddresses) {
+        // Walk the entries from the latest checkpoint, checkpoints at heights
+        // which are no longer indexed were erased together with their entries
+        std::vector<std::pair<int, CAddressHistoryCheckpoint> > vCheckpoints;
+        if (!ReadAddressHistoryCheckpoints(address.first, address.second, std::numeric_limits<int>::max(), vCheckpoints))
+            return false;
+
+        CAddressHistoryCheckpoint balance;
+        int nFrom = 0;
+        if (!vCheckpoints.empty()) {
+            balance = vCheckpoints.back().second;
+            nFrom = vCheckpoints.back().first + 1;
+        }
+
+        unsigned int nSinceCheckpoint = 0;
+        int nHeight = -1;
+
+        // Checkpoints go after the last entry of a block, so they cover whole
+        // blocks, and only in the blocks just written, whose hash is known
+        auto checkpoint = [&]() {
+            std::map<int, uint256>::const_iterator mi = mapBlockHash.find(nHeight);
+            if (nSinceCheckpoint >= ADDRESS_HISTORY_CHECKPOINT_INTERVAL && mi != mapBlockHash.end()) {
+                balance.blockHash = mi->second;
+                batch.Write(make_pair(DB_ADDRESSHISTORYCHECKPOINT, CAddressHistoryIteratorHeightKey(address.first, address.second, nHeight)), balance);
+                nSinceCheckpoint = 0;
+            }
+        };
+
+        pcursor->Seek(make_pair(DB_ADDRESSHISTORY, CAddressHistoryIteratorHeightKey(address.first, address.second, nFrom)));
+
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<char,CAddressHistoryKey> key;
+            if (!pcursor->GetKey(key) || key.first != DB_ADDRESSHISTORY || key.second.hashBytes != address.first || key.second.hashBytes2 != address.second)
+                break;
+            if (key.second.blockHeight != nHeight)
+                checkpoint();
+            CAddressHistoryValue value;
+            if (!pcursor->GetValue(value))
+                return error("failed to get address history value");
+            balance.spendable += value.spendable;
+            balance.stakable += value.stakable;
+            balance.voting_weight += value.voting_weight;
+            nSinceCheckpoint++;
+            nHeight = key.second.blockHeight;
+            pcursor->Next();
+        }
+        checkpoint();
+    }
+
+    return WriteBatch(batch);
+}
+
+// Erases up to nMax - nCount entries under prefix, whose keys are of type K
+template<typename K>
+static void EraseIndexEntries(CBlockTreeDB& db, CDBBatch& batch, char prefix, size_t& nCount, size_t nMax) {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+
+    pcursor->Seek(prefix);
+
+    while (pcursor->Valid() && nCount < nMax) {
+        boost::this_thread::interruption_point();
+        std::pair<char, K> key;
+        if (!pcursor->GetKey(key) || key.first != prefix)
+            break;
+        batch.Erase(key);
+        nCount++;
+        pcursor->Next();
+    }
+}
+
+bool CBlockTreeDB::EraseIndex(const std::string &name, size_t nMax, bool &fDone) {
+    CDBBatch batch(*this);
+    size_t nCount = 0;
+
+    if (name == "txindex") {
+        EraseIndexEntries<uint256>(*this, batch, DB_TXINDEX, nCount, nMax);
+    } else if (name == "addressindex") {
+        EraseIndexEntries<CAddressIndexKey>(*this, batch, DB_ADDRESSINDEX, nCount, nMax);
+        EraseIndexEntries<CAddressUnspentKey>(*this, batch, DB_ADDRESSUNSPENTINDEX, nCount, nMax);
+        EraseIndexEntries<CAddressHistoryKey>(*this, batch, DB_ADDRESSHISTORY, nCount, nMax);
+        EraseIndexEntries<CAddressHistoryIteratorHeightKey>(*this, batch, DB_ADDRESSHISTORYCHECKPOINT, nCount, nMax);
+    } else if (name == "spentindex") {
+        EraseIndexEntries<CSpentIndexKey>(*this, batch, DB_SPENTINDEX, nCount, nMax);
+    } else if (name == "timestampindex") {
+        EraseIndexEntries<CTimestampIndexKey>(*this, batch, DB_TIMESTAMPINDEX, nCount, nMax);
+        EraseIndexEntries<CTimestampBlockIndexKey>(*this, batch, DB_BLOCKHASHINDEX, nCount, nMax);
+    } else {
+        return error("%s: unknown index %s", __func__, name);
+    }
+
+    fDone = nCount < nMax;
+
+    // The best block goes with the last entries
+    if (fDone)
+        batch.Erase(make_pair(DB_INDEX_BEST_BLOCK, name));
+
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteIndexBestBlock(const std::string &name, const uint256 &hash) {
+    return Write(std::make_pair(DB_INDEX_BEST_BLOCK, name), hash);
+}
+
+bool CBlockTreeDB::ReadIndexBestBlock(const std::string &name, uint256 &hash) {
+    return Read(std::make_pair(DB_INDEX_BEST_BLOCK, name), hash);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -803,31 +1321,186 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+static void ThreadVerifyBlockIndexHashes(const std::vector<std::pair<uint256, CBlockHeader>>* pvHeaders, std::atomic<size_t>* pnNext, std::atomic<bool>* pfFailed)
+{
+    static const size_t nChunkSize = 1024;
+
+    while (!*pfFailed)
+    {
+        size_t nStart = pnNext->fetch_add(nChunkSize);
+        if (nStart >= pvHeaders->size())
+            break;
+
+        size_t nEnd = std::min(nStart + nChunkSize, pvHeaders->size());
+        for (size_t i = nStart; i < nEnd; i++)
+        {
+            const std::pair<uint256, CBlockHeader>& entry = (*pvHeaders)[i];
+            if (entry.second.GetHash() != entry.first)
+            {
+                LogPrintf("%s: block index entry %s does not match its header\n", __func__, entry.first.ToString());
+                *pfFailed = true;
+                break;
+            }
+        }
+    }
+}
+
+/** Recompute the hash of every loaded header over all the cores and compare it with the key it was stored under */
+static bool VerifyBlockIndexHashes(const std::vector<std::pair<uint256, CBlockHeader>>& vHeaders)
+{
+    int64_t nStart = GetTimeMillis();
+
+    std::atomic<size_t> nNext(0);
+    std::atomic<bool> fFailed(false);
+
+    int nThreads = std::max(GetNumCores(), 1);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&ThreadVerifyBlockIndexHashes, &vHeaders, &nNext, &fFailed));
+    threadGroup.join_all();
+
+    LogPrintf("%s: checked %u block index hashes with %d threads in %dms\n", __func__, vHeaders.size(), nThreads, GetTimeMillis() - nStart);
+
+    return !fFailed;
+}
+
+/** A batch of block index records, read from the cursor and decoded on a worker thread */
+struct CBlockIndexLoadBatch
+{
+    std::vector<uint256> vHashes;
+    std::vector<CDataStream> vRaw;
+    std::vector<CDiskBlockIndex> vDecoded;
+    bool fDecoded;
+    bool fFailed;
+
+    CBlockIndexLoadBatch() : fDecoded(false), fFailed(false) {}
+};
+
+/** Batches shared between the cursor walk and the decoding threads */
+struct CBlockIndexLoadQueue
+{
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<CBlockIndexLoadBatch> batches;
+    size_t nNext;
+    bool fDone;
+
+    CBlockIndexLoadQueue() : nNext(0), fDone(false) {}
+};
+
+static const size_t BLOCK_INDEX_LOAD_BATCH = 4096;
+
+static void ThreadDecodeBlockIndex(CBlockIndexLoadQueue* queue)
+{
+    while (true)
+    {
+        CBlockIndexLoadBatch* batch;
+        {
+            boost::unique_lock<boost::mutex> lock(queue->cs);
+            while (queue->nNext == queue->batches.size() && !queue->fDone)
+                queue->cond.wait(lock);
+            if (queue->nNext == queue->batches.size())
+                return;
+            // deque::push_back leaves references to the other elements valid
+            batch = &queue->batches[queue->nNext++];
+        }
+
+        bool fFailed = false;
+        batch->vDecoded.resize(batch->vRaw.size());
+        for (size_t i = 0; i < batch->vRaw.size(); i++)
+        {
+            try {
+                batch->vRaw[i] >> batch->vDecoded[i];
+            } catch (const std::exception&) {
+                fFailed = true;
+                break;
+            }
+        }
+
+        // clear() would keep the buffers allocated
+        std::vector<CDataStream>().swap(batch->vRaw);
+
+        boost::unique_lock<boost::mutex> lock(queue->cs);
+        batch->fFailed = fFailed;
+        batch->fDecoded = true;
+        queue->cond.notify_all();
+    }
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex,
+                                      boost::function<void(size_t)> reserveBlockIndex,
                                       boost::function<std::vector<std::pair<uint256, int>>*(const uint256&)> insertProposalVotes,
                                       boost::function<std::vector<std::pair<uint256, int>>*(const uint256&)> insertPaymentRequestVotes,
                                       boost::function<std::map<uint256, bool>*(const uint256&)> insertSupport,
-                                      boost::function<std::map<uint256, uint64_t>*(const uint256&)> insertConsultationVotes)
+                                      boost::function<std::map<uint256, uint64_t>*(const uint256&)> insertConsultationVotes,
+                                      bool fVerifyHashes)
 {
+    int64_t nTimeStart = GetTimeMillis();
+
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(make_pair(DB_BLOCK_INDEX, uint256()));
 
-    int nCount = 0;
+    size_t nCount = 0;
+
+    // The cursor is walked here while the records are deserialized by the
+    // worker threads, and every batch is linked into mapBlockIndex in order
+    // once it is decoded, so only a few batches are held at a time
+    CBlockIndexLoadQueue queue;
+    int nThreads = std::max(GetNumCores() - 1, 1);
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&ThreadDecodeBlockIndex, &queue));
+
+    // The entries are allocated in chunks of a few batches while the total is unknown
+    reserveBlockIndex(4 * BLOCK_INDEX_LOAD_BATCH);
+
+    // The entries are keyed by the block hash, so it is not computed again
+    // unless asked to with -verifyblockindexhashes
+    std::vector<std::pair<uint256, CBlockHeader>> vHeaders;
+
+    bool fReadFailed = false;
+    bool fDecodeFailed = false;
+    bool fHashMismatch = false;
+    uint256 hashMismatch;
+    size_t nLinked = 0;
+
+    // Links the batches decoded so far, or all of them when fWait
+    auto linkBatches = [&](bool fWait) {
+        while (!fDecodeFailed && !fHashMismatch)
+        {
+            CBlockIndexLoadBatch* batch;
+            {
+                boost::unique_lock<boost::mutex> lock(queue.cs);
+                if (nLinked == queue.batches.size())
+                    return;
+                while (fWait && !queue.batches[nLinked].fDecoded)
+                    queue.cond.wait(lock);
+                if (!queue.batches[nLinked].fDecoded)
+                    return;
+                batch = &queue.batches[nLinked++];
+            }
+
+            if (batch->fFailed) {
+                fDecodeFailed = true;
+                return;
+            }
+
+            for (size_t i = 0; i < batch->vDecoded.size(); i++) {
+                const uint256& hash = batch->vHashes[i];
+                CDiskBlockIndex& diskindex = batch->vDecoded[i];
+
+                if (!diskindex.GetStoredBlockHash().IsNull() && diskindex.GetStoredBlockHash() != hash) {
+                    fHashMismatch = true;
+                    hashMismatch = hash;
+                    return;
+                }
+
+                if (fVerifyHashes)
+                    vHeaders.push_back(std::make_pair(hash, diskindex.GetHeader()));
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        if (++nCount % PROGRESS_INTERVAL == 0) {
-            // Update the progress
-            uiInterface.ShowProgress(_("Loading block guts..."), nCount);
-        }
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
                 // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
+                CBlockIndex* pindexNew = insertBlockIndex(hash);
                 pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
                 pindexNew->nHeight        = diskindex.nHeight;
                 pindexNew->nFile          = diskindex.nFile;
@@ -853,33 +1526,107 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
                                           = diskindex.nPublicMoneySupply;
                 if (diskindex.vProposalVotes.size() > 0)
                 {
-                    auto pVotes = insertProposalVotes(diskindex.GetBlockHash());
-                    *pVotes = diskindex.vProposalVotes;
+                    auto pVotes = insertProposalVotes(hash);
+                    pVotes->swap(diskindex.vProposalVotes);
                 }
                 if (diskindex.vPaymentRequestVotes.size() > 0)
                 {
-                    auto prVotes = insertPaymentRequestVotes(diskindex.GetBlockHash());
-                    *prVotes = diskindex.vPaymentRequestVotes;
+                    auto prVotes = insertPaymentRequestVotes(hash);
+                    prVotes->swap(diskindex.vPaymentRequestVotes);
                 }
                 if (diskindex.mapSupport.size() > 0)
                 {
-                    auto supp = insertSupport(diskindex.GetBlockHash());
-                    *supp = diskindex.mapSupport;
+                    auto supp = insertSupport(hash);
+                    supp->swap(diskindex.mapSupport);
                 }
                 if (diskindex.mapConsultationVotes.size() > 0)
                 {
-                    auto cVotes = insertConsultationVotes(diskindex.GetBlockHash());
-                    *cVotes = diskindex.mapConsultationVotes;
+                    auto cVotes = insertConsultationVotes(hash);
+                    cVotes->swap(diskindex.mapConsultationVotes);
+                }
+            }
+
+            // Release the batch as soon as it is linked
+            std::vector<CDiskBlockIndex>().swap(batch->vDecoded);
+            std::vector<uint256>().swap(batch->vHashes);
+        }
+    };
+
+    CBlockIndexLoadBatch next;
+    next.vHashes.reserve(BLOCK_INDEX_LOAD_BATCH);
+    next.vRaw.reserve(BLOCK_INDEX_LOAD_BATCH);
+
+    try {
+        while (pcursor->Valid() && !fDecodeFailed && !fHashMismatch) {
+            if (++nCount % PROGRESS_INTERVAL == 0) {
+                // Update the progress
+                uiInterface.ShowProgress(_("Loading block guts..."), nCount);
+            }
+            boost::this_thread::interruption_point();
+            std::pair<char, uint256> key;
+            if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
+                CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+                if (!pcursor->GetValueStream(ssValue)) {
+                    fReadFailed = true;
+                    break;
+                }
+                next.vHashes.push_back(key.second);
+                next.vRaw.push_back(std::move(ssValue));
+
+                if (next.vRaw.size() == BLOCK_INDEX_LOAD_BATCH) {
+                    {
+                        boost::unique_lock<boost::mutex> lock(queue.cs);
+                        queue.batches.push_back(std::move(next));
+                        queue.cond.notify_all();
+                    }
+                    next = CBlockIndexLoadBatch();
+                    next.vHashes.reserve(BLOCK_INDEX_LOAD_BATCH);
+                    next.vRaw.reserve(BLOCK_INDEX_LOAD_BATCH);
+
+                    linkBatches(false);
                 }
 
                 pcursor->Next();
             } else {
-                return error("LoadBlockIndex() : failed to read value");
+                break;
             }
-        } else {
-            break;
         }
+
+        {
+            boost::unique_lock<boost::mutex> lock(queue.cs);
+            if (!next.vRaw.empty())
+                queue.batches.push_back(std::move(next));
+            queue.fDone = true;
+            queue.cond.notify_all();
+        }
+
+        if (!fReadFailed)
+            linkBatches(true);
+    } catch (...) {
+        {
+            boost::unique_lock<boost::mutex> lock(queue.cs);
+            queue.fDone = true;
+            queue.cond.notify_all();
+        }
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+        reserveBlockIndex(0);
+        throw;
     }
 
+    threadGroup.join_all();
+    reserveBlockIndex(0);
+
+    LogPrintf("%s: loaded %u block index entries with %d decoding threads in %dms\n", __func__, nCount, nThreads, GetTimeMillis() - nTimeStart);
+
+    if (fReadFailed || fDecodeFailed)
+        return error("LoadBlockIndex() : failed to read value");
+
+    if (fHashMismatch)
+        return error("LoadBlockIndex() : stored hash of block index entry %s does not match its key", hashMismatch.ToString());
+
+    if (fVerifyHashes && !VerifyBlockIndexHashes(vHeaders))
+        return error("LoadBlockIndex() : block index hashes do not match their headers");
+
     return true;
 }
@@ -16,6 +16,7 @@
 
 #include <functional>
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -26,6 +27,9 @@ class CBlockIndex;
 class CStateViewDBCursor;
 class uint256;
 
+//! Number of address history entries between two balance checkpoints
+static const unsigned int ADDRESS_HISTORY_CHECKPOINT_INTERVAL = 1000;
+
 //! Compensate for extra memory peak (x1.5-x1.9) at flush time.
 static constexpr int DB_PEAK_USAGE_FACTOR = 2;
 //! No need to periodic flush if at least this much space still available.
@@ -100,8 +104,8 @@ protected:
 public:
     CStateViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     bool GetProposal(const uint256 &pid, CProposal &coins) const;
     bool HaveProposal(const uint256 &pid) const;
     bool GetPaymentRequest(const uint256 &prid, CPaymentRequest &coins) const;
@@ -120,14 +124,18 @@ public:
                     CPaymentRequestMap &mapPaymentRequests, CVoteMap &mapVotes,
                     CConsultationMap &mapConsultations, CConsultationAnswerMap &mapAnswers,
                     CConsensusParameterMap& mapConsensus, const uint256 &hashBlock,
-                    const int &nExcludeVotes);
+                    const int &nExcludeVotes, const CMultisetHash& daoStateDelta);
     bool GetAllProposals(CProposalMap& map);
     bool GetAllPaymentRequests(CPaymentRequestMap& map);
     bool GetAllVotes(CVoteMap &map);
     bool GetAllConsultations(CConsultationMap &map);
     bool GetAllConsultationAnswers(CConsultationAnswerMap &map);
     int GetExcludeVotes() const;
+    bool GetDAOStateCommitment(CMultisetHash& commitment) const;
     CStateViewCursor *Cursor() const;
+
+    //! Attempt to update from an older database format. Returns whether an error occurred.
+    bool Upgrade();
 };
 
 /** Specialization of CStateViewCursor to iterate over a CStateViewDB */
@@ -136,8 +144,8 @@ class CStateViewDBCursor: public CStateViewCursor
 public:
     ~CStateViewDBCursor() {}
 
-    bool GetKey(uint256 &key) const;
-    bool GetValue(CCoins &coins) const;
+    bool GetKey(COutPoint &key) const;
+    bool GetValue(Coin &coin) const;
     unsigned int GetValueSize() const;
 
     bool Valid() const;
@@ -147,11 +155,38 @@ private:
     CStateViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
         CStateViewCursor(hashBlockIn), pcursor(pcursorIn) {}
     boost::scoped_ptr<CDBIterator> pcursor;
-    std::pair<char, uint256> keyTmp;
+    std::pair<char, COutPoint> keyTmp;
 
     friend class CStateViewDB;
 };
 
+/** Index entries of one connected or disconnected block */
+struct CIndexUpdate
+{
+    //! Best block of the indexes once the update is written
+    uint256 hashBlock;
+    bool fDisconnect;
+
+    std::vector<std::pair<uint256, CDiskTxPos> > vTxIndex;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddressIndex;
+    std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > vAddressHistory;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vAddressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpentIndex;
+
+    bool fTimestampIndex;
+    unsigned int nLogicalTimestamp;
+
+    //! Indexes enabled when the update was queued, whose best block it moves
+    std::vector<std::string> vIndexes;
+
+    CIndexUpdate() : fDisconnect(false), fTimestampIndex(false), nLogicalTimestamp(0) {}
+
+    size_t GetEntryCount() const
+    {
+        return vTxIndex.size() + vAddressIndex.size() + vAddressHistory.size() + vAddressUnspentIndex.size() + vSpentIndex.size() + fTimestampIndex;
+    }
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -183,17 +218,29 @@ public:
     bool ReadAddressHistory(uint160 addressHash, uint160 addressHash2,
                           std::vector<std::pair<CAddressHistoryKey, CAddressHistoryValue> > &addressIndex,
                           AddressHistoryFilter filter = AddressHistoryFilter::ALL, int start = 0, int end = 0);
+    /** Checkpoints the balances of the address pairs every ADDRESS_HISTORY_CHECKPOINT_INTERVAL entries, in the blocks of mapBlockHash */
+    bool WriteAddressHistoryCheckpoints(const std::set<std::pair<uint160, uint160> >& setAddresses, const std::map<int, uint256>& mapBlockHash);
+    bool ReadAddressHistoryCheckpoints(uint160 addressHash, uint160 addressHash2, int end,
+                                       std::vector<std::pair<int, CAddressHistoryCheckpoint> > &vect);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
+    /** Writes the updates in one batch, together with the new best block of the indexes each one names */
+    bool WriteIndexUpdates(const std::vector<CIndexUpdate>& vUpdates);
+    bool WriteIndexBestBlock(const std::string &name, const uint256 &hash);
+    bool ReadIndexBestBlock(const std::string &name, uint256 &hash);
+    /** Erases up to nMax entries of the named index, fDone tells whether it is empty now */
+    bool EraseIndex(const std::string &name, size_t nMax, bool &fDone);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex,
+                            boost::function<void(size_t)> reserveBlockIndex,
                             boost::function<std::vector<std::pair<uint256, int>>*(const uint256&)> insertProposalVotes,
                             boost::function<std::vector<std::pair<uint256, int>>*(const uint256&)> insertPaymentRequestVotes,
                             boost::function<std::map<uint256, bool>*(const uint256&)> insertSupport,
-                            boost::function<std::map<uint256, uint64_t>*(const uint256&)> insertConsultationVotes);
+                            boost::function<std::map<uint256, uint64_t>*(const uint256&)> insertConsultationVotes,
+                            bool fVerifyHashes = false);
     bool ReadProposalIndex(const uint256 &proposalid, CProposal &proposal);
     bool WriteProposalIndex(const std::vector<std::pair<uint256, CProposal> >&vect);
     bool GetProposalIndex(std::vector<CProposal>&vect);
@@ -203,6 +250,55 @@ public:
     bool WritePaymentRequestIndex(const std::vector<std::pair<uint256, CPaymentRequest> >&vect);
     bool GetPaymentRequestIndex(std::vector<CPaymentRequest>&vect);
     bool UpdatePaymentRequestIndex(const std::vector<std::pair<uint256, CPaymentRequest> >&vect);
+
+    friend class CAddressHistoryCursor;
+};
+
+/**
+ * Walks the history of an address pair in the order of the index, keeping
+ * the running balance, so a range can be served without loading the whole
+ * history. Balance checkpoints, written along with the entries by
+ * WriteIndexUpdates, are used to seek to the start of the range.
+ * They are only trusted while their block is part of the active chain, as
+ * told by fnGetBlockHash, which returns false for heights not to checkpoint.
+ */
+class CAddressHistoryCursor
+{
+public:
+    CAddressHistoryCursor(CBlockTreeDB& db, uint160 addressHash, uint160 addressHash2, AddressHistoryFilter filter,
+                          boost::function<bool(int, uint256&)> fnGetBlockHash);
+
+    /** Moves to the first entry at or above nHeight, the balance is then the one right before it */
+    bool Seek(int nHeight);
+    /** Whether the cursor is on an entry, with a height not above nEnd when given */
+    bool Valid(int nEnd = 0) const;
+    const CAddressHistoryKey& GetKey() const { return key; }
+    /** The current entry, with the fields out of the filter zeroed */
+    CAddressHistoryValue GetValue() const;
+    /** Adds the current entry to the balance and moves to the next one */
+    bool Next();
+
+    CAmount GetSpendable() const { return (filter & AddressHistoryFilter::SPENDABLE) ? balance.spendable : 0; }
+    CAmount GetStakable() const { return (filter & AddressHistoryFilter::STAKABLE) ? balance.stakable : 0; }
+    CAmount GetVotingWeight() const { return (filter & AddressHistoryFilter::VOTING_WEIGHT) ? balance.voting_weight : 0; }
+
+private:
+    CBlockTreeDB& db;
+    boost::scoped_ptr<CDBIterator> pcursor;
+    uint160 addressHash;
+    uint160 addressHash2;
+    AddressHistoryFilter filter;
+    boost::function<bool(int, uint256&)> fnGetBlockHash;
+
+    bool fValid;
+    CAddressHistoryKey key;
+    CAddressHistoryValue value;
+
+    //! Unfiltered balance before the current entry
+    CAddressHistoryCheckpoint balance;
+
+    bool UseCheckpoints() const { return !(filter & AddressHistoryFilter::GENERATED_FILTER); }
+    bool ReadEntry();
 };
 
 #endif // NAVCOIN_TXDB_H
@@ -33,7 +33,6 @@
 using namespace std;
 
 int64_t nWalletUnlockTime;
-int64_t nWalletFirstStakeTime = -1;
 static CCriticalSection cs_nWalletUnlockTime;
 
 std::string HelpRequiringPassphrase()
@@ -4041,116 +4040,60 @@ struct StakeRange {
 
 typedef vector<StakeRange> vStakeRange;
 
-// Check if we have a Tx that can be counted in staking report
-bool IsTxCountedAsStaked(const CWalletTx* tx)
-{
-    // Make sure we have a lock
-    LOCK(cs_main);
-
-    // orphan block or immature
-    if ((!tx->GetDepthInMainChain()) || (tx->GetBlocksToMaturity() > 0) || !tx->IsInMainChain())
-        return false;
-
-    // abandoned transactions
-    if (tx->isAbandoned())
-        return false;
-
-    // transaction other than POS block
-    return tx->IsCoinStake();
-}
-
-// Get the amount for a staked tx used in staking report
-CAmount GetTxStakeAmount(const CWalletTx* tx)
-{
-    // use the cached amount if available
-    if ((tx->fCreditCached || tx->fColdStakingCreditCached) && (tx->fDebitCached || tx->fColdStakingDebitCached))
-        return tx->nCreditCached + tx->nColdStakingCreditCached - tx->nDebitCached - tx->nColdStakingDebitCached;
-    // Check for cold staking
-    else if (tx->vout[1].scriptPubKey.IsColdStaking() || tx->vout[1].scriptPubKey.IsColdStakingv2())
-        return tx->GetCredit(pwalletMain->IsMine(tx->vout[1])) - tx->GetDebit(pwalletMain->IsMine(tx->vout[1]));
-
-    return tx->GetCredit(ISMINE_SPENDABLE) + tx->GetCredit(ISMINE_STAKABLE) - tx->GetDebit(ISMINE_SPENDABLE) - tx->GetDebit(ISMINE_STAKABLE);
-}
-
 // Gets timestamp for first stake
 // Returns -1 (Zero) if has not staked yet
 int64_t GetFirstStakeTime()
 {
-    // Check if we already know when
-    if (nWalletFirstStakeTime > 0)
-        return nWalletFirstStakeTime;
+    LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    // Need a pointer for the tx
-    const CWalletTx* tx;
+    int nMaxHeight;
+    int64_t nTime;
 
-    // scan the entire wallet transactions
-    for(auto& it: pwalletMain->wtxOrdered)
-    {
-        tx = it.second.first;
+    if (!pwalletMain->GetStakeReport(nMaxHeight).GetFirst(nMaxHeight, nTime))
+        return -1;
 
-        // Check if we have a useable tx
-        if (IsTxCountedAsStaked(tx)) {
-            nWalletFirstStakeTime = tx->nTime; // Save it for later use
-            return nWalletFirstStakeTime;
-        }
-    }
-
-    // Did not find the first stake
-    return nWalletFirstStakeTime;
+    return nTime;
 }
 
 // **em52: Get total coins staked on given period
-// inspired from CWallet::GetStake()
+// Served from the wallet's stake report, which keeps daily subtotals
 // Parameter vRange = Vector with given limit date, and result
-// return int =  Number of Wallet's elements analyzed
+// return int =  Number of stakes counted
 int GetsStakeSubTotal(vStakeRange& vRange)
 {
-    // Lock cs_main before we try to call GetTxStakeAmount
-    LOCK(cs_main);
-
-    int nElement = 0;
-    int64_t nAmount = 0;
+    LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    const CWalletTx* pcoin;
+    int nMaxHeight;
+    const CStakeReport& report = pwalletMain->GetStakeReport(nMaxHeight);
 
     vStakeRange::iterator vIt;
 
-    // scan the entire wallet transactions
-    for (map<uint256, CWalletTx>::const_iterator it = pwalletMain->mapWallet.begin();
-         it != pwalletMain->mapWallet.end();
-         ++it)
+    for(vIt=vRange.begin(); vIt != vRange.end(); vIt++)
     {
-        pcoin = &(*it).second;
-
-        // Check if we have a useable tx
-        if (!IsTxCountedAsStaked(pcoin))
-            continue;
-
-        nElement++;
-
-        // Get the stake tx amount from pcoin
-        nAmount = GetTxStakeAmount(pcoin);
+        if (! vIt->End)
+        {   // Manage Special case
+            int64_t nTime;
+            CAmount nAmount;
 
-        // scan the range
-        for(vIt=vRange.begin(); vIt != vRange.end(); vIt++)
-        {
-            if (pcoin->nTime >= vIt->Start)
+            if (report.GetLatest(nMaxHeight, nTime, nAmount))
             {
-                if (! vIt->End)
-                {   // Manage Special case
-                    vIt->Start = pcoin->nTime;
-                    vIt->Total = nAmount;
-                }
-                else if (pcoin->nTime <= vIt->End)
-                {
-                    vIt->Count++;
-                    vIt->Total += nAmount;
-                }
+                vIt->Start = nTime;
+                vIt->Total = nAmount;
             }
         }
+        else
+        {
+            CAmount nTotal;
+            int nCount;
+
+            report.GetRange(vIt->Start, vIt->End, nMaxHeight, nTotal, nCount);
+
+            vIt->Total += nTotal;
+            vIt->Count += nCount;
+        }
     }
 
-    return nElement;
+    return report.Count(nMaxHeight);
 }
 
 // prepare range for stake report
@@ -4285,6 +4228,76 @@ UniValue getstakereport(const UniValue& params, bool fHelp)
     return  result;
 }
 
+// getstakehistory: staked amounts of the wallet grouped in buckets of a given length
+UniValue getstakehistory(const UniValue& params, bool fHelp)
+{
+    if (!EnsureWalletIsAvailable(fHelp))
+        return NullUniValue;
+
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getstakehistory bucket_seconds ( count end_time )\n"
+            "\nReturns the amount staked by the wallet in consecutive periods of bucket_seconds,\n"
+            "the most recent first. Immature stakes are not counted.\n"
+            "\nArguments:\n"
+            "1. bucket_seconds   (numeric, required) The length of every period in seconds\n"
+            "2. count            (numeric, optional, default=30) The number of periods\n"
+            "3. end_time         (numeric, optional, default=now) The end of the most recent period\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"start\": n,       (numeric) The first second of the period\n"
+            "    \"end\": n,         (numeric) The last second of the period\n"
+            "    \"amount\": x.xxx,  (numeric) The amount staked in " + CURRENCY_UNIT + "\n"
+            "    \"count\": n        (numeric) The number of stakes\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getstakehistory", "86400")
+            + HelpExampleCli("getstakehistory", "3600 24")
+            + HelpExampleRpc("getstakehistory", "604800, 52")
+        );
+
+    int64_t nBucket = params[0].get_int64();
+    if (nBucket <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "bucket_seconds must be positive");
+
+    int64_t nBuckets = params.size() > 1 ? params[1].get_int64() : 30;
+    if (nBuckets <= 0 || nBuckets > 10000)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "count must be between 1 and 10000");
+
+    int64_t nEnd = params.size() > 2 ? params[2].get_int64() : GetTime();
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+
+    int nMaxHeight;
+    const CStakeReport& report = pwalletMain->GetStakeReport(nMaxHeight);
+
+    UniValue result(UniValue::VARR);
+
+    for (int64_t i = 0; i < nBuckets && nEnd >= 0; i++)
+    {
+        int64_t nStart = nEnd - nBucket + 1;
+
+        CAmount nTotal;
+        int nCount;
+
+        report.GetRange(nStart, nEnd, nMaxHeight, nTotal, nCount);
+
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("start", nStart);
+        entry.pushKV("end", nEnd);
+        entry.pushKV("amount", ValueFromAmount(nTotal));
+        entry.pushKV("count", nCount);
+        result.push_back(entry);
+
+        nEnd = nStart - 1;
+    }
+
+    return result;
+}
+
 UniValue resolveopenalias(const UniValue& params, bool fHelp)
 {
     bool dnssec_available; bool dnssec_valid;
@@ -5018,6 +5031,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false },
     { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false },
     { "wallet",             "getstakereport",           &getstakereport,           false },
+    { "wallet",             "getstakehistory",          &getstakehistory,          false },
     { "wallet",             "gettransaction",           &gettransaction,           false },
     { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false },
     { "wallet",             "getwalletinfo",            &getwalletinfo,            false },
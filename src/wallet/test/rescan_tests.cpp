@@ -0,0 +1,91 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/wallet.h>
+
+#include <main.h>
+#include <script/interpreter.h>
+#include <util.h>
+
+#include <set>
+
+#include <test/test_navcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(rescan_tests, TestChain100Setup)
+
+static std::set<uint256> GetWalletTxs(const CWallet& w)
+{
+    LOCK(w.cs_wallet);
+    std::set<uint256> setTxs;
+    for (const auto& it: w.mapWallet)
+        setTxs.insert(it.first);
+    return setTxs;
+}
+
+BOOST_AUTO_TEST_CASE(rescan_parallel)
+{
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CScript otherScriptPubKey = CScript() << ToByteVector(otherKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Spend one of our coinbases to somebody else, only found through its input
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = otherScriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    std::vector<CMutableTransaction> noTxns, spends;
+    spends.push_back(spend);
+
+    // More than one chunk, with every third coinbase paying us
+    for (unsigned int i = 0; i < RESCAN_CHUNK_SIZE + 50; i++)
+    {
+        CBlock block = CreateAndProcessBlock(i == 100 ? spends : noTxns, i % 3 == 0 ? scriptPubKey : otherScriptPubKey);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    }
+
+    // What the rescan did before it was parallel, one block after the other
+    CWallet serialWallet;
+    serialWallet.AddKey(coinbaseKey);
+    {
+        LOCK2(cs_main, serialWallet.cs_wallet);
+        for (CBlockIndex* pindex = chainActive.Genesis(); pindex; pindex = chainActive.Next(pindex))
+        {
+            CBlock block;
+            BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+            for (const CTransaction& tx: block.vtx)
+                serialWallet.AddToWalletIfInvolvingMe(tx, &block, true);
+        }
+    }
+
+    std::set<uint256> setSerialTxs = GetWalletTxs(serialWallet);
+    BOOST_CHECK(setSerialTxs.count(spend.GetHash()));
+    BOOST_CHECK(setSerialTxs.size() > (RESCAN_CHUNK_SIZE + 50) / 3);
+
+    const char* threads[] = {"1", "4"};
+    for (const char* strThreads: threads)
+    {
+        mapArgs["-rescanthreads"] = strThreads;
+
+        CWallet rescanWallet;
+        rescanWallet.AddKey(coinbaseKey);
+        rescanWallet.ScanForWalletTransactions(chainActive.Genesis(), true);
+
+        BOOST_CHECK(GetWalletTxs(rescanWallet) == setSerialTxs);
+    }
+    mapArgs.erase("-rescanthreads");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
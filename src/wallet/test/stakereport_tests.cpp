@@ -0,0 +1,133 @@
+// Copyright (c) 2020 The Navcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <wallet/wallet.h>
+
+#include <random.h>
+#include <test/test_navcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(stakereport_tests, BasicTestingSetup)
+
+struct Stake {
+    int64_t nTime;
+    int nHeight;
+    CAmount nAmount;
+};
+
+static void BruteForce(const std::map<uint256, Stake>& stakes, int64_t nStart, int64_t nEnd, int nMaxHeight, CAmount& nTotal, int& nCount)
+{
+    nTotal = 0;
+    nCount = 0;
+    for (const auto& it: stakes)
+    {
+        if (it.second.nTime >= nStart && it.second.nTime <= nEnd && it.second.nHeight <= nMaxHeight)
+        {
+            nTotal += it.second.nAmount;
+            nCount++;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stakereport_ranges)
+{
+    CStakeReport report;
+    std::map<uint256, Stake> stakes;
+
+    const int64_t nBase = 1577836800; // 2020-01-01
+    const int64_t nSpan = 20 * CStakeReport::DAY;
+
+    for (int i = 0; i < 500; i++)
+    {
+        Stake stake;
+        stake.nTime = nBase + insecure_rand() % nSpan;
+        stake.nHeight = i;
+        stake.nAmount = 1 + insecure_rand() % 100000;
+
+        uint256 hash = GetRandHash();
+        stakes[hash] = stake;
+        report.Update(hash, stake.nTime, stake.nHeight, stake.nAmount);
+    }
+
+    // Erase some and move some others to a different block
+    int i = 0;
+    for (auto it = stakes.begin(); it != stakes.end(); i++)
+    {
+        if (i % 7 == 0)
+        {
+            report.Erase(it->first);
+            it = stakes.erase(it);
+            continue;
+        }
+        if (i % 11 == 0)
+        {
+            it->second.nHeight += 1000;
+            report.Update(it->first, it->second.nTime, it->second.nHeight, it->second.nAmount);
+        }
+        ++it;
+    }
+
+    for (int j = 0; j < 200; j++)
+    {
+        int64_t nStart = nBase - CStakeReport::DAY + insecure_rand() % (nSpan + 2 * CStakeReport::DAY);
+        int64_t nEnd = nStart + insecure_rand() % (j % 2 ? CStakeReport::DAY : nSpan);
+        int nMaxHeight = j % 3 ? 1500 : insecure_rand() % 500;
+
+        CAmount nTotal, nExpectedTotal;
+        int nCount, nExpectedCount;
+
+        report.GetRange(nStart, nEnd, nMaxHeight, nTotal, nCount);
+        BruteForce(stakes, nStart, nEnd, nMaxHeight, nExpectedTotal, nExpectedCount);
+
+        BOOST_CHECK_EQUAL(nTotal, nExpectedTotal);
+        BOOST_CHECK_EQUAL(nCount, nExpectedCount);
+    }
+
+    // Whole days only
+    CAmount nTotal, nExpectedTotal;
+    int nCount, nExpectedCount;
+    int64_t nDayStart = (nBase / CStakeReport::DAY + 2) * CStakeReport::DAY;
+    report.GetRange(nDayStart, nDayStart + 5 * CStakeReport::DAY - 1, 1500, nTotal, nCount);
+    BruteForce(stakes, nDayStart, nDayStart + 5 * CStakeReport::DAY - 1, 1500, nExpectedTotal, nExpectedCount);
+    BOOST_CHECK_EQUAL(nTotal, nExpectedTotal);
+    BOOST_CHECK_EQUAL(nCount, nExpectedCount);
+
+    // Everything
+    report.GetRange(-1, nBase + nSpan, 1500, nTotal, nCount);
+    BOOST_CHECK_EQUAL(nCount, (int)stakes.size());
+    BOOST_CHECK_EQUAL(report.Count(1500), (int)stakes.size());
+
+    int nImmature = 0;
+    for (const auto& it: stakes)
+        if (it.second.nHeight > 250)
+            nImmature++;
+    BOOST_CHECK_EQUAL(report.Count(250), (int)stakes.size() - nImmature);
+
+    int64_t nFirst = std::numeric_limits<int64_t>::max(), nLatest = 0, nTime;
+    CAmount nLatestAmount = 0, nAmount;
+    for (const auto& it: stakes)
+    {
+        if (it.second.nHeight > 250)
+            continue;
+        nFirst = std::min(nFirst, it.second.nTime);
+        if (it.second.nTime > nLatest)
+        {
+            nLatest = it.second.nTime;
+            nLatestAmount = it.second.nAmount;
+        }
+    }
+
+    BOOST_CHECK(report.GetFirst(250, nTime));
+    BOOST_CHECK_EQUAL(nTime, nFirst);
+    BOOST_CHECK(report.GetLatest(250, nTime, nAmount));
+    BOOST_CHECK_EQUAL(nTime, nLatest);
+    BOOST_CHECK_EQUAL(nAmount, nLatestAmount);
+
+    report.Clear();
+    BOOST_CHECK(!report.GetFirst(1500, nTime));
+    BOOST_CHECK_EQUAL(report.Count(1500), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
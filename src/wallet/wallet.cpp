@@ -7,6 +7,7 @@
 
 #include <base58.h>
 #include <checkpoints.h>
+#include <checkqueue.h>
 #include <chain.h>
 #include <coincontrol.h>
 #include <consensus/dao.h>
@@ -400,6 +401,236 @@ bool CWallet::SelectCoinsForStaking(int64_t nTargetValue, unsigned int nSpendTim
     return true;
 }
 
+bool CWallet::GetStakeKernelInput(const CWalletTx* pcoin, unsigned int n, CStakeKernelInput& input)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    COutPoint prevout(pcoin->GetHash(), n);
+
+    std::map<COutPoint, CStakeKernelInput>::iterator it = mapStakeKernelInputs.find(prevout);
+    if (it != mapStakeKernelInputs.end())
+    {
+        input = it->second;
+        return true;
+    }
+
+    BlockMap::iterator mi = mapBlockIndex.find(pcoin->hashBlock);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+        return false;
+
+    if (n >= pcoin->vout.size())
+        return false;
+
+    input.nValue = pcoin->vout[n].nValue;
+    input.nTime = pcoin->nTime;
+    input.nBlockTime = mi->second->GetBlockTime();
+
+    mapStakeKernelInputs[prevout] = input;
+
+    return true;
+}
+
+constexpr int64_t CStakeReport::DAY;
+
+void CStakeReport::Update(const uint256& hash, int64_t nTime, int nHeight, CAmount nAmount)
+{
+    Erase(hash);
+
+    Entry entry;
+    entry.nTime = nTime;
+    entry.nHeight = nHeight;
+    entry.nAmount = nAmount;
+
+    mapEntries[hash] = entry;
+    setByTime.insert(std::make_pair(nTime, hash));
+    setByHeight.insert(std::make_pair(nHeight, hash));
+
+    std::pair<CAmount, int>& day = mapDays[nTime / DAY];
+    day.first += nAmount;
+    day.second++;
+}
+
+void CStakeReport::Erase(const uint256& hash)
+{
+    std::map<uint256, Entry>::iterator it = mapEntries.find(hash);
+    if (it == mapEntries.end())
+        return;
+
+    const Entry& entry = it->second;
+
+    setByTime.erase(std::make_pair(entry.nTime, hash));
+    setByHeight.erase(std::make_pair(entry.nHeight, hash));
+
+    std::map<int64_t, std::pair<CAmount, int>>::iterator itDay = mapDays.find(entry.nTime / DAY);
+    if (itDay != mapDays.end())
+    {
+        itDay->second.first -= entry.nAmount;
+        if (--itDay->second.second <= 0)
+            mapDays.erase(itDay);
+    }
+
+    mapEntries.erase(it);
+}
+
+void CStakeReport::Clear()
+{
+    mapEntries.clear();
+    setByTime.clear();
+    setByHeight.clear();
+    mapDays.clear();
+}
+
+void CStakeReport::Sum(int64_t nStart, int64_t nEnd, CAmount& nTotal, int& nCount) const
+{
+    for (std::set<std::pair<int64_t, uint256>>::const_iterator it = setByTime.lower_bound(std::make_pair(nStart, uint256()));
+         it != setByTime.end() && it->first <= nEnd; ++it)
+    {
+        nTotal += mapEntries.at(it->second).nAmount;
+        nCount++;
+    }
+}
+
+void CStakeReport::GetRange(int64_t nStart, int64_t nEnd, int nMaxHeight, CAmount& nTotal, int& nCount) const
+{
+    nTotal = 0;
+    nCount = 0;
+
+    nStart = std::max(nStart, (int64_t)0);
+    if (nStart > nEnd)
+        return;
+
+    // Whole days come from the subtotals, the edges from the entries
+    int64_t nFirstDay = (nStart + DAY - 1) / DAY;
+    int64_t nLastDay = (nEnd + 1) / DAY;
+
+    if (nFirstDay >= nLastDay)
+    {
+        Sum(nStart, nEnd, nTotal, nCount);
+    }
+    else
+    {
+        Sum(nStart, nFirstDay * DAY - 1, nTotal, nCount);
+        for (std::map<int64_t, std::pair<CAmount, int>>::const_iterator it = mapDays.lower_bound(nFirstDay);
+             it != mapDays.end() && it->first < nLastDay; ++it)
+        {
+            nTotal += it->second.first;
+            nCount += it->second.second;
+        }
+        Sum(nLastDay * DAY, nEnd, nTotal, nCount);
+    }
+
+    // Stakes which are not mature yet are only a handful at the top
+    for (std::set<std::pair<int, uint256>>::const_reverse_iterator it = setByHeight.rbegin();
+         it != setByHeight.rend() && it->first > nMaxHeight; ++it)
+    {
+        const Entry& entry = mapEntries.at(it->second);
+        if (entry.nTime >= nStart && entry.nTime <= nEnd)
+        {
+            nTotal -= entry.nAmount;
+            nCount--;
+        }
+    }
+}
+
+bool CStakeReport::GetFirst(int nMaxHeight, int64_t& nTime) const
+{
+    for (std::set<std::pair<int64_t, uint256>>::const_iterator it = setByTime.begin(); it != setByTime.end(); ++it)
+    {
+        if (mapEntries.at(it->second).nHeight > nMaxHeight)
+            continue;
+        nTime = it->first;
+        return true;
+    }
+    return false;
+}
+
+bool CStakeReport::GetLatest(int nMaxHeight, int64_t& nTime, CAmount& nAmount) const
+{
+    for (std::set<std::pair<int64_t, uint256>>::const_reverse_iterator it = setByTime.rbegin(); it != setByTime.rend(); ++it)
+    {
+        const Entry& entry = mapEntries.at(it->second);
+        if (entry.nHeight > nMaxHeight)
+            continue;
+        nTime = entry.nTime;
+        nAmount = entry.nAmount;
+        return true;
+    }
+    return false;
+}
+
+int CStakeReport::Count(int nMaxHeight) const
+{
+    int nCount = mapEntries.size();
+    for (std::set<std::pair<int, uint256>>::const_reverse_iterator it = setByHeight.rbegin();
+         it != setByHeight.rend() && it->first > nMaxHeight; ++it)
+        nCount--;
+    return nCount;
+}
+
+void CWallet::UpdateStakeReport(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (!wtx.IsCoinStake() || wtx.isAbandoned())
+    {
+        stakeReport.Erase(wtx.GetHash());
+        return;
+    }
+
+    BlockMap::iterator mi = mapBlockIndex.find(wtx.hashBlock);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+    {
+        stakeReport.Erase(wtx.GetHash());
+        return;
+    }
+
+    CAmount nAmount;
+
+    // use the cached amount if available
+    if ((wtx.fCreditCached || wtx.fColdStakingCreditCached) && (wtx.fDebitCached || wtx.fColdStakingDebitCached))
+        nAmount = wtx.nCreditCached + wtx.nColdStakingCreditCached - wtx.nDebitCached - wtx.nColdStakingDebitCached;
+    // Check for cold staking
+    else if (wtx.vout.size() > 1 && (wtx.vout[1].scriptPubKey.IsColdStaking() || wtx.vout[1].scriptPubKey.IsColdStakingv2()))
+        nAmount = wtx.GetCredit(IsMine(wtx.vout[1])) - wtx.GetDebit(IsMine(wtx.vout[1]));
+    else
+        nAmount = wtx.GetCredit(ISMINE_SPENDABLE) + wtx.GetCredit(ISMINE_STAKABLE) - wtx.GetDebit(ISMINE_SPENDABLE) - wtx.GetDebit(ISMINE_STAKABLE);
+
+    stakeReport.Update(wtx.GetHash(), wtx.nTime, mi->second->nHeight, nAmount);
+}
+
+const CStakeReport& CWallet::GetStakeReport(int& nMaxHeight)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (!fStakeReportBuilt)
+    {
+        int64_t nStart = GetTimeMillis();
+
+        stakeReport.Clear();
+        fStakeReportBuilt = true;
+
+        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            if (it->second.IsCoinStake())
+                UpdateStakeReport(it->second);
+
+        LogPrint("wallet", "%s: built stake report with %d stakes in %dms\n", __func__, stakeReport.Count(std::numeric_limits<int>::max()), GetTimeMillis() - nStart);
+    }
+
+#if CLIENT_BUILD_IS_TEST_RELEASE
+    bool fTestNet = GetBoolArg("-testnet", true);
+#else
+    bool fTestNet = GetBoolArg("-testnet", false);
+#endif
+
+    // Mirrors CMerkleTx::GetBlocksToMaturity
+    nMaxHeight = chainActive.Height() - (fTestNet ? 0 : Params().GetConsensus().nCoinbaseMaturity);
+
+    return stakeReport;
+}
+
 bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int64_t nSearchInterval, int64_t nFees, CMutableTransaction& txNew, CKey& key, CScript& kernelScriptPubKey)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -434,20 +665,44 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
 
     CStateViewCache view(pcoinsTip);
 
+    // Look up the kernel inputs once, the search below then runs without
+    // touching the disk or the locks
+    std::map<std::pair<const CWalletTx*,unsigned int>, CStakeKernelInput> mapKernelInputs;
+    {
+        LOCK2(cs_main, cs_wallet);
+        for(PAIRTYPE(const CWalletTx*, unsigned int) pcoin: setCoins)
+        {
+            CStakeKernelInput input;
+            if (GetStakeKernelInput(pcoin.first, pcoin.second, input))
+                mapKernelInputs[pcoin] = input;
+        }
+    }
+
     int64_t nCredit = 0;
     CScript scriptPubKeyKernel;
     for(PAIRTYPE(const CWalletTx*, unsigned int) pcoin: setCoins)
     {
         static int nMaxStakeSearchInterval = 60;
         bool fKernelFound = false;
+
+        if (!mapKernelInputs.count(pcoin))
+            continue;
+
+        const CStakeKernelInput& input = mapKernelInputs[pcoin];
+        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
+        CStakeKernelSearch kernelSearch(pindexPrev, nBits, input.nBlockTime, input.nTime, input.nValue, prevoutStake);
+
+
         for (unsigned int n=0; n<min(nSearchInterval,(int64_t)nMaxStakeSearchInterval) && !fKernelFound && pindexPrev == chainActive.Tip(); n++)
         {
             boost::this_thread::interruption_point();
             // Search backward in time from the given txNew timestamp
             // Search nSearchInterval seconds back up to nMaxStakeSearchInterval
-            COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-            int64_t nBlockTime;
-            if (CheckKernel(pindexPrev, nBits, txNew.nTime - n, prevoutStake, view, &nBlockTime))
+            if (txNew.nTime - n < kernelSearch.GetMinTime())
+                break; // the older timestamps fail the min age too
+
+            arith_uint256 hashProofOfStake;
+            if (kernelSearch.Check(txNew.nTime - n, hashProofOfStake))
             {
                 // Found a kernel
                 LogPrint("coinstake", "CreateCoinStake : kernel found\n");
@@ -670,6 +925,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
         }
 
         std::vector<bls::G2Element> vBLSSignatures;
+        bool fViewTag = IsBLSCTViewTagEnabled(pindexPrev, Params().GetConsensus());
 
         for (const auto& entry: splitMap)
         {
@@ -690,7 +946,7 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
                 blsctDoublePublicKey dk = boost::get<blsctDoublePublicKey>(entry.first.Get());
                 bls::G1Element nonce;
 
-                if (!CreateBLSCTOutput(ephemeralKey, nonce, blsctOut, dk, thisOut, "Staking reward", gammaOuts, strFailReason, false, vBLSSignatures))
+                if (!CreateBLSCTOutput(ephemeralKey, nonce, blsctOut, dk, thisOut, "Staking reward", gammaOuts, strFailReason, false, vBLSSignatures, fViewTag))
                 {
                     return error("%s: Could not redirect stakes to xNAV: %s\n", __func__, strFailReason);
                 }
@@ -1611,58 +1867,14 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
 
             if (blsctData == nullptr)
             {
-                CValidationState state;
-                CStateView dummy;
-                CStateViewCache view(&dummy);
                 blsctKey k;
 
                 if (GetBLSCTViewKey(k))
                 {
-                    std::vector<bls::G1Element> nonces;
-                    std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
-
-                    bls::PrivateKey vk = k.GetKey();
-
-                    for (unsigned int i = 0; i < wtx.vout.size(); i++)
-                    {
-                        CTxOut out = wtx.vout[i];
-
-                        if (out.outputKey.size() == 0 || out.outputKey.size() == 0 || out.spendingKey.size() == 0)
-                            continue;
-
-                        bls::G1Element n = bls::G1Element::FromByteVector(out.outputKey);
-                        n = n * vk;
-
-                        uint256 ekhash = SerializeHash(out.ephemeralKey);
-
-                        bool fHaveSubAddressKey = CBasicKeyStore::HaveBLSCTSubAddress(out.outputKey, out.spendingKey);
-
-                        if (mapNonces.count(ekhash) && mapNonces[ekhash].size() > 0 && !fHaveSubAddressKey)
-                        {
-                            try
-                            {
-                                n = bls::G1Element::FromByteVector(mapNonces[ekhash]);
-                            }
-                            catch(...)
-                            {
-                                proofs.push_back(std::make_pair(i, out.GetBulletproof()));
-                                nonces.push_back(n);
-                                continue;
-                            }
-
-                        }
-                        proofs.push_back(std::make_pair(i, out.GetBulletproof()));
-                        nonces.push_back(n);
-                    }
-
-                    if (!VerifyBulletproof(proofs, data, nonces, true))
-                    {
+                    if (!RecoverBLSCTData(wtx, k.GetKey(), data))
                         return error("%s: VerifyBulletproof returned false\n", __func__);
-                    }
-                    else
-                    {
-                        blsctData = &data;
-                    }
+
+                    blsctData = &data;
                 }
             }
 
@@ -1713,6 +1925,53 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletD
     return true;
 }
 
+bool CWallet::RecoverBLSCTData(const CTransaction& tx, const bls::PrivateKey& vk, std::vector<RangeproofEncodedData>& vData) const
+{
+    std::vector<bls::G1Element> nonces;
+    std::vector<std::pair<int, BulletproofsRangeproof>> proofs;
+
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        const CTxOut& out = tx.vout[i];
+
+        if (out.outputKey.size() == 0 || out.outputKey.size() == 0 || out.spendingKey.size() == 0)
+            continue;
+
+        bls::G1Element n = out.GetOutputKey();
+        n = n * vk;
+
+        std::map<uint256, std::vector<unsigned char>>::const_iterator itNonce = mapNonces.find(SerializeHash(out.ephemeralKey));
+
+        bool fHaveNonce = itNonce != mapNonces.end() && itNonce->second.size() > 0;
+        bool fViewTagMatch = out.viewTag.empty() || out.viewTag == CalculateViewTag(n);
+
+        // Outputs sent to somebody else can only be recovered with the nonce we kept when creating them
+        if (!fViewTagMatch && !fHaveNonce)
+            continue;
+
+        bool fHaveSubAddressKey = fViewTagMatch && CBasicKeyStore::HaveBLSCTSubAddress(out);
+
+        if (fHaveNonce && !fHaveSubAddressKey)
+        {
+            try
+            {
+                n = bls::G1Element::FromByteVector(itNonce->second);
+            }
+            catch(...)
+            {
+                proofs.push_back(std::make_pair(i, out.GetBulletproof()));
+                nonces.push_back(n);
+                continue;
+            }
+
+        }
+        proofs.push_back(std::make_pair(i, out.GetBulletproof()));
+        nonces.push_back(n);
+    }
+
+    return VerifyBulletproof(proofs, vData, nonces, true);
+}
+
 /**
  * Add a transaction to the wallet, or update it.
  * pblock is optional, but should be provided if the transaction is known to be in a block.
@@ -1886,7 +2145,21 @@ void CWallet::SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex,
 {
     LOCK2(cs_main, cs_wallet);
 
-    if (!AddToWalletIfInvolvingMe(tx, pblock, true, blsctData))
+    // The block of the outputs changed or their inputs got spent, the
+    // cached stake kernel inputs are no longer valid
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+        mapStakeKernelInputs.erase(COutPoint(tx.GetHash(), i));
+    for(const CTxIn& txin: tx.vin)
+        mapStakeKernelInputs.erase(txin.prevout);
+
+    bool fInvolvesMe = AddToWalletIfInvolvingMe(tx, pblock, true, blsctData);
+
+    // Coinstakes enter the stake report when their block is connected and
+    // leave it when it is disconnected
+    if (fStakeReportBuilt && tx.IsCoinStake() && mapWallet.count(tx.GetHash()))
+        UpdateStakeReport(mapWallet[tx.GetHash()]);
+
+    if (!fInvolvesMe)
        return; // Not one of ours
 
     // If a transaction changes 'conflicted' state, that changes the balance
@@ -1943,7 +2216,7 @@ isminetype CWallet::IsMine(const CTxOut& txout) const
 
         try
         {
-            bool fHaveSubAddressKey = CBasicKeyStore::HaveBLSCTSubAddress(txout.outputKey, txout.spendingKey);
+            bool fHaveSubAddressKey = CBasicKeyStore::HaveBLSCTSubAddress(txout);
             if (fHaveSubAddressKey)
             {
                 ret = ISMINE_SPENDABLE_PRIVATE;
@@ -2317,12 +2590,124 @@ void CWalletTx::GetAccountAmounts(const string& strAccount, CAmount& nReceived,
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  */
+/** A block of a rescan, read and matched against the wallet keys ahead of being added to the wallet */
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    CDiskBlockPos pos;
+    uint256 hash;
+    CBlock block;
+    bool fRead;
+    //! CWallet::IsMine of every transaction of the block
+    std::vector<bool> vIsMine;
+    //! The blsCT outputs recovered from the transactions which pay us, when vRecovered is set
+    std::vector<std::vector<RangeproofEncodedData>> vBLSCTData;
+    std::vector<bool> vRecovered;
+
+    CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), pos(pindexIn->GetBlockPos()), hash(pindexIn->GetBlockHash()), fRead(false) {}
+};
+
+/**
+ * Closure reading one block of a rescan and matching it against the wallet keys, run
+ * on the rescan threads. Only the key store and the nonces are read, cs_wallet is held
+ * by the scanning thread for the whole rescan.
+ */
+class CRescanCheck
+{
+private:
+    const CWallet* pwallet;
+    const blsctKey* pviewKey;
+    CRescanBlock* pblock;
+
+public:
+    CRescanCheck(): pwallet(0), pviewKey(0), pblock(0) {}
+    CRescanCheck(const CWallet* pwalletIn, const blsctKey* pviewKeyIn, CRescanBlock* pblockIn) :
+        pwallet(pwalletIn), pviewKey(pviewKeyIn), pblock(pblockIn) {}
+
+    bool operator()()
+    {
+        CRescanBlock& b = *pblock;
+
+        b.fRead = ReadBlockFromDisk(b.block, b.pos, Params().GetConsensus()) && b.block.GetHash() == b.hash;
+        if (!b.fRead)
+            return true;
+
+        b.vIsMine.resize(b.block.vtx.size());
+        b.vBLSCTData.resize(b.block.vtx.size());
+        b.vRecovered.resize(b.block.vtx.size());
+        for (size_t j = 0; j < b.block.vtx.size(); j++)
+        {
+            const CTransaction& tx = b.block.vtx[j];
+
+            b.vIsMine[j] = pwallet->IsMine(tx);
+
+            // AddToWallet recovers the outputs itself when this is not done here
+            if (b.vIsMine[j] && pviewKey && tx.IsCTOutput())
+            {
+                try
+                {
+                    b.vRecovered[j] = pwallet->RecoverBLSCTData(tx, pviewKey->GetKey(), b.vBLSCTData[j]);
+                }
+                catch(...)
+                {
+                    b.vRecovered[j] = false;
+                }
+            }
+        }
+
+        // The queue stops running checks after a failed one
+        return true;
+    }
+
+    void swap(CRescanCheck &check) {
+        std::swap(pwallet, check.pwallet);
+        std::swap(pviewKey, check.pviewKey);
+        std::swap(pblock, check.pblock);
+    }
+};
+
+static void ThreadRescanCheck(CCheckQueue<CRescanCheck>* pqueue)
+{
+    RenameThread("navcoin-rescan");
+    pqueue->Thread();
+}
+
+// Fills vBlocks with the next chunk of the active chain starting at pindex, which is moved past it
+static void GetRescanChunk(std::vector<CRescanBlock>& vBlocks, CBlockIndex*& pindex)
+{
+    AssertLockHeld(cs_main);
+
+    vBlocks.clear();
+
+    while (pindex && vBlocks.size() < RESCAN_CHUNK_SIZE)
+    {
+        vBlocks.push_back(CRescanBlock(pindex));
+        pindex = chainActive.Next(pindex);
+    }
+}
+
+// Queues the checks of a chunk
+static void AddRescanChunk(CCheckQueueControl<CRescanCheck>& control, const CWallet* pwallet, const blsctKey* pviewKey, std::vector<CRescanBlock>& vBlocks)
+{
+    std::vector<CRescanCheck> vChecks;
+    vChecks.reserve(vBlocks.size());
+    for (CRescanBlock& b: vBlocks)
+        vChecks.push_back(CRescanCheck(pwallet, pviewKey, &b));
+    control.Add(vChecks);
+}
+
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
+    int64_t nStartTime = GetTimeMillis();
+    int64_t nBlocks = 0;
     const CChainParams& chainParams = Params();
 
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads = std::max(GetNumCores(), 1);
+
     CBlockIndex* pindex = pindexStart;
     {
         LOCK2(cs_main, cs_wallet);
@@ -2335,27 +2720,102 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.Tip(), false);
-        while (pindex)
+
+        blsctKey viewKey;
+        const blsctKey* pviewKey = GetBLSCTViewKey(viewKey) ? &viewKey : nullptr;
+
+        // Blocks are read and checked against our keys by the same threads for the whole rescan,
+        // one chunk ahead of the previous chunk whose transactions are added in chain order.
+        CCheckQueue<CRescanCheck> rescanqueue(1);
+        boost::thread_group threadGroup;
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&ThreadRescanCheck, &rescanqueue));
+
+        std::vector<CRescanBlock> vBlocks, vNextBlocks;
+
+        try
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+            {
+                CCheckQueueControl<CRescanCheck> control(&rescanqueue);
+                GetRescanChunk(vBlocks, pindex);
+                AddRescanChunk(control, this, pviewKey, vBlocks);
+                control.Wait();
+            }
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex, Params().GetConsensus());
-            for(CTransaction& tx: block.vtx)
+            while (!vBlocks.empty())
             {
-                std::vector<RangeproofEncodedData> blsctData;
+                CCheckQueueControl<CRescanCheck> control(&rescanqueue);
+                GetRescanChunk(vNextBlocks, pindex);
+                AddRescanChunk(control, this, pviewKey, vNextBlocks);
 
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate, &blsctData))
-                    ret++;
-            }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+                for (CRescanBlock& b: vBlocks)
+                {
+                    if (b.pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    {
+                        double dRate = nBlocks * 1000.0 / std::max(GetTimeMillis() - nStartTime, (int64_t)1);
+                        ShowProgress(strprintf("%s (%.1f %s)", _("Rescanning..."), dRate, _("blocks/s")),
+                                     std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), b.pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+                    }
+
+                    if (!b.fRead)
+                    {
+                        error("%s: could not read block %s at %s", __func__, b.hash.ToString(), b.pos.ToString());
+                        continue;
+                    }
+
+                    for (size_t j = 0; j < b.block.vtx.size(); j++)
+                    {
+                        const CTransaction& tx = b.block.vtx[j];
+
+                        // Transactions which don't pay us can only involve us through our previous transactions
+                        if (!b.vIsMine[j] && !mapWallet.count(tx.GetHash()))
+                        {
+                            bool fSpendsKnown = false;
+                            for (const CTxIn& txin: tx.vin)
+                            {
+                                if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout))
+                                {
+                                    fSpendsKnown = true;
+                                    break;
+                                }
+                            }
+                            if (!fSpendsKnown)
+                                continue;
+                        }
+
+                        if (AddToWalletIfInvolvingMe(tx, &b.block, fUpdate, b.vRecovered[j] ? &b.vBLSCTData[j] : nullptr))
+                            ret++;
+                    }
+
+                    nBlocks++;
+
+                    if (GetTime() >= nNow + 60) {
+                        nNow = GetTime();
+                        LogPrintf("Still rescanning. At block %d. Progress=%f (%.1f blocks/s)\n", b.pindex->nHeight, Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), b.pindex),
+                                  nBlocks * 1000.0 / std::max(GetTimeMillis() - nStartTime, (int64_t)1));
+                    }
+                }
+
+                control.Wait();
+                vBlocks.swap(vNextBlocks);
             }
         }
+        catch (...)
+        {
+            threadGroup.interrupt_all();
+            threadGroup.join_all();
+            throw;
+        }
+
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+        // Built again from mapWallet on next use
+        fStakeReportBuilt = false;
+
+        LogPrintf("%s: scanned %d blocks in %dms with %d threads\n", __func__, nBlocks, GetTimeMillis() - nStartTime, nThreads);
     }
     return ret;
 }
@@ -3602,6 +4062,7 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
         LOCK2(cs_main, cs_wallet);
         {
             std::vector<COutput> vAvailableCoins;
+            bool fViewTag = IsBLSCTViewTagEnabled(chainActive.Tip(), Params().GetConsensus());
 
             if(fPrivate)
                 AvailablePrivateCoins(vAvailableCoins, true, coinControl);
@@ -3706,7 +4167,7 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
 
                         bls::PrivateKey ephemeralKey = bk.GetKey();
 
-                        if (!CreateBLSCTOutput(ephemeralKey, nonce, txout, blsctDoublePublicKey(recipient.vk, recipient.sk), nValue, recipient.sMemo, gammaOuts, strFailReason, fPrivate, vBLSSignatures))
+                        if (!CreateBLSCTOutput(ephemeralKey, nonce, txout, blsctDoublePublicKey(recipient.vk, recipient.sk), nValue, recipient.sMemo, gammaOuts, strFailReason, fPrivate, vBLSSignatures, fViewTag))
                         {
                             uiInterface.ShowProgress("Constructing BLSCT transaction...", 100);
                             return false;
@@ -3779,7 +4240,7 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                     uiInterface.ShowProgress("Constructing BLSCT transaction...", -1);
                     bls::G1Element nonce;
 
-                    if (!CreateBLSCTOutput(ephemeralKey, nonce, newTxOut, k, nChange, "Change", gammaOuts, strFailReason, fPrivate, vBLSSignatures))
+                    if (!CreateBLSCTOutput(ephemeralKey, nonce, newTxOut, k, nChange, "Change", gammaOuts, strFailReason, fPrivate, vBLSSignatures, fViewTag))
                     {
                         uiInterface.ShowProgress("Constructing BLSCT transaction...", 100);
                         strFailReason = _("Error creating BLSCT change output");
@@ -3950,7 +4411,7 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                             try
                             {
 
-                                if (!(s.GetG1Element() == bls::G1Element::FromBytes(coin.first->vout[coin.second].spendingKey.data())))
+                                if (!(s.GetG1Element() == coin.first->vout[coin.second].GetSpendingKey()))
                                 {
                                     strFailReason = _("Failed to recover signing key");
                                     if (fPrivate)
@@ -5358,6 +5819,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
                                                             CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of threads reading blocks during a rescan (0 = all cores, default: %d)"), DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
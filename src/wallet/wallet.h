@@ -64,6 +64,10 @@ static const unsigned int DEFAULT_TX_CONFIRM_TARGET = 2;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 10000;
 static const bool DEFAULT_WALLETBROADCAST = true;
+//! -rescanthreads default, 0 uses all the cores
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Blocks read ahead by the rescan threads
+static const unsigned int RESCAN_CHUNK_SIZE = 200;
 
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
@@ -627,6 +631,55 @@ public:
     std::string ToString() const;
 };
 
+/** The fields of a staked coin which go into the stake kernel, cached by the wallet */
+struct CStakeKernelInput
+{
+    CAmount nValue;
+    unsigned int nTime;
+    unsigned int nBlockTime;
+
+    CStakeKernelInput() : nValue(0), nTime(0), nBlockTime(0) {}
+};
+
+/**
+ * Coinstakes of the wallet ordered by time, with daily subtotals, so stake
+ * reports over any range cost about one step per day instead of a scan of
+ * mapWallet. Entries carry their height so the ones which are not mature
+ * yet can be left out at query time.
+ */
+class CStakeReport
+{
+public:
+    static constexpr int64_t DAY = 24 * 60 * 60;
+
+    void Update(const uint256& hash, int64_t nTime, int nHeight, CAmount nAmount);
+    void Erase(const uint256& hash);
+    void Clear();
+
+    /** Total and count of the stakes with a time in [nStart, nEnd] and a height up to nMaxHeight */
+    void GetRange(int64_t nStart, int64_t nEnd, int nMaxHeight, CAmount& nTotal, int& nCount) const;
+    /** The first and the latest stake with a height up to nMaxHeight */
+    bool GetFirst(int nMaxHeight, int64_t& nTime) const;
+    bool GetLatest(int nMaxHeight, int64_t& nTime, CAmount& nAmount) const;
+    /** Number of stakes with a height up to nMaxHeight */
+    int Count(int nMaxHeight) const;
+
+private:
+    struct Entry {
+        int64_t nTime;
+        int nHeight;
+        CAmount nAmount;
+    };
+
+    std::map<uint256, Entry> mapEntries;
+    std::set<std::pair<int64_t, uint256>> setByTime;
+    std::set<std::pair<int, uint256>> setByHeight;
+    //! Total and count of the stakes of every day, by time / DAY
+    std::map<int64_t, std::pair<CAmount, int>> mapDays;
+
+    void Sum(int64_t nStart, int64_t nEnd, CAmount& nTotal, int& nCount) const;
+};
+
 struct sortByCoinAgeDescending
 {
     inline bool operator() (const COutput& cOutput1, const COutput& cOutput2)
@@ -759,6 +812,23 @@ private:
     bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = NULL) const;
     bool SelectCoinsForStaking(int64_t nTargetValue, unsigned int nSpendTime, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, int64_t& nValueRet) const;
 
+    /**
+     * Kernel inputs of the coins tried by CreateCoinStake, so the search does
+     * not read the previous transaction from disk for every coin and timestamp.
+     * Entries are dropped in SyncTransaction when the coin is spent or its
+     * block changes.
+     */
+    std::map<COutPoint, CStakeKernelInput> mapStakeKernelInputs;
+    bool GetStakeKernelInput(const CWalletTx* pcoin, unsigned int n, CStakeKernelInput& input);
+
+    /**
+     * Coinstakes for the stake reports. Built on first use, then kept up to
+     * date in SyncTransaction, and built again after a rescan.
+     */
+    CStakeReport stakeReport;
+    bool fStakeReportBuilt;
+    void UpdateStakeReport(const CWalletTx& wtx);
+
     CWalletDB *pwalletdbEncryption;
 
     //! the current wallet version: clients below this version are not able to load the wallet
@@ -851,12 +921,19 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         aggSession = 0;
+        fStakeReportBuilt = false;
         fNeedsBLSCTGeneration = false;
         fBroadcastTransactions = false;
     }
 
     bool IsHDEnabled() const;
 
+    /**
+     * The coinstakes of the wallet, building the report if needed, and the
+     * highest height at which they are mature. Requires cs_main and cs_wallet.
+     */
+    const CStakeReport& GetStakeReport(int& nMaxHeight);
+
     bool IsCryptedTx() const;
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -976,6 +1053,11 @@ public:
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFromLoadWallet, CWalletDB* pwalletdb, const std::vector<RangeproofEncodedData> *blsctData = nullptr);
+    /**
+     * Recover the amounts and memos of the blsCT outputs of tx sent to us, or sent by us when we kept their nonce.
+     * It only reads the wallet, so the rescan threads can run it while the scanning thread holds cs_wallet.
+     */
+    bool RecoverBLSCTData(const CTransaction& tx, const bls::PrivateKey& vk, std::vector<RangeproofEncodedData>& vData) const;
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, const CBlock* pblock, const bool fConnect = true, const std::vector<RangeproofEncodedData> *blsctData = nullptr);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate, const std::vector<RangeproofEncodedData> *blsctData = nullptr);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);